@@ -1001,7 +1001,7 @@ struct __DRIlegacyExtensionRec {
  * conjunction with the core extension.
  */
 #define __DRI_SWRAST "DRI_SWRast"
-#define __DRI_SWRAST_VERSION 4
+#define __DRI_SWRAST_VERSION 5
 
 struct __DRIswrastExtensionRec {
     __DRIextension base;
@@ -1049,6 +1049,25 @@ struct __DRIswrastExtensionRec {
                                     const __DRIconfig ***driver_configs,
                                     void *loaderPrivate);
 
+   /**
+    * Like __DRIcoreExtensionRec::swapBuffers, but only the given
+    * rectangles of the back buffer are copied to the window.  Each
+    * rectangle is x, y, width and height, with a bottom-left origin.
+    * No rectangles means the whole drawable.
+    *
+    * \since version 5
+    */
+   void (*swapBuffersWithDamage)(__DRIdrawable *drawable,
+                                 int nrects, const int *rects);
+
+   /**
+    * Return the age of the back buffer as defined by EGL_EXT_buffer_age:
+    * the number of swaps since its contents were presented, or 0 if they
+    * are undefined.
+    *
+    * \since version 5
+    */
+   int (*queryBufferAge)(__DRIdrawable *drawable);
 };
 
 /** Common DRI function definitions, shared among DRI2 and Image extensions
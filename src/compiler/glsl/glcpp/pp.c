@@ -25,6 +25,7 @@
 #include <string.h>
 #include <ctype.h>
 #include "glcpp.h"
+#include "glcpp-parse.h"
 #include "main/mtypes.h"
 
 void
@@ -254,3 +255,36 @@ glcpp_preprocess(void *ralloc_ctx, const char **shader, char **info_log,
 	glcpp_parser_destroy (parser);
 	return errors;
 }
+
+/* Return whether the preprocessor would find an #include directive in the
+ * shader.  Only the lexer runs, so directives in skipped conditional blocks
+ * count as well.
+ */
+bool
+glcpp_has_include(const char *shader, struct gl_context *gl_ctx)
+{
+	glcpp_parser_t *parser = glcpp_parser_create(gl_ctx, NULL, NULL);
+	bool has_include = false;
+
+	if (! gl_ctx->Const.DisableGLSLLineContinuations)
+		shader = remove_line_continuations(parser, shader);
+
+	/* The lexer isn't needed if the word doesn't occur at all. */
+	if (strstr(shader, "include")) {
+		YYSTYPE value;
+		YYLTYPE location;
+		int token;
+
+		glcpp_lex_set_source_string(parser, shader);
+
+		while ((token = glcpp_lex(&value, &location, parser->scanner))) {
+			if (token == INCLUDE) {
+				has_include = true;
+				break;
+			}
+		}
+	}
+
+	glcpp_parser_destroy(parser);
+	return has_include;
+}
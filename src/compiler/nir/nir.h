@@ -2734,6 +2734,13 @@ typedef struct nir_function {
     */
    nir_function_impl *impl;
 
+   /** The serialized implementation of this function, if it was lazily
+    * deserialized by nir_deserialize_packed() and impl is still NULL.
+    *
+    * See nir_materialize_function().
+    */
+   struct nir_packed_impl *packed_impl;
+
    bool is_entrypoint;
 } nir_function;
 
@@ -3078,6 +3085,15 @@ typedef struct nir_shader {
     */
    void *constant_data;
    unsigned constant_data_size;
+
+   /** Pool for blocks, control flow nodes and instructions.
+    *
+    * Owned by the shader.  See ralloc_pool_create().
+    */
+   void *pool;
+
+   /** Pass statistics, only used with NIR_PASS_STATS */
+   struct nir_pass_stats *pass_stats;
 } nir_shader;
 
 #define nir_foreach_function(func, shader) \
@@ -3625,6 +3641,44 @@ static inline bool should_serialize_deserialize_nir(void) { return false; }
 static inline bool should_print_nir(void) { return false; }
 #endif /* NDEBUG */
 
+typedef struct {
+   int64_t start_ns;
+   unsigned instr_count;
+} nir_pass_timing;
+
+void nir_pass_stats_begin_impl(nir_shader *shader, nir_pass_timing *timing);
+void nir_pass_stats_end_impl(nir_shader *shader, const char *pass,
+                             const nir_pass_timing *timing, bool progress);
+
+static inline bool
+should_record_nir_pass_stats(void)
+{
+   static const char *format = NULL;
+   if (!format) {
+      /* "json" or "csv", see nir_pass_stats.c */
+      format = getenv("NIR_PASS_STATS");
+      if (!format)
+         format = "";
+   }
+
+   return format[0] != '\0';
+}
+
+static inline void
+nir_pass_stats_begin(nir_shader *shader, nir_pass_timing *timing)
+{
+   if (should_record_nir_pass_stats())
+      nir_pass_stats_begin_impl(shader, timing);
+}
+
+static inline void
+nir_pass_stats_end(nir_shader *shader, const char *pass,
+                   const nir_pass_timing *timing, bool progress)
+{
+   if (should_record_nir_pass_stats())
+      nir_pass_stats_end_impl(shader, pass, timing, progress);
+}
+
 #define _PASS(pass, nir, do_pass) do {                               \
    if (should_skip_nir(#pass)) {                                     \
       printf("skipping %s\n", #pass);                                \
@@ -3645,7 +3699,11 @@ static inline bool should_print_nir(void) { return false; }
    nir_metadata_set_validation_flag(nir);                            \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
-   if (pass(nir, ##__VA_ARGS__)) {                                   \
+   nir_pass_timing _timing;                                          \
+   nir_pass_stats_begin(nir, &_timing);                              \
+   bool _progress = pass(nir, ##__VA_ARGS__);                        \
+   nir_pass_stats_end(nir, #pass, &_timing, _progress);              \
+   if (_progress) {                                                  \
       progress = true;                                               \
       if (should_print_nir())                                        \
          nir_print_shader(nir, stdout);                              \
@@ -3656,7 +3714,10 @@ static inline bool should_print_nir(void) { return false; }
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir,                  \
    if (should_print_nir())                                           \
       printf("%s\n", #pass);                                         \
+   nir_pass_timing _timing;                                          \
+   nir_pass_stats_begin(nir, &_timing);                              \
    pass(nir, ##__VA_ARGS__);                                         \
+   nir_pass_stats_end(nir, #pass, &_timing, false);                  \
    if (should_print_nir())                                           \
       nir_print_shader(nir, stdout);                                 \
 )
@@ -4343,7 +4404,10 @@ bool nir_opt_algebraic(nir_shader *shader);
 bool nir_opt_algebraic_before_ffma(nir_shader *shader);
 bool nir_opt_algebraic_late(nir_shader *shader);
 bool nir_opt_algebraic_distribute_src_mods(nir_shader *shader);
+bool nir_opt_algebraic_combined(nir_shader *shader);
 bool nir_opt_constant_folding(nir_shader *shader);
+nir_load_const_instr *nir_try_constant_fold_alu(nir_shader *shader,
+                                                nir_alu_instr *instr);
 
 /* Try to combine a and b into a.  Return true if combination was possible,
  * which will result in b being removed by the pass.  Return false if
@@ -4359,6 +4423,8 @@ bool nir_opt_combine_memory_barriers(nir_shader *shader,
 bool nir_opt_combine_stores(nir_shader *shader, nir_variable_mode modes);
 
 bool nir_copy_prop(nir_shader *shader);
+bool nir_copy_prop_instr(nir_instr *instr);
+bool nir_copy_prop_if(nir_if *if_stmt);
 
 bool nir_opt_copy_prop_vars(nir_shader *shader);
 
@@ -1118,8 +1118,9 @@ const uint16_t ${pass_name}_transform_counts[] = {
 % endfor
 };
 
+% for entry_name, impl_name in entry_points:
 bool
-${pass_name}(nir_shader *shader)
+${entry_name}(nir_shader *shader)
 {
    bool progress = false;
    bool condition_flags[${len(condition_list)}];
@@ -1134,23 +1135,31 @@ ${pass_name}(nir_shader *shader)
 
    nir_foreach_function(function, shader) {
       if (function->impl) {
-         progress |= nir_algebraic_impl(function->impl, condition_flags,
-                                        ${pass_name}_transforms,
-                                        ${pass_name}_transform_counts,
-                                        ${pass_name}_table);
+         progress |= ${impl_name}(function->impl, condition_flags,
+                                  ${pass_name}_transforms,
+                                  ${pass_name}_transform_counts,
+                                  ${pass_name}_table);
       }
    }
 
    return progress;
 }
+% endfor
 """)
 
 
 class AlgebraicPass(object):
-   def __init__(self, pass_name, transforms):
+   def __init__(self, pass_name, transforms, combined_pass_name=None):
+      """If combined_pass_name is given, a second entry point with that name
+      is emitted, which runs the transforms through
+      nir_algebraic_combined_impl."""
       self.xforms = []
       self.opcode_xforms = defaultdict(lambda : [])
       self.pass_name = pass_name
+      self.entry_points = [(pass_name, 'nir_algebraic_impl')]
+      if combined_pass_name:
+         self.entry_points.append((combined_pass_name,
+                                   'nir_algebraic_combined_impl'))
 
       error = False
 
@@ -1209,6 +1218,7 @@ class AlgebraicPass(object):
 
    def render(self):
       return _algebraic_pass_template.render(pass_name=self.pass_name,
+                                             entry_points=self.entry_points,
                                              xforms=self.xforms,
                                              opcode_xforms=self.opcode_xforms,
                                              condition_list=condition_list,
@@ -702,6 +702,8 @@ static nir_function *
 clone_function(clone_state *state, const nir_function *fxn, nir_shader *ns)
 {
    assert(ns == state->ns);
+   /* Lazily deserialized functions have to be materialized first. */
+   assert(fxn->packed_impl == NULL);
    nir_function *nfxn = nir_function_create(ns, fxn->name);
 
    /* Needed for call instructions */
@@ -795,7 +797,10 @@ nir_shader_replace(nir_shader *dst, nir_shader *src)
    /* Re-parent all of src's ralloc children to dst */
    ralloc_adopt(dst, src);
 
+   /* dst keeps its pass statistics, src is only standing in for it. */
+   struct nir_pass_stats *pass_stats = dst->pass_stats;
    memcpy(dst, src, sizeof(*dst));
+   dst->pass_stats = pass_stats;
 
    /* We have to move all the linked lists over separately because we need the
     * pointers in the list elements to point to the lists in dst and not src.
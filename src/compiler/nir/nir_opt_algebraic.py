@@ -1923,7 +1923,8 @@ for op in ['fmul', 'fdot_replicated2', 'fdot_replicated3', 'fdot_replicated4']:
        (('fabs', (op + '(is_used_once)', a, b)), (op, ('fabs', a), ('fabs', b))),
    ])
 
-print(nir_algebraic.AlgebraicPass("nir_opt_algebraic", optimizations).render())
+print(nir_algebraic.AlgebraicPass("nir_opt_algebraic", optimizations,
+                                  "nir_opt_algebraic_combined").render())
 print(nir_algebraic.AlgebraicPass("nir_opt_algebraic_before_ffma",
                                   before_ffma_optimizations).render())
 print(nir_algebraic.AlgebraicPass("nir_opt_algebraic_late",
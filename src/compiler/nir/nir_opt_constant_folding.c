@@ -34,18 +34,23 @@
 
 struct constant_fold_state {
    nir_shader *shader;
-   unsigned execution_mode;
    bool has_load_constant;
    bool has_indirect_load_const;
 };
 
-static bool
-constant_fold_alu_instr(struct constant_fold_state *state, nir_alu_instr *instr)
+/**
+ * Evaluates \p instr if all of its sources are constants.
+ *
+ * Returns a new load_const holding the result, not yet inserted into the
+ * shader, or NULL if \p instr can't be folded.  \p instr is left untouched.
+ */
+nir_load_const_instr *
+nir_try_constant_fold_alu(nir_shader *shader, nir_alu_instr *instr)
 {
    nir_const_value src[NIR_MAX_VEC_COMPONENTS][NIR_MAX_VEC_COMPONENTS];
 
    if (!instr->dest.dest.is_ssa)
-      return false;
+      return NULL;
 
    /* In the case that any outputs/inputs have unsized types, then we need to
     * guess the bit-size. In this case, the validator ensures that all
@@ -62,7 +67,7 @@ constant_fold_alu_instr(struct constant_fold_state *state, nir_alu_instr *instr)
 
    for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; i++) {
       if (!instr->src[i].src.is_ssa)
-         return false;
+         return NULL;
 
       if (bit_size == 0 &&
           !nir_alu_type_get_type_size(nir_op_infos[instr->op].input_types[i]))
@@ -71,7 +76,7 @@ constant_fold_alu_instr(struct constant_fold_state *state, nir_alu_instr *instr)
       nir_instr *src_instr = instr->src[i].src.ssa->parent_instr;
 
       if (src_instr->type != nir_instr_type_load_const)
-         return false;
+         return NULL;
       nir_load_const_instr* load_const = nir_instr_as_load_const(src_instr);
 
       for (unsigned j = 0; j < nir_ssa_alu_instr_src_components(instr, i);
@@ -95,15 +100,27 @@ constant_fold_alu_instr(struct constant_fold_state *state, nir_alu_instr *instr)
    for (unsigned i = 0; i < nir_op_infos[instr->op].num_inputs; ++i)
       srcs[i] = src[i];
    nir_eval_const_opcode(instr->op, dest, instr->dest.dest.ssa.num_components,
-                         bit_size, srcs, state->execution_mode);
+                         bit_size, srcs,
+                         shader->info.float_controls_execution_mode);
 
    nir_load_const_instr *new_instr =
-      nir_load_const_instr_create(state->shader,
+      nir_load_const_instr_create(shader,
                                   instr->dest.dest.ssa.num_components,
                                   instr->dest.dest.ssa.bit_size);
 
    memcpy(new_instr->value, dest, sizeof(*new_instr->value) * new_instr->def.num_components);
 
+   return new_instr;
+}
+
+static bool
+constant_fold_alu_instr(struct constant_fold_state *state, nir_alu_instr *instr)
+{
+   nir_load_const_instr *new_instr =
+      nir_try_constant_fold_alu(state->shader, instr);
+   if (!new_instr)
+      return false;
+
    nir_instr_insert_before(&instr->instr, &new_instr->instr);
 
    nir_ssa_def_rewrite_uses(&instr->dest.dest.ssa,
@@ -235,7 +252,6 @@ nir_opt_constant_folding(nir_shader *shader)
    bool progress = false;
    struct constant_fold_state state;
    state.shader = shader;
-   state.execution_mode = shader->info.float_controls_execution_mode;
    state.has_load_constant = false;
    state.has_indirect_load_const = false;
 
@@ -172,8 +172,8 @@ copy_prop_alu_src(nir_alu_instr *parent_alu_instr, unsigned index)
    return true;
 }
 
-static bool
-copy_prop_instr(nir_instr *instr)
+bool
+nir_copy_prop_instr(nir_instr *instr)
 {
    bool progress = false;
    switch (instr->type) {
@@ -247,10 +247,14 @@ copy_prop_instr(nir_instr *instr)
    }
 }
 
-static bool
-copy_prop_if(nir_if *if_stmt)
+bool
+nir_copy_prop_if(nir_if *if_stmt)
 {
-   return copy_prop_src(&if_stmt->condition, NULL, if_stmt, 1);
+   bool progress = false;
+   while (copy_prop_src(&if_stmt->condition, NULL, if_stmt, 1))
+      progress = true;
+
+   return progress;
 }
 
 static bool
@@ -260,12 +264,12 @@ nir_copy_prop_impl(nir_function_impl *impl)
 
    nir_foreach_block(block, impl) {
       nir_foreach_instr(instr, block) {
-         if (copy_prop_instr(instr))
+         if (nir_copy_prop_instr(instr))
             progress = true;
       }
 
       nir_if *if_stmt = nir_block_get_following_if(block);
-      if (if_stmt && copy_prop_if(if_stmt))
+      if (if_stmt && nir_copy_prop_if(if_stmt))
          progress = true;
       }
 
@@ -0,0 +1,285 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nir.h"
+#include "util/os_time.h"
+#include "util/simple_mtx.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * \file nir_pass_stats.c
+ *
+ * Per-pass profiling for NIR_PASS and NIR_PASS_V.
+ *
+ * Setting NIR_PASS_STATS to "json" or "csv" records, for every pass
+ * invocation, the wall time, the instruction count before and after the
+ * pass and whether it made progress.  The numbers are summed up per pass
+ * name, both for each shader and for the whole process, and written to
+ * NIR_PASS_STATS_FILE (stderr by default) when the process exits.
+ *
+ * The records live in a process-wide context rather than on the shader, so
+ * they survive the shader being freed, swept or replaced.
+ */
+
+struct nir_pass_stats_entry {
+   const char *pass;
+   uint64_t calls;
+   uint64_t progress;
+   uint64_t time_ns;
+   uint64_t instrs_before;
+   uint64_t instrs_after;
+};
+
+struct nir_pass_stats {
+   struct list_head link;
+
+   unsigned id;
+   gl_shader_stage stage;
+   char *name;
+
+   /* Pass name -> nir_pass_stats_entry */
+   struct hash_table *entries;
+};
+
+static simple_mtx_t stats_lock = _SIMPLE_MTX_INITIALIZER_NP;
+static void *stats_ctx;
+static struct hash_table *process_entries;
+static struct list_head shader_stats;
+static unsigned num_shader_stats;
+static bool stats_dumped;
+
+static unsigned
+count_instrs(nir_shader *shader)
+{
+   unsigned count = 0;
+
+   nir_foreach_function(function, shader) {
+      if (!function->impl)
+         continue;
+
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+
+   return count;
+}
+
+static void
+print_json_string(FILE *fp, const char *str)
+{
+   fputc('"', fp);
+   for (const char *c = str; *c; c++) {
+      if (*c == '"' || *c == '\\')
+         fprintf(fp, "\\%c", *c);
+      else if ((unsigned char)*c < 0x20)
+         fprintf(fp, "\\u%04x", *c);
+      else
+         fputc(*c, fp);
+   }
+   fputc('"', fp);
+}
+
+static void
+print_json_entries(FILE *fp, struct hash_table *entries, const char *indent)
+{
+   bool first = true;
+
+   hash_table_foreach(entries, he) {
+      const struct nir_pass_stats_entry *e = he->data;
+
+      fprintf(fp, "%s\n%s{\"pass\": ", first ? "" : ",", indent);
+      print_json_string(fp, e->pass);
+      fprintf(fp, ", \"calls\": %"PRIu64", \"progress\": %"PRIu64", "
+              "\"time_ns\": %"PRIu64", \"instrs_before\": %"PRIu64", "
+              "\"instrs_after\": %"PRIu64"}",
+              e->calls, e->progress, e->time_ns,
+              e->instrs_before, e->instrs_after);
+      first = false;
+   }
+}
+
+static void
+print_json(FILE *fp)
+{
+   fprintf(fp, "{\n  \"passes\": [");
+   print_json_entries(fp, process_entries, "    ");
+   fprintf(fp, "\n  ],\n  \"shaders\": [");
+
+   bool first = true;
+   list_for_each_entry(struct nir_pass_stats, stats, &shader_stats, link) {
+      fprintf(fp, "%s\n    {\"id\": %u, \"stage\": \"%s\", \"name\": ",
+              first ? "" : ",", stats->id,
+              _mesa_shader_stage_to_abbrev(stats->stage));
+      print_json_string(fp, stats->name);
+      fprintf(fp, ", \"passes\": [");
+      print_json_entries(fp, stats->entries, "      ");
+      fprintf(fp, "\n    ]}");
+      first = false;
+   }
+
+   fprintf(fp, "\n  ]\n}\n");
+}
+
+static void
+print_csv_entries(FILE *fp, struct hash_table *entries, const char *scope)
+{
+   hash_table_foreach(entries, he) {
+      const struct nir_pass_stats_entry *e = he->data;
+
+      fprintf(fp, "%s,%s,%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64"\n",
+              scope, e->pass, e->calls, e->progress, e->time_ns,
+              e->instrs_before, e->instrs_after);
+   }
+}
+
+static void
+print_csv(FILE *fp)
+{
+   fprintf(fp, "scope,pass,calls,progress,time_ns,instrs_before,instrs_after\n");
+   print_csv_entries(fp, process_entries, "process");
+
+   list_for_each_entry(struct nir_pass_stats, stats, &shader_stats, link) {
+      /* Shader names may contain anything, identify shaders by id and
+       * stage only.
+       */
+      char scope[32];
+      snprintf(scope, sizeof(scope), "%s%u",
+               _mesa_shader_stage_to_abbrev(stats->stage), stats->id);
+      print_csv_entries(fp, stats->entries, scope);
+   }
+}
+
+static void
+nir_pass_stats_dump(void)
+{
+   const char *format = getenv("NIR_PASS_STATS");
+   const char *filename = getenv("NIR_PASS_STATS_FILE");
+   FILE *fp = stderr;
+
+   simple_mtx_lock(&stats_lock);
+
+   if (filename) {
+      fp = fopen(filename, "w");
+      if (!fp) {
+         fprintf(stderr, "nir: failed to open %s\n", filename);
+         goto out;
+      }
+   }
+
+   if (strcmp(format, "csv") == 0)
+      print_csv(fp);
+   else
+      print_json(fp);
+
+   if (fp != stderr)
+      fclose(fp);
+
+out:
+   ralloc_free(stats_ctx);
+   stats_ctx = NULL;
+   stats_dumped = true;
+   simple_mtx_unlock(&stats_lock);
+}
+
+static struct nir_pass_stats_entry *
+get_entry(struct hash_table *entries, const char *pass)
+{
+   struct hash_entry *he = _mesa_hash_table_search(entries, pass);
+   if (he)
+      return he->data;
+
+   struct nir_pass_stats_entry *e =
+      rzalloc(stats_ctx, struct nir_pass_stats_entry);
+   /* Don't keep pointers into drivers that may be unloaded before exit. */
+   e->pass = ralloc_strdup(e, pass);
+   _mesa_hash_table_insert(entries, e->pass, e);
+
+   return e;
+}
+
+static void
+add_sample(struct nir_pass_stats_entry *e, uint64_t time_ns,
+           unsigned instrs_before, unsigned instrs_after, bool progress)
+{
+   e->calls++;
+   e->progress += progress;
+   e->time_ns += time_ns;
+   e->instrs_before += instrs_before;
+   e->instrs_after += instrs_after;
+}
+
+void
+nir_pass_stats_begin_impl(nir_shader *shader, nir_pass_timing *timing)
+{
+   timing->instr_count = count_instrs(shader);
+   timing->start_ns = os_time_get_nano();
+}
+
+void
+nir_pass_stats_end_impl(nir_shader *shader, const char *pass,
+                        const nir_pass_timing *timing, bool progress)
+{
+   uint64_t time_ns = os_time_get_nano() - timing->start_ns;
+   unsigned instrs_after = count_instrs(shader);
+
+   simple_mtx_lock(&stats_lock);
+
+   /* Passes run from other atexit handlers aren't recorded. */
+   if (stats_dumped) {
+      simple_mtx_unlock(&stats_lock);
+      return;
+   }
+
+   if (!stats_ctx) {
+      stats_ctx = ralloc_context(NULL);
+      process_entries = _mesa_hash_table_create(stats_ctx, _mesa_hash_string,
+                                                _mesa_key_string_equal);
+      list_inithead(&shader_stats);
+      atexit(nir_pass_stats_dump);
+   }
+
+   struct nir_pass_stats *stats = shader->pass_stats;
+   if (!stats) {
+      stats = rzalloc(stats_ctx, struct nir_pass_stats);
+      stats->id = num_shader_stats++;
+      stats->stage = shader->info.stage;
+      stats->name = ralloc_strdup(stats, shader->info.name ?
+                                         shader->info.name : "");
+      stats->entries = _mesa_hash_table_create(stats, _mesa_hash_string,
+                                               _mesa_key_string_equal);
+      list_addtail(&stats->link, &shader_stats);
+      shader->pass_stats = stats;
+   }
+
+   add_sample(get_entry(process_entries, pass), time_ns,
+              timing->instr_count, instrs_after, progress);
+   add_sample(get_entry(stats->entries, pass), time_ns,
+              timing->instr_count, instrs_after, progress);
+
+   simple_mtx_unlock(&stats_lock);
+}
@@ -855,7 +855,7 @@ nir_algebraic_automaton(nir_instr *instr, struct util_dynarray *states,
    }
 }
 
-static bool
+static nir_ssa_def *
 nir_algebraic_instr(nir_builder *build, nir_instr *instr,
                     struct hash_table *range_ht,
                     const bool *condition_flags,
@@ -867,11 +867,11 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
 {
 
    if (instr->type != nir_instr_type_alu)
-      return false;
+      return NULL;
 
    nir_alu_instr *alu = nir_instr_as_alu(instr);
    if (!alu->dest.dest.is_ssa)
-      return false;
+      return NULL;
 
    unsigned bit_size = alu->dest.dest.ssa.bit_size;
    const unsigned execution_mode =
@@ -884,24 +884,300 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
                                           alu->dest.dest.ssa.index);
    for (uint16_t i = 0; i < transform_counts[xform_idx]; i++) {
       const struct transform *xform = &transforms[xform_idx][i];
-      if (condition_flags[xform->condition_offset] &&
-          !(xform->search->inexact && ignore_inexact) &&
-          nir_replace_instr(build, alu, range_ht, states, pass_op_table,
-                            xform->search, xform->replace, worklist)) {
+      if (!condition_flags[xform->condition_offset] ||
+          (xform->search->inexact && ignore_inexact))
+         continue;
+
+      nir_ssa_def *ssa_val =
+         nir_replace_instr(build, alu, range_ht, states, pass_op_table,
+                           xform->search, xform->replace, worklist);
+      if (ssa_val) {
          _mesa_hash_table_clear(range_ht, NULL);
-         return true;
+         return ssa_val;
       }
    }
 
-   return false;
+   return NULL;
 }
 
-bool
-nir_algebraic_impl(nir_function_impl *impl,
-                   const bool *condition_flags,
-                   const struct transform **transforms,
-                   const uint16_t *transform_counts,
-                   const struct per_op_table *pass_op_table)
+/* The combined mode of nir_algebraic_impl() also folds constants,
+ * propagates copies, into if conditions as well, and removes dead
+ * instructions, from the same worklist, so that a single call reaches the
+ * point where a loop over those passes would stop making progress.  Every change pushes the instructions it may
+ * have enabled something for: the users of a rewritten value, the sources
+ * of a removed instruction and the instructions a replacement created.
+ */
+struct combined_state {
+   nir_shader *shader;
+   nir_function_impl *impl;
+   nir_instr_worklist *worklist;
+   struct util_dynarray *states;
+   const struct per_op_table *pass_op_table;
+
+   /* Source instructions of an instruction before copy propagation. */
+   struct util_dynarray srcs;
+
+   /* Users of an instruction before it was replaced. */
+   struct util_dynarray users;
+
+   /* SSA values numbered from here on were created by a replacement. */
+   unsigned first_new_index;
+};
+
+static void
+grow_states(struct util_dynarray *states, nir_function_impl *impl)
+{
+   unsigned old_count = util_dynarray_num_elements(states, uint16_t);
+   if (old_count >= impl->ssa_alloc)
+      return;
+
+   util_dynarray_resize(states, uint16_t, impl->ssa_alloc);
+   memset(util_dynarray_element(states, uint16_t, old_count), 0,
+          (impl->ssa_alloc - old_count) * sizeof(uint16_t));
+}
+
+static void
+push_uses(nir_ssa_def *def, nir_instr_worklist *worklist)
+{
+   nir_foreach_use(use_src, def)
+      nir_instr_worklist_push_tail(worklist, use_src->parent_instr);
+}
+
+/* Pushes an instruction whose sources were rewritten, and its users.  Either
+ * may match a pattern now even if no automaton state changed, for instance
+ * because two of the values it looks at are the same value now.
+ */
+static void
+push_rewritten_instr(nir_instr *instr, nir_instr_worklist *worklist)
+{
+   nir_instr_worklist_push_tail(worklist, instr);
+
+   nir_ssa_def *def = nir_instr_ssa_def(instr);
+   if (def)
+      push_uses(def, worklist);
+}
+
+static void
+push_rewritten_uses(nir_ssa_def *def, nir_instr_worklist *worklist)
+{
+   nir_foreach_use(use_src, def)
+      push_rewritten_instr(use_src->parent_instr, worklist);
+}
+
+/* Called for an instruction that lost a use.  It is pushed if it is dead
+ * now.  If its value is left with a single use, that user is pushed instead,
+ * as it may match an is_used_once pattern now.
+ */
+static void
+push_src_instr(nir_instr *src_instr, nir_instr_worklist *worklist)
+{
+   nir_ssa_def *def = nir_instr_ssa_def(src_instr);
+   if (def == NULL || !list_is_empty(&def->if_uses))
+      return;
+
+   if (list_is_empty(&def->uses))
+      nir_instr_worklist_push_tail(worklist, src_instr);
+   else if (list_is_singular(&def->uses))
+      push_uses(def, worklist);
+}
+
+static bool
+push_src_instr_cb(nir_src *src, void *_state)
+{
+   struct combined_state *state = _state;
+
+   if (src->is_ssa)
+      push_src_instr(src->ssa->parent_instr, state->worklist);
+
+   return true;
+}
+
+/* \p instr must have been removed, its sources still point at the values
+ * it used.
+ */
+static void
+push_src_instrs(struct combined_state *state, nir_instr *instr)
+{
+   nir_foreach_src(instr, push_src_instr_cb, state);
+}
+
+static bool
+gather_src_instr(nir_src *src, void *_state)
+{
+   struct combined_state *state = _state;
+
+   if (src->is_ssa)
+      util_dynarray_append(&state->srcs, nir_instr *, src->ssa->parent_instr);
+
+   return true;
+}
+
+static void
+gather_users(struct combined_state *state, nir_instr *instr)
+{
+   util_dynarray_clear(&state->users);
+
+   nir_ssa_def *def = nir_instr_ssa_def(instr);
+   if (def == NULL)
+      return;
+
+   nir_foreach_use(use_src, def)
+      util_dynarray_append(&state->users, nir_instr *, use_src->parent_instr);
+}
+
+static bool
+push_new_src_instr(nir_src *src, void *_state);
+
+static void
+push_new_instrs(struct combined_state *state, nir_instr *instr)
+{
+   nir_ssa_def *def = nir_instr_ssa_def(instr);
+   if (def == NULL || def->index < state->first_new_index)
+      return;
+
+   nir_instr_worklist_push_tail(state->worklist, instr);
+   nir_foreach_src(instr, push_new_src_instr, state);
+}
+
+static bool
+push_new_src_instr(nir_src *src, void *_state)
+{
+   if (src->is_ssa)
+      push_new_instrs(_state, src->ssa->parent_instr);
+
+   return true;
+}
+
+static bool
+instr_is_dead(nir_instr *instr)
+{
+   switch (instr->type) {
+   case nir_instr_type_alu:
+   case nir_instr_type_deref:
+   case nir_instr_type_load_const:
+   case nir_instr_type_ssa_undef:
+   case nir_instr_type_tex:
+   case nir_instr_type_phi:
+      break;
+
+   case nir_instr_type_intrinsic: {
+      const nir_intrinsic_info *info =
+         &nir_intrinsic_infos[nir_instr_as_intrinsic(instr)->intrinsic];
+      if (!(info->flags & NIR_INTRINSIC_CAN_ELIMINATE) || !info->has_dest)
+         return false;
+      break;
+   }
+
+   default:
+      return false;
+   }
+
+   nir_ssa_def *def = nir_instr_ssa_def(instr);
+   return list_is_empty(&def->uses) && list_is_empty(&def->if_uses);
+}
+
+static void
+combined_update_automaton(struct combined_state *state, nir_instr *instr)
+{
+   if (nir_algebraic_automaton(instr, state->states, state->pass_op_table)) {
+      nir_algebraic_update_automaton(instr, state->worklist, state->states,
+                                     state->pass_op_table);
+   }
+}
+
+/* Propagates copies into the conditions of the ifs that use the value of
+ * \p instr, which may leave \p instr dead.
+ */
+static bool
+copy_prop_if_uses(nir_instr *instr)
+{
+   nir_ssa_def *def = nir_instr_ssa_def(instr);
+   if (def == NULL)
+      return false;
+
+   bool progress = false;
+   nir_foreach_if_use_safe(use_src, def)
+      progress |= nir_copy_prop_if(use_src->parent_if);
+
+   return progress;
+}
+
+/* Replaces \p instr by a load_const if all of its sources are constants.
+ * \p instr is removed, but not freed as it may still be in the worklist.
+ */
+static nir_load_const_instr *
+constant_fold_instr(struct combined_state *state, nir_instr *instr)
+{
+   if (instr->type != nir_instr_type_alu)
+      return NULL;
+
+   nir_alu_instr *alu = nir_instr_as_alu(instr);
+   nir_load_const_instr *load_const =
+      nir_try_constant_fold_alu(state->shader, alu);
+   if (load_const == NULL)
+      return NULL;
+
+   nir_instr_insert_before(instr, &load_const->instr);
+   grow_states(state->states, state->impl);
+   nir_algebraic_automaton(&load_const->instr, state->states,
+                           state->pass_op_table);
+
+   nir_ssa_def_rewrite_uses(&alu->dest.dest.ssa,
+                            nir_src_for_ssa(&load_const->def));
+   nir_instr_remove(instr);
+
+   return load_const;
+}
+
+/* Runs dead code elimination, copy propagation and constant folding on
+ * \p instr.  Returns true if \p instr was removed.
+ */
+static bool
+combined_instr(struct combined_state *state, nir_instr *instr,
+               bool *progress)
+{
+   if (copy_prop_if_uses(instr))
+      *progress = true;
+
+   if (instr_is_dead(instr)) {
+      nir_instr_remove(instr);
+      push_src_instrs(state, instr);
+      *progress = true;
+      return true;
+   }
+
+   util_dynarray_clear(&state->srcs);
+   nir_foreach_src(instr, gather_src_instr, state);
+   if (nir_copy_prop_instr(instr)) {
+      /* The copies may be dead now. */
+      util_dynarray_foreach(&state->srcs, nir_instr *, src_instr)
+         push_src_instr(*src_instr, state->worklist);
+      combined_update_automaton(state, instr);
+      nir_ssa_def *def = nir_instr_ssa_def(instr);
+      if (def)
+         push_rewritten_uses(def, state->worklist);
+      *progress = true;
+   }
+
+   nir_load_const_instr *load_const = constant_fold_instr(state, instr);
+   if (load_const == NULL)
+      return false;
+
+   nir_algebraic_update_automaton(&load_const->instr, state->worklist,
+                                  state->states, state->pass_op_table);
+   push_rewritten_uses(&load_const->def, state->worklist);
+   push_src_instrs(state, instr);
+   *progress = true;
+   return true;
+}
+
+static bool
+algebraic_impl(nir_function_impl *impl,
+               const bool *condition_flags,
+               const struct transform **transforms,
+               const uint16_t *transform_counts,
+               const struct per_op_table *pass_op_table,
+               bool combined)
 {
    bool progress = false;
 
@@ -917,15 +1193,46 @@ nir_algebraic_impl(nir_function_impl *impl,
       return false;
    memset(states.data, 0, states.size);
 
+   /* Copy propagation and the dead code checks only handle SSA values. */
+   if (!exec_list_is_empty(&impl->registers))
+      combined = false;
+
    struct hash_table *range_ht = _mesa_pointer_hash_table_create(NULL);
 
    nir_instr_worklist *worklist = nir_instr_worklist_create();
 
-   /* Walk top-to-bottom setting up the automaton state. */
+   struct combined_state state = {
+      .shader = build.shader,
+      .impl = impl,
+      .worklist = worklist,
+      .states = &states,
+      .pass_op_table = pass_op_table,
+   };
+   util_dynarray_init(&state.srcs, NULL);
+   util_dynarray_init(&state.users, NULL);
+
+   /* Walk top-to-bottom setting up the automaton state.  The combined mode
+    * propagates copies and folds constants on the way, as the sources are
+    * final already, which leaves the worklist with what replacements enable.
+    */
    nir_foreach_block(block, impl) {
-      nir_foreach_instr(instr, block) {
+      nir_foreach_instr_safe(instr, block) {
+         if (combined) {
+            progress |= nir_copy_prop_instr(instr);
+            if (constant_fold_instr(&state, instr)) {
+               progress = true;
+               continue;
+            }
+         }
+
          nir_algebraic_automaton(instr, &states, pass_op_table);
       }
+
+      if (combined) {
+         nir_if *if_stmt = nir_block_get_following_if(block);
+         if (if_stmt)
+            progress |= nir_copy_prop_if(if_stmt);
+      }
    }
 
    /* Put our instrs in the worklist such that we're popping the last instr
@@ -947,12 +1254,34 @@ nir_algebraic_impl(nir_function_impl *impl,
       if (exec_node_is_tail_sentinel(&instr->node))
          continue;
 
-      progress |= nir_algebraic_instr(&build, instr,
-                                      range_ht, condition_flags,
-                                      transforms, transform_counts, &states,
-                                      pass_op_table, worklist);
+      if (combined && combined_instr(&state, instr, &progress))
+         continue;
+
+      state.first_new_index = impl->ssa_alloc;
+      if (combined)
+         gather_users(&state, instr);
+
+      nir_ssa_def *ssa_val =
+         nir_algebraic_instr(&build, instr,
+                             range_ht, condition_flags,
+                             transforms, transform_counts, &states,
+                             pass_op_table, worklist);
+      if (!ssa_val)
+         continue;
+
+      progress = true;
+
+      if (combined) {
+         /* nir_replace_instr() removed instr. */
+         push_src_instrs(&state, instr);
+         push_new_instrs(&state, ssa_val->parent_instr);
+         util_dynarray_foreach(&state.users, nir_instr *, user)
+            push_rewritten_instr(*user, worklist);
+      }
    }
 
+   util_dynarray_fini(&state.srcs);
+   util_dynarray_fini(&state.users);
    nir_instr_worklist_destroy(worklist);
    ralloc_free(range_ht);
    util_dynarray_fini(&states);
@@ -968,3 +1297,25 @@ nir_algebraic_impl(nir_function_impl *impl,
 
    return progress;
 }
+
+bool
+nir_algebraic_impl(nir_function_impl *impl,
+                   const bool *condition_flags,
+                   const struct transform **transforms,
+                   const uint16_t *transform_counts,
+                   const struct per_op_table *pass_op_table)
+{
+   return algebraic_impl(impl, condition_flags, transforms, transform_counts,
+                         pass_op_table, false);
+}
+
+bool
+nir_algebraic_combined_impl(nir_function_impl *impl,
+                            const bool *condition_flags,
+                            const struct transform **transforms,
+                            const uint16_t *transform_counts,
+                            const struct per_op_table *pass_op_table)
+{
+   return algebraic_impl(impl, condition_flags, transforms, transform_counts,
+                         pass_op_table, true);
+}
@@ -212,4 +212,15 @@ nir_algebraic_impl(nir_function_impl *impl,
                    const uint16_t *transform_counts,
                    const struct per_op_table *pass_op_table);
 
+/* Same as nir_algebraic_impl, but also does constant folding, copy
+ * propagation and dead code elimination from the same worklist, only
+ * revisiting instructions whose sources or uses changed.
+ */
+bool
+nir_algebraic_combined_impl(nir_function_impl *impl,
+                            const bool *condition_flags,
+                            const struct transform **transforms,
+                            const uint16_t *transform_counts,
+                            const struct per_op_table *pass_op_table);
+
 #endif /* _NIR_SEARCH_ */
@@ -2028,6 +2028,7 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
 
    blob_write_uint32(blob, exec_list_length(&nir->functions));
    nir_foreach_function(fxn, nir) {
+      assert(fxn->packed_impl == NULL);
       write_function(&ctx, fxn);
    }
 
@@ -2106,6 +2107,457 @@ nir_deserialize(void *mem_ctx,
    return ctx.nir;
 }
 
+/*
+ * Packed serialization
+ *
+ * The packed form starts with a nir_packed_header, followed by sections
+ * which all start at a 16-byte aligned offset from it.  blob_writer and
+ * blob_reader align relative to the start of their data, so the nir_serialize
+ * encoding of the globals and of each function body reads the same from a
+ * section as it was written into the whole blob.
+ *
+ * Object IDs 0 to num_global_objects - 1 are the variables and functions
+ * from the globals section.  Each function body numbers its own objects
+ * from there on, so that it can be read on its own.
+ */
+
+#define NIR_PACKED_MAGIC 0x5052494e /* "NIRP" */
+#define NIR_PACKED_ALIGN 16
+
+struct nir_packed_header {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t size;
+   uint32_t shader_info_size;
+
+   /* Offsets from the header of the sections and strings, 0 if absent. */
+   uint32_t info;
+   uint32_t name;
+   uint32_t label;
+   uint32_t io_vars;
+   uint32_t num_io_vars;
+
+   /* Variables, function declarations and constant data. */
+   uint32_t globals;
+   uint32_t globals_size;
+   uint32_t num_global_objects;
+
+   /* A nir_packed_function per function, in order. */
+   uint32_t functions;
+   uint32_t num_functions;
+};
+
+struct nir_packed_function {
+   uint32_t impl;
+   uint32_t impl_size;
+
+   /* The number of object IDs, including the global ones. */
+   uint32_t num_objects;
+   uint32_t pad;
+};
+
+struct nir_packed_impl {
+   const uint8_t *data;
+   uint32_t size;
+   uint32_t num_objects;
+
+   /* The objects of the globals section, by object ID. */
+   void **global_objects;
+   uint32_t num_global_objects;
+};
+
+static uint32_t
+write_packed_align(struct blob *blob, size_t start)
+{
+   static const uint8_t zeros[NIR_PACKED_ALIGN];
+
+   blob_write_bytes(blob, zeros,
+                    ALIGN_POT(blob->size, NIR_PACKED_ALIGN) - blob->size);
+   return blob->size - start;
+}
+
+static uint32_t
+write_packed_string(struct blob *blob, size_t start, const char *str)
+{
+   if (!str)
+      return 0;
+
+   uint32_t offset = blob->size - start;
+   blob_write_string(blob, str);
+   return offset;
+}
+
+static void
+write_packed_io_vars(struct blob *blob, size_t start, const nir_shader *nir,
+                     bool strip, struct nir_packed_header *header)
+{
+   struct util_dynarray io_vars;
+   util_dynarray_init(&io_vars, NULL);
+
+   const struct exec_list *lists[] = { &nir->inputs, &nir->outputs };
+   for (unsigned i = 0; i < ARRAY_SIZE(lists); i++) {
+      foreach_list_typed(nir_variable, var, node, lists[i]) {
+         const struct glsl_type *type = glsl_without_array(var->type);
+         bool is_vs_input = nir->info.stage == MESA_SHADER_VERTEX &&
+                            var->data.mode == nir_var_shader_in;
+
+         struct nir_packed_io_var io = {
+            .mode = var->data.mode,
+            .location = var->data.location,
+            .driver_location = var->data.driver_location,
+            .name = write_packed_string(blob, start,
+                                        strip ? NULL : var->name),
+            .num_slots = glsl_count_attribute_slots(var->type, is_vs_input),
+            .location_frac = var->data.location_frac,
+            .interpolation = var->data.interpolation,
+            .base_type = glsl_get_base_type(type),
+            .vector_elements = glsl_get_vector_elements(type),
+            .flags = (var->data.patch ? NIR_PACKED_IO_PATCH : 0) |
+                     (var->data.compact ? NIR_PACKED_IO_COMPACT : 0) |
+                     (var->data.per_view ? NIR_PACKED_IO_PER_VIEW : 0) |
+                     (var->data.centroid ? NIR_PACKED_IO_CENTROID : 0) |
+                     (var->data.sample ? NIR_PACKED_IO_SAMPLE : 0) |
+                     (var->data.invariant ? NIR_PACKED_IO_INVARIANT : 0),
+         };
+         util_dynarray_append(&io_vars, struct nir_packed_io_var, io);
+      }
+   }
+
+   header->io_vars = write_packed_align(blob, start);
+   header->num_io_vars =
+      util_dynarray_num_elements(&io_vars, struct nir_packed_io_var);
+   blob_write_bytes(blob, io_vars.data, io_vars.size);
+
+   util_dynarray_fini(&io_vars);
+}
+
+/**
+ * Serialize NIR into the packed form, see nir_serialize.h.
+ *
+ * The packed shader starts at the next 16-byte aligned offset of the blob.
+ */
+void
+nir_serialize_packed(struct blob *blob, const nir_shader *nir, bool strip)
+{
+   write_packed_align(blob, 0);
+   const size_t start = blob->size;
+
+   struct nir_packed_header header = {
+      .magic = NIR_PACKED_MAGIC,
+      .version = NIR_PACKED_VERSION,
+      .shader_info_size = sizeof(shader_info),
+   };
+   intptr_t header_offset = blob_reserve_bytes(blob, sizeof(header));
+
+   if (!strip) {
+      header.name = write_packed_string(blob, start, nir->info.name);
+      header.label = write_packed_string(blob, start, nir->info.label);
+   }
+
+   write_packed_io_vars(blob, start, nir, strip, &header);
+
+   struct shader_info info = nir->info;
+   info.name = info.label = NULL;
+   header.info = write_packed_align(blob, start);
+   blob_write_bytes(blob, (uint8_t *) &info, sizeof(info));
+
+   write_ctx ctx = {0};
+   ctx.remap_table = _mesa_pointer_hash_table_create(NULL);
+   ctx.blob = blob;
+   ctx.nir = nir;
+   ctx.strip = strip;
+   util_dynarray_init(&ctx.phi_fixups, NULL);
+
+   header.globals = write_packed_align(blob, start);
+
+   write_var_list(&ctx, &nir->uniforms);
+   write_var_list(&ctx, &nir->inputs);
+   write_var_list(&ctx, &nir->outputs);
+   write_var_list(&ctx, &nir->shared);
+   write_var_list(&ctx, &nir->globals);
+   write_var_list(&ctx, &nir->system_values);
+
+   blob_write_uint32(blob, nir->num_inputs);
+   blob_write_uint32(blob, nir->num_uniforms);
+   blob_write_uint32(blob, nir->num_outputs);
+   blob_write_uint32(blob, nir->num_shared);
+   blob_write_uint32(blob, nir->scratch_size);
+
+   blob_write_uint32(blob, nir->constant_data_size);
+   if (nir->constant_data_size > 0)
+      blob_write_bytes(blob, nir->constant_data, nir->constant_data_size);
+
+   header.num_functions = exec_list_length(&nir->functions);
+   blob_write_uint32(blob, header.num_functions);
+   nir_foreach_function(fxn, nir) {
+      assert(fxn->packed_impl == NULL);
+      write_function(&ctx, fxn);
+   }
+
+   header.globals_size = blob->size - start - header.globals;
+   header.num_global_objects = ctx.next_idx;
+
+   header.functions = write_packed_align(blob, start);
+   intptr_t functions_offset =
+      blob_reserve_bytes(blob, header.num_functions *
+                               sizeof(struct nir_packed_function));
+
+   unsigned i = 0;
+   nir_foreach_function(fxn, nir) {
+      struct nir_packed_function packed = { 0 };
+
+      if (fxn->impl) {
+         /* Every body is read with a fresh read_ctx. */
+         ctx.next_idx = header.num_global_objects;
+         ctx.last_type = NULL;
+         ctx.last_interface_type = NULL;
+         memset(&ctx.last_var_data, 0, sizeof(ctx.last_var_data));
+
+         packed.impl = write_packed_align(blob, start);
+         write_function_impl(&ctx, fxn->impl);
+         packed.impl_size = blob->size - start - packed.impl;
+         packed.num_objects = ctx.next_idx;
+      }
+
+      blob_overwrite_bytes(blob, functions_offset + i++ * sizeof(packed),
+                           &packed, sizeof(packed));
+   }
+
+   header.size = blob->size - start;
+   blob_overwrite_bytes(blob, header_offset, &header, sizeof(header));
+
+   _mesa_hash_table_destroy(ctx.remap_table, NULL);
+   util_dynarray_fini(&ctx.phi_fixups);
+}
+
+/**
+ * Checks that \p data holds a packed shader written by this version of
+ * nir_serialize_packed() with sections that fit into \p size bytes.
+ */
+bool
+nir_packed_shader_check(const void *data, size_t size)
+{
+   const struct nir_packed_header *header = data;
+
+   if ((uintptr_t)data % NIR_PACKED_ALIGN != 0 || size < sizeof(*header))
+      return false;
+
+   if (header->magic != NIR_PACKED_MAGIC ||
+       header->version != NIR_PACKED_VERSION ||
+       header->shader_info_size != sizeof(shader_info) ||
+       header->size > size)
+      return false;
+
+   if ((uint64_t)header->info + sizeof(shader_info) > header->size ||
+       (uint64_t)header->io_vars +
+       (uint64_t)header->num_io_vars * sizeof(struct nir_packed_io_var) >
+       header->size ||
+       (uint64_t)header->globals + header->globals_size > header->size ||
+       (uint64_t)header->functions +
+       (uint64_t)header->num_functions * sizeof(struct nir_packed_function) >
+       header->size)
+      return false;
+
+   const struct nir_packed_function *functions =
+      (const void *)((const uint8_t *)data + header->functions);
+   for (unsigned i = 0; i < header->num_functions; i++) {
+      if ((uint64_t)functions[i].impl + functions[i].impl_size > header->size)
+         return false;
+   }
+
+   return true;
+}
+
+/**
+ * Returns the shader_info of a packed shader, without copying it.  The name
+ * and label are NULL, see nir_packed_shader_name() and
+ * nir_packed_shader_label().
+ */
+const shader_info *
+nir_packed_shader_info(const void *data)
+{
+   const struct nir_packed_header *header = data;
+   return (const shader_info *)((const uint8_t *)data + header->info);
+}
+
+const char *
+nir_packed_shader_string(const void *data, uint32_t offset)
+{
+   return offset ? (const char *)data + offset : NULL;
+}
+
+const char *
+nir_packed_shader_name(const void *data)
+{
+   const struct nir_packed_header *header = data;
+   return nir_packed_shader_string(data, header->name);
+}
+
+const char *
+nir_packed_shader_label(const void *data)
+{
+   const struct nir_packed_header *header = data;
+   return nir_packed_shader_string(data, header->label);
+}
+
+/**
+ * Returns the inputs followed by the outputs of a packed shader.
+ */
+const struct nir_packed_io_var *
+nir_packed_shader_io_vars(const void *data, unsigned *count)
+{
+   const struct nir_packed_header *header = data;
+
+   *count = header->num_io_vars;
+   return (const struct nir_packed_io_var *)
+      ((const uint8_t *)data + header->io_vars);
+}
+
+static nir_function_impl *
+read_packed_function_impl(nir_function *fxn,
+                          const struct nir_packed_impl *packed)
+{
+   struct blob_reader blob;
+   blob_reader_init(&blob, packed->data, packed->size);
+
+   read_ctx ctx = {0};
+   ctx.nir = fxn->shader;
+   ctx.blob = &blob;
+   list_inithead(&ctx.phi_srcs);
+   ctx.idx_table_len = packed->num_objects;
+   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+   memcpy(ctx.idx_table, packed->global_objects,
+          packed->num_global_objects * sizeof(uintptr_t));
+   ctx.next_idx = packed->num_global_objects;
+
+   nir_function_impl *impl = read_function_impl(&ctx, fxn);
+
+   free(ctx.idx_table);
+
+   return impl;
+}
+
+/**
+ * Deserializes a packed shader in place.
+ *
+ * If \p lazy is set, function bodies are left serialized until
+ * nir_materialize_function() or nir_materialize_shader() is called, and
+ * \p data has to stay valid until then.  In the meantime the shader can be
+ * inspected, but not modified or passed to anything that walks the
+ * function bodies, which nir_validate_shader() checks.
+ */
+nir_shader *
+nir_deserialize_packed(void *mem_ctx,
+                       const struct nir_shader_compiler_options *options,
+                       const void *data, bool lazy)
+{
+   const struct nir_packed_header *header = data;
+   const uint8_t *base = data;
+
+   assert(header->magic == NIR_PACKED_MAGIC &&
+          header->version == NIR_PACKED_VERSION);
+
+   struct shader_info info = *nir_packed_shader_info(data);
+   nir_shader *nir = nir_shader_create(mem_ctx, info.stage, options, NULL);
+
+   const char *name = nir_packed_shader_name(data);
+   const char *label = nir_packed_shader_label(data);
+   info.name = name ? ralloc_strdup(nir, name) : NULL;
+   info.label = label ? ralloc_strdup(nir, label) : NULL;
+
+   nir->info = info;
+
+   struct blob_reader blob;
+   blob_reader_init(&blob, base + header->globals, header->globals_size);
+
+   read_ctx ctx = {0};
+   ctx.nir = nir;
+   ctx.blob = &blob;
+   list_inithead(&ctx.phi_srcs);
+   ctx.idx_table_len = header->num_global_objects;
+   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+
+   read_var_list(&ctx, &nir->uniforms);
+   read_var_list(&ctx, &nir->inputs);
+   read_var_list(&ctx, &nir->outputs);
+   read_var_list(&ctx, &nir->shared);
+   read_var_list(&ctx, &nir->globals);
+   read_var_list(&ctx, &nir->system_values);
+
+   nir->num_inputs = blob_read_uint32(&blob);
+   nir->num_uniforms = blob_read_uint32(&blob);
+   nir->num_outputs = blob_read_uint32(&blob);
+   nir->num_shared = blob_read_uint32(&blob);
+   nir->scratch_size = blob_read_uint32(&blob);
+
+   nir->constant_data_size = blob_read_uint32(&blob);
+   if (nir->constant_data_size > 0) {
+      nir->constant_data = ralloc_size(nir, nir->constant_data_size);
+      blob_copy_bytes(&blob, nir->constant_data, nir->constant_data_size);
+   }
+
+   unsigned num_functions = blob_read_uint32(&blob);
+   for (unsigned i = 0; i < num_functions; i++)
+      read_function(&ctx);
+
+   const struct nir_packed_function *functions =
+      (const void *)(base + header->functions);
+   unsigned i = 0;
+   nir_foreach_function(fxn, nir) {
+      const struct nir_packed_function *function = &functions[i++];
+      if (fxn->impl != NIR_SERIALIZE_FUNC_HAS_IMPL)
+         continue;
+
+      struct nir_packed_impl packed = {
+         .data = base + function->impl,
+         .size = function->impl_size,
+         .num_objects = function->num_objects,
+         .global_objects = ctx.idx_table,
+         .num_global_objects = ctx.idx_table_len,
+      };
+
+      if (!lazy) {
+         fxn->impl = read_packed_function_impl(fxn, &packed);
+         continue;
+      }
+
+      fxn->impl = NULL;
+      fxn->packed_impl = ralloc(fxn, struct nir_packed_impl);
+      *fxn->packed_impl = packed;
+      fxn->packed_impl->global_objects =
+         ralloc_array(fxn->packed_impl, void *, ctx.idx_table_len);
+      memcpy(fxn->packed_impl->global_objects, ctx.idx_table,
+             ctx.idx_table_len * sizeof(void *));
+   }
+
+   free(ctx.idx_table);
+
+   return nir;
+}
+
+/**
+ * Deserializes the body of a function left serialized by a lazy
+ * nir_deserialize_packed(), and returns fxn->impl.
+ */
+nir_function_impl *
+nir_materialize_function(nir_function *fxn)
+{
+   if (fxn->packed_impl) {
+      fxn->impl = read_packed_function_impl(fxn, fxn->packed_impl);
+      ralloc_free(fxn->packed_impl);
+      fxn->packed_impl = NULL;
+   }
+
+   return fxn->impl;
+}
+
+void
+nir_materialize_shader(nir_shader *shader)
+{
+   nir_foreach_function(fxn, shader)
+      nir_materialize_function(fxn);
+}
+
 void
 nir_shader_serialize_deserialize(nir_shader *shader)
 {
@@ -36,6 +36,65 @@ nir_shader *nir_deserialize(void *mem_ctx,
                             const struct nir_shader_compiler_options *options,
                             struct blob_reader *blob);
 
+/**
+ * Packed serialization
+ *
+ * nir_serialize_packed() writes a versioned form of the shader which is
+ * read in place: every offset in it is relative to its start, so a cache
+ * entry or a mapped file can be used directly without copying it into a
+ * blob_reader first.  The shader_info and a table of the shader's inputs
+ * and outputs can be queried without deserializing anything, and each
+ * function body lives in its own section so that nir_deserialize_packed()
+ * can leave it for nir_materialize_function().
+ *
+ * The data has to be 16-byte aligned, as malloc'ed and mapped memory is,
+ * and it's only valid for the build of Mesa that wrote it, like the output
+ * of nir_serialize().
+ */
+#define NIR_PACKED_VERSION 1
+
+enum nir_packed_io_var_flags {
+   NIR_PACKED_IO_PATCH     = (1 << 0),
+   NIR_PACKED_IO_COMPACT   = (1 << 1),
+   NIR_PACKED_IO_PER_VIEW  = (1 << 2),
+   NIR_PACKED_IO_CENTROID  = (1 << 3),
+   NIR_PACKED_IO_SAMPLE    = (1 << 4),
+   NIR_PACKED_IO_INVARIANT = (1 << 5),
+};
+
+/** A shader input or output, as recorded by nir_serialize_packed(). */
+struct nir_packed_io_var {
+   uint32_t mode;          /**< nir_var_shader_in or nir_var_shader_out */
+   int32_t location;
+   uint32_t driver_location;
+   uint32_t name;          /**< See nir_packed_shader_string() */
+   uint16_t num_slots;     /**< glsl_count_attribute_slots() of the type */
+   uint8_t location_frac;
+   uint8_t interpolation;
+   uint8_t base_type;      /**< glsl_base_type without arrays */
+   uint8_t vector_elements;
+   uint8_t flags;          /**< nir_packed_io_var_flags */
+   uint8_t pad;
+};
+
+void nir_serialize_packed(struct blob *blob, const nir_shader *nir,
+                          bool strip);
+
+bool nir_packed_shader_check(const void *data, size_t size);
+const shader_info *nir_packed_shader_info(const void *data);
+const char *nir_packed_shader_string(const void *data, uint32_t offset);
+const char *nir_packed_shader_name(const void *data);
+const char *nir_packed_shader_label(const void *data);
+const struct nir_packed_io_var *
+nir_packed_shader_io_vars(const void *data, unsigned *count);
+
+nir_shader *
+nir_deserialize_packed(void *mem_ctx,
+                       const struct nir_shader_compiler_options *options,
+                       const void *data, bool lazy);
+nir_function_impl *nir_materialize_function(nir_function *fxn);
+void nir_materialize_shader(nir_shader *shader);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -176,7 +176,13 @@ nir_sweep(nir_shader *nir)
    }
 
    ralloc_steal(nir, nir->constant_data);
+   ralloc_steal(nir, nir->pool);
 
    /* Free everything we didn't steal back. */
    ralloc_free(rubbish);
+
+   /* Dead instructions went back to the pool, release the slabs they left
+    * empty.
+    */
+   ralloc_pool_trim(nir->pool);
 }
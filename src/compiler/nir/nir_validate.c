@@ -1210,6 +1210,11 @@ validate_function_impl(nir_function_impl *impl, validate_state *state)
 static void
 validate_function(nir_function *func, validate_state *state)
 {
+   /* Lazily deserialized functions have to be materialized before running
+    * any pass on the shader.
+    */
+   validate_assert(state, func->packed_impl == NULL);
+
    if (func->impl != NULL) {
       validate_assert(state, func->impl->function == func);
       validate_function_impl(func->impl, state);
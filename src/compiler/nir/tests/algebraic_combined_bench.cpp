@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Compares nir_opt_algebraic_combined with the fixed-point loop drivers use:
+ *
+ *    do {
+ *       progress = false;
+ *       progress |= nir_copy_prop(nir);
+ *       progress |= nir_opt_dce(nir);
+ *       progress |= nir_opt_algebraic(nir);
+ *       progress |= nir_opt_constant_folding(nir);
+ *    } while (progress);
+ *
+ * over a generated corpus.  Every shader is made of the things front-ends
+ * and lowering passes leave behind for this loop: input loads feeding long
+ * arithmetic chains, swizzling movs and vecs, constant subexpressions,
+ * algebraic identities, dead values and branches.
+ *
+ * The passes are called directly rather than through NIR_PASS, so that
+ * validation in debug builds doesn't end up in the timings.
+ *
+ * Usage: nir_algebraic_combined_bench [num_shaders] [instrs_per_shader] [seed]
+ *
+ * Exits with a failure if the loop still changes a shader after
+ * nir_opt_algebraic_combined, which is what the test suite checks on a
+ * small corpus.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "nir.h"
+#include "nir_builder.h"
+#include "util/os_time.h"
+
+namespace {
+
+struct rng {
+   uint64_t state;
+
+   unsigned next(unsigned n)
+   {
+      /* xorshift64* */
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+      return (unsigned)((state * 0x2545F4914F6CDD1DULL) >> 33) % n;
+   }
+};
+
+nir_ssa_def *
+pick(rng &r, const std::vector<nir_ssa_def *> &values)
+{
+   /* Favour recent values, like real expression trees do. */
+   unsigned n = values.size();
+   unsigned window = MIN2(n, 16u);
+   return r.next(4) ? values[n - 1 - r.next(window)] : values[r.next(n)];
+}
+
+nir_ssa_def *
+emit_value(nir_builder *b, rng &r, std::vector<nir_ssa_def *> &values)
+{
+   nir_ssa_def *x = pick(r, values);
+   nir_ssa_def *y = pick(r, values);
+
+   switch (r.next(14)) {
+   case 0:  return nir_fadd(b, x, y);
+   case 1:  return nir_fmul(b, x, y);
+   case 2:  return nir_ffma(b, x, y, pick(r, values));
+   case 3:  return nir_fmul(b, x, nir_imm_float(b, 1.0f));
+   case 4:  return nir_fadd(b, x, nir_imm_float(b, 0.0f));
+   case 5:  return nir_fneg(b, nir_fneg(b, x));
+   case 6:  return nir_fmax(b, x, x);
+   case 7:  return nir_fadd(b, nir_imm_float(b, r.next(8)),
+                               nir_imm_float(b, r.next(8)));
+   case 8:  return nir_fmul(b, nir_fadd(b, nir_imm_float(b, 2.0f),
+                                           nir_imm_float(b, 0.5f)), x);
+   case 9:  return nir_mov(b, x);
+   case 10: {
+      nir_ssa_def *comps[4] = { x, y, x, y };
+      nir_ssa_def *v = nir_vec(b, comps, 4);
+      return nir_channel(b, v, r.next(4));
+   }
+   case 11: return nir_fsat(b, nir_fsat(b, x));
+   case 12: return nir_bcsel(b, nir_flt(b, x, y), x, x);
+   default: return nir_fsub(b, x, nir_fneg(b, y));
+   }
+}
+
+void
+store_values(nir_builder *b, nir_variable *out,
+             std::vector<nir_ssa_def *> &values)
+{
+   /* Sum up everything computed since the inputs were loaded, so that only
+    * the values dropped on purpose are dead.
+    */
+   std::vector<nir_ssa_def *> sums(values.begin() + 4, values.end());
+   values.resize(4);
+   if (sums.empty())
+      return;
+
+   while (sums.size() > 1) {
+      unsigned half = sums.size() / 2;
+      for (unsigned i = 0; i < half; i++)
+         sums[i] = nir_fadd(b, sums[2 * i], sums[2 * i + 1]);
+      if (sums.size() % 2)
+         sums[half++] = sums.back();
+      sums.resize(half);
+   }
+
+   nir_store_var(b, out, sums[0], 0x1);
+}
+
+nir_shader *
+build_shader(const nir_shader_compiler_options *options, rng &r,
+             unsigned num_instrs)
+{
+   nir_builder b;
+   nir_builder_init_simple_shader(&b, NULL, MESA_SHADER_FRAGMENT, options);
+
+   nir_variable *in =
+      nir_variable_create(b.shader, nir_var_shader_in,
+                          glsl_vec4_type(), "in");
+   nir_variable *out =
+      nir_variable_create(b.shader, nir_var_shader_out,
+                          glsl_float_type(), "out");
+
+   std::vector<nir_ssa_def *> values;
+   nir_ssa_def *input = nir_load_var(&b, in);
+   for (unsigned c = 0; c < 4; c++)
+      values.push_back(nir_channel(&b, input, c));
+
+   nir_if *nif = NULL;
+   while (b.impl->ssa_alloc < num_instrs) {
+      if (!nif && r.next(64) == 0) {
+         store_values(&b, out, values);
+         nir_ssa_def *cond = nir_flt(&b, pick(r, values), values[0]);
+         /* Some conditions are copies, for copy propagation into ifs. */
+         if (r.next(2) == 0)
+            cond = nir_mov(&b, cond);
+         nif = nir_push_if(&b, cond);
+      } else if (nif && r.next(32) == 0) {
+         store_values(&b, out, values);
+         nir_pop_if(&b, nif);
+         nif = NULL;
+      }
+
+      nir_ssa_def *v = emit_value(&b, r, values);
+      /* Drop some values on the floor, for dead code elimination. */
+      if (r.next(8))
+         values.push_back(v);
+   }
+
+   store_values(&b, out, values);
+   if (nif)
+      nir_pop_if(&b, nif);
+
+   return b.shader;
+}
+
+unsigned
+count_instrs(nir_shader *shader)
+{
+   unsigned count = 0;
+   nir_foreach_function(function, shader) {
+      if (!function->impl)
+         continue;
+      nir_foreach_block(block, function->impl) {
+         nir_foreach_instr(instr, block)
+            count++;
+      }
+   }
+   return count;
+}
+
+bool
+run_loop(nir_shader *nir)
+{
+   bool any_progress = false;
+   bool progress;
+   do {
+      progress = false;
+      progress |= nir_copy_prop(nir);
+      progress |= nir_opt_dce(nir);
+      progress |= nir_opt_algebraic(nir);
+      progress |= nir_opt_constant_folding(nir);
+      any_progress |= progress;
+   } while (progress);
+
+   return any_progress;
+}
+
+} /* namespace */
+
+int
+main(int argc, char **argv)
+{
+   unsigned num_shaders = argc > 1 ? atoi(argv[1]) : 500;
+   unsigned num_instrs = argc > 2 ? atoi(argv[2]) : 2000;
+   rng r = { argc > 3 ? strtoull(argv[3], NULL, 0) : 0x5eed };
+
+   glsl_type_singleton_init_or_ref();
+
+   static const nir_shader_compiler_options options = { };
+
+   int64_t loop_ns = 0, combined_ns = 0;
+   uint64_t instrs_before = 0, instrs_loop = 0, instrs_combined = 0;
+   unsigned leftover = 0;
+
+   for (unsigned i = 0; i < num_shaders; i++) {
+      nir_shader *a = build_shader(&options, r, num_instrs);
+      nir_shader *b = nir_shader_clone(NULL, a);
+      instrs_before += count_instrs(a);
+
+      int64_t start = os_time_get_nano();
+      run_loop(a);
+      loop_ns += os_time_get_nano() - start;
+      instrs_loop += count_instrs(a);
+
+      start = os_time_get_nano();
+      nir_opt_algebraic_combined(b);
+      combined_ns += os_time_get_nano() - start;
+      instrs_combined += count_instrs(b);
+
+      /* Count the shaders the loop still finds something to do in. */
+      if (run_loop(b))
+         leftover++;
+
+      ralloc_free(a);
+      ralloc_free(b);
+   }
+
+   printf("shaders: %u, instructions: %" PRIu64 "\n",
+          num_shaders, instrs_before);
+   printf("loop:     %8.2f ms, %" PRIu64 " instructions left\n",
+          loop_ns / 1e6, instrs_loop);
+   printf("combined: %8.2f ms, %" PRIu64 " instructions left\n",
+          combined_ns / 1e6, instrs_combined);
+   printf("shaders the loop still changed after combined: %u\n", leftover);
+
+   glsl_type_singleton_decref();
+   return leftover ? EXIT_FAILURE : EXIT_SUCCESS;
+}
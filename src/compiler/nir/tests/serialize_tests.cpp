@@ -282,3 +282,217 @@ TEST_P(nir_serialize_all_but_one_test, single_channel)
 
    ASSERT_SWIZZLE_EQ(vec_alu, vec_alu_dup, 1, 0);
 }
+
+namespace {
+
+class nir_serialize_packed_test : public ::testing::Test {
+protected:
+   nir_serialize_packed_test();
+   ~nir_serialize_packed_test();
+
+   void build_shader();
+   void pack(bool strip);
+   void ASSERT_SHADERS_EQ(nir_shader *a, nir_shader *b);
+
+   void *mem_ctx;
+   nir_builder *b;
+   nir_variable *in, *out;
+   struct blob packed;
+   const nir_shader_compiler_options options;
+};
+
+nir_serialize_packed_test::nir_serialize_packed_test()
+:  options()
+{
+   glsl_type_singleton_init_or_ref();
+
+   mem_ctx = ralloc_context(NULL);
+
+   b = rzalloc(mem_ctx, nir_builder);
+   nir_builder_init_simple_shader(b, mem_ctx, MESA_SHADER_FRAGMENT, &options);
+   b->shader->info.name = ralloc_strdup(b->shader, "packed");
+
+   blob_init(&packed);
+}
+
+nir_serialize_packed_test::~nir_serialize_packed_test()
+{
+   blob_finish(&packed);
+   ralloc_free(mem_ctx);
+
+   glsl_type_singleton_decref();
+}
+
+void
+nir_serialize_packed_test::build_shader()
+{
+   in = nir_variable_create(b->shader, nir_var_shader_in,
+                            glsl_vec4_type(), "in");
+   in->data.location = VARYING_SLOT_VAR0;
+   in->data.interpolation = INTERP_MODE_FLAT;
+   out = nir_variable_create(b->shader, nir_var_shader_out,
+                             glsl_float_type(), "out");
+   out->data.location = FRAG_RESULT_DATA0;
+
+   /* A second function using a shader variable, so that its body refers to
+    * objects of the globals section.
+    */
+   nir_function *helper = nir_function_create(b->shader, "helper");
+   helper->num_params = 1;
+   helper->params = ralloc_array(b->shader, nir_parameter, 1);
+   helper->params[0].num_components = 1;
+   helper->params[0].bit_size = 32;
+
+   nir_builder hb;
+   nir_builder_init(&hb, nir_function_impl_create(helper));
+   hb.cursor = nir_after_cf_list(&hb.impl->body);
+   nir_store_var(&hb, out, nir_fmul_imm(&hb, nir_load_param(&hb, 0), 2.0),
+                 0x1);
+
+   nir_ssa_def *x = nir_channel(b, nir_load_var(b, in), 0);
+   nir_push_if(b, nir_flt(b, x, nir_imm_float(b, 0.0)));
+   nir_ssa_def *then_def = nir_fneg(b, x);
+   nir_push_else(b, NULL);
+   nir_ssa_def *else_def = nir_fadd_imm(b, x, 1.0);
+   nir_pop_if(b, NULL);
+
+   nir_call_instr *call = nir_call_instr_create(b->shader, helper);
+   call->params[0] = nir_src_for_ssa(nir_if_phi(b, then_def, else_def));
+   nir_builder_instr_insert(b, &call->instr);
+
+   nir_validate_shader(b->shader, "packed test");
+}
+
+void
+nir_serialize_packed_test::pack(bool strip)
+{
+   /* Start at an odd offset, the packed shader has to align itself. */
+   blob_write_uint8(&packed, 0xff);
+   nir_serialize_packed(&packed, b->shader, strip);
+   ASSERT_FALSE(packed.out_of_memory);
+}
+
+void
+nir_serialize_packed_test::ASSERT_SHADERS_EQ(nir_shader *a, nir_shader *b)
+{
+   struct blob blob_a, blob_b;
+   blob_init(&blob_a);
+   blob_init(&blob_b);
+
+   nir_serialize(&blob_a, a, false);
+   nir_serialize(&blob_b, b, false);
+
+   ASSERT_EQ(blob_a.size, blob_b.size);
+   ASSERT_EQ(memcmp(blob_a.data, blob_b.data, blob_a.size), 0);
+
+   blob_finish(&blob_a);
+   blob_finish(&blob_b);
+}
+
+} // namespace
+
+TEST_F(nir_serialize_packed_test, round_trip)
+{
+   build_shader();
+   pack(false);
+
+   const void *data = packed.data + 16;
+   ASSERT_TRUE(nir_packed_shader_check(data, packed.size - 16));
+
+   nir_shader *dup = nir_deserialize_packed(mem_ctx, &options, data, false);
+   nir_validate_shader(dup, "packed round trip");
+
+   ASSERT_SHADERS_EQ(b->shader, dup);
+}
+
+TEST_F(nir_serialize_packed_test, lazy)
+{
+   build_shader();
+   pack(false);
+
+   const void *data = packed.data + 16;
+   nir_shader *dup = nir_deserialize_packed(mem_ctx, &options, data, true);
+
+   nir_foreach_function(fxn, dup) {
+      ASSERT_EQ(fxn->impl, nullptr);
+      ASSERT_NE(fxn->packed_impl, nullptr);
+   }
+   ASSERT_EQ(exec_list_length(&dup->inputs), 1u);
+   ASSERT_EQ(exec_list_length(&dup->outputs), 1u);
+
+   /* Materialize the callee first, out of order. */
+   nir_function *helper =
+      exec_node_data(nir_function, exec_list_get_tail(&dup->functions), node);
+   ASSERT_NE(nir_materialize_function(helper), nullptr);
+   nir_materialize_shader(dup);
+   nir_validate_shader(dup, "lazy packed round trip");
+
+   ASSERT_SHADERS_EQ(b->shader, dup);
+}
+
+TEST_F(nir_serialize_packed_test, queries)
+{
+   build_shader();
+   pack(false);
+
+   const void *data = packed.data + 16;
+   const shader_info *info = nir_packed_shader_info(data);
+   ASSERT_EQ(info->stage, MESA_SHADER_FRAGMENT);
+   ASSERT_EQ(info->name, nullptr);
+   ASSERT_STREQ(nir_packed_shader_name(data), "packed");
+   ASSERT_EQ(nir_packed_shader_label(data), nullptr);
+
+   unsigned count;
+   const struct nir_packed_io_var *io = nir_packed_shader_io_vars(data, &count);
+   ASSERT_EQ(count, 2u);
+
+   ASSERT_EQ(io[0].mode, (uint32_t)nir_var_shader_in);
+   ASSERT_EQ(io[0].location, VARYING_SLOT_VAR0);
+   ASSERT_EQ(io[0].interpolation, INTERP_MODE_FLAT);
+   ASSERT_EQ(io[0].base_type, GLSL_TYPE_FLOAT);
+   ASSERT_EQ(io[0].vector_elements, 4);
+   ASSERT_EQ(io[0].num_slots, 1);
+   ASSERT_STREQ(nir_packed_shader_string(data, io[0].name), "in");
+
+   ASSERT_EQ(io[1].mode, (uint32_t)nir_var_shader_out);
+   ASSERT_EQ(io[1].location, FRAG_RESULT_DATA0);
+   ASSERT_EQ(io[1].vector_elements, 1);
+   ASSERT_STREQ(nir_packed_shader_string(data, io[1].name), "out");
+}
+
+TEST_F(nir_serialize_packed_test, strip)
+{
+   build_shader();
+   pack(true);
+
+   const void *data = packed.data + 16;
+   ASSERT_EQ(nir_packed_shader_name(data), nullptr);
+
+   unsigned count;
+   const struct nir_packed_io_var *io = nir_packed_shader_io_vars(data, &count);
+   ASSERT_EQ(count, 2u);
+   ASSERT_EQ(nir_packed_shader_string(data, io[0].name), nullptr);
+
+   nir_shader *dup = nir_deserialize_packed(mem_ctx, &options, data, false);
+   nir_validate_shader(dup, "stripped packed round trip");
+}
+
+TEST_F(nir_serialize_packed_test, check)
+{
+   build_shader();
+   pack(false);
+
+   uint8_t *data = packed.data + 16;
+   size_t size = packed.size - 16;
+   ASSERT_TRUE(nir_packed_shader_check(data, size));
+
+   ASSERT_FALSE(nir_packed_shader_check(data, size - 1));
+   ASSERT_FALSE(nir_packed_shader_check(data, 8));
+
+   /* The version follows the magic number. */
+   uint32_t version;
+   memcpy(&version, data + 4, sizeof(version));
+   version++;
+   memcpy(data + 4, &version, sizeof(version));
+   ASSERT_FALSE(nir_packed_shader_check(data, size));
+}
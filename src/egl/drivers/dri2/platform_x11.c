@@ -1173,6 +1173,35 @@ dri2_x11_get_sync_values(_EGLDisplay *display, _EGLSurface *surface,
    return EGL_TRUE;
 }
 
+static EGLBoolean
+dri2_x11_swrast_swap_buffers_with_damage(_EGLDriver *drv, _EGLDisplay *disp,
+                                         _EGLSurface *draw,
+                                         const EGLint *rects, EGLint n_rects)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
+   struct dri2_egl_surface *dri2_surf = dri2_egl_surface(draw);
+
+   if (dri2_dpy->swrast->base.version < 5)
+      return dri2_x11_swap_buffers(drv, disp, draw);
+
+   dri2_dpy->swrast->swapBuffersWithDamage(dri2_surf->dri_drawable,
+                                           n_rects, rects);
+   return EGL_TRUE;
+}
+
+static EGLint
+dri2_x11_swrast_query_buffer_age(_EGLDriver *drv, _EGLDisplay *disp,
+                                 _EGLSurface *surf)
+{
+   struct dri2_egl_display *dri2_dpy = dri2_egl_display(disp);
+   struct dri2_egl_surface *dri2_surf = dri2_egl_surface(surf);
+
+   if (dri2_dpy->swrast->base.version < 5)
+      return 0;
+
+   return dri2_dpy->swrast->queryBufferAge(dri2_surf->dri_drawable);
+}
+
 static const struct dri2_egl_display_vtbl dri2_x11_swrast_display_vtbl = {
    .authenticate = NULL,
    .create_window_surface = dri2_x11_create_window_surface,
@@ -1181,11 +1210,12 @@ static const struct dri2_egl_display_vtbl dri2_x11_swrast_display_vtbl = {
    .destroy_surface = dri2_x11_destroy_surface,
    .create_image = dri2_create_image_khr,
    .swap_buffers = dri2_x11_swap_buffers,
+   .swap_buffers_with_damage = dri2_x11_swrast_swap_buffers_with_damage,
    .swap_buffers_region = dri2_fallback_swap_buffers_region,
    .post_sub_buffer = dri2_fallback_post_sub_buffer,
    /* XXX: should really implement this since X11 has pixmaps */
    .copy_buffers = dri2_fallback_copy_buffers,
-   .query_buffer_age = dri2_fallback_query_buffer_age,
+   .query_buffer_age = dri2_x11_swrast_query_buffer_age,
    .query_surface = dri2_query_surface,
    .create_wayland_buffer_from_image = dri2_fallback_create_wayland_buffer_from_image,
    .get_sync_values = dri2_fallback_get_sync_values,
@@ -1318,6 +1348,11 @@ dri2_initialize_x11_swrast(_EGLDriver *drv, _EGLDisplay *disp)
 
    dri2_setup_screen(disp);
 
+   if (dri2_dpy->swrast->base.version >= 5) {
+      disp->Extensions.EXT_buffer_age = EGL_TRUE;
+      disp->Extensions.EXT_swap_buffers_with_damage = EGL_TRUE;
+   }
+
    if (!dri2_x11_add_configs_for_visuals(dri2_dpy, disp, true))
       goto cleanup;
 
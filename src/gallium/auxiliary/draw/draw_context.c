@@ -586,6 +586,26 @@ draw_set_force_passthrough( struct draw_context *draw, boolean enable )
 }
 
 
+/**
+ * Let the driver provide a persistent cache for the code generated for
+ * vertex shader variants.
+ */
+void
+draw_set_disk_cache_callbacks(struct draw_context *draw,
+                              void *data_cookie,
+                              void (*find_shader)(void *cookie,
+                                                  struct lp_cached_code *cache,
+                                                  unsigned char ir_sha1_cache_key[20]),
+                              void (*insert_shader)(void *cookie,
+                                                    struct lp_cached_code *cache,
+                                                    unsigned char ir_sha1_cache_key[20]))
+{
+   draw->disk_cache_find_shader = find_shader;
+   draw->disk_cache_insert_shader = insert_shader;
+   draw->disk_cache_cookie = data_cookie;
+}
+
+
 
 /**
  * Allocate an extra vertex/geometry shader vertex attribute, if it doesn't
@@ -801,6 +821,18 @@ draw_total_tes_outputs(const struct draw_context *draw)
    return info->num_outputs + draw->extra_shader_outputs.num;
 }
 
+/**
+ * Return the number of vertices the post-transform vertex cache (see
+ * DRAW_VERTEX_CACHE_SIZE) provided instead of shading them, since the
+ * context was created.  These are not counted in the vs_invocations
+ * statistic.
+ */
+uint64_t
+draw_get_vertex_cache_hits(const struct draw_context *draw)
+{
+   return draw->pt.vertex_cache_hits;
+}
+
 /**
  * Provide TGSI sampler objects for vertex/geometry shaders that use
  * texture fetches.  This state only needs to be set once per context.
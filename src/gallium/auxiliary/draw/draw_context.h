@@ -51,6 +51,7 @@ struct draw_fragment_shader;
 struct tgsi_sampler;
 struct tgsi_image;
 struct tgsi_buffer;
+struct lp_cached_code;
 
 /*
  * structure to contain driver internal information 
@@ -160,6 +161,9 @@ draw_total_tcs_outputs(const struct draw_context *draw);
 uint
 draw_total_tes_outputs(const struct draw_context *draw);
 
+uint64_t
+draw_get_vertex_cache_hits(const struct draw_context *draw);
+
 void
 draw_texture_sampler(struct draw_context *draw,
                      enum pipe_shader_type shader_type,
@@ -335,6 +339,16 @@ void draw_set_driver_clipping( struct draw_context *draw,
 void draw_set_force_passthrough( struct draw_context *draw, 
                                  boolean enable );
 
+void
+draw_set_disk_cache_callbacks(struct draw_context *draw,
+                              void *data_cookie,
+                              void (*find_shader)(void *cookie,
+                                                  struct lp_cached_code *cache,
+                                                  unsigned char ir_sha1_cache_key[20]),
+                              void (*insert_shader)(void *cookie,
+                                                    struct lp_cached_code *cache,
+                                                    unsigned char ir_sha1_cache_key[20]));
+
 
 /*******************************************************************************
  * Draw statistics
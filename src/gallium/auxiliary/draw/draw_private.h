@@ -71,6 +71,7 @@ struct tgsi_buffer;
 struct draw_pt_front_end;
 struct draw_assembler;
 struct draw_llvm;
+struct lp_cached_code;
 
 
 /**
@@ -226,6 +227,20 @@ struct draw_context
          float (*planes)[DRAW_TOTAL_CLIP_PLANES][4]; 
       } user;
 
+      /**
+       * Bumped for every draw instance and state validation.  Vertices
+       * shaded under another stamp can't be reused by the post-transform
+       * vertex cache.  Starts at zero, the stamp of the cleared cache
+       * tags, and is bumped before any vertex gets shaded.
+       */
+      unsigned vertex_cache_stamp;
+
+      /**
+       * Number of vertices taken from the post-transform vertex cache
+       * rather than shaded, see draw_get_vertex_cache_hits().
+       */
+      uint64_t vertex_cache_hits;
+
       boolean test_fse;         /* enable FSE even though its not correct (eg for softpipe) */
       boolean no_fse;           /* disable FSE even when it is correct */
    } pt;
@@ -370,6 +385,15 @@ struct draw_context
 
    struct draw_llvm *llvm;
 
+   /** Driver callbacks for the on-disk cache of JIT'ed shader code */
+   void *disk_cache_cookie;
+   void (*disk_cache_find_shader)(void *cookie,
+                                  struct lp_cached_code *cache,
+                                  unsigned char ir_sha1_cache_key[20]);
+   void (*disk_cache_insert_shader)(void *cookie,
+                                    struct lp_cached_code *cache,
+                                    unsigned char ir_sha1_cache_key[20]);
+
    /** Texture sampler and sampler view state.
     * Note that we have arrays indexed by shader type.  At this time
     * we only handle vertex and geometry shaders in the draw module, but
@@ -571,6 +571,7 @@ draw_vbo(struct draw_context *draw,
       }
 
       draw_new_instance(draw);
+      draw->pt.vertex_cache_stamp++;
 
       if (info->primitive_restart) {
          draw_pt_arrays_restart(draw, info);
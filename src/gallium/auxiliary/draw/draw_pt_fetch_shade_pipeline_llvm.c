@@ -28,6 +28,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_tess.h"
@@ -41,6 +42,44 @@
 #include "gallivm/lp_bld_debug.h"
 
 
+/** Max number of threads helping to run vertex shaders, see DRAW_VS_THREADS */
+#define DRAW_MAX_VS_THREADS 8
+
+/** Smaller vertex chunks are shaded by the calling thread only */
+#define DRAW_MIN_PARALLEL_VS_VERTICES 256
+
+/** Max number of entries of the post-transform vertex cache */
+#define DRAW_MAX_VERTEX_CACHE_SIZE 65536
+
+
+struct llvm_middle_end;
+
+/**
+ * A thread's share of the vertices of a chunk: fetch, vertex shader,
+ * clip test and viewport transform for a contiguous range of vertices.
+ */
+struct llvm_vs_task {
+   struct llvm_middle_end *fpme;
+   struct vertex_header *verts;
+   unsigned count;
+   unsigned start_or_maxelt;
+   unsigned vid_base;
+   const unsigned *elts;
+   boolean clipped;
+   struct util_queue_fence fence;
+};
+
+
+/**
+ * Tag of a post-transform vertex cache entry: the fetch element of the
+ * vertex, and the vertex cache stamp it was shaded under.
+ */
+struct llvm_vcache_tag {
+   unsigned elt;
+   unsigned stamp;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -58,6 +97,29 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   unsigned num_vs_threads;
+   struct util_queue vs_queue;
+   struct llvm_vs_task *vs_tasks;   /**< num_vs_threads + 1 tasks */
+
+   /**
+    * Post-transform vertex cache for indexed draws, see
+    * DRAW_VERTEX_CACHE_SIZE.  A direct-mapped cache of shaded vertices,
+    * indexed by the low bits of the fetch element.  It lives as long as
+    * draw::pt::vertex_cache_stamp doesn't change, so vertices are reused
+    * across the segments vsplit cuts a draw into.
+    */
+   struct {
+      unsigned size;                  /**< entries, power of two, or zero */
+      unsigned vertex_size;           /**< largest vertex size verts fits */
+      struct llvm_vcache_tag *tags;
+      char *verts;
+
+      /* The misses of a chunk, kept across chunks */
+      unsigned scratch_count;         /**< vertices the buffers below fit */
+      unsigned *miss_elts;            /**< and miss slots, 2 x count */
+      char *shaded;
+   } vcache;
 };
 
 
@@ -69,6 +131,78 @@ llvm_middle_end(struct draw_pt_middle_end *middle)
 }
 
 
+/**
+ * Allocate the post-transform vertex cache, if requested with
+ * DRAW_VERTEX_CACHE_SIZE.  The vertices are allocated once the vertex
+ * size is known.
+ */
+static void
+llvm_middle_end_init_vcache(struct llvm_middle_end *fpme)
+{
+   unsigned size = debug_get_num_option("DRAW_VERTEX_CACHE_SIZE", 0);
+
+   if (!size)
+      return;
+
+   size = util_next_power_of_two(MIN2(size, DRAW_MAX_VERTEX_CACHE_SIZE));
+
+   /* cleared tags have a stamp of zero, which never matches */
+   fpme->vcache.tags = CALLOC(size, sizeof *fpme->vcache.tags);
+   if (!fpme->vcache.tags)
+      return;
+
+   fpme->vcache.size = size;
+}
+
+
+static void
+llvm_middle_end_destroy_vcache(struct llvm_middle_end *fpme)
+{
+   FREE(fpme->vcache.tags);
+   FREE(fpme->vcache.verts);
+   FREE(fpme->vcache.miss_elts);
+   FREE(fpme->vcache.shaded);
+   fpme->vcache.tags = NULL;
+   fpme->vcache.verts = NULL;
+   fpme->vcache.miss_elts = NULL;
+   fpme->vcache.shaded = NULL;
+   fpme->vcache.size = 0;
+   fpme->vcache.vertex_size = 0;
+   fpme->vcache.scratch_count = 0;
+}
+
+
+/**
+ * Make sure the miss buffers of the vertex cache fit a chunk of count
+ * vertices.  They only grow, so chunks don't allocate once the largest
+ * one has been seen.
+ */
+static boolean
+llvm_middle_end_vcache_scratch(struct llvm_middle_end *fpme, unsigned count)
+{
+   count = align(count, lp_native_vector_width / 32);
+
+   if (count <= fpme->vcache.scratch_count)
+      return TRUE;
+
+   FREE(fpme->vcache.miss_elts);
+   FREE(fpme->vcache.shaded);
+   fpme->vcache.miss_elts = MALLOC(2 * count * sizeof(unsigned));
+   fpme->vcache.shaded = MALLOC(count * fpme->vcache.vertex_size);
+   if (!fpme->vcache.miss_elts || !fpme->vcache.shaded) {
+      FREE(fpme->vcache.miss_elts);
+      FREE(fpme->vcache.shaded);
+      fpme->vcache.miss_elts = NULL;
+      fpme->vcache.shaded = NULL;
+      fpme->vcache.scratch_count = 0;
+      return FALSE;
+   }
+
+   fpme->vcache.scratch_count = count;
+   return TRUE;
+}
+
+
 static void
 llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
 {
@@ -344,6 +478,20 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    /* return even number */
    *max_vertices = *max_vertices & ~1;
 
+   /* The shaded vertices depend on the state being validated here */
+   draw->pt.vertex_cache_stamp++;
+   if (fpme->vcache.size && fpme->vcache.vertex_size < fpme->vertex_size) {
+      FREE(fpme->vcache.verts);
+      fpme->vcache.verts = MALLOC(fpme->vcache.size * fpme->vertex_size);
+      if (fpme->vcache.verts)
+         fpme->vcache.vertex_size = fpme->vertex_size;
+      else
+         llvm_middle_end_destroy_vcache(fpme);
+
+      /* the shaded vertices buffer is sized for the old vertex size */
+      fpme->vcache.scratch_count = 0;
+   }
+
    /* Find/create the vertex shader variant */
    {
       struct draw_llvm_variant_key *key;
@@ -554,6 +702,231 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Fetch, shade, clip test and viewport transform count vertices into verts.
+ * Returns whether any vertex was clipped or had a non-one edge flag.
+ */
+static boolean
+run_vs(struct llvm_middle_end *fpme,
+       struct vertex_header *verts,
+       unsigned count,
+       unsigned start_or_maxelt,
+       unsigned vid_base,
+       const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+
+   return fpme->current_variant->jit_func(&fpme->llvm->jit_context,
+                                          verts,
+                                          draw->pt.user.vbuffer,
+                                          count,
+                                          start_or_maxelt,
+                                          fpme->vertex_size,
+                                          draw->pt.vertex_buffer,
+                                          draw->instance_id,
+                                          vid_base,
+                                          draw->start_instance,
+                                          elts, draw->pt.user.drawid);
+}
+
+
+static void
+vs_task_execute(void *data, int thread_index)
+{
+   struct llvm_vs_task *task = data;
+
+   task->clipped = run_vs(task->fpme, task->verts, task->count,
+                          task->start_or_maxelt, task->vid_base, task->elts);
+}
+
+
+/**
+ * Split the vertices of a chunk in contiguous ranges and run the vertex
+ * shader of each range on its own thread.  Every range writes its
+ * vertices at their place in verts, so the output is in vertex order
+ * once all threads are done.
+ *
+ * The generated code always writes whole SIMD vectors of vertices, so
+ * every range but the last one is a multiple of the vector length.
+ */
+static boolean
+run_vs_parallel(struct llvm_middle_end *fpme,
+                struct vertex_header *verts,
+                unsigned count,
+                boolean linear,
+                unsigned start_or_maxelt,
+                unsigned vid_base,
+                const unsigned *elts)
+{
+   const unsigned num_tasks = fpme->num_vs_threads + 1;
+   const unsigned vector_length = lp_native_vector_width / 32;
+   const unsigned verts_per_task =
+      align(DIV_ROUND_UP(count, num_tasks), vector_length);
+   boolean clipped = FALSE;
+   unsigned first = 0;
+   unsigned num_used = 0;
+   unsigned i;
+
+   for (i = 0; i < num_tasks && first < count; i++) {
+      struct llvm_vs_task *task = &fpme->vs_tasks[i];
+
+      task->fpme = fpme;
+      task->verts = (struct vertex_header *)
+         ((char *)verts + first * fpme->vertex_size);
+      task->count = MIN2(verts_per_task, count - first);
+      task->vid_base = vid_base;
+      task->clipped = FALSE;
+
+      /* The linear path fetches from start, the elts path from the elts */
+      if (linear) {
+         task->start_or_maxelt = start_or_maxelt + first;
+         task->elts = NULL;
+      }
+      else {
+         task->start_or_maxelt = start_or_maxelt;
+         task->elts = elts + first;
+      }
+
+      /* the calling thread runs the first range itself */
+      if (i > 0)
+         util_queue_add_job(&fpme->vs_queue, task, &task->fence,
+                            vs_task_execute, NULL, 0);
+
+      first += task->count;
+      num_used++;
+   }
+
+   vs_task_execute(&fpme->vs_tasks[0], 0);
+
+   for (i = 0; i < num_used; i++) {
+      struct llvm_vs_task *task = &fpme->vs_tasks[i];
+
+      if (i > 0)
+         util_queue_fence_wait(&task->fence);
+
+      clipped |= task->clipped;
+   }
+
+   return clipped;
+}
+
+
+static inline boolean
+use_parallel_vs(const struct llvm_middle_end *fpme, unsigned count)
+{
+   return fpme->num_vs_threads &&
+          count >= DRAW_MIN_PARALLEL_VS_VERTICES;
+}
+
+
+/**
+ * Shade count vertices, on several threads if the chunk is large enough.
+ */
+static boolean
+shade_vertices(struct llvm_middle_end *fpme,
+               struct vertex_header *verts,
+               unsigned count,
+               boolean linear,
+               unsigned start_or_maxelt,
+               unsigned vid_base,
+               const unsigned *elts)
+{
+   if (use_parallel_vs(fpme, count)) {
+      return run_vs_parallel(fpme, verts, count, linear, start_or_maxelt,
+                             vid_base, elts);
+   }
+   else {
+      return run_vs(fpme, verts, count, start_or_maxelt, vid_base, elts);
+   }
+}
+
+
+/**
+ * Whether a shaded vertex needs the draw pipeline, like the clip result
+ * of the generated vertex function does.
+ */
+static inline boolean
+vertex_needs_pipeline(const struct vertex_header *vertex,
+                      boolean need_edgeflags)
+{
+   return vertex->clipmask != 0 || (need_edgeflags && !vertex->edgeflag);
+}
+
+
+/**
+ * Shade the vertices of the fetch elements elts through the post-transform
+ * vertex cache: vertices found in the cache are copied, the others are
+ * shaded and then put in the cache.
+ * Returns the number of vertices which were shaded in num_shaded.
+ */
+static boolean
+shade_vertices_cached(struct llvm_middle_end *fpme,
+                      struct vertex_header *verts,
+                      unsigned count,
+                      unsigned start_or_maxelt,
+                      unsigned vid_base,
+                      const unsigned *elts,
+                      unsigned *num_shaded)
+{
+   const unsigned stamp = fpme->draw->pt.vertex_cache_stamp;
+   const unsigned mask = fpme->vcache.size - 1;
+   const unsigned vertex_size = fpme->vertex_size;
+   const boolean need_edgeflags =
+      fpme->current_variant->key.need_edgeflags;
+   struct vertex_header *shaded;
+   unsigned *miss_elts;
+   unsigned *miss_slots;
+   unsigned num_misses = 0;
+   boolean clipped = FALSE;
+   unsigned i;
+
+   if (!llvm_middle_end_vcache_scratch(fpme, count)) {
+      *num_shaded = count;
+      return shade_vertices(fpme, verts, count, FALSE, start_or_maxelt,
+                            vid_base, elts);
+   }
+   shaded = (struct vertex_header *)fpme->vcache.shaded;
+   miss_elts = fpme->vcache.miss_elts;
+   miss_slots = miss_elts + fpme->vcache.scratch_count;
+
+   for (i = 0; i < count; i++) {
+      const unsigned idx = elts[i] & mask;
+      const struct llvm_vcache_tag *tag = &fpme->vcache.tags[idx];
+      struct vertex_header *dst =
+         (struct vertex_header *)((char *)verts + i * vertex_size);
+
+      if (tag->elt == elts[i] && tag->stamp == stamp) {
+         memcpy(dst, fpme->vcache.verts + idx * vertex_size, vertex_size);
+         clipped |= vertex_needs_pipeline(dst, need_edgeflags);
+      }
+      else {
+         miss_elts[num_misses] = elts[i];
+         miss_slots[num_misses] = i;
+         num_misses++;
+      }
+   }
+
+   if (num_misses) {
+      clipped |= shade_vertices(fpme, shaded, num_misses, FALSE,
+                                start_or_maxelt, vid_base, miss_elts);
+
+      for (i = 0; i < num_misses; i++) {
+         const unsigned idx = miss_elts[i] & mask;
+         const char *src = (const char *)shaded + i * vertex_size;
+
+         memcpy((char *)verts + miss_slots[i] * vertex_size, src,
+                vertex_size);
+         memcpy(fpme->vcache.verts + idx * vertex_size, src, vertex_size);
+         fpme->vcache.tags[idx].elt = miss_elts[i];
+         fpme->vcache.tags[idx].stamp = stamp;
+      }
+   }
+
+   *num_shaded = num_misses;
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -579,6 +952,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    unsigned opt = fpme->opt;
    boolean clipped = 0;
    unsigned start_or_maxelt, vid_base;
+   unsigned num_shaded;
    const unsigned *elts;
    ushort *tes_elts_out = NULL;
 
@@ -601,7 +975,6 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       else
          draw->statistics.ia_primitives +=
             u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
    }
 
    if (fetch_info->linear) {
@@ -614,17 +987,21 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       vid_base = draw->pt.user.eltBias;
       elts = fetch_info->elts;
    }
-   clipped = fpme->current_variant->jit_func(&fpme->llvm->jit_context,
-                                             llvm_vert_info.verts,
-                                             draw->pt.user.vbuffer,
-                                             fetch_info->count,
-                                             start_or_maxelt,
-                                             fpme->vertex_size,
-                                             draw->pt.vertex_buffer,
-                                             draw->instance_id,
-                                             vid_base,
-                                             draw->start_instance,
-                                             elts, draw->pt.user.drawid);
+   if (elts && fpme->vcache.size) {
+      clipped = shade_vertices_cached(fpme, llvm_vert_info.verts,
+                                      fetch_info->count, start_or_maxelt,
+                                      vid_base, elts, &num_shaded);
+   }
+   else {
+      clipped = shade_vertices(fpme, llvm_vert_info.verts, fetch_info->count,
+                               fetch_info->linear, start_or_maxelt,
+                               vid_base, elts);
+      num_shaded = fetch_info->count;
+   }
+
+   if (draw->collect_statistics)
+      draw->statistics.vs_invocations += num_shaded;
+   draw->pt.vertex_cache_hits += fetch_info->count - num_shaded;
 
    /* Finished with fetch and vs:
     */
@@ -876,11 +1253,66 @@ llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 }
 
 
+/**
+ * Start the threads helping to run the vertex shaders of large vertex
+ * chunks, if requested with DRAW_VS_THREADS.  Failing that, vertices are
+ * shaded by the calling thread only.
+ */
+static void
+llvm_middle_end_init_vs_threads(struct llvm_middle_end *fpme)
+{
+   unsigned num_threads = debug_get_num_option("DRAW_VS_THREADS", 0);
+   unsigned i;
+
+   num_threads = MIN2(num_threads, DRAW_MAX_VS_THREADS);
+   if (!num_threads)
+      return;
+
+   fpme->vs_tasks = CALLOC(num_threads + 1, sizeof *fpme->vs_tasks);
+   if (!fpme->vs_tasks)
+      return;
+
+   if (!util_queue_init(&fpme->vs_queue, "drawvs", num_threads, num_threads,
+                        0)) {
+      FREE(fpme->vs_tasks);
+      fpme->vs_tasks = NULL;
+      return;
+   }
+
+   for (i = 0; i < num_threads + 1; i++)
+      util_queue_fence_init(&fpme->vs_tasks[i].fence);
+
+   fpme->num_vs_threads = num_threads;
+}
+
+
+static void
+llvm_middle_end_destroy_vs_threads(struct llvm_middle_end *fpme)
+{
+   unsigned i;
+
+   if (!fpme->num_vs_threads)
+      return;
+
+   util_queue_destroy(&fpme->vs_queue);
+
+   for (i = 0; i < fpme->num_vs_threads + 1; i++)
+      util_queue_fence_destroy(&fpme->vs_tasks[i].fence);
+
+   FREE(fpme->vs_tasks);
+   fpme->vs_tasks = NULL;
+   fpme->num_vs_threads = 0;
+}
+
+
 static void
 llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
 
+   llvm_middle_end_destroy_vs_threads(fpme);
+   llvm_middle_end_destroy_vcache(fpme);
+
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
 
@@ -941,6 +1373,9 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   llvm_middle_end_init_vs_threads(fpme);
+   llvm_middle_end_init_vcache(fpme);
+
    return &fpme->base;
 
  fail:
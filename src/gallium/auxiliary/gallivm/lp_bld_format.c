@@ -26,9 +26,20 @@
  **************************************************************************/
 
 
+#include "util/format/u_format.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+
 #include "lp_bld_format.h"
 
 
+/**
+ * Number of entries in a lp_build_format_cache.
+ * Set up by lp_build_init(), constant afterwards since it's baked into
+ * the generated code.
+ */
+unsigned lp_build_format_cache_size = LP_BUILD_FORMAT_CACHE_SIZE;
+
 
 LLVMTypeRef
 lp_build_format_cache_type(struct gallivm_state *gallivm)
@@ -37,20 +48,90 @@ lp_build_format_cache_type(struct gallivm_state *gallivm)
    LLVMTypeRef s;
 
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_DATA] =
-         LLVMArrayType(LLVMInt32TypeInContext(gallivm->context),
-                       LP_BUILD_FORMAT_CACHE_SIZE * 16);
+         LLVMPointerType(LLVMInt32TypeInContext(gallivm->context), 0);
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_TAGS] =
-         LLVMArrayType(LLVMInt64TypeInContext(gallivm->context),
-                       LP_BUILD_FORMAT_CACHE_SIZE);
-#if LP_BUILD_FORMAT_CACHE_DEBUG
+         LLVMPointerType(LLVMInt64TypeInContext(gallivm->context), 0);
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL] =
          LLVMInt64TypeInContext(gallivm->context);
    elem_types[LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS] =
          LLVMInt64TypeInContext(gallivm->context);
-#endif
 
    s = LLVMStructTypeInContext(gallivm->context, elem_types,
                                LP_BUILD_FORMAT_CACHE_MEMBER_COUNT, 0);
 
    return s;
 }
+
+
+/**
+ * Allocate a block cache with lp_build_format_cache_size entries.
+ * The struct, the tags and the texel data share a single allocation.
+ */
+struct lp_build_format_cache *
+lp_build_format_cache_create(void)
+{
+   unsigned size = MAX2(lp_build_format_cache_size, 1);
+   size_t data_offset = align(sizeof(struct lp_build_format_cache), 16);
+   size_t tags_offset = data_offset + size * 16 * sizeof(uint32_t);
+   struct lp_build_format_cache *cache;
+   uint8_t *mem;
+
+   mem = align_malloc(tags_offset + size * sizeof(uint64_t), 16);
+   if (!mem)
+      return NULL;
+
+   cache = (struct lp_build_format_cache *)mem;
+   cache->cache_data = (uint32_t *)(mem + data_offset);
+   cache->cache_tags = (uint64_t *)(mem + tags_offset);
+   cache->cache_access_total = 0;
+   cache->cache_access_miss = 0;
+   lp_build_format_cache_reset(cache);
+
+   return cache;
+}
+
+
+/**
+ * Invalidate all entries (but keep the statistics).
+ */
+void
+lp_build_format_cache_reset(struct lp_build_format_cache *cache)
+{
+   memset(cache->cache_tags, 0,
+          MAX2(lp_build_format_cache_size, 1) * sizeof(uint64_t));
+}
+
+
+void
+lp_build_format_cache_destroy(struct lp_build_format_cache *cache)
+{
+   align_free(cache);
+}
+
+
+/**
+ * Whether fetches from the given format can go through the block cache.
+ *
+ * That's the case for S3TC, and for any other 4x4 block-compressed format
+ * which can be decoded to RGBA8 without loss, as the cache gets filled by
+ * util_format_description::unpack_rgba_8unorm().
+ */
+boolean
+lp_build_format_cache_supported(const struct util_format_description *format_desc)
+{
+   if (!lp_build_format_cache_size)
+      return FALSE;
+
+   if (!util_format_is_compressed(format_desc->format) ||
+       format_desc->block.width != 4 ||
+       format_desc->block.height != 4 ||
+       format_desc->block.depth != 1) {
+      return FALSE;
+   }
+
+   if (format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC)
+      return TRUE;
+
+   return format_desc->unpack_rgba_8unorm != NULL &&
+          util_format_fits_8unorm(format_desc);
+}
@@ -44,41 +44,53 @@ struct lp_type;
 struct lp_build_context;
 
 
-#define LP_BUILD_FORMAT_CACHE_DEBUG 0
 /*
  * Block cache
  *
- * Optional block cache to be used when unpacking big pixel blocks.
+ * Optional per-thread cache of decoded 4x4 pixel blocks, used when fetching
+ * from block-compressed formats (S3TC, RGTC, ETC, BPTC, ...).  The number of
+ * entries defaults to LP_BUILD_FORMAT_CACHE_SIZE and can be changed with
+ * the LP_TEXTURE_CACHE_SIZE environment variable (0 disables the cache).
  * Must be a power of 2
  */
 
 #define LP_BUILD_FORMAT_CACHE_SIZE 128
 
+extern unsigned lp_build_format_cache_size;
+
 /*
  * Note: cache_data needs 16 byte alignment.
  */
 struct lp_build_format_cache
 {
-   PIPE_ALIGN_VAR(16) uint32_t cache_data[LP_BUILD_FORMAT_CACHE_SIZE][4][4];
-   uint64_t cache_tags[LP_BUILD_FORMAT_CACHE_SIZE];
-#if LP_BUILD_FORMAT_CACHE_DEBUG
+   uint32_t *cache_data;  /**< [size][4][4] texels, RGBA8 */
+   uint64_t *cache_tags;  /**< [size] block addresses */
    uint64_t cache_access_total;
    uint64_t cache_access_miss;
-#endif
 };
 
 
 enum {
    LP_BUILD_FORMAT_CACHE_MEMBER_DATA = 0,
    LP_BUILD_FORMAT_CACHE_MEMBER_TAGS,
-#if LP_BUILD_FORMAT_CACHE_DEBUG
    LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_TOTAL,
    LP_BUILD_FORMAT_CACHE_MEMBER_ACCESS_MISS,
-#endif
    LP_BUILD_FORMAT_CACHE_MEMBER_COUNT
 };
 
 
+struct lp_build_format_cache *
+lp_build_format_cache_create(void);
+
+void
+lp_build_format_cache_reset(struct lp_build_format_cache *cache);
+
+void
+lp_build_format_cache_destroy(struct lp_build_format_cache *cache);
+
+boolean
+lp_build_format_cache_supported(const struct util_format_description *format_desc);
+
 LLVMTypeRef
 lp_build_format_cache_type(struct gallivm_state *gallivm);
 
@@ -175,10 +187,31 @@ lp_build_fetch_subsampled_rgba_aos(struct gallivm_state *gallivm,
                                    LLVMValueRef j);
 
 
+/*
+ * Cached block decoding
+ */
+
+LLVMValueRef
+lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
+                             const struct util_format_description *format_desc,
+                             unsigned n,
+                             LLVMValueRef base_ptr,
+                             LLVMValueRef offset,
+                             LLVMValueRef i,
+                             LLVMValueRef j,
+                             LLVMValueRef cache);
+
+
 /*
  * S3TC
  */
 
+void
+lp_build_decode_s3tc_block(struct gallivm_state *gallivm,
+                           const struct util_format_description *format_desc,
+                           LLVMValueRef ptr,
+                           LLVMValueRef col[4]);
+
 LLVMValueRef
 lp_build_fetch_s3tc_rgba_aos(struct gallivm_state *gallivm,
                              const struct util_format_description *format_desc,
@@ -28,13 +28,19 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_compiler.h"
+#include "pipe/p_state.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
+#include "tgsi/tgsi_parse.h"
+#include "compiler/nir/nir_serialize.h"
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
+#include "lp_bld_format.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
 
@@ -211,6 +217,11 @@ gallivm_free_ir(struct gallivm_state *gallivm)
       LLVMDisposeModule(gallivm->module);
    }
 
+   if (gallivm->cache) {
+      lp_free_objcache(gallivm->cache->jit_obj_cache);
+      gallivm->cache->jit_obj_cache = NULL;
+   }
+
    FREE(gallivm->module_name);
 
    if (gallivm->target) {
@@ -230,6 +241,7 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->passmgr = NULL;
    gallivm->context = NULL;
    gallivm->builder = NULL;
+   gallivm->cache = NULL;
 }
 
 
@@ -245,6 +257,10 @@ gallivm_free_code(struct gallivm_state *gallivm)
    gallivm->code = NULL;
    lp_free_memory_manager(gallivm->memorymgr);
    gallivm->memorymgr = NULL;
+#if GALLIVM_USE_ORCJIT
+   lp_free_orc_module(gallivm->orc);
+   gallivm->orc = NULL;
+#endif
 }
 
 
@@ -263,12 +279,22 @@ init_gallivm_engine(struct gallivm_state *gallivm)
          optlevel = Default;
       }
 
+#if GALLIVM_USE_ORCJIT
+      ret = lp_build_add_orc_module(&gallivm->orc,
+                                    gallivm->cache,
+                                    gallivm->module,
+                                    gallivm->module_name,
+                                    (unsigned) optlevel,
+                                    &error);
+#else
       ret = lp_build_create_jit_compiler_for_module(&gallivm->engine,
                                                     &gallivm->code,
+                                                    gallivm->cache,
                                                     gallivm->module,
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
                                                     &error);
+#endif
       if (ret) {
          _debug_printf("%s\n", error);
          LLVMDisposeMessage(error);
@@ -310,7 +336,7 @@ fail:
  */
 static boolean
 init_gallivm_state(struct gallivm_state *gallivm, const char *name,
-                   LLVMContextRef context)
+                   LLVMContextRef context, struct lp_cached_code *cache)
 {
    assert(!gallivm->context);
    assert(!gallivm->module);
@@ -319,6 +345,7 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
       return FALSE;
 
    gallivm->context = context;
+   gallivm->cache = cache;
 
    if (!gallivm->context)
       goto fail;
@@ -341,9 +368,11 @@ init_gallivm_state(struct gallivm_state *gallivm, const char *name,
    if (!gallivm->builder)
       goto fail;
 
+#if !GALLIVM_USE_ORCJIT
    gallivm->memorymgr = lp_get_default_memory_manager();
    if (!gallivm->memorymgr)
       goto fail;
+#endif
 
    /* FIXME: MC-JIT only allows compiling one module at a time, and it must be
     * complete when MC-JIT is created. So defer the MC-JIT engine creation for
@@ -447,6 +476,13 @@ lp_build_init(void)
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   lp_build_format_cache_size = debug_get_num_option("LP_TEXTURE_CACHE_SIZE",
+                                                     LP_BUILD_FORMAT_CACHE_SIZE);
+   if (lp_build_format_cache_size) {
+      lp_build_format_cache_size =
+         util_next_power_of_two(MIN2(lp_build_format_cache_size, 4096));
+   }
+
 #if LLVM_VERSION_MAJOR < 4
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
@@ -492,17 +528,55 @@ lp_build_init(void)
 
 
 
+/**
+ * Compute the shader cache key of a shader variant: a hash of the shader
+ * IR, of the variant key and of an extra value the key doesn't cover.
+ */
+void
+lp_build_ir_cache_key(const struct pipe_shader_state *state,
+                      const void *key, size_t key_size,
+                      uint32_t val_32bit,
+                      unsigned char ir_sha1_cache_key[20])
+{
+   struct blob blob = { 0 };
+   unsigned ir_size;
+   void *ir_binary;
+
+   if (state->type == PIPE_SHADER_IR_NIR) {
+      blob_init(&blob);
+      nir_serialize(&blob, state->ir.nir, true);
+      ir_binary = blob.data;
+      ir_size = blob.size;
+   } else {
+      ir_binary = (void *)state->tokens;
+      ir_size = tgsi_num_tokens(state->tokens) * sizeof(struct tgsi_token);
+   }
+
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, key, key_size);
+   _mesa_sha1_update(&ctx, &val_32bit, sizeof(val_32bit));
+   _mesa_sha1_update(&ctx, ir_binary, ir_size);
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+
+   if (state->type == PIPE_SHADER_IR_NIR)
+      blob_finish(&blob);
+}
+
+
 /**
  * Create a new gallivm_state object.
+ * \param cache  optional object code cache entry, see struct lp_cached_code
  */
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context)
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache)
 {
    struct gallivm_state *gallivm;
 
    gallivm = CALLOC_STRUCT(gallivm_state);
    if (gallivm) {
-      if (!init_gallivm_state(gallivm, name, context)) {
+      if (!init_gallivm_state(gallivm, name, context, cache)) {
          FREE(gallivm);
          gallivm = NULL;
       }
@@ -550,6 +624,21 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Address of a compiled function.  With the ORC JIT this waits for the
+ * module's code generation to finish.
+ */
+static void *
+get_function_code(struct gallivm_state *gallivm, LLVMValueRef func)
+{
+#if GALLIVM_USE_ORCJIT
+   return lp_build_orc_lookup(gallivm->orc, LLVMGetValueName(func));
+#else
+   return LLVMGetPointerToGlobal(gallivm->engine, func);
+#endif
+}
+
+
 /**
  * Compile a module.
  * This does IR optimization on all functions in the module.
@@ -586,6 +675,12 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
+   /* The object code is already cached, so skip the IR optimizations:
+    * the module is only needed to look up the function symbols.
+    */
+   if (gallivm->cache && gallivm->cache->data_size)
+      goto skip_opt;
+
 #if GALLIVM_HAVE_CORO
    LLVMRunPassManager(gallivm->cgpassmgr, gallivm->module);
 #endif
@@ -617,6 +712,8 @@ gallivm_compile_module(struct gallivm_state *gallivm)
                    gallivm->module_name, time_msec);
    }
 
+skip_opt:
+
    /* Setting the module's DataLayout to an empty string will cause the
     * ExecutionEngine to copy to the DataLayout string from its target machine
     * to the module.  As of LLVM 3.8 the module and the execution engine are
@@ -639,7 +736,9 @@ gallivm_compile_module(struct gallivm_state *gallivm)
    if (!init_gallivm_engine(gallivm)) {
       assert(0);
    }
+#if !GALLIVM_USE_ORCJIT
    assert(gallivm->engine);
+#endif
 
    ++gallivm->compiled;
 
@@ -653,7 +752,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
           * LLVMGetPointerToGlobal() will abort otherwise.
           */
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = get_function_code(gallivm, llvm_func);
             lp_disassemble(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -666,7 +765,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
       while (llvm_func) {
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = get_function_code(gallivm, llvm_func);
             lp_profile(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -686,12 +785,11 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    int64_t time_begin = 0;
 
    assert(gallivm->compiled);
-   assert(gallivm->engine);
 
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
-   code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   code = get_function_code(gallivm, func);
    assert(code);
    jit_func = pointer_to_func(code);
 
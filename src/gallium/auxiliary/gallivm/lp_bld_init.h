@@ -39,6 +39,21 @@
 extern "C" {
 #endif
 
+struct pipe_shader_state;
+
+/**
+ * Compiled object code of a module, as stored in / loaded from a shader
+ * cache.  If data_size is non-zero on gallivm_create() the object code is
+ * used instead of compiling the module, otherwise the object code produced
+ * by the compilation is returned here.
+ */
+struct lp_cached_code {
+   void *data;
+   size_t data_size;
+   bool dont_cache;  /**< module embeds process-specific pointers */
+   void *jit_obj_cache;
+};
+
 struct gallivm_state
 {
    char *module_name;
@@ -51,6 +66,10 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+#if GALLIVM_USE_ORCJIT
+   struct lp_orc_module *orc;
+#endif
+   struct lp_cached_code *cache;
    unsigned compiled;
 };
 
@@ -60,7 +79,8 @@ lp_build_init(void);
 
 
 struct gallivm_state *
-gallivm_create(const char *name, LLVMContextRef context);
+gallivm_create(const char *name, LLVMContextRef context,
+               struct lp_cached_code *cache);
 
 void
 gallivm_destroy(struct gallivm_state *gallivm);
@@ -79,6 +99,12 @@ func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func);
 
+void
+lp_build_ir_cache_key(const struct pipe_shader_state *state,
+                      const void *key, size_t key_size,
+                      uint32_t val_32bit,
+                      unsigned char ir_sha1_cache_key[20]);
+
 #ifdef __cplusplus
 }
 #endif
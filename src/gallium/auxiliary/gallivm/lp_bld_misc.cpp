@@ -59,6 +59,8 @@
 #include <llvm/ADT/Triple.h>
 #include <llvm/Analysis/TargetLibraryInfo.h>
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
 #include <llvm/Support/PrettyStackTrace.h>
@@ -72,6 +74,16 @@
 #include <llvm/IR/Module.h>
 #include <llvm/Support/CBindingWrapping.h>
 
+#if GALLIVM_USE_ORCJIT
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/Support/SmallVectorMemoryBuffer.h>
+#include <atomic>
+#endif
+
 #include <llvm/Config/llvm-config.h>
 #if LLVM_USE_INTEL_JITEVENTS
 #include <llvm/ExecutionEngine/JITEventListener.h>
@@ -87,7 +99,9 @@
 #include "pipe/p_config.h"
 #include "util/u_debug.h"
 #include "util/u_cpu_detect.h"
+#include "util/u_queue.h"
 
+#include "lp_bld_init.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_debug.h"
 
@@ -290,60 +304,61 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
-/**
- * Same as LLVMCreateJITCompilerForModule, but:
- * - allows using MCJIT and enabling AVX feature where available.
- * - set target options
- *
- * See also:
- * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
- * - llvm/tools/lli/lli.cpp
- * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+/*
+ * MCJIT object cache backed by a struct lp_cached_code.
+ * If the cache entry already holds object code, MCJIT loads it instead of
+ * running the code generator on the module.  Otherwise the object code
+ * emitted for the module is copied into the entry, so the caller can store
+ * it in a persistent shader cache.
  */
-extern "C"
-LLVMBool
-lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
-                                        lp_generated_code **OutCode,
-                                        LLVMModuleRef M,
-                                        LLVMMCJITMemoryManagerRef CMM,
-                                        unsigned OptLevel,
-                                        char **OutError)
-{
-   using namespace llvm;
+class LPObjectCache : public llvm::ObjectCache {
 
-   std::string Error;
-   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
+   struct lp_cached_code *cache_out;
+   bool has_object;
 
-   /**
-    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
-    * friends for configuring code generation options, like stack alignment.
-    */
-   TargetOptions options;
-#if defined(PIPE_ARCH_X86)
-   options.StackAlignmentOverride = 4;
-#endif
+   public:
 
-   builder.setEngineKind(EngineKind::JIT)
-          .setErrorStr(&Error)
-          .setTargetOptions(options)
-          .setOptLevel((CodeGenOpt::Level)OptLevel);
+      LPObjectCache(struct lp_cached_code *cache) {
+         cache_out = cache;
+         has_object = false;
+      }
 
-#ifdef _WIN32
-    /*
-     * MCJIT works on Windows, but currently only through ELF object format.
-     *
-     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
-     * different strings for MinGW/MSVC, so better play it safe and be
-     * explicit.
-     */
-#  ifdef _WIN64
-    LLVMSetTarget(M, "x86_64-pc-win32-elf");
-#  else
-    LLVMSetTarget(M, "i686-pc-win32-elf");
-#  endif
-#endif
+      virtual ~LPObjectCache() {
+      }
 
-   llvm::SmallVector<std::string, 16> MAttrs;
+      virtual void notifyObjectCompiled(const llvm::Module *M,
+                                        llvm::MemoryBufferRef Obj) {
+         /* One module per engine, so there is one object only. */
+         assert(!has_object);
+         has_object = true;
+         cache_out->data_size = Obj.getBufferSize();
+         cache_out->data = malloc(cache_out->data_size);
+         if (!cache_out->data) {
+            cache_out->data_size = 0;
+            return;
+         }
+         memcpy(cache_out->data, Obj.getBufferStart(), cache_out->data_size);
+      }
+
+      virtual std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) {
+         if (!cache_out->data_size)
+            return NULL;
+         return llvm::MemoryBuffer::getMemBuffer(
+            llvm::StringRef((const char *)cache_out->data, cache_out->data_size),
+            "", false);
+      }
+};
+
+
+/**
+ * Host -mattr and -mcpu options for the code generator, shared by the
+ * MCJIT and ORC paths.
+ */
+static void
+lp_get_host_target_options(llvm::SmallVectorImpl<std::string> &MAttrs,
+                           std::string &MCPU)
+{
+   using namespace llvm;
 
 #if LLVM_VERSION_MAJOR >= 4 && (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64) || defined(PIPE_ARCH_ARM))
    /* llvm-3.3+ implements sys::getHostCPUFeatures for Arm
@@ -433,8 +448,6 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 #endif
 #endif
 
-   builder.setMAttrs(MAttrs);
-
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
       int n = MAttrs.size();
       if (n > 0) {
@@ -445,7 +458,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
       }
    }
 
-   StringRef MCPU = llvm::sys::getHostCPUName();
+   MCPU = llvm::sys::getHostCPUName().str();
    /*
     * The cpu bits are no longer set automatically, so need to set mcpu manually.
     * Note that the MAttrs set above will be sort of ignored (since we should
@@ -459,19 +472,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
     * can't handle. Not entirely sure if we really need to do anything yet.
     */
 
-#ifdef PIPE_ARCH_PPC_64
-   /*
-    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
-    * of the Medium code model once dynamically generated JIT-compiled shader
-    * programs are linked in and relocated.  Yet the default code model as of
-    * LLVM 8 is Medium or even Small.
-    * The cost of changing from Medium to Large is negligible:
-    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
-    * - change an add-immediate (addis) instruction to a load (ld).
-    */
-   builder.setCodeModel(CodeModel::Large);
-
-#if UTIL_ARCH_LITTLE_ENDIAN
+#if defined(PIPE_ARCH_PPC_64) && UTIL_ARCH_LITTLE_ENDIAN
    /*
     * Versions of LLVM prior to 4.0 lacked a table entry for "POWER8NVL",
     * resulting in (big-endian) "generic" being returned on
@@ -484,11 +485,86 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    if (MCPU == "generic")
       MCPU = "pwr8";
 #endif
-#endif
-   builder.setMCPU(MCPU);
+
    if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM | GALLIVM_DEBUG_DUMP_BC)) {
-      debug_printf("llc -mcpu option: %s\n", MCPU.str().c_str());
+      debug_printf("llc -mcpu option: %s\n", MCPU.c_str());
    }
+}
+
+
+/**
+ * Same as LLVMCreateJITCompilerForModule, but:
+ * - allows using MCJIT and enabling AVX feature where available.
+ * - set target options
+ *
+ * See also:
+ * - llvm/lib/ExecutionEngine/ExecutionEngineBindings.cpp
+ * - llvm/tools/lli/lli.cpp
+ * - http://markmail.org/message/ttkuhvgj4cxxy2on#query:+page:1+mid:aju2dggerju3ivd3+state:results
+ */
+extern "C"
+LLVMBool
+lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
+                                        lp_generated_code **OutCode,
+                                        struct lp_cached_code *cache_out,
+                                        LLVMModuleRef M,
+                                        LLVMMCJITMemoryManagerRef CMM,
+                                        unsigned OptLevel,
+                                        char **OutError)
+{
+   using namespace llvm;
+
+   std::string Error;
+   EngineBuilder builder(std::unique_ptr<Module>(unwrap(M)));
+
+   /**
+    * LLVM 3.1+ haven't more "extern unsigned llvm::StackAlignmentOverride" and
+    * friends for configuring code generation options, like stack alignment.
+    */
+   TargetOptions options;
+#if defined(PIPE_ARCH_X86)
+   options.StackAlignmentOverride = 4;
+#endif
+
+   builder.setEngineKind(EngineKind::JIT)
+          .setErrorStr(&Error)
+          .setTargetOptions(options)
+          .setOptLevel((CodeGenOpt::Level)OptLevel);
+
+#ifdef _WIN32
+    /*
+     * MCJIT works on Windows, but currently only through ELF object format.
+     *
+     * XXX: We could use `LLVM_HOST_TRIPLE "-elf"` but LLVM_HOST_TRIPLE has
+     * different strings for MinGW/MSVC, so better play it safe and be
+     * explicit.
+     */
+#  ifdef _WIN64
+    LLVMSetTarget(M, "x86_64-pc-win32-elf");
+#  else
+    LLVMSetTarget(M, "i686-pc-win32-elf");
+#  endif
+#endif
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   std::string MCPU;
+
+   lp_get_host_target_options(MAttrs, MCPU);
+   builder.setMAttrs(MAttrs);
+   builder.setMCPU(MCPU);
+
+#ifdef PIPE_ARCH_PPC_64
+   /*
+    * Large programs, e.g. gnome-shell and firefox, may tax the addressability
+    * of the Medium code model once dynamically generated JIT-compiled shader
+    * programs are linked in and relocated.  Yet the default code model as of
+    * LLVM 8 is Medium or even Small.
+    * The cost of changing from Medium to Large is negligible:
+    * - an additional 8-byte pointer stored immediately before the shader entrypoint;
+    * - change an add-immediate (addis) instruction to a load (ld).
+    */
+   builder.setCodeModel(CodeModel::Large);
+#endif
 
    ShaderMemoryManager *MM = NULL;
    BaseMemoryManager* JMM = reinterpret_cast<BaseMemoryManager*>(CMM);
@@ -506,6 +582,11 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    JIT->RegisterJITEventListener(JEL);
 #endif
    if (JIT) {
+      if (cache_out) {
+         LPObjectCache *objcache = new LPObjectCache(cache_out);
+         JIT->setObjectCache(objcache);
+         cache_out->jit_obj_cache = (void *)objcache;
+      }
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -524,6 +605,14 @@ lp_free_generated_code(struct lp_generated_code *code)
    ShaderMemoryManager::freeGeneratedCode(code);
 }
 
+extern "C"
+void
+lp_free_objcache(void *objcache_ptr)
+{
+   LPObjectCache *objcache = (LPObjectCache *)objcache_ptr;
+   delete objcache;
+}
+
 extern "C"
 LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager()
@@ -540,6 +629,381 @@ lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr)
    delete reinterpret_cast<BaseMemoryManager*>(memorymgr);
 }
 
+#if GALLIVM_USE_ORCJIT
+
+/*
+ * ORC JIT.
+ *
+ * All gallivm modules share a single LLJIT with a pool of compile threads.
+ * Each module gets its own JITDylib, so its code can be freed on its own
+ * with removeJITDylib().  The module is handed over as bitcode and only
+ * compiled once one of its symbols is looked up, on a compile thread, into
+ * a private LLVMContext; gallivm_compile_module() kicks off that lookup
+ * right away, so code generation overlaps with whatever the caller does
+ * until gallivm_jit_function().
+ *
+ * The IR optimization passes still run on the calling thread, on the
+ * caller's context.
+ */
+
+static once_flag lp_orc_once_flag = ONCE_FLAG_INIT;
+static llvm::orc::LLJIT *lp_orc_jit = NULL;
+static llvm::orc::JITTargetMachineBuilder *lp_orc_jtmb = NULL;
+static std::atomic<unsigned> lp_orc_dylib_serial;
+
+/* Target machines are not thread safe, so each compile thread has its own. */
+static thread_local std::unique_ptr<llvm::TargetMachine> lp_orc_tm;
+
+
+static void
+lp_orc_report_error(llvm::Error Err)
+{
+   std::string Msg;
+   llvm::raw_string_ostream OS(Msg);
+   llvm::logAllUnhandledErrors(std::move(Err), OS, "gallivm: ");
+   _debug_printf("%s", OS.str().c_str());
+}
+
+
+/*
+ * Stop the compile threads before the process tears down the LLVM statics
+ * they may still be using.  See also u_queue.c.
+ */
+static void
+lp_orc_exit(void)
+{
+   delete lp_orc_jit;
+   lp_orc_jit = NULL;
+   delete lp_orc_jtmb;
+   lp_orc_jtmb = NULL;
+}
+
+
+static void
+lp_orc_init(void)
+{
+   using namespace llvm;
+   using namespace llvm::orc;
+
+   TargetOptions options;
+#if defined(PIPE_ARCH_X86)
+   options.StackAlignmentOverride = 4;
+#endif
+
+   llvm::SmallVector<std::string, 16> MAttrs;
+   std::string MCPU;
+
+   lp_get_host_target_options(MAttrs, MCPU);
+
+   JITTargetMachineBuilder *JTMB =
+      new JITTargetMachineBuilder(Triple(sys::getProcessTriple()));
+   JTMB->setCPU(MCPU)
+        .addFeatures(std::vector<std::string>(MAttrs.begin(), MAttrs.end()))
+        .setOptions(options);
+#ifdef PIPE_ARCH_PPC_64
+   /* See lp_build_create_jit_compiler_for_module(). */
+   JTMB->setCodeModel(CodeModel::Large);
+#endif
+
+   /*
+    * Code generation of a shader variant is single threaded, so more threads
+    * only help when several variants are compiled at once.  Zero compiles
+    * on the thread that looks the code up, like MCJIT.
+    */
+   unsigned NumThreads = debug_get_num_option("GALLIVM_COMPILE_THREADS",
+                                              MIN2(util_cpu_caps.nr_cpus, 8));
+
+   auto J = LLJITBuilder()
+               .setJITTargetMachineBuilder(*JTMB)
+               .setNumCompileThreads(NumThreads)
+               .create();
+   if (!J) {
+      lp_orc_report_error(J.takeError());
+      delete JTMB;
+      return;
+   }
+
+   /* Resolve calls into the process, e.g. to libm or debug helpers. */
+   auto Gen = DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*J)->getDataLayout().getGlobalPrefix());
+   if (!Gen) {
+      lp_orc_report_error(Gen.takeError());
+      delete JTMB;
+      return;
+   }
+   (*J)->getMainJITDylib().addGenerator(std::move(*Gen));
+
+   /*
+    * Failures that matter are reported by the lookup which needs the code,
+    * don't report them twice.
+    */
+   (*J)->getExecutionSession().setErrorReporter([](Error Err) {
+      consumeError(std::move(Err));
+   });
+
+   /* Code may be shared by several screens, so the JIT lives until exit. */
+   lp_orc_jtmb = JTMB;
+   lp_orc_jit = J->release();
+   atexit(lp_orc_exit);
+}
+
+
+static llvm::TargetMachine *
+lp_orc_get_target_machine(void)
+{
+   if (!lp_orc_tm) {
+      llvm::orc::JITTargetMachineBuilder JTMB = *lp_orc_jtmb;
+      auto TM = JTMB.createTargetMachine();
+      if (!TM) {
+         lp_orc_report_error(TM.takeError());
+         return NULL;
+      }
+      lp_orc_tm = std::move(*TM);
+   }
+   return lp_orc_tm.get();
+}
+
+
+/*
+ * One gallivm module, as bitcode.  Materializing it compiles the whole
+ * module into one object, which is then linked like any other.
+ */
+class LPModuleMaterializationUnit : public llvm::orc::MaterializationUnit {
+
+   std::string Name;
+   std::unique_ptr<llvm::MemoryBuffer> Bitcode;
+   struct lp_cached_code *cache_out;
+   llvm::CodeGenOpt::Level OptLevel;
+
+   public:
+
+      LPModuleMaterializationUnit(std::string Name,
+                                  llvm::orc::SymbolFlagsMap Symbols,
+                                  std::unique_ptr<llvm::MemoryBuffer> Bitcode,
+                                  struct lp_cached_code *cache,
+                                  llvm::CodeGenOpt::Level OptLevel)
+#if LLVM_VERSION_MAJOR >= 14
+         : MaterializationUnit(Interface(std::move(Symbols), nullptr)),
+#else
+         : MaterializationUnit(std::move(Symbols), nullptr),
+#endif
+           Name(std::move(Name)), Bitcode(std::move(Bitcode)),
+           cache_out(cache), OptLevel(OptLevel) {
+      }
+
+      virtual llvm::StringRef getName() const {
+         return Name;
+      }
+
+      virtual void
+      materialize(std::unique_ptr<llvm::orc::MaterializationResponsibility> R) {
+         using namespace llvm;
+
+         LLVMContext Ctx;
+         auto M = parseBitcodeFile(Bitcode->getMemBufferRef(), Ctx);
+         if (!M) {
+            lp_orc_report_error(M.takeError());
+            R->failMaterialization();
+            return;
+         }
+         (*M)->setDataLayout(lp_orc_jit->getDataLayout());
+         (*M)->setTargetTriple(lp_orc_jit->getTargetTriple().str());
+
+         TargetMachine *TM = lp_orc_get_target_machine();
+         if (!TM) {
+            R->failMaterialization();
+            return;
+         }
+         TM->setOptLevel(OptLevel);
+
+         /* Hands the object code to the caller for its shader cache. */
+         std::unique_ptr<LPObjectCache> objcache;
+         if (cache_out)
+            objcache.reset(new LPObjectCache(cache_out));
+
+         orc::SimpleCompiler Compile(*TM, objcache.get());
+         auto Obj = Compile(**M);
+         if (!Obj) {
+            lp_orc_report_error(Obj.takeError());
+            R->failMaterialization();
+            return;
+         }
+
+         lp_orc_jit->getObjLinkingLayer().emit(std::move(R), std::move(*Obj));
+      }
+
+   private:
+
+      virtual void discard(const llvm::orc::JITDylib &JD,
+                           const llvm::orc::SymbolStringPtr &Sym) {
+         /* Every module has a dylib of its own, nothing can override it. */
+         assert(0);
+      }
+};
+
+
+/*
+ * A module added to the ORC JIT: its dylib, and a fence which is signalled
+ * once the background compilation is over.
+ */
+struct lp_orc_module {
+   llvm::orc::JITDylib *JD;
+   struct util_queue_fence compiled;
+};
+
+
+/**
+ * Add a module to the ORC JIT.
+ *
+ * If cache_out holds object code it is linked instead, otherwise the
+ * object code is returned in it once the module has been compiled, i.e.
+ * at the latest when lp_build_orc_lookup() returns.
+ *
+ * The module is not consumed and must be disposed of by the caller.
+ */
+extern "C"
+LLVMBool
+lp_build_add_orc_module(struct lp_orc_module **OutModule,
+                        struct lp_cached_code *cache_out,
+                        LLVMModuleRef M,
+                        const char *name,
+                        unsigned OptLevel,
+                        char **OutError)
+{
+   using namespace llvm;
+   using namespace llvm::orc;
+
+   call_once(&lp_orc_once_flag, lp_orc_init);
+   if (!lp_orc_jit) {
+      *OutError = strdup("failed to create the ORC JIT");
+      return 1;
+   }
+
+   ExecutionSession &ES = lp_orc_jit->getExecutionSession();
+   std::string DylibName = std::string(name ? name : "gallivm") + "." +
+                           std::to_string(lp_orc_dylib_serial++);
+
+   auto JD = ES.createJITDylib(DylibName);
+   if (!JD) {
+      *OutError = strdup(toString(JD.takeError()).c_str());
+      return 1;
+   }
+   JD->addToLinkOrder(lp_orc_jit->getMainJITDylib());
+
+   struct lp_orc_module *module = new lp_orc_module;
+   module->JD = &*JD;
+   util_queue_fence_init(&module->compiled);
+
+   Error Err = Error::success();
+   if (cache_out && cache_out->data_size) {
+      Err = lp_orc_jit->addObjectFile(*JD,
+         MemoryBuffer::getMemBufferCopy(
+            StringRef((const char *)cache_out->data, cache_out->data_size),
+            DylibName));
+   } else {
+      Module *Mod = unwrap(M);
+      MangleAndInterner Mangle(ES, lp_orc_jit->getDataLayout());
+      SymbolFlagsMap Symbols;
+      SymbolLookupSet Functions;
+
+      for (GlobalValue &GV : Mod->global_values()) {
+         if (GV.isDeclaration() || GV.hasLocalLinkage())
+            continue;
+         SymbolStringPtr Sym = Mangle(GV.getName());
+         Symbols[Sym] = JITSymbolFlags::fromGlobalValue(GV);
+         if (isa<Function>(GV))
+            Functions.add(Sym);
+      }
+
+      SmallVector<char, 0> Buf;
+      raw_svector_ostream OS(Buf);
+      WriteBitcodeToFile(*Mod, OS);
+
+      Err = JD->define(std::make_unique<LPModuleMaterializationUnit>(
+         DylibName, std::move(Symbols),
+         std::make_unique<SmallVectorMemoryBuffer>(std::move(Buf)),
+         cache_out, (CodeGenOpt::Level)OptLevel));
+
+      /*
+       * Start compiling in the background.  Errors are reported again by
+       * the lookup which actually needs the code.
+       */
+      if (!Err && !Functions.empty()) {
+         util_queue_fence_reset(&module->compiled);
+         ES.lookup(LookupKind::Static, makeJITDylibSearchOrder(&*JD),
+                   std::move(Functions), SymbolState::Ready,
+                   [module](Expected<SymbolMap> Result) {
+                      consumeError(Result.takeError());
+                      util_queue_fence_signal(&module->compiled);
+                   },
+                   NoDependenciesToRegister);
+      }
+   }
+
+   if (Err) {
+      *OutError = strdup(toString(std::move(Err)).c_str());
+      lp_free_orc_module(module);
+      return 1;
+   }
+
+   *OutModule = module;
+   return 0;
+}
+
+
+/**
+ * Look up a function added with lp_build_add_orc_module(), waiting for its
+ * module to be compiled if need be.
+ */
+extern "C"
+void *
+lp_build_orc_lookup(struct lp_orc_module *module, const char *name)
+{
+   if (!lp_orc_jit)
+      return NULL;
+
+   auto Sym = lp_orc_jit->lookup(*module->JD, name);
+   if (!Sym) {
+      lp_orc_report_error(Sym.takeError());
+      return NULL;
+   }
+#if LLVM_VERSION_MAJOR >= 15
+   return Sym->toPtr<void *>();
+#else
+   return (void *)(uintptr_t)Sym->getAddress();
+#endif
+}
+
+
+/**
+ * Free the code of a module.
+ */
+extern "C"
+void
+lp_free_orc_module(struct lp_orc_module *module)
+{
+   if (!module)
+      return;
+
+   /*
+    * RuntimeDyld can't have an object removed while it is being linked, so
+    * let a compilation nobody waited for run to completion.
+    */
+   util_queue_fence_wait(&module->compiled);
+
+   if (lp_orc_jit) {
+      llvm::Error Err =
+         lp_orc_jit->getExecutionSession().removeJITDylib(*module->JD);
+      if (Err)
+         lp_orc_report_error(std::move(Err));
+   }
+
+   util_queue_fence_destroy(&module->compiled);
+   delete module;
+}
+
+#endif /* GALLIVM_USE_ORCJIT */
+
 extern "C" LLVMValueRef
 lp_get_called_value(LLVMValueRef call)
 {
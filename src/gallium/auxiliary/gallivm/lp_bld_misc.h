@@ -53,9 +53,12 @@ extern void
 lp_set_target_options(void);
 
 
+struct lp_cached_code;
+
 extern int
 lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         struct lp_generated_code **OutCode,
+                                        struct lp_cached_code *cache_out,
                                         LLVMModuleRef M,
                                         LLVMMCJITMemoryManagerRef MM,
                                         unsigned OptLevel,
@@ -64,12 +67,33 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
+extern void
+lp_free_objcache(void *objcache);
+
 extern LLVMMCJITMemoryManagerRef
 lp_get_default_memory_manager();
 
 extern void
 lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr);
 
+#if GALLIVM_USE_ORCJIT
+struct lp_orc_module;
+
+extern int
+lp_build_add_orc_module(struct lp_orc_module **OutModule,
+                        struct lp_cached_code *cache_out,
+                        LLVMModuleRef M,
+                        const char *name,
+                        unsigned OptLevel,
+                        char **OutError);
+
+extern void *
+lp_build_orc_lookup(struct lp_orc_module *module, const char *name);
+
+extern void
+lp_free_orc_module(struct lp_orc_module *module);
+#endif
+
 extern LLVMValueRef
 lp_get_called_value(LLVMValueRef call);
 
@@ -2112,3 +2112,88 @@ lp_build_sample_offset(struct lp_build_context *bld,
 
    *out_offset = offset;
 }
+
+
+/**
+ * Compute the partial offset of a texel along the x or y axis of a tiled
+ * texture layout (see LP_SAMPLER_TILE_SIZE).  The layout is separable,
+ * so the offset of (x, y) is the sum of the two partial offsets.
+ *
+ * @param axis        0 for x, 1 for y
+ * @param texel_size  texel size in bytes
+ * @param coord       coordinate in texels
+ * @param stride      row stride in bytes (only used for y)
+ */
+void
+lp_build_sample_partial_offset_tiled(struct lp_build_context *bld,
+                                     unsigned axis,
+                                     unsigned texel_size,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef stride,
+                                     LLVMValueRef *out_offset)
+{
+   const unsigned tile_shift = util_logbase2(LP_SAMPLER_TILE_SIZE);
+   LLVMValueRef tile_mask, in_tile, tile;
+
+   assert(axis < 2);
+
+   tile_mask = lp_build_const_int_vec(bld->gallivm, bld->type,
+                                      LP_SAMPLER_TILE_SIZE - 1);
+   in_tile = lp_build_and(bld, coord, tile_mask);
+   tile = lp_build_andnot(bld, coord, tile_mask);
+
+   if (axis == 0) {
+      /* x_tile * tile_size^2 + x_in_tile texels */
+      tile = lp_build_shl_imm(bld, tile, tile_shift);
+      *out_offset = lp_build_mul_imm(bld, lp_build_add(bld, tile, in_tile),
+                                     texel_size);
+   }
+   else {
+      /* tile row start, plus y_in_tile * tile_size texels */
+      in_tile = lp_build_shl_imm(bld, in_tile, tile_shift);
+      *out_offset = lp_build_add(bld, lp_build_mul(bld, tile, stride),
+                                 lp_build_mul_imm(bld, in_tile, texel_size));
+   }
+}
+
+
+/**
+ * Compute the offset of a texel in a tiled texture layout.
+ *
+ * Same interface as lp_build_sample_offset(), but only formats with 1x1
+ * pixel blocks can be tiled, so the sub-block coordinates are always zero.
+ */
+void
+lp_build_sample_offset_tiled(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset,
+                             LLVMValueRef *out_i,
+                             LLVMValueRef *out_j)
+{
+   const unsigned texel_size = format_desc->block.bits/8;
+   LLVMValueRef offset;
+
+   assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+
+   lp_build_sample_partial_offset_tiled(bld, 0, texel_size, x, NULL, &offset);
+
+   if (y && y_stride) {
+      LLVMValueRef y_offset;
+      lp_build_sample_partial_offset_tiled(bld, 1, texel_size, y, y_stride,
+                                           &y_offset);
+      offset = lp_build_add(bld, offset, y_offset);
+   }
+
+   if (z && z_stride) {
+      offset = lp_build_add(bld, offset, lp_build_mul(bld, z, z_stride));
+   }
+
+   *out_offset = offset;
+   *out_i = bld->zero;
+   *out_j = bld->zero;
+}
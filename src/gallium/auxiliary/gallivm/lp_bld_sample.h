@@ -146,6 +146,19 @@ struct lp_img_params
    LLVMValueRef indata2[4];
    LLVMValueRef *outdata;
 };
+/**
+ * Side of the square texel tiles of a tiled texture layout.
+ *
+ * Tiles are stored row-major inside a tile row, and tile rows are
+ * row_stride * LP_SAMPLER_TILE_SIZE bytes apart, so the texel (x, y) is at
+ *
+ *    (y & ~3) * row_stride + ((x & ~3) * 4 + (y & 3) * 4 + (x & 3)) * bpp
+ *
+ * The driver must align the level width and height to the tile size.
+ */
+#define LP_SAMPLER_TILE_SIZE 4
+
+
 /**
  * Texture static state.
  *
@@ -167,6 +180,7 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+   unsigned tiled:1;         /**< texels stored in LP_SAMPLER_TILE_SIZE tiles */
 };
 
 
@@ -631,6 +645,28 @@ lp_build_sample_offset(struct lp_build_context *bld,
                        LLVMValueRef *out_j);
 
 
+void
+lp_build_sample_partial_offset_tiled(struct lp_build_context *bld,
+                                     unsigned axis,
+                                     unsigned texel_size,
+                                     LLVMValueRef coord,
+                                     LLVMValueRef stride,
+                                     LLVMValueRef *out_offset);
+
+
+void
+lp_build_sample_offset_tiled(struct lp_build_context *bld,
+                             const struct util_format_description *format_desc,
+                             LLVMValueRef x,
+                             LLVMValueRef y,
+                             LLVMValueRef z,
+                             LLVMValueRef y_stride,
+                             LLVMValueRef z_stride,
+                             LLVMValueRef *out_offset,
+                             LLVMValueRef *out_i,
+                             LLVMValueRef *out_j);
+
+
 void
 lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                     const struct lp_static_sampler_state *static_sampler_state,
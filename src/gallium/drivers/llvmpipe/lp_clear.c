@@ -37,6 +37,7 @@
 #include "lp_context.h"
 #include "lp_setup.h"
 #include "lp_query.h"
+#include "lp_state_cs.h"
 #include "lp_debug.h"
 
 
@@ -60,5 +61,7 @@ llvmpipe_clear(struct pipe_context *pipe,
    if (LP_PERF & PERF_NO_DEPTH)
       buffers &= ~PIPE_CLEAR_DEPTHSTENCIL;
 
+   llvmpipe_cs_sync_render(llvmpipe, TRUE);
+
    lp_setup_clear( llvmpipe->setup, color, depth, stencil, buffers );
 }
@@ -38,6 +38,8 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/u_upload_mgr.h"
+#include "util/u_threaded_context.h"
+#include "util/u_debug.h"
 #include "lp_clear.h"
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -46,12 +48,72 @@
 #include "lp_surface.h"
 #include "lp_query.h"
 #include "lp_setup.h"
+#include "lp_screen.h"
+#include "lp_texture.h"
 
 /* This is only safe if there's just one concurrent context */
 #ifdef EMBEDDED_DEVICE
 #define USE_GLOBAL_LLVM_CONTEXT
 #endif
 
+/**
+ * Start the threads compiling fragment shader variants in the background,
+ * if requested with LP_ASYNC_COMPILE.  Each thread has its own LLVM
+ * context, as those can't be shared between threads.
+ */
+static void
+lp_create_compile_threads(struct llvmpipe_context *llvmpipe)
+{
+#ifndef USE_GLOBAL_LLVM_CONTEXT
+   unsigned num_threads = debug_get_num_option("LP_ASYNC_COMPILE", 0);
+   unsigned i;
+
+   num_threads = MIN2(num_threads, LP_MAX_COMPILE_THREADS);
+   if (!num_threads)
+      return;
+
+   for (i = 0; i < num_threads; i++) {
+      llvmpipe->compile_contexts[i] = LLVMContextCreate();
+      if (!llvmpipe->compile_contexts[i])
+         goto fail;
+   }
+
+   if (!util_queue_init(&llvmpipe->compile_queue, "lpfs", 64, num_threads,
+                        UTIL_QUEUE_INIT_RESIZE_IF_FULL))
+      goto fail;
+
+   llvmpipe->num_compile_threads = num_threads;
+   return;
+
+fail:
+   for (i = 0; i < num_threads; i++) {
+      if (llvmpipe->compile_contexts[i])
+         LLVMContextDispose(llvmpipe->compile_contexts[i]);
+      llvmpipe->compile_contexts[i] = NULL;
+   }
+#endif
+}
+
+
+static void
+lp_destroy_compile_threads(struct llvmpipe_context *llvmpipe)
+{
+   unsigned i;
+
+   if (!llvmpipe->num_compile_threads)
+      return;
+
+   util_queue_finish(&llvmpipe->compile_queue);
+   util_queue_destroy(&llvmpipe->compile_queue);
+
+   for (i = 0; i < llvmpipe->num_compile_threads; i++) {
+      LLVMContextDispose(llvmpipe->compile_contexts[i]);
+      llvmpipe->compile_contexts[i] = NULL;
+   }
+   llvmpipe->num_compile_threads = 0;
+}
+
+
 static void llvmpipe_destroy( struct pipe_context *pipe )
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
@@ -101,6 +163,8 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
 
    lp_delete_setup_variants(llvmpipe);
 
+   lp_destroy_compile_threads(llvmpipe);
+
 #ifndef USE_GLOBAL_LLVM_CONTEXT
    LLVMContextDispose(llvmpipe->context);
 #endif
@@ -131,6 +195,24 @@ llvmpipe_render_condition(struct pipe_context *pipe,
    llvmpipe->render_cond_cond = condition;
 }
 
+static void
+lp_draw_disk_cache_find_shader(void *cookie,
+                               struct lp_cached_code *cache,
+                               unsigned char ir_sha1_cache_key[20])
+{
+   struct llvmpipe_screen *screen = cookie;
+   lp_disk_cache_find_shader(screen, cache, ir_sha1_cache_key);
+}
+
+static void
+lp_draw_disk_cache_insert_shader(void *cookie,
+                                 struct lp_cached_code *cache,
+                                 unsigned char ir_sha1_cache_key[20])
+{
+   struct llvmpipe_screen *screen = cookie;
+   lp_disk_cache_insert_shader(screen, cache, ir_sha1_cache_key);
+}
+
 struct pipe_context *
 llvmpipe_create_context(struct pipe_screen *screen, void *priv,
                         unsigned flags)
@@ -187,6 +269,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context)
       goto fail;
 
+   lp_create_compile_threads(llvmpipe);
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -195,6 +279,12 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->draw)
       goto fail;
 
+   if (llvmpipe_screen(screen)->disk_shader_cache)
+      draw_set_disk_cache_callbacks(llvmpipe->draw,
+                                    llvmpipe_screen(screen),
+                                    lp_draw_disk_cache_find_shader,
+                                    lp_draw_disk_cache_insert_shader);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create( &llvmpipe->pipe,
@@ -239,7 +329,22 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
     */
    llvmpipe->dirty |= LP_NEW_SCISSOR;
 
-   return &llvmpipe->pipe;
+   /* Compute-only contexts are only used by clover, which doesn't need it. */
+   if ((flags & PIPE_CONTEXT_COMPUTE_ONLY) ||
+       !llvmpipe_screen(screen)->threaded)
+      return &llvmpipe->pipe;
+
+   /*
+    * Run the context on its own thread, so that draw, binning and state
+    * validation overlap with the application.  This is off on single CPU
+    * systems, GALLIUM_THREAD overrides that.  The screen decides, since
+    * user vertex buffers have to be disabled for threaded contexts.
+    */
+   return threaded_context_create(&llvmpipe->pipe,
+                                  &llvmpipe_screen(screen)->pool_transfers,
+                                  llvmpipe_replace_buffer_storage,
+                                  NULL, /* create_fence */
+                                  NULL);
 
  fail:
    llvmpipe_destroy(&llvmpipe->pipe);
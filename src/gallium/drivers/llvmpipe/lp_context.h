@@ -35,7 +35,9 @@
 
 #include "draw/draw_vertex.h"
 #include "util/u_blitter.h"
+#include "util/u_queue.h"
 
+#include "lp_limits.h"
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
 #include "lp_setup.h"
@@ -149,11 +151,12 @@ struct llvmpipe_context {
    struct blitter_context *blitter;
 
    unsigned tex_timestamp;
+   unsigned cs_tex_timestamp;
 
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
-   unsigned nr_fs_instrs;
+   unsigned nr_fs_instrs;  /**< updated atomically by compile threads */
 
    struct lp_setup_variant_list_item setup_variants_list;
    unsigned nr_setup_variants;
@@ -172,6 +175,14 @@ struct llvmpipe_context {
    /** The LLVMContext to use for LLVM related work */
    LLVMContextRef context;
 
+   /**
+    * Queue compiling fragment shader variants in the background, with an
+    * LLVMContext for each of its threads.
+    */
+   struct util_queue compile_queue;
+   LLVMContextRef compile_contexts[LP_MAX_COMPILE_THREADS];
+   unsigned num_compile_threads;
+
    int max_global_buffers;
    struct pipe_resource **global_buffers;
 
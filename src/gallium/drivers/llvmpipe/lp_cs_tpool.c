@@ -30,8 +30,62 @@
 
 #include "util/u_thread.h"
 #include "util/u_memory.h"
+#include "util/u_math.h"
+#include "util/u_atomic.h"
 #include "lp_cs_tpool.h"
 
+/* Chunks of iterations per thread of a task, on average.  More balance
+ * the load better, less mean fewer trips to the shared counters.
+ */
+#define LP_CS_CHUNKS_PER_THREAD 8
+
+/**
+ * Run chunks of iterations of the task until they are all taken.
+ */
+static void
+lp_cs_tpool_run_chunks(struct lp_cs_tpool_task *task,
+                       struct lp_cs_local_mem *lmem)
+{
+   const unsigned chunk = task->iter_per_fetch;
+
+   for (;;) {
+      unsigned start = p_atomic_add_return(&task->iter_start, chunk) - chunk;
+      unsigned end, i;
+
+      if (start >= task->iter_total)
+         break;
+
+      end = MIN2(start + chunk, task->iter_total);
+      for (i = start; i < end; i++)
+         task->work(task->data, i, lmem);
+
+      p_atomic_add(&task->iter_finished, end - start);
+   }
+}
+
+/**
+ * Work on the task until all its iterations are taken.
+ * Called and returns with pool->m held.
+ */
+static void
+lp_cs_tpool_work_on_task(struct lp_cs_tpool *pool,
+                         struct lp_cs_tpool_task *task,
+                         struct lp_cs_local_mem *lmem)
+{
+   task->busy++;
+   mtx_unlock(&pool->m);
+
+   lp_cs_tpool_run_chunks(task, lmem);
+
+   mtx_lock(&pool->m);
+   if (!list_is_empty(&task->list))
+      list_delinit(&task->list);
+
+   /* The iterations still running were taken by busy threads. */
+   if (--task->busy == 0)
+      cnd_broadcast(&task->finish);
+}
+
 static int
 lp_cs_tpool_worker(void *data)
 {
@@ -52,17 +106,7 @@ lp_cs_tpool_worker(void *data)
 
       task = list_first_entry(&pool->workqueue, struct lp_cs_tpool_task,
                               list);
-      unsigned this_iter = task->iter_start++;
-
-      if (task->iter_start == task->iter_total)
-         list_del(&task->list);
-
-      mtx_unlock(&pool->m);
-      task->work(task->data, this_iter, &lmem);
-      mtx_lock(&pool->m);
-      task->iter_finished++;
-      if (task->iter_finished == task->iter_total)
-         cnd_broadcast(&task->finish);
+      lp_cs_tpool_work_on_task(pool, task, &lmem);
    }
    mtx_unlock(&pool->m);
    FREE(lmem.local_mem_ptr);
@@ -82,9 +126,21 @@ lp_cs_tpool_create(unsigned num_threads)
 
    list_inithead(&pool->workqueue);
    assert (num_threads <= LP_MAX_THREADS);
-   pool->num_threads = num_threads;
-   for (unsigned i = 0; i < num_threads; i++)
+   if (num_threads) {
+      pool->threads = CALLOC(num_threads, sizeof(thrd_t));
+      if (!pool->threads) {
+         cnd_destroy(&pool->new_work);
+         mtx_destroy(&pool->m);
+         FREE(pool);
+         return NULL;
+      }
+   }
+   for (unsigned i = 0; i < num_threads; i++) {
       pool->threads[i] = u_thread_create(lp_cs_tpool_worker, pool);
+      if (!pool->threads[i])
+         break;
+      pool->num_threads++;
+   }
    return pool;
 }
 
@@ -105,6 +161,7 @@ lp_cs_tpool_destroy(struct lp_cs_tpool *pool)
 
    cnd_destroy(&pool->new_work);
    mtx_destroy(&pool->m);
+   FREE(pool->threads);
    FREE(pool);
 }
 
@@ -121,6 +178,7 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
       for (unsigned t = 0; t < num_iters; t++) {
          work(data, t, &lmem);
       }
+      FREE(lmem.local_mem_ptr);
       return NULL;
    }
    task = CALLOC_STRUCT(lp_cs_tpool_task);
@@ -131,13 +189,16 @@ lp_cs_tpool_queue_task(struct lp_cs_tpool *pool,
    task->work = work;
    task->data = data;
    task->iter_total = num_iters;
+   /* The thread waiting for the task helps too. */
+   task->iter_per_fetch =
+      DIV_ROUND_UP(num_iters, (pool->num_threads + 1) * LP_CS_CHUNKS_PER_THREAD);
    cnd_init(&task->finish);
 
    mtx_lock(&pool->m);
 
    list_addtail(&task->list, &pool->workqueue);
 
-   cnd_signal(&pool->new_work);
+   cnd_broadcast(&pool->new_work);
    mtx_unlock(&pool->m);
    return task;
 }
@@ -147,15 +208,23 @@ lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
                           struct lp_cs_tpool_task **task_handle)
 {
    struct lp_cs_tpool_task *task = *task_handle;
+   struct lp_cs_local_mem lmem;
 
    if (!pool || !task)
       return;
 
+   memset(&lmem, 0, sizeof(lmem));
+
    mtx_lock(&pool->m);
-   while (task->iter_finished < task->iter_total)
+   if (!list_is_empty(&task->list))
+      lp_cs_tpool_work_on_task(pool, task, &lmem);
+
+   while (task->busy || task->iter_finished < task->iter_total)
       cnd_wait(&task->finish, &pool->m);
    mtx_unlock(&pool->m);
 
+   FREE(lmem.local_mem_ptr);
+
    cnd_destroy(&task->finish);
    FREE(task);
    *task_handle = NULL;
@@ -28,6 +28,8 @@
  * The item is added to the work queue once, but it must execute
  * number of iterations times. This saves storing a bunch of queue
  * structs with just unique indexes in them.
+ * Threads take the iterations in chunks with an atomic counter, so the
+ * pool mutex is only taken once per thread and task.
  * It also supports a local memory support struct to be passed from
  * outside the thread exec function.
  */
@@ -45,7 +47,7 @@ struct lp_cs_tpool {
    mtx_t m;
    cnd_t new_work;
 
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
    unsigned num_threads;
    struct list_head workqueue;
    bool shutdown;
@@ -61,11 +63,13 @@ typedef void (*lp_cs_tpool_task_func)(void *data, int iter_idx, struct lp_cs_loc
 struct lp_cs_tpool_task {
    lp_cs_tpool_task_func work;
    void *data;
-   struct list_head list;
+   struct list_head list;     /**< empty once all iterations are taken */
    cnd_t finish;
    unsigned iter_total;
-   unsigned iter_start;
-   unsigned iter_finished;
+   unsigned iter_per_fetch;
+   unsigned iter_start;       /**< atomic */
+   unsigned iter_finished;    /**< atomic */
+   unsigned busy;             /**< threads working on it, under pool->m */
 };
 
 struct lp_cs_tpool *lp_cs_tpool_create(unsigned num_threads);
@@ -75,6 +79,7 @@ struct lp_cs_tpool_task *lp_cs_tpool_queue_task(struct lp_cs_tpool *,
                                                 lp_cs_tpool_task_func func,
                                                 void *data, int num_iters);
 
+/* Helps running the remaining iterations, then waits for the others. */
 void lp_cs_tpool_wait_for_task(struct lp_cs_tpool *pool,
                             struct lp_cs_tpool_task **task);
 
@@ -38,6 +38,7 @@
 
 #include "lp_context.h"
 #include "lp_state.h"
+#include "lp_state_cs.h"
 #include "lp_query.h"
 
 #include "draw/draw_context.h"
@@ -66,6 +67,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
       return;
    }
 
+   llvmpipe_cs_sync_render(lp, FALSE);
+
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
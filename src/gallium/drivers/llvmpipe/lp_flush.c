@@ -38,6 +38,7 @@
 #include "lp_flush.h"
 #include "lp_context.h"
 #include "lp_setup.h"
+#include "lp_screen.h"
 
 
 /**
@@ -50,6 +51,9 @@ llvmpipe_flush( struct pipe_context *pipe,
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
 
+   /* compute dispatches are complete when they are flushed */
+   lp_csctx_wait(llvmpipe->csctx);
+
    draw_flush(llvmpipe->draw);
 
    /* ask the setup module to flush */
@@ -107,6 +111,9 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
 {
    unsigned referenced;
 
+   /* This includes the last compute dispatch, which llvmpipe_flush() waits
+    * for.
+    */
    referenced = llvmpipe_is_resource_referenced(pipe, resource, level);
 
    if ((referenced & LP_REFERENCED_FOR_WRITE) ||
@@ -120,6 +127,12 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
             return FALSE;
 
          llvmpipe_finish(pipe, reason);
+
+         /* The resource may also be in use by the scenes of other
+          * contexts.
+          */
+         llvmpipe_screen_wait_rasterizer(llvmpipe_screen(pipe->screen),
+                                         FALSE);
       } else {
          /*
           * Just flush.
@@ -65,7 +65,18 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Upper limit for the number of rasterizer / compute threads.
+ * All per-thread state is allocated at runtime, so this is only a sanity
+ * check for LP_NUM_THREADS.
+ */
+#define LP_MAX_THREADS 1024
+
+/**
+ * Max number of NUMA nodes which get their own band of tiles.
+ * Threads on additional nodes share the bands of the first ones.
+ */
+#define LP_MAX_NUMA_NODES 16
 
 
 /**
@@ -95,6 +106,18 @@
  */
 #define LP_MAX_SETUP_VARIANTS 64
 
+/**
+ * Max number of threads compiling fragment shader variants in the
+ * background, see LP_ASYNC_COMPILE.
+ */
+#define LP_MAX_COMPILE_THREADS 8
+
+/**
+ * Max number of threads helping the app thread bin large draws, see
+ * LP_BIN_THREADS.
+ */
+#define LP_MAX_BIN_THREADS 8
+
 /*
  * Max point size reported. Cap vertex shader point sizes to this.
  */
@@ -25,6 +25,8 @@
  *
  **************************************************************************/
 
+#include <inttypes.h>
+
 #include "util/u_debug.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
@@ -99,12 +101,50 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
 
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
+      debug_printf("llvmpipe: nr_color_tile_clear_skip:     %9u\n", lp_count.nr_color_tile_clear_skip);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
+      debug_printf("llvmpipe: nr_scene_chunks:              %9u\n", lp_count.nr_scene_chunks);
+      debug_printf("llvmpipe: nr_scene_full_flushes:        %9u\n", lp_count.nr_scene_full_flushes);
+      debug_printf("llvmpipe: nr_scene_oom_flushes:         %9u\n", lp_count.nr_scene_oom_flushes);
+      debug_printf("llvmpipe: peak_scene_size:              %9u\n", lp_count.peak_scene_size);
+
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
    }
 }
+
+
+void
+lp_print_thread_counters(unsigned thread,
+                         const struct lp_thread_counters *counters)
+{
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      int64_t total = counters->busy_time + counters->idle_time;
+      float busy = total ? 100.0 * (float) counters->busy_time / (float) total : 0.0;
+
+      debug_printf("llvmpipe: thread %2u: scenes %u, bins %u (%u stolen), "
+                   "busy %.3f sec (%3.0f%%), idle %.3f sec\n",
+                   thread, counters->nr_scenes, counters->nr_bins,
+                   counters->nr_stolen_bins,
+                   counters->busy_time / 1000000.0, busy,
+                   counters->idle_time / 1000000.0);
+      if (counters->nr_tex_cache_accesses) {
+         uint64_t hits = counters->nr_tex_cache_accesses -
+                         counters->nr_tex_cache_misses;
+         debug_printf("llvmpipe: thread %2u: texture block cache: "
+                      "%" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate)\n",
+                      thread, hits, counters->nr_tex_cache_misses,
+                      100.0 * (double) hits /
+                      (double) counters->nr_tex_cache_accesses);
+      }
+      if (counters->nr_hiz_rejected_16) {
+         debug_printf("llvmpipe: thread %2u: %" PRIu64 " 16x16 blocks "
+                      "rejected by depth bounds\n",
+                      thread, counters->nr_hiz_rejected_16);
+      }
+   }
+}
@@ -60,23 +60,51 @@ struct lp_counters
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
+   unsigned nr_color_tile_clear_skip;  /**< tile already held the value */
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   unsigned nr_scene_chunks;        /**< data chunks allocated by scenes */
+   unsigned nr_scene_full_flushes;  /**< flushes between draws, scene large */
+   unsigned nr_scene_oom_flushes;   /**< flushes while binning, out of memory */
+   unsigned peak_scene_size;        /**< most memory used by one scene */
 };
 
 
 extern struct lp_counters lp_count;
 
 
+/**
+ * Per rasterizer thread counters, to measure the load balance between
+ * the threads.  Only updated with LP_DEBUG=counters.
+ */
+struct lp_thread_counters
+{
+   int64_t busy_time;       /**< rasterizing bins, in microseconds */
+   int64_t idle_time;       /**< waiting for the other threads to finish
+                                 the scene, in microseconds */
+   unsigned nr_scenes;
+   unsigned nr_bins;
+   unsigned nr_stolen_bins; /**< bins taken from other threads */
+   uint64_t nr_tex_cache_accesses; /**< compressed texel fetches */
+   uint64_t nr_tex_cache_misses;   /**< blocks decoded */
+   uint64_t nr_hiz_rejected_16;    /**< 16x16 blocks failing the depth
+                                        bounds test */
+};
+
+
 /** Increment the named counter (only for debug builds) */
 #ifdef DEBUG
 #define LP_COUNT(counter) lp_count.counter++
 #define LP_COUNT_ADD(counter, incr)  lp_count.counter += (incr)
 #define LP_COUNT_GET(counter) (lp_count.counter)
+#define LP_COUNT_MAX(counter, value) \
+   do { if ((value) > lp_count.counter) lp_count.counter = (value); } while (0)
 #else
 #define LP_COUNT(counter) do {} while (0)
 #define LP_COUNT_ADD(counter, incr) (void)(incr)
 #define LP_COUNT_GET(counter) 0
+#define LP_COUNT_MAX(counter, value) (void)(value)
 #endif
 
 
@@ -88,4 +116,9 @@ extern void
 lp_print_counters(void);
 
 
+extern void
+lp_print_thread_counters(unsigned thread,
+                         const struct lp_thread_counters *counters);
+
+
 #endif /* LP_PERF_H */
@@ -53,13 +53,21 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES ||
+          (type >= PIPE_QUERY_DRIVER_SPECIFIC &&
+           type < PIPE_QUERY_DRIVER_SPECIFIC + LP_QUERY_DRIVER_TYPES));
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* The per-thread counters are allocated together with the query. */
+   pq = CALLOC(1, sizeof(*pq) + 2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
+      pq->num_threads = num_threads;
       pq->type = type;
       pq->index = index;
    }
@@ -96,9 +104,8 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
                           bool wait,
                           union pipe_query_result *vresult)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
+   unsigned num_threads = pq->num_threads;
    uint64_t *result = (uint64_t *)vresult;
    int i;
 
@@ -182,6 +189,9 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
       *stats = pq->stats;
    }
       break;
+   case LP_QUERY_VS_CACHE_HITS:
+      vresult->u64 = pq->vs_cache_hits;
+      break;
    default:
       assert(0);
       break;
@@ -199,9 +209,8 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
                                    struct pipe_resource *resource,
                                    unsigned offset)
 {
-   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq = llvmpipe_query(q);
+   unsigned num_threads = pq->num_threads;
    struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
    bool unflushed = false;
    bool unsignalled = false;
@@ -267,6 +276,9 @@ llvmpipe_get_query_result_resource(struct pipe_context *pipe,
       case PIPE_QUERY_SO_OVERFLOW_PREDICATE:
          value = !!(pq->num_primitives_generated[0] > pq->num_primitives_written[0]);
          break;
+      case LP_QUERY_VS_CACHE_HITS:
+         value = pq->vs_cache_hits;
+         break;
       case PIPE_QUERY_PIPELINE_STATISTICS:
          switch ((enum pipe_statistics_query_index)index) {
          case PIPE_STAT_QUERY_IA_VERTICES:
@@ -360,8 +372,8 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, pq->num_threads * sizeof(*pq->start));
+   memset(pq->end, 0, pq->num_threads * sizeof(*pq->end));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -395,6 +407,9 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
       memcpy(&pq->stats, &llvmpipe->pipeline_statistics, sizeof(pq->stats));
       llvmpipe->active_statistics_queries++;
       break;
+   case LP_QUERY_VS_CACHE_HITS:
+      pq->vs_cache_hits = draw_get_vertex_cache_hits(llvmpipe->draw);
+      break;
    case PIPE_QUERY_OCCLUSION_COUNTER:
    case PIPE_QUERY_OCCLUSION_PREDICATE:
    case PIPE_QUERY_OCCLUSION_PREDICATE_CONSERVATIVE:
@@ -473,6 +488,10 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
          llvmpipe->pipeline_statistics.ds_invocations - pq->stats.ds_invocations;
       llvmpipe->active_statistics_queries--;
       break;
+   case LP_QUERY_VS_CACHE_HITS:
+      pq->vs_cache_hits =
+         draw_get_vertex_cache_hits(llvmpipe->draw) - pq->vs_cache_hits;
+      break;
    case PIPE_QUERY_OCCLUSION_COUNTER:
    case PIPE_QUERY_OCCLUSION_PREDICATE:
    case PIPE_QUERY_OCCLUSION_PREDICATE_CONSERVATIVE:
@@ -517,6 +536,35 @@ llvmpipe_set_active_query_state(struct pipe_context *pipe, bool enable)
    llvmpipe->dirty |= LP_NEW_OCCLUSION_QUERY;
 }
 
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   static const struct pipe_driver_query_info queries[] = {
+      /* vertices the draw module's post-transform vertex cache provided */
+      { "vs-cache-hits", LP_QUERY_VS_CACHE_HITS, { 0 },
+        PIPE_DRIVER_QUERY_TYPE_UINT64, PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE },
+   };
+
+   STATIC_ASSERT(ARRAY_SIZE(queries) == LP_QUERY_DRIVER_TYPES);
+
+   if (!info)
+      return ARRAY_SIZE(queries);
+
+   if (index >= ARRAY_SIZE(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
+void
+llvmpipe_init_screen_query_funcs(struct pipe_screen *screen)
+{
+   screen->get_driver_query_info = llvmpipe_get_driver_query_info;
+}
+
 void llvmpipe_init_query_funcs(struct llvmpipe_context *llvmpipe )
 {
    llvmpipe->pipe.create_query = llvmpipe_create_query;
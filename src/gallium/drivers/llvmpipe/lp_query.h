@@ -35,20 +35,31 @@
 
 #include <limits.h>
 #include "os/os_thread.h"
+#include "util/u_threaded_context.h"
 #include "lp_limits.h"
 
 
 struct llvmpipe_context;
 
 
+/**
+ * Driver specific queries, see llvmpipe_get_driver_query_info().
+ */
+#define LP_QUERY_VS_CACHE_HITS     (PIPE_QUERY_DRIVER_SPECIFIC + 0)
+#define LP_QUERY_DRIVER_TYPES      1
+
+
 struct llvmpipe_query {
-   uint64_t start[LP_MAX_THREADS];  /* start count value for each thread */
-   uint64_t end[LP_MAX_THREADS];    /* end count value for each thread */
+   struct threaded_query base;      /* must be first, zero-initialized */
+   uint64_t *start;                 /* start count value for each thread */
+   uint64_t *end;                   /* end count value for each thread */
+   unsigned num_threads;            /* size of the start/end arrays */
    struct lp_fence *fence;          /* fence from last scene this was binned in */
    unsigned type;                   /* PIPE_QUERY_* */
    unsigned index;
    unsigned num_primitives_generated[PIPE_MAX_VERTEX_STREAMS];
    unsigned num_primitives_written[PIPE_MAX_VERTEX_STREAMS];
+   uint64_t vs_cache_hits;
 
    struct pipe_query_data_pipeline_statistics stats;
 };
@@ -56,6 +67,8 @@ struct llvmpipe_query {
 
 extern void llvmpipe_init_query_funcs(struct llvmpipe_context * );
 
+extern void llvmpipe_init_screen_query_funcs(struct pipe_screen *screen);
+
 extern boolean llvmpipe_check_render_cond(struct llvmpipe_context *);
 
 #endif /* LP_QUERY_H */
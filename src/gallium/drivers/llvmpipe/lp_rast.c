@@ -26,6 +26,7 @@
  **************************************************************************/
 
 #include <limits.h>
+#include <stdio.h>
 #include "util/u_memory.h"
 #include "util/u_math.h"
 #include "util/u_rect.h"
@@ -34,6 +35,7 @@
 #include "util/u_string.h"
 #include "util/u_thread.h"
 #include "util/u_memset.h"
+#include "util/u_cpu_detect.h"
 #include "util/os_time.h"
 
 #include "lp_scene_queue.h"
@@ -70,10 +72,18 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_wait_shaders( scene );
+   lp_scene_bin_iter_begin( scene, rast->num_threads,
+                            rast->thread_nodes, rast->num_nodes );
 }
 
 
+/**
+ * End rasterizing a scene.
+ * Called once per scene by one thread, after all threads are done with
+ * the bins.  The scene itself is only recycled by the setup module once
+ * its fence has been signalled.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
@@ -83,6 +93,40 @@ lp_rast_end( struct lp_rasterizer *rast )
 }
 
 
+/**
+ * Whether coarse depth rejection can be used with this depth buffer
+ * format.  Only unorm formats, where the stored depth is always the
+ * fragment depth clamped to [0,1], and quantized.
+ */
+static boolean
+lp_rast_hiz_format(enum pipe_format format)
+{
+   switch (format) {
+   case PIPE_FORMAT_Z16_UNORM:
+   case PIPE_FORMAT_Z32_UNORM:
+   case PIPE_FORMAT_Z24_UNORM_S8_UINT:
+   case PIPE_FORMAT_Z24X8_UNORM:
+   case PIPE_FORMAT_S8_UINT_Z24_UNORM:
+   case PIPE_FORMAT_X8Z24_UNORM:
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+static void
+lp_rast_hiz_set(struct lp_rasterizer_task *task, float zmin, float zmax)
+{
+   unsigned i;
+
+   for (i = 0; i < LP_HIZ_BLOCKS; i++) {
+      task->hiz_zmin[i] = zmin;
+      task->hiz_zmax[i] = zmax;
+   }
+}
+
+
 /**
  * Beginning rasterization of a tile.
  * \param x  window X position of the tile, in pixels
@@ -109,18 +153,87 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
    task->thread_data.vis_counter = 0;
    task->thread_data.ps_invocations = 0;
 
+   task->tile_clears_valid = FALSE;
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
-      if (task->scene->fb.cbufs[i]) {
+      const struct pipe_surface *cbuf = task->scene->fb.cbufs[i];
+
+      task->tile_clears[i] = NULL;
+      if (cbuf) {
          task->color_tiles[i] = scene->cbufs[i].map +
                                 scene->cbufs[i].stride * task->y +
                                 scene->cbufs[i].format_bytes * task->x;
       }
+      if (cbuf && scene->cbufs[i].tile_clears) {
+         unsigned tiles_x = DIV_ROUND_UP(cbuf->texture->width0, TILE_SIZE);
+
+         task->tile_clears[i] = &scene->cbufs[i].tile_clears[y * tiles_x + x];
+         task->tile_whole[i] =
+            task->x + task->width == MIN2(task->x + TILE_SIZE, cbuf->width) &&
+            task->y + task->height == MIN2(task->y + TILE_SIZE, cbuf->height);
+         task->tile_clears_valid = TRUE;
+      }
    }
    if (task->scene->fb.zsbuf) {
       task->depth_tile = scene->zsbuf.map +
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
    }
+
+   /* The tile's depth contents are unknown until cleared or drawn to.
+    * Layered framebuffers would need bounds per layer, don't bother.
+    */
+   task->hiz_enabled = scene->zsbuf.map &&
+                       scene->fb_max_layer == 0 &&
+                       lp_rast_hiz_format(scene->fb.zsbuf->format) &&
+                       !(LP_PERF & PERF_NO_HIZ);
+   if (task->hiz_enabled)
+      lp_rast_hiz_set(task, 0.0f, 1.0f);
+}
+
+
+/**
+ * Forget that the current tile held clear values, when drawing to it.
+ */
+static void
+lp_rast_forget_tile_clears(struct lp_rasterizer_task *task)
+{
+   const struct lp_scene *scene = task->scene;
+   unsigned i, layer;
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      struct lp_tile_clear_state *tile = task->tile_clears[i];
+      if (tile) {
+         for (layer = 0; layer <= scene->fb_max_layer; layer++)
+            tile[layer * scene->cbufs[i].tile_clears_layer_stride].bytes = 0;
+      }
+   }
+   task->tile_clears_valid = FALSE;
+}
+
+
+/**
+ * Whether all the bound layers of the current tile of a color buffer
+ * already hold nothing but the clear value.
+ */
+static boolean
+lp_rast_tile_holds_clear(const struct lp_rasterizer_task *task,
+                         unsigned cbuf, const union util_color *uc)
+{
+   const struct lp_scene *scene = task->scene;
+   const struct lp_tile_clear_state *tile = task->tile_clears[cbuf];
+   const unsigned bytes = scene->cbufs[cbuf].format_bytes;
+   unsigned layer;
+
+   if (!tile || !task->tile_clears_valid)
+      return FALSE;
+
+   for (layer = 0; layer <= scene->fb_max_layer; layer++) {
+      tile = &task->tile_clears[cbuf][layer *
+                                      scene->cbufs[cbuf].tile_clears_layer_stride];
+      if (tile->bytes != bytes || memcmp(&tile->value, uc, bytes) != 0)
+         return FALSE;
+   }
+   return TRUE;
 }
 
 
@@ -128,6 +241,9 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
  * Clear the rasterizer's current color tile.
  * This is a bin command called during bin processing.
  * Clear commands always clear all bound layers.
+ *
+ * Tiles which already hold the clear value (typically the background of
+ * a mostly static UI, untouched since the previous frame) aren't written.
  */
 static void
 lp_rast_clear_color(struct lp_rasterizer_task *task,
@@ -135,8 +251,10 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 {
    const struct lp_scene *scene = task->scene;
    unsigned cbuf = arg.clear_rb->cbuf;
+   struct lp_tile_clear_state *tile = task->tile_clears[cbuf];
    union util_color uc;
    enum pipe_format format;
+   unsigned layer;
 
    /* we never bin clear commands for non-existing buffers */
    assert(cbuf < scene->fb.nr_cbufs);
@@ -152,6 +270,10 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
    LP_DBG(DEBUG_RAST, "%s clear value (target format %d) raw 0x%x,0x%x,0x%x,0x%x\n",
           __FUNCTION__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
+   if (lp_rast_tile_holds_clear(task, cbuf, &uc)) {
+      LP_COUNT(nr_color_tile_clear_skip);
+      return;
+   }
 
    util_fill_box(scene->cbufs[cbuf].map,
                  format,
@@ -165,6 +287,15 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
                  scene->fb_max_layer + 1,
                  &uc);
 
+   if (tile) {
+      for (layer = 0; layer <= scene->fb_max_layer; layer++) {
+         tile[layer * scene->cbufs[cbuf].tile_clears_layer_stride].value = uc;
+         tile[layer * scene->cbufs[cbuf].tile_clears_layer_stride].bytes =
+            task->tile_whole[cbuf] ? scene->cbufs[cbuf].format_bytes : 0;
+      }
+      task->tile_clears_valid = TRUE;
+   }
+
    /* this will increase for each rb which probably doesn't mean much */
    LP_COUNT(nr_color_tile_clear);
 }
@@ -284,6 +415,137 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
          dst_layer += scene->zsbuf.layer_stride;
       }
    }
+
+   if (task->hiz_enabled) {
+      const uint32_t zmask = util_pack_mask_z(scene->fb.zsbuf->format, ~0);
+
+      if ((clear_mask64 & zmask) == zmask) {
+         const unsigned shift = ffs(zmask) - 1;
+         const float z = (float)((double)((arg.clear_zstencil.value & zmask) >> shift) /
+                                 (double)(zmask >> shift));
+         lp_rast_hiz_set(task, z, z);
+      }
+      else if (clear_mask64 & zmask) {
+         lp_rast_hiz_set(task, 0.0f, 1.0f);
+      }
+   }
+}
+
+
+/**
+ * Coarse depth rejection.
+ *
+ * Each task keeps a conservative min/max of the depth values in every
+ * 16x16 block of its current tile.  The bounds are set by depth clears
+ * and follow the depth writes of the triangles drawn, which tighten them
+ * when a block is fully covered.  A block where the triangle's depth
+ * plane lies entirely behind the bounds would fail the depth test
+ * everywhere, so it needn't be shaded at all.
+ *
+ * \param full_mask  blocks of the tile fully covered by the triangle
+ * \param partial_mask  blocks partially covered by the triangle
+ * \return the blocks which may pass the depth test
+ */
+unsigned
+lp_rast_hiz_blocks(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned full_mask,
+                   unsigned partial_mask)
+{
+   const struct lp_fragment_shader_variant *variant = task->state->variant;
+   const unsigned test = variant->hiz_test;
+   const unsigned update = variant->hiz_update;
+   const boolean full_write = variant->hiz_full_write;
+   unsigned mask = full_mask | partial_mask;
+   unsigned visible = mask;
+   float z0, dzdx, dzdy, dz_lo, dz_hi, margin;
+
+   assert(task->hiz_enabled);
+
+   /* A variant which failed to compile writes nothing */
+   if ((test == LP_HIZ_NONE && update == LP_HIZ_NONE) ||
+       !variant->jit_function[RAST_EDGE_TEST])
+      return visible;
+
+   /* Depth is the z channel of the position, always the first input. */
+   z0 = GET_A0(inputs)[0][2];
+   dzdx = GET_DADX(inputs)[0][2];
+   dzdy = GET_DADY(inputs)[0][2];
+
+   /* Range of the plane over a block, relative to its corner */
+   dz_lo = MIN2(dzdx * 15, 0.0f) + MIN2(dzdy * 15, 0.0f);
+   dz_hi = MAX2(dzdx * 15, 0.0f) + MAX2(dzdy * 15, 0.0f);
+
+   /* Allow for rounding differences with the shader's interpolation and
+    * for the quantization of the stored depth.
+    */
+   margin = (fabsf(z0) +
+             fabsf(dzdx) * (task->x + TILE_SIZE) +
+             fabsf(dzdy) * (task->y + TILE_SIZE)) * (1.0f / (1 << 20)) +
+            1.0f / (1 << 14);
+
+   while (mask) {
+      const int i = ffs(mask) - 1;
+      const int x = task->x + (i % (TILE_SIZE / 16)) * 16;
+      const int y = task->y + (i / (TILE_SIZE / 16)) * 16;
+      const float z = z0 + dzdx * x + dzdy * y;
+      const boolean full = (full_mask >> i) & 1;
+      float zlo = z + dz_lo - margin;
+      float zhi = z + dz_hi + margin;
+
+      mask &= ~(1 << i);
+
+      if (zlo <= zhi) {
+         zlo = CLAMP(zlo, 0.0f, 1.0f);
+         zhi = CLAMP(zhi, 0.0f, 1.0f);
+      }
+      else {
+         /* NaN or infinite plane */
+         zlo = 0.0f;
+         zhi = 1.0f;
+      }
+
+      if ((test == LP_HIZ_LESS && zlo > task->hiz_zmax[i]) ||
+          (test == LP_HIZ_GREATER && zhi < task->hiz_zmin[i])) {
+         visible &= ~(1 << i);
+         if (LP_DEBUG & DEBUG_COUNTERS)
+            task->counters.nr_hiz_rejected_16++;
+         continue;
+      }
+
+      switch (update) {
+      case LP_HIZ_LESS:
+         /* Written values only ever get smaller */
+         task->hiz_zmin[i] = MIN2(task->hiz_zmin[i], zlo);
+         if (full && full_write)
+            task->hiz_zmax[i] = MIN2(task->hiz_zmax[i], zhi);
+         break;
+      case LP_HIZ_GREATER:
+         task->hiz_zmax[i] = MAX2(task->hiz_zmax[i], zhi);
+         if (full && full_write)
+            task->hiz_zmin[i] = MAX2(task->hiz_zmin[i], zlo);
+         break;
+      case LP_HIZ_ALWAYS:
+         if (full && full_write) {
+            task->hiz_zmin[i] = zlo;
+            task->hiz_zmax[i] = zhi;
+            break;
+         }
+         /* fallthrough */
+      case LP_HIZ_ANY:
+         task->hiz_zmin[i] = MIN2(task->hiz_zmin[i], zlo);
+         task->hiz_zmax[i] = MAX2(task->hiz_zmax[i], zhi);
+         break;
+      case LP_HIZ_UNKNOWN:
+         task->hiz_zmin[i] = 0.0f;
+         task->hiz_zmax[i] = 1.0f;
+         break;
+      default:
+         break;
+      }
+   }
+
+   return visible;
 }
 
 
@@ -302,6 +564,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
+   unsigned visible = ~0;
    unsigned x, y;
 
    if (inputs->disable) {
@@ -318,6 +581,16 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
+   /* The variant failed to compile on a compile thread */
+   if (!variant->jit_function[RAST_WHOLE])
+      return;
+
+   if (task->hiz_enabled) {
+      visible = lp_rast_hiz_blocks(task, inputs, 0xffff, 0);
+      if (!visible)
+         return;
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
@@ -327,6 +600,9 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
          unsigned depth_stride = 0;
          unsigned i;
 
+         if (!(visible & (1 << ((y / 16) * (TILE_SIZE / 16) + x / 16))))
+            continue;
+
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
@@ -446,8 +722,10 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    /*
     * The rasterizer may produce fragments outside our
     * allocated 4x4 blocks hence need to filter them out here.
+    * Variants which failed to compile have no function to run.
     */
-   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height &&
+       variant->jit_function[RAST_EDGE_TEST]) {
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
@@ -593,6 +871,29 @@ static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
    lp_rast_triangle_32_4_16
 };
 
+static once_flag dispatch_once_flag = ONCE_FLAG_INIT;
+
+/**
+ * Swap the generic triangle commands for the widest edge-mask kernels
+ * the CPU supports.
+ */
+static void
+init_dispatch(void)
+{
+#ifdef LP_USE_AVX512
+   if (util_cpu_caps.has_avx512f) {
+      lp_rast_tri_init_avx512(dispatch);
+      return;
+   }
+#endif
+#ifdef LP_USE_AVX2
+   if (util_cpu_caps.has_avx2) {
+      lp_rast_tri_init_avx2(dispatch);
+      return;
+   }
+#endif
+}
+
 
 static void
 do_rasterize_bin(struct lp_rasterizer_task *task,
@@ -607,6 +908,13 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
 
    for (block = bin->head; block; block = block->next) {
       for (k = 0; k < block->count; k++) {
+         /* anything but clears, queries and state changes may draw */
+         if (task->tile_clears_valid &&
+             block->cmd[k] > LP_RAST_OP_CLEAR_ZSTENCIL &&
+             (block->cmd[k] < LP_RAST_OP_BEGIN_QUERY ||
+              block->cmd[k] > LP_RAST_OP_SET_STATE))
+            lp_rast_forget_tile_clears(task);
+
          dispatch[block->cmd[k]]( task, block->arg[k] );
       }
    }
@@ -669,47 +977,39 @@ rasterize_scene(struct lp_rasterizer_task *task,
 
    /* Clear the cache tags. This should not always be necessary but
       simpler for now. */
-#if LP_USE_TEXTURE_CACHE
-   memset(task->thread_data.cache->cache_tags, 0,
-          sizeof(task->thread_data.cache->cache_tags));
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-   task->thread_data.cache->cache_access_total = 0;
-   task->thread_data.cache->cache_access_miss = 0;
-#endif
-#endif
+   lp_build_format_cache_reset(task->thread_data.cache);
 
    if (!task->rast->no_rast) {
       /* loop over scene bins, rasterize each */
       {
          struct cmd_bin *bin;
+         boolean stolen;
+         int64_t start = 0;
          int i, j;
 
+         if (LP_DEBUG & DEBUG_COUNTERS)
+            start = os_time_get();
+
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+         while ((bin = lp_scene_bin_iter_next(scene, task->thread_index,
+                                              &i, &j, &stolen))) {
             if (!is_empty_bin( bin ))
                rasterize_bin(task, bin, i, j);
-         }
-      }
-   }
 
+            if (LP_DEBUG & DEBUG_COUNTERS) {
+               task->counters.nr_bins++;
+               if (stolen)
+                  task->counters.nr_stolen_bins++;
+            }
+         }
 
-#if LP_BUILD_FORMAT_CACHE_DEBUG
-   {
-      uint64_t total, miss;
-      total = task->thread_data.cache->cache_access_total;
-      miss = task->thread_data.cache->cache_access_miss;
-      if (total) {
-         debug_printf("thread %d cache access %llu miss %llu hit rate %f\n",
-                 task->thread_index, (long long unsigned)total,
-                 (long long unsigned)miss,
-                 (float)(total - miss)/(float)total);
+         if (LP_DEBUG & DEBUG_COUNTERS) {
+            task->counters.busy_time += os_time_get() - start;
+            task->counters.nr_scenes++;
+         }
       }
    }
-#endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
 
    task->scene = NULL;
 }
@@ -739,6 +1039,10 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 
       lp_rast_end( rast );
 
+      if (scene->fence) {
+         lp_fence_signal(scene->fence);
+      }
+
       util_fpstate_set(fpstate);
 
       rast->curr_scene = NULL;
@@ -759,29 +1063,12 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
-void
-lp_rast_finish( struct lp_rasterizer *rast )
-{
-   if (rast->num_threads == 0) {
-      /* nothing to do */
-   }
-   else {
-      int i;
-
-      /* wait for work to complete */
-      for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
-      }
-   }
-}
-
-
 /**
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. signal the scene's fence
  */
 static int
 thread_function(void *init_data)
@@ -802,6 +1089,8 @@ thread_function(void *init_data)
    util_fpstate_set_denorms_to_zero(fpstate);
 
    while (1) {
+      struct lp_scene *scene;
+
       /* wait for work */
       if (debug)
          debug_printf("thread %d waiting for work\n", task->thread_index);
@@ -828,23 +1117,33 @@ thread_function(void *init_data)
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
-      rasterize_scene(task,
-                      rast->curr_scene);
+      scene = rast->curr_scene;
+      rasterize_scene(task, scene);
       
       /* wait for all threads to finish with this scene */
-      util_barrier_wait( &rast->barrier );
+      if (LP_DEBUG & DEBUG_COUNTERS) {
+         int64_t start = os_time_get();
+         util_barrier_wait( &rast->barrier );
+         task->counters.idle_time += os_time_get() - start;
+      }
+      else {
+         util_barrier_wait( &rast->barrier );
+      }
 
-      /* XXX: shouldn't be necessary:
-       */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
+      /* Signal done with work.  The fence only completes once every
+       * thread got here, and thread 0 only does so after unmapping the
+       * framebuffer, so the setup module may then recycle the scene.
+       */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
 
-      pipe_semaphore_signal(&task->work_done);
+      if (scene->fence) {
+         lp_fence_signal(scene->fence);
+      }
    }
 
 #ifdef _WIN32
@@ -855,6 +1154,114 @@ thread_function(void *init_data)
 }
 
 
+#if defined(PIPE_OS_LINUX)
+/**
+ * Parse a sysfs list like "0-3,8,10-11" into list[].
+ * \return number of entries read
+ */
+static unsigned
+read_sysfs_list(const char *path, unsigned *list, unsigned max)
+{
+   char buf[8192];
+   unsigned count = 0;
+   FILE *f;
+   char *p;
+
+   f = fopen(path, "r");
+   if (!f)
+      return 0;
+   p = fgets(buf, sizeof buf, f);
+   fclose(f);
+
+   while (p && count < max) {
+      unsigned long first, last;
+      char *end;
+
+      first = last = strtoul(p, &end, 10);
+      if (end == p)
+         break;
+      if (*end == '-') {
+         p = end + 1;
+         last = strtoul(p, &end, 10);
+         if (end == p)
+            break;
+      }
+      for (unsigned long v = first; v <= last && count < max; v++)
+         list[count++] = v;
+      p = *end == ',' ? end + 1 : NULL;
+   }
+
+   return count;
+}
+#endif
+
+
+/**
+ * Pin the rasterizer threads to CPUs, spreading them evenly over the NUMA
+ * nodes, and record the node of each thread.  Each node then works on its
+ * own band of tiles, so the pages of the color/depth buffers which are
+ * first touched by a node stay local to it.
+ */
+static void
+assign_thread_affinity(struct lp_rasterizer *rast)
+{
+   const unsigned max_cpus = 1024;
+   unsigned *cpus, *cpu_nodes;
+   unsigned num_cpus = 0;
+   unsigned i;
+
+   cpus = MALLOC(max_cpus * sizeof *cpus);
+   cpu_nodes = MALLOC(max_cpus * sizeof *cpu_nodes);
+   if (!cpus || !cpu_nodes)
+      goto out;
+
+#if defined(PIPE_OS_LINUX)
+   {
+      unsigned nodes[256];
+      unsigned num_nodes;
+
+      num_nodes = read_sysfs_list("/sys/devices/system/node/online",
+                                  nodes, ARRAY_SIZE(nodes));
+      for (i = 0; i < num_nodes; i++) {
+         char path[64];
+         unsigned n;
+
+         snprintf(path, sizeof path,
+                  "/sys/devices/system/node/node%u/cpulist", nodes[i]);
+         n = read_sysfs_list(path, cpus + num_cpus, max_cpus - num_cpus);
+         for (unsigned j = 0; j < n; j++)
+            cpu_nodes[num_cpus + j] = i;
+         num_cpus += n;
+      }
+   }
+#endif
+
+   if (!num_cpus) {
+      /* no topology information, assume a single node */
+      num_cpus = MIN2(util_cpu_caps.nr_cpus, max_cpus);
+      for (i = 0; i < num_cpus; i++) {
+         cpus[i] = i;
+         cpu_nodes[i] = 0;
+      }
+   }
+
+   if (!num_cpus)
+      goto out;
+
+   for (i = 0; i < rast->num_threads; i++) {
+      unsigned idx = i * num_cpus / rast->num_threads;
+
+      util_pin_thread_to_cpu(rast->threads[i], cpus[idx]);
+      rast->thread_nodes[i] = cpu_nodes[idx] % LP_MAX_NUMA_NODES;
+      rast->num_nodes = MAX2(rast->num_nodes, rast->thread_nodes[i] + 1);
+   }
+
+out:
+   FREE(cpus);
+   FREE(cpu_nodes);
+}
+
+
 /**
  * Initialize semaphores and spawn the threads.
  */
@@ -874,6 +1281,10 @@ create_rast_threads(struct lp_rasterizer *rast)
          break;
       }
    }
+
+   if (rast->num_threads > 1 &&
+       debug_get_bool_option("LP_NUMA_AFFINITY", FALSE))
+      assign_thread_affinity(rast);
 }
 
 
@@ -889,6 +1300,8 @@ lp_rast_create( unsigned num_threads )
    struct lp_rasterizer *rast;
    unsigned i;
 
+   call_once(&dispatch_once_flag, init_dispatch);
+
    rast = CALLOC_STRUCT(lp_rasterizer);
    if (!rast) {
       goto no_rast;
@@ -899,12 +1312,26 @@ lp_rast_create( unsigned num_threads )
       goto no_full_scenes;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   rast->thread_nodes = CALLOC(MAX2(1, num_threads),
+                               sizeof *rast->thread_nodes);
+   if (!rast->tasks || !rast->thread_nodes) {
+      goto no_tasks;
+   }
+
+   if (num_threads) {
+      rast->threads = CALLOC(num_threads, sizeof *rast->threads);
+      if (!rast->threads) {
+         goto no_tasks;
+      }
+   }
+   rast->num_nodes = 1;
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
-      task->thread_data.cache = align_malloc(sizeof(struct lp_build_format_cache),
-                                             16);
+      task->thread_data.cache = lp_build_format_cache_create();
       if (!task->thread_data.cache) {
          goto no_thread_data_cache;
       }
@@ -926,12 +1353,16 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
-         align_free(rast->tasks[i].thread_data.cache);
+         lp_build_format_cache_destroy(rast->tasks[i].thread_data.cache);
       }
    }
 
+   FREE(rast->threads);
+no_tasks:
+   FREE(rast->thread_nodes);
+   FREE(rast->tasks);
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
    FREE(rast);
@@ -972,7 +1403,13 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
       pipe_semaphore_destroy(&rast->tasks[i].work_done);
    }
    for (i = 0; i < MAX2(1, rast->num_threads); i++) {
-      align_free(rast->tasks[i].thread_data.cache);
+      struct lp_rasterizer_task *task = &rast->tasks[i];
+      task->counters.nr_tex_cache_accesses =
+         task->thread_data.cache->cache_access_total;
+      task->counters.nr_tex_cache_misses =
+         task->thread_data.cache->cache_access_miss;
+      lp_print_thread_counters(i, &task->counters);
+      lp_build_format_cache_destroy(task->thread_data.cache);
    }
 
    /* for synchronizing rasterization threads */
@@ -982,6 +1419,9 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->thread_nodes);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
@@ -37,6 +37,7 @@
 #include "lp_state.h"
 #include "lp_texture.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 #define TILE_VECTOR_HEIGHT 4
@@ -76,6 +77,9 @@ extern const struct lp_rasterizer_task *jit_task;
 struct lp_rasterizer;
 struct cmd_bin;
 
+/** Number of 16x16 blocks in a tile */
+#define LP_HIZ_BLOCKS ((TILE_SIZE / 16) * (TILE_SIZE / 16))
+
 /**
  * Per-thread rasterization state
  */
@@ -91,12 +95,34 @@ struct lp_rasterizer_task
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
 
+   /**
+    * Clear state of the current tile in each color buffer (of its first
+    * layer), NULL if untracked.  tile_whole tells whether the tile covers
+    * the whole TILE_SIZE tile of the buffer.  tile_clears_valid is cleared
+    * once the states were reset after drawing to the tile.
+    */
+   struct lp_tile_clear_state *tile_clears[PIPE_MAX_COLOR_BUFS];
+   boolean tile_whole[PIPE_MAX_COLOR_BUFS];
+   boolean tile_clears_valid;
+
+   /**
+    * Conservative min/max depth of each 16x16 block of the current tile,
+    * used to skip blocks where the depth test must fail.  Only kept up to
+    * date while hiz_enabled is set.
+    */
+   boolean hiz_enabled;
+   float hiz_zmin[LP_HIZ_BLOCKS];
+   float hiz_zmax[LP_HIZ_BLOCKS];
+
    /** "back" pointer */
    struct lp_rasterizer *rast;
 
    /** "my" index */
    unsigned thread_index;
 
+   /** Load balance statistics */
+   struct lp_thread_counters counters;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
@@ -122,10 +148,16 @@ struct lp_rasterizer
    struct lp_scene *curr_scene;
 
    /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   thrd_t threads[LP_MAX_THREADS];
+   thrd_t *threads;
+
+   /** NUMA node of each thread, selects the band of bins to work on */
+   unsigned *thread_nodes;
+
+   /** Number of NUMA nodes the threads are spread over, 1 if not pinned */
+   unsigned num_nodes;
 
    /** For synchronizing the rasterization threads */
    util_barrier barrier;
@@ -215,6 +247,42 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 
 
 
+unsigned
+lp_rast_hiz_blocks(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned full_mask,
+                   unsigned partial_mask);
+
+
+/**
+ * Coarse depth rejection for a partially covered size x size area at
+ * x, y, which need not be aligned to the 16x16 blocks.
+ * \return FALSE if the depth test fails everywhere in the area
+ */
+static inline boolean
+lp_rast_hiz_area(struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 unsigned x, unsigned y, unsigned size)
+{
+   unsigned x0, y0, x1, y1, bx, by;
+   unsigned mask = 0;
+
+   if (!task->hiz_enabled)
+      return TRUE;
+
+   x0 = (x - task->x) / 16;
+   y0 = (y - task->y) / 16;
+   x1 = MIN2(x - task->x + size - 1, TILE_SIZE - 1) / 16;
+   y1 = MIN2(y - task->y + size - 1, TILE_SIZE - 1) / 16;
+
+   for (by = y0; by <= y1; by++)
+      for (bx = x0; bx <= x1; bx++)
+         mask |= 1 << (by * (TILE_SIZE / 16) + bx);
+
+   return lp_rast_hiz_blocks(task, inputs, 0, mask) != 0;
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -255,8 +323,10 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    /*
     * The rasterizer may produce fragments outside our
     * allocated 4x4 blocks hence need to filter them out here.
+    * Variants which failed to compile have no function to run.
     */
-   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+   if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height &&
+       variant->jit_function[RAST_WHOLE]) {
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
 
@@ -278,6 +348,36 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    }
 }
 
+
+/**
+ * Shade all pixels in a 4x4 block.
+ */
+static inline void
+block_full_4(struct lp_rasterizer_task *task,
+             const struct lp_rast_triangle *tri,
+             int x, int y)
+{
+   lp_rast_shade_quads_all(task, &tri->inputs, x, y);
+}
+
+
+/**
+ * Shade all pixels in a 16x16 block.
+ */
+static inline void
+block_full_16(struct lp_rasterizer_task *task,
+              const struct lp_rast_triangle *tri,
+              int x, int y)
+{
+   unsigned ix, iy;
+   assert(x % 16 == 0);
+   assert(y % 16 == 0);
+   for (iy = 0; iy < 16; iy += 4)
+      for (ix = 0; ix < 16; ix += 4)
+	 block_full_4(task, tri, x + ix, y + iy);
+}
+
+
 void lp_rast_triangle_1( struct lp_rasterizer_task *, 
                          const union lp_rast_cmd_arg );
 void lp_rast_triangle_2( struct lp_rasterizer_task *, 
@@ -328,9 +428,25 @@ void lp_rast_triangle_32_3_4(struct lp_rasterizer_task *,
 void lp_rast_triangle_32_3_16( struct lp_rasterizer_task *, 
                             const union lp_rast_cmd_arg );
 
-void lp_rast_triangle_32_4_16( struct lp_rasterizer_task *, 
+void lp_rast_triangle_32_4_16( struct lp_rasterizer_task *,
                             const union lp_rast_cmd_arg );
 
+/*
+ * Wider x86 edge-mask kernels, built from lp_rast_tri_simd.c once per
+ * instruction set.  The init functions replace the generic triangle
+ * entries of a command dispatch table; the mask functions are exported
+ * for lp_test_tri.
+ */
+void lp_rast_tri_init_avx2(lp_rast_cmd_func *dispatch);
+void lp_rast_tri_build_masks_avx2(int c, int cdiff, int dcdx, int dcdy,
+                                  unsigned *outmask, unsigned *partmask);
+unsigned lp_rast_tri_build_mask_linear_avx2(int c, int dcdx, int dcdy);
+
+void lp_rast_tri_init_avx512(lp_rast_cmd_func *dispatch);
+void lp_rast_tri_build_masks_avx512(int c, int cdiff, int dcdx, int dcdy,
+                                    unsigned *outmask, unsigned *partmask);
+unsigned lp_rast_tri_build_mask_linear_avx512(int c, int dcdx, int dcdy);
+
 void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg);
@@ -35,34 +35,6 @@
 #include "lp_perf.h"
 #include "lp_rast_priv.h"
 
-/**
- * Shade all pixels in a 4x4 block.
- */
-static void
-block_full_4(struct lp_rasterizer_task *task,
-             const struct lp_rast_triangle *tri,
-             int x, int y)
-{
-   lp_rast_shade_quads_all(task, &tri->inputs, x, y);
-}
-
-
-/**
- * Shade all pixels in a 16x16 block.
- */
-static void
-block_full_16(struct lp_rasterizer_task *task,
-              const struct lp_rast_triangle *tri,
-              int x, int y)
-{
-   unsigned ix, iy;
-   assert(x % 16 == 0);
-   assert(y % 16 == 0);
-   for (iy = 0; iy < 16; iy += 4)
-      for (ix = 0; ix < 16; ix += 4)
-	 block_full_4(task, tri, x + ix, y + iy);
-}
-
 static inline unsigned
 build_mask_linear(int32_t c, int32_t dcdx, int32_t dcdy)
 {
@@ -265,6 +237,9 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   if (!lp_rast_hiz_area(task, &tri->inputs, x, y, 16))
+      return;
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &unused, &dcdx, &dcdy);
 
@@ -373,6 +348,9 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   if (!lp_rast_hiz_area(task, &tri->inputs, x, y, 4))
+      return;
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &unused, &dcdx, &dcdy);
 
@@ -566,6 +544,9 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    vshuf_mask2 = (__m128i) vec_splats((unsigned int) 0x04050607);
 #endif
 
+   if (!lp_rast_hiz_area(task, &tri->inputs, x, y, 16))
+      return;
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &rej4);
 
@@ -0,0 +1,254 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Triangle rasterization with AVX2 / AVX-512 edge-mask evaluation.
+ *
+ * This file is compiled once per instruction set (see meson.build), with
+ * the matching -m flags, and the rasterizer picks the widest variant the
+ * CPU supports at runtime.  Only the mask builders differ from
+ * lp_rast_tri.c; the block traversal is the shared lp_rast_tri_tmp.h.
+ *
+ * Each mask is the sign of c + i * dcdx + j * dcdy over a 4x4 grid of
+ * steps, one bit per step.  With AVX2 the grid fits in two registers and
+ * with AVX-512 in one, so we can read the sign bits directly instead of
+ * saturating down to bytes like the SSE path does.
+ */
+
+#include <limits.h>
+#include "util/u_math.h"
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_rast_priv.h"
+
+#include <immintrin.h>
+
+
+#if defined(__AVX512F__)
+
+#define LP_SIMD_NAME(name) name##_avx512
+
+static inline __m512i
+cstep_16(int c, int dcdx, int dcdy)
+{
+   /* 128-bit lane n holds row n of the grid */
+   const __m512i row_idx = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1,
+                                             2, 2, 2, 2, 3, 3, 3, 3);
+   __m512i xstep = _mm512_broadcast_i32x4(
+      _mm_setr_epi32(0, dcdx, dcdx * 2, dcdx * 3));
+   __m512i ystep = _mm512_permutexvar_epi32(row_idx,
+      _mm512_castsi128_si512(_mm_setr_epi32(0, dcdy, dcdy * 2, dcdy * 3)));
+
+   return _mm512_add_epi32(_mm512_set1_epi32(c),
+                           _mm512_add_epi32(xstep, ystep));
+}
+
+static inline unsigned
+build_mask_linear_simd(int c, int dcdx, int dcdy)
+{
+   return _mm512_cmplt_epi32_mask(cstep_16(c, dcdx, dcdy),
+                                  _mm512_setzero_si512());
+}
+
+static inline void
+build_masks_simd(int c,
+                 int cdiff,
+                 int dcdx,
+                 int dcdy,
+                 unsigned *outmask,
+                 unsigned *partmask)
+{
+   __m512i cstep = cstep_16(c, dcdx, dcdy);
+   __m512i zero = _mm512_setzero_si512();
+
+   *outmask |= _mm512_cmplt_epi32_mask(cstep, zero);
+   *partmask |= _mm512_cmplt_epi32_mask(
+      _mm512_add_epi32(cstep, _mm512_set1_epi32(cdiff)), zero);
+}
+
+#elif defined(__AVX2__)
+
+#define LP_SIMD_NAME(name) name##_avx2
+
+static inline unsigned
+sign_bits_8x2(__m256i cstep01, __m256i cstep23)
+{
+   return _mm256_movemask_ps(_mm256_castsi256_ps(cstep01)) |
+          (_mm256_movemask_ps(_mm256_castsi256_ps(cstep23)) << 8);
+}
+
+/**
+ * Rows 0 and 1 of the grid go in cstep01, rows 2 and 3 in cstep23.
+ */
+static inline void
+cstep_8x2(int c, int dcdx, int dcdy, __m256i *cstep01, __m256i *cstep23)
+{
+   *cstep01 = _mm256_add_epi32(_mm256_set1_epi32(c),
+                               _mm256_setr_epi32(0, dcdx, dcdx * 2, dcdx * 3,
+                                                 dcdy, dcdy + dcdx,
+                                                 dcdy + dcdx * 2,
+                                                 dcdy + dcdx * 3));
+   *cstep23 = _mm256_add_epi32(*cstep01, _mm256_set1_epi32(dcdy * 2));
+}
+
+static inline unsigned
+build_mask_linear_simd(int c, int dcdx, int dcdy)
+{
+   __m256i cstep01, cstep23;
+
+   cstep_8x2(c, dcdx, dcdy, &cstep01, &cstep23);
+
+   return sign_bits_8x2(cstep01, cstep23);
+}
+
+static inline void
+build_masks_simd(int c,
+                 int cdiff,
+                 int dcdx,
+                 int dcdy,
+                 unsigned *outmask,
+                 unsigned *partmask)
+{
+   __m256i cstep01, cstep23;
+   __m256i cio8 = _mm256_set1_epi32(cdiff);
+
+   cstep_8x2(c, dcdx, dcdy, &cstep01, &cstep23);
+
+   *outmask |= sign_bits_8x2(cstep01, cstep23);
+   *partmask |= sign_bits_8x2(_mm256_add_epi32(cstep01, cio8),
+                              _mm256_add_epi32(cstep23, cio8));
+}
+
+#else
+#error "lp_rast_tri_simd.c must be built with -mavx2 or -mavx512f"
+#endif
+
+
+#define BUILD_MASKS(c, cdiff, dcdx, dcdy, omask, pmask) build_masks_simd((int)c, (int)cdiff, dcdx, dcdy, omask, pmask)
+#define BUILD_MASK_LINEAR(c, dcdx, dcdy) build_mask_linear_simd((int)c, dcdx, dcdy)
+
+/* The entry points are only reachable through the dispatch table. */
+#define TRI_LINKAGE static
+
+#define RASTER_64 1
+
+#define TAG(x) x##_simd_1
+#define NR_PLANES 1
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_2
+#define NR_PLANES 2
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_3
+#define NR_PLANES 3
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_4
+#define NR_PLANES 4
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_5
+#define NR_PLANES 5
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_6
+#define NR_PLANES 6
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_7
+#define NR_PLANES 7
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_8
+#define NR_PLANES 8
+#include "lp_rast_tri_tmp.h"
+
+#undef RASTER_64
+
+#define TAG(x) x##_simd_32_1
+#define NR_PLANES 1
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_32_2
+#define NR_PLANES 2
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_32_3
+#define NR_PLANES 3
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_32_4
+#define NR_PLANES 4
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_32_5
+#define NR_PLANES 5
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_32_6
+#define NR_PLANES 6
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_32_7
+#define NR_PLANES 7
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_simd_32_8
+#define NR_PLANES 8
+#include "lp_rast_tri_tmp.h"
+
+
+void
+LP_SIMD_NAME(lp_rast_tri_init)(lp_rast_cmd_func *dispatch)
+{
+   dispatch[LP_RAST_OP_TRIANGLE_1] = lp_rast_triangle_simd_1;
+   dispatch[LP_RAST_OP_TRIANGLE_2] = lp_rast_triangle_simd_2;
+   dispatch[LP_RAST_OP_TRIANGLE_3] = lp_rast_triangle_simd_3;
+   dispatch[LP_RAST_OP_TRIANGLE_4] = lp_rast_triangle_simd_4;
+   dispatch[LP_RAST_OP_TRIANGLE_5] = lp_rast_triangle_simd_5;
+   dispatch[LP_RAST_OP_TRIANGLE_6] = lp_rast_triangle_simd_6;
+   dispatch[LP_RAST_OP_TRIANGLE_7] = lp_rast_triangle_simd_7;
+   dispatch[LP_RAST_OP_TRIANGLE_8] = lp_rast_triangle_simd_8;
+   dispatch[LP_RAST_OP_TRIANGLE_32_1] = lp_rast_triangle_simd_32_1;
+   dispatch[LP_RAST_OP_TRIANGLE_32_2] = lp_rast_triangle_simd_32_2;
+   dispatch[LP_RAST_OP_TRIANGLE_32_3] = lp_rast_triangle_simd_32_3;
+   dispatch[LP_RAST_OP_TRIANGLE_32_4] = lp_rast_triangle_simd_32_4;
+   dispatch[LP_RAST_OP_TRIANGLE_32_5] = lp_rast_triangle_simd_32_5;
+   dispatch[LP_RAST_OP_TRIANGLE_32_6] = lp_rast_triangle_simd_32_6;
+   dispatch[LP_RAST_OP_TRIANGLE_32_7] = lp_rast_triangle_simd_32_7;
+   dispatch[LP_RAST_OP_TRIANGLE_32_8] = lp_rast_triangle_simd_32_8;
+}
+
+void
+LP_SIMD_NAME(lp_rast_tri_build_masks)(int c, int cdiff, int dcdx, int dcdy,
+                                      unsigned *outmask, unsigned *partmask)
+{
+   build_masks_simd(c, cdiff, dcdx, dcdy, outmask, partmask);
+}
+
+unsigned
+LP_SIMD_NAME(lp_rast_tri_build_mask_linear)(int c, int dcdx, int dcdy)
+{
+   return build_mask_linear_simd(c, dcdx, dcdy);
+}
@@ -30,6 +30,10 @@
  */
 
 
+#ifndef TRI_LINKAGE
+#define TRI_LINKAGE
+#endif
+
 
 /**
  * Prototype for a 8 plane rasterizer function.  Will codegenerate
@@ -173,7 +177,7 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
  * Scan the tile in chunks and figure out which pixels to rasterize
  * for this triangle.
  */
-void
+TRI_LINKAGE void
 TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
                       const union lp_rast_cmd_arg arg)
 {
@@ -301,6 +305,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       partial_mask &= ~(1 << i);
 
+      /* Skip blocks hidden behind what's already in the depth buffer */
+      if (task->hiz_enabled &&
+          !lp_rast_hiz_blocks(task, &tri->inputs, 0, 1 << i))
+         continue;
+
       LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
@@ -316,6 +325,10 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
+      if (task->hiz_enabled &&
+          !lp_rast_hiz_blocks(task, &tri->inputs, 1 << i, 0))
+         continue;
+
       LP_COUNT(nr_fully_covered_16);
       block_full_16(task, tri, px, py);
    }
@@ -345,6 +358,9 @@ TRI_16(struct lp_rasterizer_task *task,
    x += task->x;
    y += task->y;
 
+   if (!lp_rast_hiz_area(task, &tri->inputs, x, y, 16))
+      return;
+
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
       const int dcdy = plane[j].dcdy * 4;
@@ -410,6 +426,9 @@ TRI_4(struct lp_rasterizer_task *task,
    const int y = task->y + (mask >> 8);
    unsigned j;
 
+   if (!lp_rast_hiz_area(task, &tri->inputs, x, y, 4))
+      return;
+
    /* Iterate over partials:
     */
    {
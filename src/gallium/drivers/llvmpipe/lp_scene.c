@@ -31,9 +31,30 @@
 #include "util/u_inlines.h"
 #include "util/simple_list.h"
 #include "util/format/u_format.h"
+#include "util/u_atomic.h"
+#include "util/u_queue.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_screen.h"
+
+#if defined(PIPE_OS_LINUX)
+#include <sys/mman.h>
+#endif
+
+
+/* Bytes per chunk of data blocks, a huge page on x86.
+ */
+#define DATA_CHUNK_SIZE (2 * 1024 * 1024)
+
+struct data_chunk {
+   struct data_chunk *next;
+   struct data_block blocks[];
+};
+
+#define DATA_CHUNK_BLOCKS \
+   ((DATA_CHUNK_SIZE - sizeof(struct data_chunk)) / sizeof(struct data_block))
 
 
 #define RESOURCE_REF_SZ 32
@@ -45,6 +66,12 @@ struct resource_ref {
    struct resource_ref *next;
 };
 
+/** List of fragment shader variants still being compiled */
+struct shader_ref {
+   struct util_queue_fence *ready;
+   struct shader_ref *next;
+};
+
 
 /**
  * Create a new scene object.
@@ -58,11 +85,9 @@ lp_scene_create( struct pipe_context *pipe )
       return NULL;
 
    scene->pipe = pipe;
+   list_inithead(&scene->in_flight_link);
 
-   scene->data.head =
-      CALLOC_STRUCT(data_block);
-
-   (void) mtx_init(&scene->mutex, mtx_plain);
+   scene->data.head = &scene->data.first;
 
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
@@ -89,10 +114,23 @@ lp_scene_create( struct pipe_context *pipe )
 void
 lp_scene_destroy(struct lp_scene *scene)
 {
+   unsigned i;
+
+   for (i = 0; i < scene->num_bin_scenes; i++)
+      lp_scene_destroy(scene->bin_scenes[i]);
+
    lp_fence_reference(&scene->fence, NULL);
-   mtx_destroy(&scene->mutex);
-   assert(scene->data.head->next == NULL);
-   FREE(scene->data.head);
+   FREE(scene->bin_refs);
+   FREE(scene->bin_order);
+   FREE(scene->deques);
+   FREE(scene->band_threads);
+
+   while (scene->data.chunks) {
+      struct data_chunk *chunk = scene->data.chunks;
+      scene->data.chunks = chunk->next;
+      align_free(chunk);
+   }
+
    FREE(scene);
 }
 
@@ -118,6 +156,64 @@ lp_scene_is_empty(struct lp_scene *scene )
 }
 
 
+/**
+ * Create the scenes the binning threads put their commands in, see
+ * lp_scene::bin_scenes.
+ */
+boolean
+lp_scene_create_bin_scenes(struct lp_scene *scene, unsigned count)
+{
+   assert(count <= ARRAY_SIZE(scene->bin_scenes));
+
+   while (scene->num_bin_scenes < count) {
+      struct lp_scene *bin_scene = lp_scene_create(scene->pipe);
+      if (!bin_scene)
+         return FALSE;
+
+      scene->bin_scenes[scene->num_bin_scenes++] = bin_scene;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Append the commands of another scene's bins to this scene's bins, and
+ * empty the other scene's bins.  The other scene's data must stay around
+ * until this scene has been rasterized.
+ */
+void
+lp_scene_append_bins(struct lp_scene *scene, struct lp_scene *other)
+{
+   unsigned x, y;
+
+   assert(other->tiles_x == scene->tiles_x);
+   assert(other->tiles_y == scene->tiles_y);
+
+   for (x = 0; x < scene->tiles_x; x++) {
+      for (y = 0; y < scene->tiles_y; y++) {
+         struct cmd_bin *src = lp_scene_get_bin(other, x, y);
+         struct cmd_bin *dst = lp_scene_get_bin(scene, x, y);
+
+         if (src->num_cmds) {
+            if (dst->tail)
+               dst->tail->next = src->head;
+            else
+               dst->head = src->head;
+            dst->tail = src->tail;
+            dst->last_state = src->last_state;
+            dst->num_cmds += src->num_cmds;
+         }
+
+         src->head = NULL;
+         src->tail = NULL;
+         src->last_state = NULL;
+         src->num_cmds = 0;
+      }
+   }
+}
+
+
 /* Returns true if there has ever been a failed allocation attempt in
  * this scene.  Used in triangle emit to avoid having to check success
  * at each bin.
@@ -129,6 +225,35 @@ lp_scene_is_oom(struct lp_scene *scene)
 }
 
 
+/**
+ * Memory used by the scene, including the bin scenes of the threads which
+ * helped binning its draws, whose commands it references.
+ */
+static unsigned
+lp_scene_total_size(const struct lp_scene *scene)
+{
+   unsigned size = scene->scene_size;
+   unsigned i;
+
+   for (i = 0; i < scene->num_bin_scenes; i++)
+      size += scene->bin_scenes[i]->scene_size;
+
+   return size;
+}
+
+
+/**
+ * Whether the scene has grown past LP_SCENE_MAX_SIZE.  It is only checked
+ * between draws, so that binning never has to stop and start over in a
+ * new scene because of the size.
+ */
+boolean
+lp_scene_is_full(const struct lp_scene *scene)
+{
+   return lp_scene_total_size(scene) > LP_SCENE_MAX_SIZE;
+}
+
+
 /* Remove all commands from a bin.  Tries to reuse some of the memory
  * allocated to the bin, however.
  */
@@ -138,6 +263,7 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
    struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
 
    bin->last_state = NULL;
+   bin->num_cmds = 0;
    bin->head = bin->tail;
    if (bin->tail) {
       bin->tail->next = NULL;
@@ -157,6 +283,8 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       struct pipe_surface *cbuf = scene->fb.cbufs[i];
 
+      scene->cbufs[i].tile_clears = NULL;
+
       if (!cbuf) {
          scene->cbufs[i].stride = 0;
          scene->cbufs[i].layer_stride = 0;
@@ -175,6 +303,19 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                      cbuf->u.tex.first_layer,
                                                      LP_TEX_USAGE_READ_WRITE);
          scene->cbufs[i].format_bytes = util_format_get_blocksize(cbuf->format);
+
+         /* only level 0 is tracked, rendering to the others is rare */
+         if (cbuf->u.tex.level == 0) {
+            struct lp_tile_clear_state *tiles =
+               llvmpipe_resource_tile_clears(cbuf->texture);
+            unsigned stride = DIV_ROUND_UP(cbuf->texture->width0, TILE_SIZE) *
+                              DIV_ROUND_UP(cbuf->texture->height0, TILE_SIZE);
+            if (tiles) {
+               scene->cbufs[i].tile_clears =
+                  tiles + cbuf->u.tex.first_layer * stride;
+               scene->cbufs[i].tile_clears_layer_stride = stride;
+            }
+         }
       }
       else {
          struct llvmpipe_resource *lpr = llvmpipe_resource(cbuf->texture);
@@ -204,12 +345,13 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
 
 
 /**
- * Free all the temporary data in a scene.
+ * Unmap the framebuffer surfaces mapped by lp_scene_begin_rasterization().
+ * Called by the rasterizer once all threads are done with the scene.
  */
 void
 lp_scene_end_rasterization(struct lp_scene *scene )
 {
-   int i, j;
+   int i;
 
    /* Unmap color buffers */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
@@ -232,6 +374,54 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                               zsbuf->u.tex.first_layer);
       scene->zsbuf.map = NULL;
    }
+}
+
+
+static void
+lp_scene_release_resources(struct resource_ref *list)
+{
+   struct resource_ref *ref;
+   int i, j = 0;
+
+   for (ref = list; ref; ref = ref->next) {
+      for (i = 0; i < ref->count; i++) {
+         if (LP_DEBUG & DEBUG_SETUP)
+            debug_printf("resource %d: %p %dx%d sz %d\n",
+                         j,
+                         (void *) ref->resource[i],
+                         ref->resource[i]->width0,
+                         ref->resource[i]->height0,
+                         llvmpipe_resource_size(ref->resource[i]));
+         j++;
+         pipe_resource_reference(&ref->resource[i], NULL);
+      }
+   }
+}
+
+
+/**
+ * Free all the temporary data in a scene so that it can be reused for
+ * binning.  The scene's fence must have been signalled (or the scene
+ * never queued for rasterization) since the rasterizer threads may
+ * otherwise still be reading the bins.
+ */
+void
+lp_scene_reset(struct lp_scene *scene )
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
+   int i, j;
+
+   assert(!scene->fence || lp_fence_signalled(scene->fence));
+
+   /* No longer visible to the other contexts */
+   mtx_lock(&screen->rast_mutex);
+   list_delinit(&scene->in_flight_link);
+   mtx_unlock(&screen->rast_mutex);
+
+   LP_COUNT_MAX(peak_scene_size, lp_scene_total_size(scene));
+
+   for (i = 0; i < scene->num_bin_scenes; i++)
+      lp_scene_reset(scene->bin_scenes[i]);
 
    /* Reset all command lists:
     */
@@ -241,6 +431,7 @@ lp_scene_end_rasterization(struct lp_scene *scene )
          bin->head = NULL;
          bin->tail = NULL;
          bin->last_state = NULL;
+         bin->num_cmds = 0;
       }
    }
 
@@ -251,30 +442,14 @@ lp_scene_end_rasterization(struct lp_scene *scene )
 
    /* Decrement texture ref counts
     */
-   {
-      struct resource_ref *ref;
-      int i, j = 0;
-
-      for (ref = scene->resources; ref; ref = ref->next) {
-         for (i = 0; i < ref->count; i++) {
-            if (LP_DEBUG & DEBUG_SETUP)
-               debug_printf("resource %d: %p %dx%d sz %d\n",
-                            j,
-                            (void *) ref->resource[i],
-                            ref->resource[i]->width0,
-                            ref->resource[i]->height0,
-                            llvmpipe_resource_size(ref->resource[i]));
-            j++;
-            pipe_resource_reference(&ref->resource[i], NULL);
-         }
-      }
+   lp_scene_release_resources(scene->resources);
+   lp_scene_release_resources(scene->writeable_resources);
 
-      if (LP_DEBUG & DEBUG_SETUP)
-         debug_printf("scene %d resources, sz %d\n",
-                      j, scene->resource_reference_size);
-   }
+   if (LP_DEBUG & DEBUG_SETUP)
+      debug_printf("scene resources sz %d\n",
+                   scene->resource_reference_size);
 
-   /* Free all scene data blocks:
+   /* Put all scene data blocks but the current one on the free list:
     */
    {
       struct data_block_list *list = &scene->data;
@@ -282,7 +457,8 @@ lp_scene_end_rasterization(struct lp_scene *scene )
 
       for (block = list->head->next; block; block = tmp) {
          tmp = block->next;
-	 FREE(block);
+         block->next = list->free;
+         list->free = block;
       }
 
       list->head->next = NULL;
@@ -292,6 +468,8 @@ lp_scene_end_rasterization(struct lp_scene *scene )
    lp_fence_reference(&scene->fence, NULL);
 
    scene->resources = NULL;
+   scene->writeable_resources = NULL;
+   scene->shader_fences = NULL;
    scene->scene_size = 0;
    scene->resource_reference_size = 0;
 
@@ -327,27 +505,62 @@ lp_scene_new_cmd_block( struct lp_scene *scene,
 }
 
 
+/**
+ * Allocate a chunk of data blocks and add them to the free list.
+ * Chunks are huge page sized and aligned, so that binning many small
+ * primitives doesn't take a TLB miss every few of them.
+ */
+static boolean
+lp_scene_new_data_chunk( struct lp_scene *scene )
+{
+   struct data_block_list *list = &scene->data;
+   struct data_chunk *chunk;
+   unsigned i;
+
+   chunk = align_malloc(DATA_CHUNK_SIZE, DATA_CHUNK_SIZE);
+   if (!chunk)
+      return FALSE;
+
+#if defined(PIPE_OS_LINUX) && defined(MADV_HUGEPAGE)
+   madvise(chunk, DATA_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+
+   for (i = DATA_CHUNK_BLOCKS; i-- > 0; ) {
+      chunk->blocks[i].next = list->free;
+      list->free = &chunk->blocks[i];
+   }
+
+   chunk->next = list->chunks;
+   list->chunks = chunk;
+
+   LP_COUNT(nr_scene_chunks);
+
+   return TRUE;
+}
+
+
 struct data_block *
 lp_scene_new_data_block( struct lp_scene *scene )
 {
-   if (scene->scene_size + DATA_BLOCK_SIZE > LP_SCENE_MAX_SIZE) {
+   struct data_block_list *list = &scene->data;
+   struct data_block *block;
+
+   if (!list->free && !lp_scene_new_data_chunk(scene)) {
       if (0) debug_printf("%s: failed\n", __FUNCTION__);
       scene->alloc_failed = TRUE;
       return NULL;
    }
-   else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
-      if (!block)
-         return NULL;
-      
-      scene->scene_size += sizeof *block;
 
-      block->used = 0;
-      block->next = scene->data.head;
-      scene->data.head = block;
+   block = list->free;
+   list->free = block->next;
 
-      return block;
-   }
+   scene->scene_size += sizeof *block;
+
+   block->used = 0;
+   block->next = list->head;
+   list->head = block;
+
+   return block;
 }
 
 
@@ -374,14 +587,17 @@ lp_scene_data_size( const struct lp_scene *scene )
 boolean
 lp_scene_add_resource_reference(struct lp_scene *scene,
                                 struct pipe_resource *resource,
-                                boolean initializing_scene)
+                                boolean initializing_scene,
+                                boolean writeable)
 {
-   struct resource_ref *ref, **last = &scene->resources;
+   struct resource_ref **list = writeable ? &scene->writeable_resources :
+                                            &scene->resources;
+   struct resource_ref *ref, **last = list;
    int i;
 
    /* Look at existing resource blocks:
     */
-   for (ref = scene->resources; ref; ref = ref->next) {
+   for (ref = *list; ref; ref = ref->next) {
       last = &ref->next;
 
       /* Search for this resource:
@@ -429,86 +645,342 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
 /**
  * Does this scene have a reference to the given resource?
+ * Returns a mask of LP_REFERENCED_FOR_READ/WRITE bits.
  */
-boolean
+unsigned
 lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
    int i;
 
+   /* check the render targets */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource)
+      return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+
+   for (ref = scene->writeable_resources; ref; ref = ref->next) {
+      for (i = 0; i < ref->count; i++)
+         if (ref->resource[i] == resource)
+            return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+
    for (ref = scene->resources; ref; ref = ref->next) {
       for (i = 0; i < ref->count; i++)
          if (ref->resource[i] == resource)
-            return TRUE;
+            return LP_REFERENCED_FOR_READ;
    }
 
-   return FALSE;
+   return LP_UNREFERENCED;
 }
 
 
+/**
+ * Make the rasterizer wait for a fragment shader variant which is still
+ * being compiled before running the scene.
+ */
+boolean
+lp_scene_add_shader_fence(struct lp_scene *scene,
+                          struct util_queue_fence *ready)
+{
+   struct shader_ref *ref;
+
+   for (ref = scene->shader_fences; ref; ref = ref->next) {
+      if (ref->ready == ready)
+         return TRUE;
+   }
+
+   ref = lp_scene_alloc(scene, sizeof *ref);
+   if (!ref)
+      return FALSE;
+
+   ref->ready = ready;
+   ref->next = scene->shader_fences;
+   scene->shader_fences = ref;
+   return TRUE;
+}
+
+
+/**
+ * Wait for all the shader variants referenced by the scene to be compiled.
+ */
+void
+lp_scene_wait_shaders(struct lp_scene *scene)
+{
+   struct shader_ref *ref;
+
+   for (ref = scene->shader_fences; ref; ref = ref->next)
+      util_queue_fence_wait(ref->ready);
+}
+
+
+
+
+static int
+compare_bin_cost(const void *a, const void *b)
+{
+   const struct lp_bin_ref *ra = a, *rb = b;
+
+   /* most expensive first, raster order among bins of equal cost */
+   if (ra->cost != rb->cost)
+      return ra->cost < rb->cost ? 1 : -1;
+   return ra->order < rb->order ? -1 : ra->order > rb->order;
+}
 
 
-/** advance curr_x,y to the next bin */
 static boolean
-next_bin(struct lp_scene *scene)
+alloc_bin_iter(struct lp_scene *scene, unsigned num_bins, unsigned num_threads)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
+   if (scene->max_bins < num_bins) {
+      FREE(scene->bin_refs);
+      FREE(scene->bin_order);
+      scene->bin_refs = MALLOC(num_bins * sizeof *scene->bin_refs);
+      scene->bin_order = MALLOC(num_bins * sizeof *scene->bin_order);
+      scene->max_bins = num_bins;
+   }
+
+   if (scene->num_deques != num_threads) {
+      FREE(scene->deques);
+      FREE(scene->band_threads);
+      scene->deques = MALLOC(num_threads * sizeof *scene->deques);
+      scene->band_threads = MALLOC(num_threads * sizeof *scene->band_threads);
+      scene->num_deques = num_threads;
    }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
+
+   if (!scene->bin_refs || !scene->bin_order ||
+       !scene->deques || !scene->band_threads) {
+      FREE(scene->bin_refs);
+      FREE(scene->bin_order);
+      FREE(scene->deques);
+      FREE(scene->band_threads);
+      scene->bin_refs = NULL;
+      scene->bin_order = NULL;
+      scene->deques = NULL;
+      scene->band_threads = NULL;
+      scene->max_bins = 0;
+      scene->num_deques = 0;
       return FALSE;
    }
+
    return TRUE;
 }
 
 
+static inline unsigned
+thread_band(const struct lp_scene *scene, unsigned thread)
+{
+   return scene->thread_nodes ?
+      scene->thread_nodes[thread] % scene->num_bands : 0;
+}
+
+
+/**
+ * Prepare for iterating over the bins.
+ *
+ * The non-empty bins are sorted by their number of commands and dealt
+ * round-robin to the deques of the rasterizer threads, so that every
+ * thread starts with its most expensive bins.  The tile rows are split
+ * in one band per NUMA node and the bins of a band are only dealt to the
+ * threads of that node.
+ *
+ * \param num_threads   number of rasterizer threads, 0 if not threaded
+ * \param thread_nodes  NUMA node of each thread, may be NULL
+ * \param num_nodes     number of NUMA nodes the threads are spread over
+ */
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+lp_scene_bin_iter_begin( struct lp_scene *scene,
+                         unsigned num_threads,
+                         const unsigned *thread_nodes,
+                         unsigned num_nodes )
+{
+   unsigned band_start[LP_MAX_NUMA_NODES];
+   unsigned band_count[LP_MAX_NUMA_NODES];
+   unsigned band_next[LP_MAX_NUMA_NODES];
+   unsigned num_tiles = scene->tiles_x * scene->tiles_y;
+   unsigned num_bins = 0, next_any = 0;
+   unsigned i, x, y, t, b;
+
+   num_threads = MAX2(num_threads, 1);
+   scene->next_bin = 0;
+
+   if (!alloc_bin_iter(scene, num_tiles, num_threads))
+      return;
+
+   scene->thread_nodes = thread_nodes;
+   scene->num_bands = MAX2(MIN3(num_nodes, LP_MAX_NUMA_NODES,
+                                scene->tiles_y), 1);
+
+   for (y = 0; y < scene->tiles_y; y++) {
+      for (x = 0; x < scene->tiles_x; x++) {
+         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+         if (bin->head) {
+            struct lp_bin_ref *ref = &scene->bin_refs[num_bins++];
+            ref->cost = bin->num_cmds;
+            ref->order = y * scene->tiles_x + x;
+            ref->x = x;
+            ref->y = y;
+         }
+      }
+   }
+
+   qsort(scene->bin_refs, num_bins, sizeof *scene->bin_refs,
+         compare_bin_cost);
+
+   /* group the threads by band */
+   for (b = 0; b < scene->num_bands; b++) {
+      band_count[b] = 0;
+      band_next[b] = 0;
+   }
+   for (t = 0; t < num_threads; t++)
+      band_count[thread_band(scene, t)]++;
+   for (b = 0, i = 0; b < scene->num_bands; b++) {
+      band_start[b] = i;
+      i += band_count[b];
+      band_count[b] = 0;
+   }
+   for (t = 0; t < num_threads; t++) {
+      b = thread_band(scene, t);
+      scene->band_threads[band_start[b] + band_count[b]++] = t;
+   }
+
+   /* deal the bins, counting the bins per thread in the deques */
+   for (t = 0; t < num_threads; t++)
+      scene->deques[t] = 0;
+   for (i = 0; i < num_bins; i++) {
+      struct lp_bin_ref *ref = &scene->bin_refs[i];
+
+      b = ref->y * scene->num_bands / scene->tiles_y;
+      if (band_count[b]) {
+         t = scene->band_threads[band_start[b] + band_next[b]];
+         band_next[b] = (band_next[b] + 1) % band_count[b];
+      } else {
+         /* no thread on this node */
+         t = next_any;
+         next_any = (next_any + 1) % num_threads;
+      }
+      ref->thread = t;
+      scene->deques[t]++;
+   }
+
+   /* lay out the bins of each thread contiguously, keeping the cost order */
+   for (t = 0, i = 0; t < num_threads; t++) {
+      unsigned count = scene->deques[t];
+      scene->deques[t] = i;
+      i += count;
+   }
+   for (i = 0; i < num_bins; i++) {
+      const struct lp_bin_ref *ref = &scene->bin_refs[i];
+      scene->bin_order[scene->deques[ref->thread]++] =
+         ref->x | (ref->y << 16);
+   }
+   /* now deques[t] holds the end of the range of thread t */
+   for (t = num_threads; t-- > 0; ) {
+      uint64_t head = t ? scene->deques[t - 1] : 0;
+      uint64_t tail = scene->deques[t];
+      scene->deques[t] = (tail << 32) | head;
+   }
+}
+
+
+/**
+ * Take a bin index from the head or the tail of a deque.
+ */
+static boolean
+deque_take(uint64_t *deque, boolean from_head, unsigned *index)
 {
-   scene->curr_x = scene->curr_y = -1;
+   uint64_t old = p_atomic_read(deque);
+
+   for (;;) {
+      unsigned head = (unsigned) old;
+      unsigned tail = (unsigned) (old >> 32);
+      uint64_t new, prev;
+
+      if (head >= tail)
+         return FALSE;
+
+      if (from_head) {
+         *index = head;
+         new = old + 1;
+      } else {
+         *index = tail - 1;
+         new = old - ((uint64_t) 1 << 32);
+      }
+
+      prev = p_atomic_cmpxchg(deque, old, new);
+      if (prev == old)
+         return TRUE;
+      old = prev;
+   }
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  Once the thread's own deque is empty it
+ * steals bins from the other threads, from threads of the same NUMA node
+ * first.
+ * \param stolen  returns whether the bin came from another thread
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread,
+                        int *x, int *y, boolean *stolen )
 {
-   struct cmd_bin *bin = NULL;
+   unsigned index, pass, i;
 
-   mtx_lock(&scene->mutex);
+   *stolen = FALSE;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
+   if (!scene->deques) {
+      /* out of memory in lp_scene_bin_iter_begin, use raster order */
+      index = p_atomic_inc_return(&scene->next_bin) - 1;
+      if (index >= scene->tiles_x * scene->tiles_y)
+         return NULL;
+      *x = index % scene->tiles_x;
+      *y = index / scene->tiles_x;
+      return lp_scene_get_bin(scene, *x, *y);
    }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
+
+   assert(thread < scene->num_deques);
+
+   if (deque_take(&scene->deques[thread], TRUE, &index))
+      goto found;
+
+   for (pass = 0; pass < 2; pass++) {
+      for (i = 1; i < scene->num_deques; i++) {
+         unsigned victim = (thread + i) % scene->num_deques;
+         boolean same_band =
+            thread_band(scene, victim) == thread_band(scene, thread);
+
+         if (same_band != (pass == 0))
+            continue;
+
+         if (deque_take(&scene->deques[victim], FALSE, &index)) {
+            *stolen = TRUE;
+            goto found;
+         }
+      }
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   return NULL;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+found:
+   *x = scene->bin_order[index] & 0xffff;
+   *y = scene->bin_order[index] >> 16;
+   return lp_scene_get_bin(scene, *x, *y);
 }
 
 
+/**
+ * \param damage  if not NULL, the part of the framebuffer (in pixels) which
+ *                needs rendering, commands for the whole framebuffer are
+ *                only binned to the tiles it covers.
+ */
 void lp_scene_begin_binning(struct lp_scene *scene,
-                            struct pipe_framebuffer_state *fb)
+                            struct pipe_framebuffer_state *fb,
+                            const struct u_rect *damage)
 {
    int i;
    unsigned max_layer = ~0;
@@ -522,6 +994,19 @@ void lp_scene_begin_binning(struct lp_scene *scene,
    assert(scene->tiles_x <= TILES_X);
    assert(scene->tiles_y <= TILES_Y);
 
+   if (damage) {
+      scene->bin_tiles.x0 = damage->x0 / TILE_SIZE;
+      scene->bin_tiles.y0 = damage->y0 / TILE_SIZE;
+      scene->bin_tiles.x1 = damage->x1 / TILE_SIZE;
+      scene->bin_tiles.y1 = damage->y1 / TILE_SIZE;
+   }
+   else {
+      scene->bin_tiles.x0 = 0;
+      scene->bin_tiles.y0 = 0;
+      scene->bin_tiles.x1 = scene->tiles_x - 1;
+      scene->bin_tiles.y1 = scene->tiles_y - 1;
+   }
+
    /*
     * Determine how many layers the fb has (used for clamping layer value).
     * OpenGL (but not d3d10) permits different amount of layers per rt, however
@@ -545,6 +1030,9 @@ void lp_scene_begin_binning(struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+
+   for (i = 0; i < scene->num_bin_scenes; i++)
+      lp_scene_begin_binning(scene->bin_scenes[i], fb, damage);
 }
 
 
@@ -36,8 +36,11 @@
 #define LP_SCENE_H
 
 #include "os/os_thread.h"
+#include "util/list.h"
+#include "util/u_rect.h"
 #include "lp_rast.h"
 #include "lp_debug.h"
+#include "lp_limits.h"
 
 struct lp_scene_queue;
 struct lp_rast_state;
@@ -58,9 +61,12 @@ struct lp_rast_state;
  */
 #define DATA_BLOCK_SIZE (64 * 1024)
 
-/* Scene temporary storage is clamped to this size:
+/* Scenes grow as needed while binning.  A scene which has grown past
+ * this size is flushed before the next draw is binned, which bounds how
+ * much work queues up ahead of the rasterizer, and how much memory the
+ * scene keeps for reuse:
  */
-#define LP_SCENE_MAX_SIZE (9*1024*1024)
+#define LP_SCENE_MAX_SIZE (36*1024*1024)
 
 /* The maximum amount of texture storage referenced by a scene is
  * clamped to this size:
@@ -97,9 +103,23 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;       /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   unsigned num_cmds;   /**< estimate of the rasterization cost */
+};
+
+
+/**
+ * A non-empty bin, for ordering the bins by cost before rasterization.
+ */
+struct lp_bin_ref {
+   unsigned cost;
+   unsigned order;      /**< position in raster order */
+   unsigned thread;     /**< thread the bin is assigned to */
+   uint16_t x, y;
 };
    
 
+struct data_chunk;
+
 /**
  * This stores bulk data which is used for all memory allocations
  * within a scene.
@@ -109,13 +129,21 @@ struct cmd_bin {
  *
  * Include the first block of data statically to ensure we can always
  * initiate a scene without relying on malloc succeeding.
+ *
+ * The other blocks are carved out of larger chunks, which the scene keeps
+ * until it is destroyed.  Blocks released by lp_scene_reset() go to the
+ * free list and are reused by the following scenes.
  */
 struct data_block_list {
    struct data_block first;
    struct data_block *head;
+   struct data_block *free;
+   struct data_chunk *chunks;
 };
 
 struct resource_ref;
+struct shader_ref;
+struct util_queue_fence;
 
 /**
  * All bins and bin data are contained here.
@@ -129,6 +157,9 @@ struct lp_scene {
    struct pipe_context *pipe;
    struct lp_fence *fence;
 
+   /** Link in llvmpipe_screen::scenes_in_flight while queued */
+   struct list_head in_flight_link;
+
    /* The queries still active at end of scene */
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned num_active_queries;
@@ -143,6 +174,12 @@ struct lp_scene {
       unsigned stride;
       unsigned layer_stride;
       unsigned format_bytes;
+      /**
+       * Clear state of the tiles of the first layer, NULL if untracked,
+       * and the number of states per layer.
+       */
+      struct lp_tile_clear_state *tile_clears;
+      unsigned tile_clears_layer_stride;
    } zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
 
    /* The amount of layers in the fb (minimum of all attachments) */
@@ -154,6 +191,12 @@ struct lp_scene {
    /** list of resources referenced by the scene commands */
    struct resource_ref *resources;
 
+   /** list of resources written by the scene commands (SSBOs, images) */
+   struct resource_ref *writeable_resources;
+
+   /** fences of the fragment shaders still compiling, see LP_ASYNC_COMPILE */
+   struct shader_ref *shader_fences;
+
    /** Total memory used by the scene (in bytes).  This sums all the
     * data blocks and counts all bins, state, resource references and
     * other random allocations within the scene.
@@ -172,8 +215,35 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /**
+    * Tiles which commands binned everywhere go to, inclusive.  All of them
+    * unless rendering is limited to the damage region of the color buffer.
+    */
+   struct u_rect bin_tiles;
+
+   /**
+    * For iterating over bins, see lp_scene_bin_iter_begin().
+    * Each rasterizer thread has a deque of bins, stored as a range of
+    * bin_order packed as (tail << 32) | head.  The owner takes bins from
+    * the head, idle threads steal from the tail.
+    */
+   struct lp_bin_ref *bin_refs;
+   uint32_t *bin_order;          /**< x | y << 16, grouped by thread */
+   unsigned max_bins;
+   uint64_t *deques;
+   unsigned *band_threads;       /**< thread indices grouped by band */
+   unsigned num_deques;
+   const unsigned *thread_nodes;
+   unsigned num_bands;
+   unsigned next_bin;            /**< for raster order when deques is NULL */
+
+   /**
+    * Private bins and data of the threads binning a draw in parallel.
+    * Their commands are appended to this scene's bins, so they live and
+    * are reset along with this scene.
+    */
+   struct lp_scene *bin_scenes[LP_MAX_BIN_THREADS + 1];
+   unsigned num_bin_scenes;
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -187,6 +257,11 @@ void lp_scene_destroy(struct lp_scene *scene);
 
 boolean lp_scene_is_empty(struct lp_scene *scene );
 boolean lp_scene_is_oom(struct lp_scene *scene );
+boolean lp_scene_is_full(const struct lp_scene *scene);
+
+boolean lp_scene_create_bin_scenes(struct lp_scene *scene, unsigned count);
+
+void lp_scene_append_bins(struct lp_scene *scene, struct lp_scene *other);
 
 
 struct data_block *lp_scene_new_data_block( struct lp_scene *scene );
@@ -196,10 +271,16 @@ struct cmd_block *lp_scene_new_cmd_block( struct lp_scene *scene,
 
 boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
-                                        boolean initializing_scene);
+                                        boolean initializing_scene,
+                                        boolean writeable);
+
+unsigned lp_scene_is_resource_referenced(const struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+boolean lp_scene_add_shader_fence(struct lp_scene *scene,
+                                  struct util_queue_fence *ready);
+
+void lp_scene_wait_shaders(struct lp_scene *scene);
 
 
 /**
@@ -322,6 +403,7 @@ lp_scene_bin_command( struct lp_scene *scene,
       tail->arg[i] = arg;
       tail->count++;
    }
+   bin->num_cmds++;
    
    return TRUE;
 }
@@ -358,9 +440,9 @@ lp_scene_bin_everywhere( struct lp_scene *scene,
 			 unsigned cmd,
 			 const union lp_rast_cmd_arg arg )
 {
-   unsigned i, j;
-   for (i = 0; i < scene->tiles_x; i++) {
-      for (j = 0; j < scene->tiles_y; j++) {
+   int i, j;
+   for (i = scene->bin_tiles.x0; i <= scene->bin_tiles.x1; i++) {
+      for (j = scene->bin_tiles.y0; j <= scene->bin_tiles.y1; j++) {
          if (!lp_scene_bin_command( scene, i, j, cmd, arg ))
             return FALSE;
       }
@@ -378,10 +460,14 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene,
+                         unsigned num_threads,
+                         const unsigned *thread_nodes,
+                         unsigned num_nodes );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned thread,
+                        int *x, int *y, boolean *stolen );
 
 
 
@@ -389,7 +475,8 @@ lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
  */
 void
 lp_scene_begin_binning(struct lp_scene *scene,
-                       struct pipe_framebuffer_state *fb);
+                       struct pipe_framebuffer_state *fb,
+                       const struct u_rect *damage);
 
 void
 lp_scene_end_binning(struct lp_scene *scene);
@@ -403,6 +490,9 @@ lp_scene_begin_rasterization(struct lp_scene *scene);
 void
 lp_scene_end_rasterization(struct lp_scene *scene);
 
+void
+lp_scene_reset(struct lp_scene *scene);
+
 
 
 
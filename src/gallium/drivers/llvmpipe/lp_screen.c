@@ -33,11 +33,19 @@
 #include "util/u_screen.h"
 #include "util/u_string.h"
 #include "util/format/u_format_s3tc.h"
+#include "util/disk_cache.h"
+#include "util/u_atomic.h"
+#include "util/hash_table.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_nir.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_format.h"
+
+#include <llvm-c/ExecutionEngine.h>
 
 #include "util/os_misc.h"
 #include "util/os_time.h"
@@ -48,6 +56,7 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_public.h"
+#include "lp_query.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
 #include "lp_cs_tpool.h"
@@ -75,6 +84,7 @@ static const struct debug_named_value lp_debug_flags[] = {
    { "cs", DEBUG_CS, NULL },
    { "tgsi_ir", DEBUG_TGSI_IR, NULL },
    { "cl", DEBUG_CL, NULL },
+   { "cache_stats", DEBUG_CACHE_STATS, NULL },
    DEBUG_NAMED_VALUE_END
 };
 #endif
@@ -89,6 +99,8 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
+   { "no_fastclear",   PERF_NO_FASTCLEAR, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -226,7 +238,8 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_COMPUTE:
       return GALLIVM_HAVE_CORO;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
-      return 1;
+      /* u_threaded_context can't take user vertex buffers */
+      return !llvmpipe_screen(screen)->threaded;
    case PIPE_CAP_VERTEX_BUFFER_OFFSET_4BYTE_ALIGNED_ONLY:
    case PIPE_CAP_VERTEX_BUFFER_STRIDE_4BYTE_ALIGNED_ONLY:
    case PIPE_CAP_VERTEX_ELEMENT_SRC_OFFSET_4BYTE_ALIGNED_ONLY:
@@ -757,6 +770,35 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
 
 
 
+/**
+ * Wait for all the scenes queued to the rasterizer so far, by any context.
+ * The rasterizer runs the scenes in order, so the last one is enough.
+ *
+ * Returns FALSE if it would have blocked, but do_not_block was set.
+ */
+boolean
+llvmpipe_screen_wait_rasterizer(struct llvmpipe_screen *screen,
+                                boolean do_not_block)
+{
+   struct lp_fence *fence = NULL;
+   boolean done = TRUE;
+
+   mtx_lock(&screen->rast_mutex);
+   lp_fence_reference(&fence, screen->last_fence);
+   mtx_unlock(&screen->rast_mutex);
+
+   if (fence) {
+      if (do_not_block)
+         done = lp_fence_signalled(fence);
+      else
+         lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
+
+   return done;
+}
+
+
 static void
 llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
                            struct pipe_resource *resource,
@@ -768,6 +810,12 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
 
+   /* Scenes are rasterized asynchronously, so wait until everything
+    * queued so far (which includes any rendering to this display target)
+    * has landed before presenting it.
+    */
+   llvmpipe_screen_wait_rasterizer(screen, FALSE);
+
    assert(texture->dt);
    if (texture->dt)
       winsys->displaytarget_display(winsys, texture->dt, context_private, sub_box);
@@ -785,6 +833,24 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_fence_reference(&screen->last_fence, NULL);
+
+   if (LP_DEBUG & DEBUG_CACHE_STATS)
+      debug_printf("disk shader cache: hits = %u, misses = %u\n",
+                   screen->num_disk_shader_cache_hits,
+                   screen->num_disk_shader_cache_misses);
+   disk_cache_destroy(screen->disk_shader_cache);
+
+   if (LP_DEBUG & DEBUG_CACHE_STATS)
+      debug_printf("shared fs code cache: hits = %u, misses = %u\n",
+                   screen->num_fs_code_cache_hits,
+                   screen->num_fs_code_cache_misses);
+   /* The contexts are gone, and their variants with them */
+   assert(!screen->fs_code_cache ||
+          !_mesa_hash_table_num_entries(screen->fs_code_cache));
+   _mesa_hash_table_destroy(screen->fs_code_cache, NULL);
+   mtx_destroy(&screen->fs_code_mutex);
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
@@ -792,8 +858,8 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
 
    glsl_type_singleton_decref();
 
+   slab_destroy_parent(&screen->pool_transfers);
    mtx_destroy(&screen->rast_mutex);
-   mtx_destroy(&screen->cs_mutex);
    FREE(screen);
 }
 
@@ -844,6 +910,111 @@ llvmpipe_get_timestamp(struct pipe_screen *_screen)
    return os_time_get_nano();
 }
 
+static void
+lp_disk_cache_create(struct llvmpipe_screen *screen)
+{
+   struct mesa_sha1 ctx;
+   unsigned char sha1[20];
+   char cache_id[20 * 2 + 1];
+
+   /* Don't use the cache if the IR or assembly is being dumped. */
+   if (gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM |
+                        GALLIVM_DEBUG_DUMP_BC))
+      return;
+
+   _mesa_sha1_init(&ctx);
+
+   if (!disk_cache_get_function_identifier(lp_disk_cache_create, &ctx) ||
+       !disk_cache_get_function_identifier(LLVMLinkInMCJIT, &ctx))
+      return;
+
+   /* The object code is generated for the host CPU and depends on the
+    * gallivm code generation options, including the texture block cache
+    * size baked into the sampling code.
+    */
+   _mesa_sha1_update(&ctx, MESA_LLVM_VERSION_STRING,
+                     strlen(MESA_LLVM_VERSION_STRING));
+   _mesa_sha1_update(&ctx, &util_cpu_caps, sizeof(util_cpu_caps));
+   _mesa_sha1_update(&ctx, &lp_native_vector_width,
+                     sizeof(lp_native_vector_width));
+   _mesa_sha1_update(&ctx, &gallivm_perf, sizeof(gallivm_perf));
+   _mesa_sha1_update(&ctx, &lp_build_format_cache_size,
+                     sizeof(lp_build_format_cache_size));
+   _mesa_sha1_final(&ctx, sha1);
+   disk_cache_format_hex_id(cache_id, sha1, 20 * 2);
+
+   screen->disk_shader_cache = disk_cache_create("llvmpipe", cache_id, 0);
+}
+
+static uint32_t
+lp_sha1_hash(const void *key)
+{
+   return _mesa_hash_data(key, 20);
+}
+
+static bool
+lp_sha1_equal(const void *a, const void *b)
+{
+   return memcmp(a, b, 20) == 0;
+}
+
+static struct disk_cache *
+lp_get_disk_shader_cache(struct pipe_screen *_screen)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+
+   return screen->disk_shader_cache;
+}
+
+/**
+ * Look up the object code of a variant in the disk cache.
+ * On a hit, cache->data is malloc'ed and must be freed by the caller.
+ */
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+   size_t binary_size;
+   uint8_t *buffer;
+
+   if (!screen->disk_shader_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
+                          20, sha1);
+
+   buffer = disk_cache_get(screen->disk_shader_cache, sha1, &binary_size);
+   if (!buffer) {
+      cache->data_size = 0;
+      p_atomic_inc(&screen->num_disk_shader_cache_misses);
+      return;
+   }
+   cache->data_size = binary_size;
+   cache->data = buffer;
+   p_atomic_inc(&screen->num_disk_shader_cache_hits);
+}
+
+/**
+ * Store the object code produced for a variant in the disk cache.
+ */
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            unsigned char ir_sha1_cache_key[20])
+{
+   unsigned char sha1[CACHE_KEY_SIZE];
+
+   if (!screen->disk_shader_cache || !cache->data_size || cache->dont_cache)
+      return;
+
+   disk_cache_compute_key(screen->disk_shader_cache, ir_sha1_cache_key,
+                          20, sha1);
+   disk_cache_put(screen->disk_shader_cache, sha1, cache->data,
+                  cache->data_size, NULL);
+}
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -892,11 +1063,16 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_disk_shader_cache = lp_get_disk_shader_cache;
 
    screen->base.finalize_nir = llvmpipe_finalize_nir;
    llvmpipe_init_screen_resource_funcs(&screen->base);
+   llvmpipe_init_screen_query_funcs(&screen->base);
 
    screen->use_tgsi = (LP_DEBUG & DEBUG_TGSI_IR);
+   screen->tiled_textures = debug_get_bool_option("LP_TILED_TEXTURES", FALSE);
+   screen->threaded = debug_get_bool_option("GALLIUM_THREAD",
+                                            util_cpu_caps.nr_cpus > 1);
    screen->num_threads = util_cpu_caps.nr_cpus > 1 ? util_cpu_caps.nr_cpus : 0;
 #ifdef EMBEDDED_DEVICE
    screen->num_threads = 0;
@@ -911,6 +1087,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
       return NULL;
    }
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
+   list_inithead(&screen->scenes_in_flight);
 
    screen->cs_tpool = lp_cs_tpool_create(screen->num_threads);
    if (!screen->cs_tpool) {
@@ -919,7 +1096,18 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
       FREE(screen);
       return NULL;
    }
-   (void) mtx_init(&screen->cs_mutex, mtx_plain);
+
+   slab_create_parent(&screen->pool_transfers,
+                      sizeof(struct llvmpipe_transfer), 64);
+
+   lp_disk_cache_create(screen);
+
+   (void) mtx_init(&screen->fs_code_mutex, mtx_plain);
+   /* Like the disk cache, don't share code that is being dumped. */
+   if (!(gallivm_debug & (GALLIVM_DEBUG_IR | GALLIVM_DEBUG_ASM |
+                          GALLIVM_DEBUG_DUMP_BC)))
+      screen->fs_code_cache = _mesa_hash_table_create(NULL, lp_sha1_hash,
+                                                      lp_sha1_equal);
 
    return &screen->base;
 }
@@ -37,11 +37,17 @@
 #include "pipe/p_screen.h"
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
+#include "util/list.h"
+#include "util/slab.h"
 #include "gallivm/lp_bld.h"
 
 
 struct sw_winsys;
 struct lp_cs_tpool;
+struct lp_fence;
+struct lp_cached_code;
+struct disk_cache;
+struct hash_table;
 
 struct llvmpipe_screen
 {
@@ -58,12 +64,52 @@ struct llvmpipe_screen
    struct lp_rasterizer *rast;
    mtx_t rast_mutex;
 
+   /** Fence of the last scene queued to the rasterizer, under rast_mutex */
+   struct lp_fence *last_fence;
+
+   /** Scenes of all the contexts queued to the rasterizer and not
+    * recycled yet, lp_scene::in_flight_link, under rast_mutex.
+    */
+   struct list_head scenes_in_flight;
+
    struct lp_cs_tpool *cs_tpool;
-   mtx_t cs_mutex;
+
+   /** Contexts are wrapped in a threaded context (GALLIUM_THREAD) */
+   bool threaded;
+
+   /** Transfers of the threaded contexts wrapping ours */
+   struct slab_parent_pool pool_transfers;
 
    bool use_tgsi;
+
+   /** Store sampled textures in tiles (LP_TILED_TEXTURES) */
+   bool tiled_textures;
+
+   /** Persistent cache of the object code of the JIT'ed variants */
+   struct disk_cache *disk_shader_cache;
+   unsigned num_disk_shader_cache_hits;
+   unsigned num_disk_shader_cache_misses;
+
+   /** Fragment shader code shared by the contexts, lp_fs_variant_code */
+   struct hash_table *fs_code_cache;
+   mtx_t fs_code_mutex;
+   unsigned num_fs_code_cache_hits;
+   unsigned num_fs_code_cache_misses;
 };
 
+void
+lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
+                          struct lp_cached_code *cache,
+                          unsigned char ir_sha1_cache_key[20]);
+
+void
+lp_disk_cache_insert_shader(struct llvmpipe_screen *screen,
+                            struct lp_cached_code *cache,
+                            unsigned char ir_sha1_cache_key[20]);
+
+boolean
+llvmpipe_screen_wait_rasterizer(struct llvmpipe_screen *screen,
+                                boolean do_not_block);
 
 
 
@@ -48,6 +48,7 @@
 #include "lp_texture.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_setup_context.h"
@@ -64,6 +65,39 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
+/**
+ * Pick up the damage region of the window system buffer being rendered to,
+ * rendering outside of it is pointless as it won't be presented.  Only the
+ * simple single color buffer case is handled.
+ */
+static void
+lp_setup_update_damage(struct lp_setup_context *setup)
+{
+   const struct pipe_surface *cbuf = setup->fb.cbufs[0];
+   struct u_rect damage;
+   boolean has_damage = FALSE;
+
+   if (setup->fb.nr_cbufs == 1 && cbuf &&
+       llvmpipe_resource_is_texture(cbuf->texture) &&
+       cbuf->u.tex.level == 0 &&
+       cbuf->u.tex.first_layer == 0 && cbuf->u.tex.last_layer == 0) {
+      has_damage = llvmpipe_resource_get_damage(cbuf->texture, &damage);
+      if (has_damage)
+         has_damage = u_rect_test_intersection(&damage, &setup->framebuffer);
+      if (has_damage)
+         u_rect_find_intersection(&setup->framebuffer, &damage);
+   }
+
+   if (has_damage != setup->has_damage ||
+       (has_damage && memcmp(&damage, &setup->damage, sizeof damage))) {
+      setup->has_damage = has_damage;
+      if (has_damage)
+         setup->damage = damage;
+      setup->dirty |= LP_SETUP_NEW_SCISSOR;
+   }
+}
+
+
 static void
 lp_setup_get_empty_scene(struct lp_setup_context *setup)
 {
@@ -82,7 +116,15 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
       lp_fence_wait(setup->scene->fence);
    }
 
-   lp_scene_begin_binning(setup->scene, &setup->fb);
+   /* The scene may still hold the bins and resource references from the
+    * last time it was rasterized, release them now.
+    */
+   lp_scene_reset(setup->scene);
+
+   lp_setup_update_damage(setup);
+
+   lp_scene_begin_binning(setup->scene, &setup->fb,
+                          setup->has_damage ? &setup->damage : NULL);
 
 }
 
@@ -165,23 +207,17 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    if (setup->last_fence)
       setup->last_fence->issued = TRUE;
 
-   mtx_lock(&screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* Don't wait for the rasterizer here: binning of the next scene
+    * proceeds while this one is rasterized.  Anything which needs the
+    * results waits on the scene fence (see lp_setup_get_empty_scene(),
+    * llvmpipe_flush_resource() and llvmpipe_flush_frontbuffer()).
     */
+   mtx_lock(&screen->rast_mutex);
+   list_addtail(&scene->in_flight_link, &screen->scenes_in_flight);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
+   lp_fence_reference(&screen->last_fence, scene->fence);
    mtx_unlock(&screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -342,7 +378,7 @@ set_scene_state( struct lp_setup_context *setup,
 
 fail:
    if (setup->scene) {
-      lp_scene_end_rasterization(setup->scene);
+      lp_scene_reset(setup->scene);
       setup->scene = NULL;
    }
 
@@ -1043,12 +1079,16 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 /**
  * Is the given texture referenced by any scene?
  * Note: we have to check all scenes including any scenes currently
- * being rendered and the current scene being built.
+ * being rendered and the current scene being built, as well as the
+ * scenes other contexts sharing the texture still have in flight.
  */
 unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+   const struct lp_scene *scene;
+   unsigned referenced = LP_UNREFERENCED;
    unsigned i;
 
    /* check the render targets */
@@ -1060,13 +1100,35 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
+   /* check resources referenced by the scenes, including scenes queued
+    * for or currently being rasterized.  Scenes whose fence has been
+    * signalled are done, even if not recycled yet.
+    */
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+      scene = setup->scenes[i];
+
+      if (scene->fence && lp_fence_signalled(scene->fence))
+         continue;
+
+      referenced = lp_scene_is_resource_referenced(scene, texture);
+      if (referenced)
+         return referenced;
    }
 
+   mtx_lock(&screen->rast_mutex);
+   LIST_FOR_EACH_ENTRY(scene, &screen->scenes_in_flight, in_flight_link) {
+      if (scene->fence && lp_fence_signalled(scene->fence))
+         continue;
+
+      referenced = lp_scene_is_resource_referenced(scene, texture);
+      if (referenced)
+         break;
+   }
+   mtx_unlock(&screen->rast_mutex);
+
+   if (referenced)
+      return referenced;
+
    for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
       if (setup->ssbos[i].current.buffer == texture)
          return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
@@ -1271,7 +1333,45 @@ try_update_scene_state( struct lp_setup_context *setup )
             if (setup->fs.current_tex[i]) {
                if (!lp_scene_add_resource_reference(scene,
                                                     setup->fs.current_tex[i],
-                                                    new_scene)) {
+                                                    new_scene, FALSE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         /* The variant may still be compiling on another thread, in
+          * which case the scene has to wait for it before rasterizing.
+          */
+         if (setup->fs.current.variant &&
+             !util_queue_fence_is_signalled(&setup->fs.current.variant->ready)) {
+            if (!lp_scene_add_shader_fence(scene,
+                                           &setup->fs.current.variant->ready)) {
+               assert(!new_scene);
+               return FALSE;
+            }
+         }
+
+         /* Shader buffers and images may be written by the fragment
+          * shader, so the scene must keep them referenced for write
+          * until it has been rasterized.
+          */
+         for (i = 0; i < ARRAY_SIZE(setup->ssbos); i++) {
+            if (setup->ssbos[i].current.buffer) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->ssbos[i].current.buffer,
+                                                    new_scene, TRUE)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+
+         for (i = 0; i < ARRAY_SIZE(setup->images); i++) {
+            if (setup->images[i].current.resource) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->images[i].current.resource,
+                                                    new_scene, TRUE)) {
                   assert(!new_scene);
                   return FALSE;
                }
@@ -1283,7 +1383,8 @@ try_update_scene_state( struct lp_setup_context *setup )
    if (setup->dirty & LP_SETUP_NEW_SCISSOR) {
       unsigned i;
       for (i = 0; i < PIPE_MAX_VIEWPORTS; ++i) {
-         setup->draw_regions[i] = setup->framebuffer;
+         setup->draw_regions[i] = setup->has_damage ? setup->damage
+                                                    : setup->framebuffer;
          if (setup->scissor_test) {
             u_rect_possible_intersection(&setup->scissors[i],
                                          &setup->draw_regions[i]);
@@ -1337,6 +1438,16 @@ lp_setup_update_state( struct lp_setup_context *setup,
 		    setup->setup.variant->key.size) == 0);
    }
 
+   /* Start over with a new scene between draws, rather than while
+    * binning, when it has grown large.
+    */
+   if (update_scene && setup->state == SETUP_ACTIVE &&
+       !setup->bin_thread && lp_scene_is_full(setup->scene)) {
+      LP_COUNT(nr_scene_full_flushes);
+      if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
+         return FALSE;
+   }
+
    if (update_scene && setup->state != SETUP_ACTIVE) {
       if (!set_scene_state( setup, SETUP_ACTIVE, __FUNCTION__ ))
          return FALSE;
@@ -1396,6 +1507,8 @@ lp_setup_destroy( struct lp_setup_context *setup )
       pipe_resource_reference(&setup->ssbos[i].current.buffer, NULL);
    }
 
+   lp_setup_destroy_bin_threads(setup);
+
    /* free the scenes in the 'empty' queue */
    for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
       struct lp_scene *scene = setup->scenes[i];
@@ -1403,6 +1516,7 @@ lp_setup_destroy( struct lp_setup_context *setup )
       if (scene->fence)
          lp_fence_wait(scene->fence);
 
+      lp_scene_reset(scene);
       lp_scene_destroy(scene);
    }
 
@@ -1454,6 +1568,8 @@ lp_setup_create( struct pipe_context *pipe,
       }
    }
 
+   lp_setup_init_bin_threads(setup);
+
    setup->triangle = first_triangle;
    setup->line     = first_line;
    setup->point    = first_point;
@@ -1605,8 +1721,18 @@ lp_setup_flush_and_restart(struct lp_setup_context *setup)
 {
    if (0) debug_printf("%s\n", __FUNCTION__);
 
+   /* A binning thread can't flush the scene.  The primitives which didn't
+    * fit are binned again by the app thread, see lp_setup_vbuf.c.
+    */
+   if (setup->bin_thread) {
+      setup->bin_failed = TRUE;
+      return FALSE;
+   }
+
    assert(setup->state == SETUP_ACTIVE);
 
+   LP_COUNT(nr_scene_oom_flushes);
+
    if (!set_scene_state(setup, SETUP_FLUSHED, __FUNCTION__))
       return FALSE;
    
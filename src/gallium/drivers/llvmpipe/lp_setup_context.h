@@ -43,6 +43,7 @@
 #include "draw/draw_vbuf.h"
 #include "util/u_rect.h"
 #include "util/u_pack_color.h"
+#include "util/u_queue.h"
 
 #define LP_SETUP_NEW_FS          0x01
 #define LP_SETUP_NEW_CONSTANTS   0x02
@@ -53,11 +54,13 @@
 #define LP_SETUP_NEW_IMAGES      0x40
 
 struct lp_setup_variant;
+struct lp_setup_bin_task;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
+/** Max number of scenes per context.  While one scene is rasterized the
+ * next ones can be binned, up to this many in flight.
+ */
+#define MAX_SCENES 4
 
 
 
@@ -114,7 +117,9 @@ struct lp_setup_context
    struct pipe_framebuffer_state fb;
    struct u_rect framebuffer;
    struct u_rect scissors[PIPE_MAX_VIEWPORTS];
-   struct u_rect draw_regions[PIPE_MAX_VIEWPORTS];   /* intersection of fb & scissor */
+   struct u_rect draw_regions[PIPE_MAX_VIEWPORTS];   /* intersection of fb & scissor & damage */
+   struct u_rect damage;            /**< damage region of the color buffer */
+   boolean has_damage;
    struct lp_jit_viewport viewports[PIPE_MAX_VIEWPORTS];
 
    struct {
@@ -165,6 +170,14 @@ struct lp_setup_context
 
    unsigned dirty;   /**< bitmask of LP_SETUP_NEW_x bits */
 
+   /** Threads binning large draws in parallel, see LP_BIN_THREADS */
+   unsigned num_bin_threads;
+   struct util_queue bin_queue;
+   struct lp_setup_bin_task *bin_tasks;   /**< num_bin_threads + 1 */
+
+   boolean bin_thread;   /**< this is a binning thread's copy of the context */
+   boolean bin_failed;   /**< the binning thread's scene is full */
+
    void (*point)( struct lp_setup_context *,
                   const float (*v0)[4]);
 
@@ -199,6 +212,10 @@ void lp_setup_choose_point( struct lp_setup_context *setup );
 
 void lp_setup_init_vbuf(struct lp_setup_context *setup);
 
+void lp_setup_init_bin_threads(struct lp_setup_context *setup);
+
+void lp_setup_destroy_bin_threads(struct lp_setup_context *setup);
+
 boolean lp_setup_update_state( struct lp_setup_context *setup,
                             boolean update_scene);
 
@@ -40,12 +40,17 @@
 #include "lp_context.h"
 #include "draw/draw_vbuf.h"
 #include "draw/draw_vertex.h"
+#include "util/u_debug.h"
 #include "util/u_memory.h"
+#include "util/u_prim.h"
 
 
 #define LP_MAX_VBUF_INDEXES 1024
 #define LP_MAX_VBUF_SIZE    4096
 
+/** Smaller draws are binned by the app thread only */
+#define LP_MIN_PARALLEL_BIN_PRIMS 128
+
   
 
 /** cast wrapper */
@@ -130,65 +135,131 @@ static inline const_float4_ptr get_vert( const void *vertex_buffer,
 }
 
 /**
- * draw elements / indexed primitives
+ * The primitives of a draw which a thread bins.  Primitives are numbered
+ * in the order the draw emits them, which for quads is two triangles per
+ * quad.
+ */
+struct lp_prim_range {
+   unsigned next;     /**< number of the next primitive emitted */
+   unsigned first;    /**< first primitive to bin */
+   unsigned last;     /**< one past the last primitive to bin */
+   unsigned failed;   /**< first primitive which didn't fit, or ~0 */
+};
+
+static inline boolean
+prim_in_range(struct lp_prim_range *range)
+{
+   unsigned prim = range->next++;
+   return prim >= range->first && prim < range->last;
+}
+
+/**
+ * Stop binning once a binning thread's scene is full, the remaining
+ * primitives will be binned by the app thread.
+ */
+static inline void
+check_prim_failed(struct lp_setup_context *setup,
+                  struct lp_prim_range *range)
+{
+   if (unlikely(setup->bin_failed)) {
+      range->failed = range->next - 1;
+      range->last = range->failed;
+      setup->bin_failed = FALSE;
+   }
+}
+
+static inline void
+bin_point(struct lp_setup_context *setup,
+          struct lp_prim_range *range,
+          const float (*v0)[4])
+{
+   if (prim_in_range(range)) {
+      setup->point(setup, v0);
+      check_prim_failed(setup, range);
+   }
+}
+
+static inline void
+bin_line(struct lp_setup_context *setup,
+         struct lp_prim_range *range,
+         const float (*v0)[4],
+         const float (*v1)[4])
+{
+   if (prim_in_range(range)) {
+      setup->line(setup, v0, v1);
+      check_prim_failed(setup, range);
+   }
+}
+
+static inline void
+bin_triangle(struct lp_setup_context *setup,
+             struct lp_prim_range *range,
+             const float (*v0)[4],
+             const float (*v1)[4],
+             const float (*v2)[4])
+{
+   if (prim_in_range(range)) {
+      setup->triangle(setup, v0, v1, v2);
+      check_prim_failed(setup, range);
+   }
+}
+
+/**
+ * Bin the primitives of an indexed draw which are in the given range.
  */
 static void
-lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
+draw_elements_range(struct lp_setup_context *setup,
+                    struct lp_prim_range *range,
+                    const ushort *indices, uint nr)
 {
-   struct lp_setup_context *setup = lp_setup_context(vbr);
    const unsigned stride = setup->vertex_info->size * sizeof(float);
    const void *vertex_buffer = setup->vertex_buffer;
    const boolean flatshade_first = setup->flatshade_first;
    unsigned i;
 
-   assert(setup->setup.variant);
-
-   if (!lp_setup_update_state(setup, TRUE))
-      return;
-
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
-         setup->point( setup,
-                       get_vert(vertex_buffer, indices[i-0], stride) );
+         bin_point( setup, range,
+                    get_vert(vertex_buffer, indices[i-0], stride) );
       }
       break;
 
    case PIPE_PRIM_LINES:
       for (i = 1; i < nr; i += 2) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, indices[i-1], stride),
-                      get_vert(vertex_buffer, indices[i-0], stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, indices[i-1], stride),
+                   get_vert(vertex_buffer, indices[i-0], stride) );
       }
       break;
 
    case PIPE_PRIM_LINE_STRIP:
       for (i = 1; i < nr; i ++) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, indices[i-1], stride),
-                      get_vert(vertex_buffer, indices[i-0], stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, indices[i-1], stride),
+                   get_vert(vertex_buffer, indices[i-0], stride) );
       }
       break;
 
    case PIPE_PRIM_LINE_LOOP:
       for (i = 1; i < nr; i ++) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, indices[i-1], stride),
-                      get_vert(vertex_buffer, indices[i-0], stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, indices[i-1], stride),
+                   get_vert(vertex_buffer, indices[i-0], stride) );
       }
       if (nr) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, indices[nr-1], stride),
-                      get_vert(vertex_buffer, indices[0], stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, indices[nr-1], stride),
+                   get_vert(vertex_buffer, indices[0], stride) );
       }
       break;
 
    case PIPE_PRIM_TRIANGLES:
       for (i = 2; i < nr; i += 3) {
-         setup->triangle( setup,
-                          get_vert(vertex_buffer, indices[i-2], stride),
-                          get_vert(vertex_buffer, indices[i-1], stride),
-                          get_vert(vertex_buffer, indices[i-0], stride) );
+         bin_triangle( setup, range,
+                       get_vert(vertex_buffer, indices[i-2], stride),
+                       get_vert(vertex_buffer, indices[i-1], stride),
+                       get_vert(vertex_buffer, indices[i-0], stride) );
       }
       break;
 
@@ -196,20 +267,20 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       if (flatshade_first) {
          for (i = 2; i < nr; i += 1) {
             /* emit first triangle vertex as first triangle vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-2], stride),
-                             get_vert(vertex_buffer, indices[i+(i&1)-1], stride),
-                             get_vert(vertex_buffer, indices[i-(i&1)], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-2], stride),
+                          get_vert(vertex_buffer, indices[i+(i&1)-1], stride),
+                          get_vert(vertex_buffer, indices[i-(i&1)], stride) );
 
          }
       }
       else {
          for (i = 2; i < nr; i += 1) {
             /* emit last triangle vertex as last triangle vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i+(i&1)-2], stride),
-                             get_vert(vertex_buffer, indices[i-(i&1)-1], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i+(i&1)-2], stride),
+                          get_vert(vertex_buffer, indices[i-(i&1)-1], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride) );
          }
       }
       break;
@@ -218,19 +289,19 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       if (flatshade_first) {
          for (i = 2; i < nr; i += 1) {
             /* emit first non-spoke vertex as first vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-1], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride),
-                             get_vert(vertex_buffer, indices[0], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride),
+                          get_vert(vertex_buffer, indices[0], stride) );
          }
       }
       else {
          for (i = 2; i < nr; i += 1) {
             /* emit last non-spoke vertex as last vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[0], stride),
-                             get_vert(vertex_buffer, indices[i-1], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[0], stride),
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride) );
          }
       }
       break;
@@ -240,29 +311,29 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 4) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-0], stride),
-                             get_vert(vertex_buffer, indices[i-3], stride),
-                             get_vert(vertex_buffer, indices[i-2], stride) );
-
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-0], stride),
-                             get_vert(vertex_buffer, indices[i-2], stride),
-                             get_vert(vertex_buffer, indices[i-1], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-0], stride),
+                          get_vert(vertex_buffer, indices[i-3], stride),
+                          get_vert(vertex_buffer, indices[i-2], stride) );
+
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-0], stride),
+                          get_vert(vertex_buffer, indices[i-2], stride),
+                          get_vert(vertex_buffer, indices[i-1], stride) );
          }
       }
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 4) {
-            setup->triangle( setup,
-                          get_vert(vertex_buffer, indices[i-3], stride),
+            bin_triangle( setup, range,
+                       get_vert(vertex_buffer, indices[i-3], stride),
+                       get_vert(vertex_buffer, indices[i-2], stride),
+                       get_vert(vertex_buffer, indices[i-0], stride) );
+
+            bin_triangle( setup, range,
                           get_vert(vertex_buffer, indices[i-2], stride),
+                          get_vert(vertex_buffer, indices[i-1], stride),
                           get_vert(vertex_buffer, indices[i-0], stride) );
-
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-2], stride),
-                             get_vert(vertex_buffer, indices[i-1], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride) );
          }
       }
       break;
@@ -272,27 +343,27 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 2) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-0], stride),
-                             get_vert(vertex_buffer, indices[i-3], stride),
-                             get_vert(vertex_buffer, indices[i-2], stride) );
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-0], stride),
-                             get_vert(vertex_buffer, indices[i-1], stride),
-                             get_vert(vertex_buffer, indices[i-3], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-0], stride),
+                          get_vert(vertex_buffer, indices[i-3], stride),
+                          get_vert(vertex_buffer, indices[i-2], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-0], stride),
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-3], stride) );
          }
       }
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 2) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-3], stride),
-                             get_vert(vertex_buffer, indices[i-2], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride) );
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-1], stride),
-                             get_vert(vertex_buffer, indices[i-3], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-3], stride),
+                          get_vert(vertex_buffer, indices[i-2], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-3], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride) );
          }
       }
       break;
@@ -304,19 +375,19 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
       if (flatshade_first) { 
          /* emit first polygon  vertex as first triangle vertex */
          for (i = 2; i < nr; i += 1) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[0], stride),
-                             get_vert(vertex_buffer, indices[i-1], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[0], stride),
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride) );
          }
       }
       else {
          /* emit first polygon  vertex as last triangle vertex */
          for (i = 2; i < nr; i += 1) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, indices[i-1], stride),
-                             get_vert(vertex_buffer, indices[i-0], stride),
-                             get_vert(vertex_buffer, indices[0], stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, indices[i-1], stride),
+                          get_vert(vertex_buffer, indices[i-0], stride),
+                          get_vert(vertex_buffer, indices[0], stride) );
          }
       }
       break;
@@ -328,65 +399,62 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 
 
 /**
- * This function is hit when the draw module is working in pass-through mode.
- * It's up to us to convert the vertex array into point/line/tri prims.
+ * Bin the primitives of a non-indexed draw which are in the given range.
  */
 static void
-lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+draw_arrays_range(struct lp_setup_context *setup,
+                  struct lp_prim_range *range,
+                  uint start, uint nr)
 {
-   struct lp_setup_context *setup = lp_setup_context(vbr);
    const unsigned stride = setup->vertex_info->size * sizeof(float);
    const void *vertex_buffer =
       (void *) get_vert(setup->vertex_buffer, start, stride);
    const boolean flatshade_first = setup->flatshade_first;
    unsigned i;
 
-   if (!lp_setup_update_state(setup, TRUE))
-      return;
-
    switch (setup->prim) {
    case PIPE_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
-         setup->point( setup,
-                       get_vert(vertex_buffer, i-0, stride) );
+         bin_point( setup, range,
+                    get_vert(vertex_buffer, i-0, stride) );
       }
       break;
 
    case PIPE_PRIM_LINES:
       for (i = 1; i < nr; i += 2) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, i-1, stride),
-                      get_vert(vertex_buffer, i-0, stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, i-1, stride),
+                   get_vert(vertex_buffer, i-0, stride) );
       }
       break;
 
    case PIPE_PRIM_LINE_STRIP:
       for (i = 1; i < nr; i ++) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, i-1, stride),
-                      get_vert(vertex_buffer, i-0, stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, i-1, stride),
+                   get_vert(vertex_buffer, i-0, stride) );
       }
       break;
 
    case PIPE_PRIM_LINE_LOOP:
       for (i = 1; i < nr; i ++) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, i-1, stride),
-                      get_vert(vertex_buffer, i-0, stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, i-1, stride),
+                   get_vert(vertex_buffer, i-0, stride) );
       }
       if (nr) {
-         setup->line( setup,
-                      get_vert(vertex_buffer, nr-1, stride),
-                      get_vert(vertex_buffer, 0, stride) );
+         bin_line( setup, range,
+                   get_vert(vertex_buffer, nr-1, stride),
+                   get_vert(vertex_buffer, 0, stride) );
       }
       break;
 
    case PIPE_PRIM_TRIANGLES:
       for (i = 2; i < nr; i += 3) {
-         setup->triangle( setup,
-                          get_vert(vertex_buffer, i-2, stride),
-                          get_vert(vertex_buffer, i-1, stride),
-                          get_vert(vertex_buffer, i-0, stride) );
+         bin_triangle( setup, range,
+                       get_vert(vertex_buffer, i-2, stride),
+                       get_vert(vertex_buffer, i-1, stride),
+                       get_vert(vertex_buffer, i-0, stride) );
       }
       break;
 
@@ -394,19 +462,19 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       if (flatshade_first) {
          for (i = 2; i < nr; i++) {
             /* emit first triangle vertex as first triangle vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-2, stride),
-                             get_vert(vertex_buffer, i+(i&1)-1, stride),
-                             get_vert(vertex_buffer, i-(i&1), stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-2, stride),
+                          get_vert(vertex_buffer, i+(i&1)-1, stride),
+                          get_vert(vertex_buffer, i-(i&1), stride) );
          }
       }
       else {
          for (i = 2; i < nr; i++) {
             /* emit last triangle vertex as last triangle vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i+(i&1)-2, stride),
-                             get_vert(vertex_buffer, i-(i&1)-1, stride),
-                             get_vert(vertex_buffer, i-0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i+(i&1)-2, stride),
+                          get_vert(vertex_buffer, i-(i&1)-1, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
          }
       }
       break;
@@ -415,19 +483,19 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       if (flatshade_first) {
          for (i = 2; i < nr; i += 1) {
             /* emit first non-spoke vertex as first vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-1, stride),
-                             get_vert(vertex_buffer, i-0, stride),
-                             get_vert(vertex_buffer, 0, stride)  );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-0, stride),
+                          get_vert(vertex_buffer, 0, stride)  );
          }
       }
       else {
          for (i = 2; i < nr; i += 1) {
             /* emit last non-spoke vertex as last vertex */
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, 0, stride),
-                             get_vert(vertex_buffer, i-1, stride),
-                             get_vert(vertex_buffer, i-0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, 0, stride),
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
          }
       }
       break;
@@ -437,27 +505,27 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 4) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-0, stride),
-                             get_vert(vertex_buffer, i-3, stride),
-                             get_vert(vertex_buffer, i-2, stride) );
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-0, stride),
-                             get_vert(vertex_buffer, i-2, stride),
-                             get_vert(vertex_buffer, i-1, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-0, stride),
+                          get_vert(vertex_buffer, i-3, stride),
+                          get_vert(vertex_buffer, i-2, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-0, stride),
+                          get_vert(vertex_buffer, i-2, stride),
+                          get_vert(vertex_buffer, i-1, stride) );
          }
       }
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 4) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-3, stride),
-                             get_vert(vertex_buffer, i-2, stride),
-                             get_vert(vertex_buffer, i-0, stride) );
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-2, stride),
-                             get_vert(vertex_buffer, i-1, stride),
-                             get_vert(vertex_buffer, i-0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-3, stride),
+                          get_vert(vertex_buffer, i-2, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-2, stride),
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
          }
       }
       break;
@@ -467,27 +535,27 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       if (flatshade_first) { 
          /* emit last quad vertex as first triangle vertex */
          for (i = 3; i < nr; i += 2) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-0, stride),
-                             get_vert(vertex_buffer, i-3, stride),
-                             get_vert(vertex_buffer, i-2, stride) );
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-0, stride),
-                             get_vert(vertex_buffer, i-1, stride),
-                             get_vert(vertex_buffer, i-3, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-0, stride),
+                          get_vert(vertex_buffer, i-3, stride),
+                          get_vert(vertex_buffer, i-2, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-0, stride),
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-3, stride) );
          }
       }
       else {
          /* emit last quad vertex as last triangle vertex */
          for (i = 3; i < nr; i += 2) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-3, stride),
-                             get_vert(vertex_buffer, i-2, stride),
-                             get_vert(vertex_buffer, i-0, stride) );
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-1, stride),
-                             get_vert(vertex_buffer, i-3, stride),
-                             get_vert(vertex_buffer, i-0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-3, stride),
+                          get_vert(vertex_buffer, i-2, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-3, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
          }
       }
       break;
@@ -499,19 +567,19 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
       if (flatshade_first) { 
          /* emit first polygon  vertex as first triangle vertex */
          for (i = 2; i < nr; i += 1) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, 0, stride),
-                             get_vert(vertex_buffer, i-1, stride),
-                             get_vert(vertex_buffer, i-0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, 0, stride),
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-0, stride) );
          }
       }
       else {
          /* emit first polygon  vertex as last triangle vertex */
          for (i = 2; i < nr; i += 1) {
-            setup->triangle( setup,
-                             get_vert(vertex_buffer, i-1, stride),
-                             get_vert(vertex_buffer, i-0, stride),
-                             get_vert(vertex_buffer, 0, stride) );
+            bin_triangle( setup, range,
+                          get_vert(vertex_buffer, i-1, stride),
+                          get_vert(vertex_buffer, i-0, stride),
+                          get_vert(vertex_buffer, 0, stride) );
          }
       }
       break;
@@ -523,6 +591,216 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
 
 
 
+/**
+ * A binning thread's share of a draw.  The thread bins with a copy of the
+ * setup context, whose scene is one of the current scene's bin_scenes.
+ */
+struct lp_setup_bin_task {
+   struct lp_setup_context setup;
+   struct lp_prim_range range;
+   const ushort *indices;   /**< NULL for non-indexed draws */
+   uint start;
+   uint nr;
+   struct util_queue_fence fence;
+};
+
+
+static void
+bin_task_execute(void *data, int thread_index)
+{
+   struct lp_setup_bin_task *task = data;
+
+   if (task->indices)
+      draw_elements_range(&task->setup, &task->range, task->indices, task->nr);
+   else
+      draw_arrays_range(&task->setup, &task->range, task->start, task->nr);
+}
+
+
+/**
+ * Split the primitives of a draw in contiguous ranges, bin each range
+ * with its own thread into private bins, and append those to the scene's
+ * bins in primitive order.
+ *
+ * If a thread runs out of scene memory, the bins of the following ranges
+ * are dropped, and the app thread bins the rest of the draw in a new scene.
+ */
+static void
+draw_parallel(struct lp_setup_context *setup,
+              const ushort *indices, uint start, uint nr,
+              unsigned num_prims)
+{
+   struct lp_scene *scene = setup->scene;
+   const unsigned num_tasks = setup->num_bin_threads + 1;
+   const unsigned prims_per_task = DIV_ROUND_UP(num_prims, num_tasks);
+   unsigned failed = ~0;
+   unsigned i;
+
+   for (i = 0; i < num_tasks; i++) {
+      struct lp_setup_bin_task *task = &setup->bin_tasks[i];
+      struct lp_scene *bin_scene = scene->bin_scenes[i];
+
+      bin_scene->had_queries = scene->had_queries;
+
+      memcpy(&task->setup, setup, sizeof *setup);
+      task->setup.scene = bin_scene;
+      task->setup.bin_thread = TRUE;
+      task->setup.bin_failed = FALSE;
+
+      task->range.next = 0;
+      task->range.first = i * prims_per_task;
+      task->range.last = i == num_tasks - 1 ? ~0 : (i + 1) * prims_per_task;
+      task->range.failed = ~0;
+      task->indices = indices;
+      task->start = start;
+      task->nr = nr;
+
+      /* the app thread bins the first range itself */
+      if (i > 0)
+         util_queue_add_job(&setup->bin_queue, task, &task->fence,
+                            bin_task_execute, NULL, 0);
+   }
+
+   bin_task_execute(&setup->bin_tasks[0], 0);
+
+   for (i = 0; i < num_tasks; i++) {
+      struct lp_setup_bin_task *task = &setup->bin_tasks[i];
+
+      if (i > 0)
+         util_queue_fence_wait(&task->fence);
+
+      if (failed == ~0) {
+         lp_scene_append_bins(scene, task->setup.scene);
+         failed = task->range.failed;
+      }
+   }
+
+   if (failed != ~0) {
+      struct lp_prim_range range = { 0, failed, ~0, ~0 };
+
+      if (!lp_setup_flush_and_restart(setup))
+         return;
+
+      if (indices)
+         draw_elements_range(setup, &range, indices, nr);
+      else
+         draw_arrays_range(setup, &range, start, nr);
+   }
+}
+
+
+static inline boolean
+use_parallel_binning(const struct lp_setup_context *setup,
+                     unsigned num_prims)
+{
+   return setup->num_bin_threads &&
+          num_prims >= LP_MIN_PARALLEL_BIN_PRIMS;
+}
+
+
+/**
+ * draw elements / indexed primitives
+ */
+static void
+lp_setup_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
+{
+   struct lp_setup_context *setup = lp_setup_context(vbr);
+   const unsigned num_prims = u_reduced_prims_for_vertices(setup->prim, nr);
+
+   assert(setup->setup.variant);
+
+   if (!lp_setup_update_state(setup, TRUE))
+      return;
+
+   if (use_parallel_binning(setup, num_prims)) {
+      draw_parallel(setup, indices, 0, nr, num_prims);
+   }
+   else {
+      struct lp_prim_range range = { 0, 0, ~0, ~0 };
+      draw_elements_range(setup, &range, indices, nr);
+   }
+}
+
+
+/**
+ * This function is hit when the draw module is working in pass-through mode.
+ * It's up to us to convert the vertex array into point/line/tri prims.
+ */
+static void
+lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+{
+   struct lp_setup_context *setup = lp_setup_context(vbr);
+   const unsigned num_prims = u_reduced_prims_for_vertices(setup->prim, nr);
+
+   if (!lp_setup_update_state(setup, TRUE))
+      return;
+
+   if (use_parallel_binning(setup, num_prims)) {
+      draw_parallel(setup, NULL, start, nr, num_prims);
+   }
+   else {
+      struct lp_prim_range range = { 0, 0, ~0, ~0 };
+      draw_arrays_range(setup, &range, start, nr);
+   }
+}
+
+
+/**
+ * Start the threads helping to bin large draws, if requested with
+ * LP_BIN_THREADS.  Failing that, draws are binned by the app thread only.
+ */
+void
+lp_setup_init_bin_threads(struct lp_setup_context *setup)
+{
+   unsigned num_threads = debug_get_num_option("LP_BIN_THREADS", 0);
+   unsigned i;
+
+   num_threads = MIN2(num_threads, LP_MAX_BIN_THREADS);
+   if (!num_threads)
+      return;
+
+   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+      if (!lp_scene_create_bin_scenes(setup->scenes[i], num_threads + 1))
+         return;
+   }
+
+   setup->bin_tasks = CALLOC(num_threads + 1, sizeof *setup->bin_tasks);
+   if (!setup->bin_tasks)
+      return;
+
+   if (!util_queue_init(&setup->bin_queue, "lpbin", num_threads, num_threads,
+                        0)) {
+      FREE(setup->bin_tasks);
+      setup->bin_tasks = NULL;
+      return;
+   }
+
+   for (i = 0; i < num_threads + 1; i++)
+      util_queue_fence_init(&setup->bin_tasks[i].fence);
+
+   setup->num_bin_threads = num_threads;
+}
+
+
+void
+lp_setup_destroy_bin_threads(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   if (!setup->num_bin_threads)
+      return;
+
+   util_queue_destroy(&setup->bin_queue);
+
+   for (i = 0; i < setup->num_bin_threads + 1; i++)
+      util_queue_fence_destroy(&setup->bin_tasks[i].fence);
+
+   FREE(setup->bin_tasks);
+   setup->bin_tasks = NULL;
+   setup->num_bin_threads = 0;
+}
+
+
 static void
 lp_setup_vbuf_destroy(struct vbuf_render *vbr)
 {
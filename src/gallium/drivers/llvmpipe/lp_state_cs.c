@@ -29,6 +29,7 @@
 #include "util/u_string.h"
 #include "tgsi/tgsi_dump.h"
 #include "tgsi/tgsi_parse.h"
+#include "draw/draw_context.h"
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_debug.h"
 #include "gallivm/lp_bld_intr.h"
@@ -47,14 +48,6 @@
 #include "state_tracker/sw_winsys.h"
 #include "nir/nir_to_tgsi_info.h"
 #include "nir_serialize.h"
-struct lp_cs_job_info {
-   unsigned grid_size[3];
-   unsigned block_size[3];
-   unsigned req_local_mem;
-   unsigned work_dim;
-   struct lp_cs_exec *current;
-};
-
 static void
 generate_compute(struct llvmpipe_context *lp,
                  struct lp_compute_shader *shader,
@@ -92,11 +85,12 @@ generate_compute(struct llvmpipe_context *lp,
    cs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    cs_type.width = 32;           /* 32-bit float */
    cs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
-   snprintf(func_name, sizeof(func_name), "cs%u_variant%u",
-            shader->no, variant->no);
+   /* Keep the names independent of the shader/variant number so that
+    * the object code can be looked up from the disk cache.
+    */
+   snprintf(func_name, sizeof(func_name), "cs_variant");
 
-   snprintf(func_name_coro, sizeof(func_name), "cs_co_%u_variant%u",
-            shader->no, variant->no);
+   snprintf(func_name_coro, sizeof(func_name), "cs_co_variant");
 
    arg_types[0] = variant->jit_cs_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* block_x_size */
@@ -510,6 +504,8 @@ llvmpipe_delete_compute_state(struct pipe_context *pipe,
    struct lp_compute_shader *shader = cs;
    struct lp_cs_variant_list_item *li;
 
+   lp_csctx_wait(llvmpipe->csctx);
+
    if (llvmpipe->cs == cs)
       llvmpipe->cs = NULL;
    for (unsigned i = 0; i < shader->max_global_buffers; i++)
@@ -563,8 +559,8 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1u << (i & 31))) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+            llvmpipe_sampler_static_texture_state(&key->state[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
          }
       }
    }
@@ -572,8 +568,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+            llvmpipe_sampler_static_texture_state(&key->state[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
          }
       }
    }
@@ -663,6 +659,7 @@ generate_variant(struct llvmpipe_context *lp,
                  const struct lp_compute_shader_variant_key *key)
 {
    struct lp_compute_shader_variant *variant;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    char module_name[64];
 
    variant = CALLOC_STRUCT(lp_compute_shader_variant);
@@ -672,8 +669,21 @@ generate_variant(struct llvmpipe_context *lp,
    snprintf(module_name, sizeof(module_name), "cs%u_variant%u",
             shader->no, shader->variants_created);
 
-   variant->gallivm = gallivm_create(module_name, lp->context);
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   bool needs_caching = false;
+   if (screen->disk_shader_cache) {
+      lp_build_ir_cache_key(&shader->base, key, shader->variant_key_size, 0,
+                            ir_sha1_cache_key);
+
+      lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+      if (!cached.data_size)
+         needs_caching = true;
+   }
+
+   variant->gallivm = gallivm_create(module_name, lp->context, &cached);
    if (!variant->gallivm) {
+      free(cached.data);
       FREE(variant);
       return NULL;
    }
@@ -699,7 +709,11 @@ generate_variant(struct llvmpipe_context *lp,
 
    variant->jit_function = (lp_jit_cs_func)gallivm_jit_function(variant->gallivm, variant->function);
 
+   if (needs_caching) {
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+   }
    gallivm_free_ir(variant->gallivm);
+   free(cached.data);
    return variant;
 }
 
@@ -1141,7 +1155,16 @@ update_csctx_ssbo(struct llvmpipe_context *llvmpipe)
 static void
 llvmpipe_cs_update_derived(struct llvmpipe_context *llvmpipe, void *input)
 {
-   if (llvmpipe->cs_dirty & (LP_CSNEW_CS))
+   struct llvmpipe_screen *lp_screen = llvmpipe_screen(llvmpipe->pipe.screen);
+
+   /* Check for updated textures, their layout is part of the variant key.
+    */
+   if (llvmpipe->cs_tex_timestamp != lp_screen->timestamp) {
+      llvmpipe->cs_tex_timestamp = lp_screen->timestamp;
+      llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+   }
+
+   if (llvmpipe->cs_dirty & (LP_CSNEW_CS | LP_CSNEW_SAMPLER_VIEW))
       llvmpipe_update_cs(llvmpipe);
 
    if (llvmpipe->cs_dirty & LP_CSNEW_CONSTANTS) {
@@ -1236,34 +1259,188 @@ fill_grid_size(struct pipe_context *pipe,
    pipe_buffer_unmap(pipe, transfer);
 }
 
+/**
+ * Wait for the last dispatch of the context to finish.
+ */
+void
+lp_csctx_wait(struct lp_cs_context *csctx)
+{
+   struct llvmpipe_screen *screen;
+
+   if (!csctx || !csctx->task)
+      return;
+
+   screen = llvmpipe_screen(csctx->pipe->screen);
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &csctx->task);
+}
+
+/**
+ * Whether the last dispatch of the context, if it is still running,
+ * reads and/or may write the resource.
+ */
+unsigned
+lp_csctx_is_resource_referenced(const struct lp_cs_context *csctx,
+                                const struct pipe_resource *resource)
+{
+   const struct lp_compute_shader *cs;
+   unsigned i;
+
+   if (!csctx || !csctx->task)
+      return LP_UNREFERENCED;
+
+   for (i = 0; i < ARRAY_SIZE(csctx->ssbos); i++) {
+      if (csctx->ssbos[i].current.buffer == resource)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   for (i = 0; i < ARRAY_SIZE(csctx->images); i++) {
+      if (csctx->images[i].current.resource == resource)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+   cs = csctx->task_cs;
+   for (i = 0; i < (unsigned)cs->max_global_buffers; i++) {
+      if (cs->global_buffers[i] == resource)
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+   }
+
+   for (i = 0; i < ARRAY_SIZE(csctx->cs.current_tex); i++) {
+      if (csctx->cs.current_tex[i] == resource)
+         return LP_REFERENCED_FOR_READ;
+   }
+   for (i = 0; i < ARRAY_SIZE(csctx->constants); i++) {
+      if (csctx->constants[i].current.buffer == resource)
+         return LP_REFERENCED_FOR_READ;
+   }
+
+   return LP_UNREFERENCED;
+}
+
+/**
+ * Whether the last dispatch, if it is still running, may write memory.
+ */
+static boolean
+lp_csctx_writes_memory(const struct lp_cs_context *csctx)
+{
+   const struct lp_compute_shader *cs = csctx->task_cs;
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(csctx->ssbos); i++) {
+      if (csctx->ssbos[i].current.buffer)
+         return TRUE;
+   }
+   for (i = 0; i < ARRAY_SIZE(csctx->images); i++) {
+      if (csctx->images[i].current.resource)
+         return TRUE;
+   }
+   for (i = 0; i < (unsigned)cs->max_global_buffers; i++) {
+      if (cs->global_buffers[i])
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+static boolean
+cs_referenced_surface(const struct lp_cs_context *csctx,
+                      const struct pipe_surface *surf)
+{
+   return surf && lp_csctx_is_resource_referenced(csctx, surf->texture);
+}
+
+/**
+ * Called before draws or clears are binned.  They are rasterized alongside
+ * the last dispatch, which may still be running, and draws also read their
+ * vertices right away.  Wait for the dispatch if it may write memory a draw
+ * could read, or if it uses something the draw or clear writes.
+ */
+void
+llvmpipe_cs_sync_render(struct llvmpipe_context *llvmpipe,
+                        boolean clear)
+{
+   struct lp_cs_context *csctx = llvmpipe->csctx;
+   const struct pipe_framebuffer_state *fb = &llvmpipe->framebuffer;
+   unsigned i, sh;
+
+   if (!csctx || !csctx->task)
+      return;
+
+   if (!clear && lp_csctx_writes_memory(csctx))
+      goto wait;
+
+   for (i = 0; i < fb->nr_cbufs; i++) {
+      if (cs_referenced_surface(csctx, fb->cbufs[i]))
+         goto wait;
+   }
+   if (cs_referenced_surface(csctx, fb->zsbuf))
+      goto wait;
+
+   if (clear)
+      return;
+
+   for (sh = 0; sh < PIPE_SHADER_COMPUTE; sh++) {
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->ssbos[sh]); i++) {
+         if (llvmpipe->ssbos[sh][i].buffer &&
+             lp_csctx_is_resource_referenced(csctx,
+                                             llvmpipe->ssbos[sh][i].buffer))
+            goto wait;
+      }
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->images[sh]); i++) {
+         if (llvmpipe->images[sh][i].resource &&
+             lp_csctx_is_resource_referenced(csctx,
+                                             llvmpipe->images[sh][i].resource))
+            goto wait;
+      }
+   }
+   for (i = 0; i < llvmpipe->num_so_targets; i++) {
+      if (llvmpipe->so_targets[i] &&
+          lp_csctx_is_resource_referenced(csctx,
+                                          llvmpipe->so_targets[i]->target.buffer))
+         goto wait;
+   }
+
+   return;
+
+wait:
+   lp_csctx_wait(csctx);
+}
+
+/*
+ * The grid runs on the thread pool while we return, so that the next
+ * draws can be binned meanwhile.  The dispatch is waited for before
+ * the next one, and by flushes, CPU access to resources, memory barriers
+ * and anything else which could change what it is using.
+ */
 static void llvmpipe_launch_grid(struct pipe_context *pipe,
                                  const struct pipe_grid_info *info)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
-   struct lp_cs_job_info job_info;
+   struct lp_cs_context *csctx = llvmpipe->csctx;
+   struct lp_cs_job_info *job_info = &csctx->job;
+
+   lp_csctx_wait(csctx);
 
-   memset(&job_info, 0, sizeof(job_info));
+   memset(job_info, 0, sizeof(*job_info));
 
    llvmpipe_cs_update_derived(llvmpipe, info->input);
 
-   fill_grid_size(pipe, info, job_info.grid_size);
+   fill_grid_size(pipe, info, job_info->grid_size);
 
-   job_info.block_size[0] = info->block[0];
-   job_info.block_size[1] = info->block[1];
-   job_info.block_size[2] = info->block[2];
-   job_info.work_dim = info->work_dim;
-   job_info.req_local_mem = llvmpipe->cs->req_local_mem;
-   job_info.current = &llvmpipe->csctx->cs.current;
+   job_info->block_size[0] = info->block[0];
+   job_info->block_size[1] = info->block[1];
+   job_info->block_size[2] = info->block[2];
+   job_info->work_dim = info->work_dim;
+   job_info->req_local_mem = llvmpipe->cs->req_local_mem;
+   job_info->current = &csctx->cs.current;
 
-   int num_tasks = job_info.grid_size[2] * job_info.grid_size[1] * job_info.grid_size[0];
+   int num_tasks = job_info->grid_size[2] * job_info->grid_size[1] * job_info->grid_size[0];
    if (num_tasks) {
-      struct lp_cs_tpool_task *task;
-      mtx_lock(&screen->cs_mutex);
-      task = lp_cs_tpool_queue_task(screen->cs_tpool, cs_exec_fn, &job_info, num_tasks);
+      csctx->task = lp_cs_tpool_queue_task(screen->cs_tpool, cs_exec_fn,
+                                           job_info, num_tasks);
+      csctx->task_cs = llvmpipe->cs;
 
-      lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
-      mtx_unlock(&screen->cs_mutex);
+      /* The kernel arguments belong to the caller. */
+      if (info->input)
+         lp_csctx_wait(csctx);
    }
    llvmpipe->pipeline_statistics.cs_invocations += num_tasks * info->block[0] * info->block[1] * info->block[2];
 }
@@ -1287,6 +1464,8 @@ llvmpipe_set_global_binding(struct pipe_context *pipe,
    struct lp_compute_shader *cs = llvmpipe->cs;
    unsigned i;
 
+   lp_csctx_wait(llvmpipe->csctx);
+
    if (first + count > cs->max_global_buffers) {
       unsigned old_max = cs->max_global_buffers;
       cs->max_global_buffers = first + count;
@@ -1331,6 +1510,8 @@ void
 lp_csctx_destroy(struct lp_cs_context *csctx)
 {
    unsigned i;
+
+   lp_csctx_wait(csctx);
    for (i = 0; i < ARRAY_SIZE(csctx->cs.current_tex); i++) {
       pipe_resource_reference(&csctx->cs.current_tex[i], NULL);
    }
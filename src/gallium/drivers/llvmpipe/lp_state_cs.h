@@ -35,7 +35,9 @@
 #include "lp_jit.h"
 #include "lp_state_fs.h"
 
+struct llvmpipe_context;
 struct lp_compute_shader_variant;
+struct lp_cs_tpool_task;
 
 struct lp_compute_shader_variant_key
 {
@@ -99,6 +101,14 @@ struct lp_cs_exec {
    struct lp_compute_shader_variant *variant;
 };
 
+struct lp_cs_job_info {
+   unsigned grid_size[3];
+   unsigned block_size[3];
+   unsigned req_local_mem;
+   unsigned work_dim;
+   struct lp_cs_exec *current;
+};
+
 struct lp_cs_context {
    struct pipe_context *pipe;
 
@@ -125,9 +135,22 @@ struct lp_cs_context {
    } images[LP_MAX_TGSI_SHADER_IMAGES];
 
    void *input;
+
+   /**
+    * The last dispatch, which may still be running on the screen's thread
+    * pool.  Everything above is in use until lp_csctx_wait().
+    */
+   struct lp_cs_job_info job;
+   struct lp_cs_tpool_task *task;
+   struct lp_compute_shader *task_cs;  /**< for its global buffers */
 };
 
 struct lp_cs_context *lp_csctx_create(struct pipe_context *pipe);
 void lp_csctx_destroy(struct lp_cs_context *csctx);
+void lp_csctx_wait(struct lp_cs_context *csctx);
+unsigned lp_csctx_is_resource_referenced(const struct lp_cs_context *csctx,
+                                         const struct pipe_resource *resource);
+void llvmpipe_cs_sync_render(struct llvmpipe_context *llvmpipe,
+                             boolean clear);
 
 #endif
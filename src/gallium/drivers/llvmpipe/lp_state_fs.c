@@ -68,6 +68,7 @@
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
 #include "util/os_time.h"
+#include "util/hash_table.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "tgsi/tgsi_dump.h"
@@ -102,6 +103,7 @@
 #include "lp_tex_sample.h"
 #include "lp_flush.h"
 #include "lp_state_fs.h"
+#include "lp_screen.h"
 #include "lp_rast.h"
 #include "nir/nir_to_tgsi_info.h"
 
@@ -294,6 +296,7 @@ lp_build_depth_clamp(struct gallivm_state *gallivm,
 static void
 generate_fs_loop(struct gallivm_state *gallivm,
                  struct lp_fragment_shader *shader,
+                 struct nir_shader *nir,
                  const struct lp_fragment_shader_variant_key *key,
                  LLVMBuilderRef builder,
                  struct lp_type type,
@@ -510,7 +513,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
       lp_build_tgsi_soa(gallivm, tokens, &params,
                         outputs);
    else
-      lp_build_nir_soa(gallivm, shader->base.ir.nir, &params,
+      lp_build_nir_soa(gallivm, nir, &params,
                        outputs);
 
    /* Alpha test */
@@ -2436,6 +2439,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
 static void
 generate_fragment(struct llvmpipe_context *lp,
                   struct lp_fragment_shader *shader,
+                  struct nir_shader *nir,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2524,8 +2528,11 @@ generate_fragment(struct llvmpipe_context *lp,
 
    blend_vec_type = lp_build_vec_type(gallivm, blend_type);
 
-   snprintf(func_name, sizeof(func_name), "fs%u_variant%u_%s",
-            shader->no, variant->no, partial_mask ? "partial" : "whole");
+   /* The function name must not depend on the shader or variant number,
+    * otherwise the object code from the disk cache can't be reused.
+    */
+   snprintf(func_name, sizeof(func_name), "fs_variant_%s",
+            partial_mask ? "partial" : "whole");
 
    arg_types[0] = variant->jit_context_ptr_type;       /* context */
    arg_types[1] = int32_type;                          /* x */
@@ -2661,7 +2668,7 @@ generate_fragment(struct llvmpipe_context *lp,
       }
 
       generate_fs_loop(gallivm,
-                       shader, key,
+                       shader, nir, key,
                        builder,
                        fs_type,
                        context_ptr,
@@ -2861,37 +2868,313 @@ lp_debug_fs_variant(struct lp_fragment_shader_variant *variant)
       nir_print_shader(variant->shader->base.ir.nir, stderr);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->hiz_test = %u, hiz_update = %u\n",
+                variant->hiz_test, variant->hiz_update);
    debug_printf("\n");
 }
 
 
+/**
+ * Look up the code of a variant compiled by any context of the screen.
+ * Returns a new reference, or NULL.
+ */
+static struct lp_fs_variant_code *
+lp_fs_variant_code_find(struct llvmpipe_screen *screen,
+                        const unsigned char sha1[20])
+{
+   struct lp_fs_variant_code *code = NULL;
+   struct hash_entry *entry;
+
+   if (!screen->fs_code_cache)
+      return NULL;
+
+   mtx_lock(&screen->fs_code_mutex);
+   entry = _mesa_hash_table_search(screen->fs_code_cache, sha1);
+   if (entry) {
+      code = entry->data;
+      pipe_reference(NULL, &code->reference);
+      screen->num_fs_code_cache_hits++;
+   } else {
+      screen->num_fs_code_cache_misses++;
+   }
+   mtx_unlock(&screen->fs_code_mutex);
+
+   return code;
+}
+
+
+/**
+ * Wrap the freshly compiled code of a variant and make it available to the
+ * other contexts.  Takes ownership of the gallivm state.
+ *
+ * Two contexts may compile the same variant concurrently; the code which
+ * comes second then simply stays private to its variant.
+ */
+static struct lp_fs_variant_code *
+lp_fs_variant_code_create(struct llvmpipe_screen *screen,
+                          const struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_variant_code *code = CALLOC_STRUCT(lp_fs_variant_code);
+   if (!code)
+      return NULL;
+
+   pipe_reference_init(&code->reference, 1);
+   memcpy(code->sha1, variant->ir_sha1, sizeof code->sha1);
+   code->gallivm = variant->gallivm;
+   code->jit_function[RAST_WHOLE] = variant->jit_function[RAST_WHOLE];
+   code->jit_function[RAST_EDGE_TEST] = variant->jit_function[RAST_EDGE_TEST];
+   code->nr_instrs = variant->nr_instrs;
+
+   if (screen->fs_code_cache) {
+      mtx_lock(&screen->fs_code_mutex);
+      if (!_mesa_hash_table_search(screen->fs_code_cache, code->sha1)) {
+         _mesa_hash_table_insert(screen->fs_code_cache, code->sha1, code);
+         code->cached = TRUE;
+      }
+      mtx_unlock(&screen->fs_code_mutex);
+   }
+
+   return code;
+}
+
+
+/**
+ * Drop a variant's reference to its code, freeing it with the last one.
+ */
+static void
+lp_fs_variant_code_release(struct llvmpipe_screen *screen,
+                           struct lp_fs_variant_code *code)
+{
+   boolean destroy;
+
+   /*
+    * The count only drops to zero under the mutex, so that a concurrent
+    * lp_fs_variant_code_find() can't pick up the entry while it is freed.
+    */
+   mtx_lock(&screen->fs_code_mutex);
+   destroy = pipe_reference(&code->reference, NULL);
+   if (destroy && code->cached)
+      _mesa_hash_table_remove_key(screen->fs_code_cache, code->sha1);
+   mtx_unlock(&screen->fs_code_mutex);
+
+   if (destroy) {
+      gallivm_destroy(code->gallivm);
+      FREE(code);
+   }
+}
+
+
+/**
+ * Generate and compile the code of a fragment shader variant.
+ *
+ * This only reads the shader and writes the variant, so it may run on one
+ * of the context's compile threads, with that thread's LLVM context.  On
+ * success variant->code holds the result.  On failure the variant is left
+ * without code nor jit functions, and FALSE is returned.
+ */
+static boolean
+compile_variant(struct llvmpipe_context *lp,
+                struct lp_fragment_shader_variant *variant,
+                LLVMContextRef context)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct nir_shader *nir = NULL;
+   char module_name[64];
+
+   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+            shader->no, variant->no);
+
+   struct lp_cached_code cached = { 0 };
+   bool needs_caching = false;
+   if (screen->disk_shader_cache) {
+      lp_disk_cache_find_shader(screen, &cached, variant->ir_sha1);
+      if (!cached.data_size)
+         needs_caching = true;
+   }
+
+   variant->gallivm = gallivm_create(module_name, context, &cached);
+   if (!variant->gallivm) {
+      free(cached.data);
+      return FALSE;
+   }
+
+   /*
+    * The NIR translation lowers the shader in place, and other variants of
+    * the same shader may be compiled concurrently, so work on a copy.
+    */
+   if (shader->base.type == PIPE_SHADER_IR_NIR)
+      nir = nir_shader_clone(NULL, shader->base.ir.nir);
+
+   lp_jit_init_types(variant);
+   
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(lp, shader, nir, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(lp, shader, nir, variant, RAST_WHOLE);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   if (needs_caching) {
+      lp_disk_cache_insert_shader(screen, &cached, variant->ir_sha1);
+   }
+
+   gallivm_free_ir(variant->gallivm);
+   free(cached.data);
+   ralloc_free(nir);
+
+   if (variant->jit_function[RAST_EDGE_TEST])
+      variant->code = lp_fs_variant_code_create(screen, variant);
+   if (!variant->code) {
+      /* Nothing else references the code, so it goes with the gallivm. */
+      gallivm_destroy(variant->gallivm);
+      variant->gallivm = NULL;
+      variant->jit_function[RAST_WHOLE] = NULL;
+      variant->jit_function[RAST_EDGE_TEST] = NULL;
+      variant->nr_instrs = 0;
+      return FALSE;
+   }
+
+   variant->gallivm = NULL;
+   p_atomic_add(&lp->nr_fs_instrs, variant->nr_instrs);
+   return TRUE;
+}
+
+
+struct lp_fs_compile_job {
+   struct llvmpipe_context *lp;
+   struct lp_fragment_shader_variant *variant;
+};
+
+
+static void
+compile_variant_job(void *data, int thread_index)
+{
+   struct lp_fs_compile_job *job = data;
+   struct llvmpipe_context *lp = job->lp;
+   struct lp_fragment_shader_variant *variant = job->variant;
+
+   /*
+    * Draws may already have been binned with the variant.  If it fails to
+    * compile, its jit functions stay NULL and the rasterizer skips them.
+    */
+   if (!compile_variant(lp, variant, lp->compile_contexts[thread_index]))
+      debug_printf("llvmpipe: failed to compile fs #%u variant %u\n",
+                   variant->shader->no, variant->no);
+   FREE(job);
+}
+
+
+/**
+ * Work out what the rasterizer's coarse depth rejection may do with
+ * this variant.  Blocks can only be rejected when the fragment depth is
+ * the interpolated plane and a failed depth test has no other effects,
+ * i.e. no stencil and no side effects before a late depth test.
+ */
+static void
+init_variant_hiz(struct lp_fragment_shader_variant *variant)
+{
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct tgsi_shader_info *info = &variant->shader->info.base;
+   const boolean plane_z = !info->writes_z && !key->depth_clamp;
+   unsigned op;
+
+   variant->hiz_test = LP_HIZ_NONE;
+   variant->hiz_update = LP_HIZ_NONE;
+   variant->hiz_full_write = FALSE;
+
+   if (!key->depth.enabled)
+      return;
+
+   switch (key->depth.func) {
+   case PIPE_FUNC_LESS:
+   case PIPE_FUNC_LEQUAL:
+      op = LP_HIZ_LESS;
+      break;
+   case PIPE_FUNC_GREATER:
+   case PIPE_FUNC_GEQUAL:
+      op = LP_HIZ_GREATER;
+      break;
+   case PIPE_FUNC_ALWAYS:
+      op = LP_HIZ_ALWAYS;
+      break;
+   case PIPE_FUNC_NOTEQUAL:
+      op = LP_HIZ_ANY;
+      break;
+   default:
+      /* NEVER and EQUAL leave the depth values as they are */
+      op = LP_HIZ_NONE;
+      break;
+   }
+
+   if (key->depth.writemask && op != LP_HIZ_NONE)
+      variant->hiz_update = plane_z ? op : LP_HIZ_UNKNOWN;
+
+   if (plane_z &&
+       (op == LP_HIZ_LESS || op == LP_HIZ_GREATER) &&
+       !key->stencil[0].enabled &&
+       (!info->writes_memory ||
+        info->properties[TGSI_PROPERTY_FS_EARLY_DEPTH_STENCIL]))
+      variant->hiz_test = op;
+
+   variant->hiz_full_write =
+         plane_z &&
+         !key->stencil[0].enabled &&
+         !key->alpha.enabled &&
+         !key->blend.alpha_to_coverage &&
+         !info->uses_kill &&
+         !info->writes_samplemask;
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * With compile threads (LP_ASYNC_COMPILE) the code is generated in the
+ * background, and the variant's ready fence is signalled once it is
+ * usable.  Otherwise the variant is compiled before returning.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc = NULL;
    boolean fullcolormask;
-   char module_name[64];
 
    variant = MALLOC(sizeof *variant + shader->variant_key_size - sizeof variant->key);
    if (!variant)
       return NULL;
 
    memset(variant, 0, sizeof(*variant));
-   snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-
-   variant->gallivm = gallivm_create(module_name, lp->context);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
 
    variant->shader = shader;
    variant->list_item_global.base = variant;
@@ -2921,46 +3204,50 @@ generate_variant(struct llvmpipe_context *lp,
          !shader->info.base.writes_samplemask
       ? TRUE : FALSE;
 
+   init_variant_hiz(variant);
+
    if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
+   util_queue_fence_init(&variant->ready);
 
    /*
-    * Compile everything
+    * Another context may already have compiled the same shader with the
+    * same key; the generated code doesn't depend on the context.  The
+    * disk cache key also identifies the variant's code in the screen's
+    * fs_code_cache.
     */
-
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
-
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   lp_build_ir_cache_key(&shader->base, key, shader->variant_key_size, 0,
+                         variant->ir_sha1);
+   variant->code = lp_fs_variant_code_find(screen, variant->ir_sha1);
+   if (variant->code) {
+      variant->jit_function[RAST_WHOLE] =
+         variant->code->jit_function[RAST_WHOLE];
+      variant->jit_function[RAST_EDGE_TEST] =
+         variant->code->jit_function[RAST_EDGE_TEST];
+      variant->nr_instrs = variant->code->nr_instrs;
+      p_atomic_add(&lp->nr_fs_instrs, variant->nr_instrs);
+      return variant;
+   }
+
+   if (lp->num_compile_threads) {
+      struct lp_fs_compile_job *job = MALLOC_STRUCT(lp_fs_compile_job);
+      if (job) {
+         job->lp = lp;
+         job->variant = variant;
+         util_queue_add_job(&lp->compile_queue, job, &variant->ready,
+                            compile_variant_job, NULL, 0);
+         return variant;
+      }
+   }
+
+   if (!compile_variant(lp, variant, lp->context)) {
+      util_queue_fence_destroy(&variant->ready);
+      FREE(variant);
+      return NULL;
    }
 
-   gallivm_free_ir(variant->gallivm);
-
    return variant;
 }
 
@@ -3101,7 +3388,13 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants, variant->nr_instrs, lp->nr_fs_instrs);
    }
 
-   gallivm_destroy(variant->gallivm);
+   /* the variant may still be compiling */
+   util_queue_fence_wait(&variant->ready);
+   util_queue_fence_destroy(&variant->ready);
+
+   if (variant->code)
+      lp_fs_variant_code_release(llvmpipe_screen(lp->pipe.screen),
+                                 variant->code);
 
    /* remove from shader's list */
    remove_from_list(&variant->list_item_local);
@@ -3110,7 +3403,7 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
    /* remove from context's list */
    remove_from_list(&variant->list_item_global);
    lp->nr_fs_variants--;
-   lp->nr_fs_instrs -= variant->nr_instrs;
+   p_atomic_add(&lp->nr_fs_instrs, -(int)variant->nr_instrs);
 
    FREE(variant);
 }
@@ -3252,6 +3545,16 @@ llvmpipe_set_shader_images(struct pipe_context *pipe,
    for (i = start_slot, idx = 0; i < start_slot + count; i++, idx++) {
       const struct pipe_image_view *image = images ? &images[idx] : NULL;
 
+      /* image access is only implemented for linear textures */
+      if (image && image->resource &&
+          llvmpipe_resource(image->resource)->tiled)
+         llvmpipe_resource_untile(image->resource);
+
+      /* shaders may store anywhere in the image */
+      if (image && image->resource &&
+          llvmpipe_resource_is_texture(image->resource))
+         llvmpipe_resource_untrack_clears(image->resource);
+
       util_copy_image_view(&llvmpipe->images[shader][i], image);
    }
 
@@ -3482,8 +3785,8 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1u << (i & 31))) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3491,8 +3794,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            llvmpipe_sampler_static_texture_state(&fs_sampler[i].texture_state,
+                                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3604,7 +3907,8 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       variant = generate_variant(lp, shader, key);
       t1 = os_time_get();
       dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
+      if (!lp->num_compile_threads)
+         LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
@@ -3612,7 +3916,6 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
          lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
          shader->variants_cached++;
       }
    }
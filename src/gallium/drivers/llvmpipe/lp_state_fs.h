@@ -32,6 +32,7 @@
 
 #include "pipe/p_compiler.h"
 #include "pipe/p_state.h"
+#include "util/u_queue.h"
 #include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
@@ -47,6 +48,19 @@ struct lp_fragment_shader;
 #define RAST_EDGE_TEST 1
 
 
+/**
+ * How a variant's depth test and depth writes relate to the per-block
+ * depth bounds the rasterizer keeps for coarse depth rejection.
+ * See lp_rast_hiz_blocks().
+ */
+#define LP_HIZ_NONE     0  /**< no test / depth buffer untouched */
+#define LP_HIZ_LESS     1  /**< LESS, LEQUAL */
+#define LP_HIZ_GREATER  2  /**< GREATER, GEQUAL */
+#define LP_HIZ_ALWAYS   3  /**< update only: ALWAYS */
+#define LP_HIZ_ANY      4  /**< update only: NOTEQUAL */
+#define LP_HIZ_UNKNOWN  5  /**< update only: written z not the plane's */
+
+
 struct lp_sampler_static_state
 {
    /*
@@ -120,11 +134,39 @@ struct lp_fs_variant_list_item
 };
 
 
+/**
+ * The compiled code of a fragment shader variant.
+ *
+ * Variants with the same shader IR and key generate the same code, so the
+ * code is shared by all the contexts of a screen, see
+ * llvmpipe_screen::fs_code_cache.  It is freed with the last variant
+ * referencing it.
+ */
+struct lp_fs_variant_code
+{
+   struct pipe_reference reference;
+
+   /** Hash of the shader IR and the variant key */
+   unsigned char sha1[20];
+   boolean cached;  /**< in the screen's fs_code_cache */
+
+   struct gallivm_state *gallivm;
+   lp_jit_frag_func jit_function[2];
+   unsigned nr_instrs;
+};
+
+
 struct lp_fragment_shader_variant
 {
 
    boolean opaque;
 
+   /** Coarse depth rejection, LP_HIZ_x */
+   unsigned hiz_test:2;
+   unsigned hiz_update:3;
+   /** Every covered pixel reaches the depth test and is written on pass */
+   unsigned hiz_full_write:1;
+
    struct gallivm_state *gallivm;
 
    LLVMTypeRef jit_context_ptr_type;
@@ -135,9 +177,16 @@ struct lp_fragment_shader_variant
 
    lp_jit_frag_func jit_function[2];
 
+   /** Hash of the shader IR and the variant key */
+   unsigned char ir_sha1[20];
+   struct lp_fs_variant_code *code;
+
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /* Signalled once the code above is ready, see LP_ASYNC_COMPILE */
+   struct util_queue_fence ready;
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
@@ -153,6 +153,12 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
        shader == PIPE_SHADER_GEOMETRY ||
        shader == PIPE_SHADER_TESS_CTRL ||
        shader == PIPE_SHADER_TESS_EVAL) {
+      /* the draw module only samples linear textures */
+      for (i = 0; i < num; i++) {
+         if (views[i] && views[i]->texture &&
+             llvmpipe_resource(views[i]->texture)->tiled)
+            llvmpipe_resource_untile(views[i]->texture);
+      }
       draw_set_sampler_views(llvmpipe->draw,
                              shader,
                              llvmpipe->sampler_views[shader],
@@ -522,6 +528,20 @@ llvmpipe_prepare_tess_eval_images(struct llvmpipe_context *lp,
    prepare_shader_images(lp, num, views, PIPE_SHADER_TESS_EVAL);
 }
 
+/**
+ * lp_sampler_static_texture_state() plus the texture layout, for the
+ * shaders llvmpipe generates itself.
+ */
+void
+llvmpipe_sampler_static_texture_state(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+
+   if (view && view->texture && view->target != PIPE_BUFFER)
+      state->tiled = llvmpipe_resource_const(view->texture)->tiled;
+}
+
 void
 llvmpipe_init_sampler_funcs(struct llvmpipe_context *llvmpipe)
 {
@@ -0,0 +1,369 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * Draws with client-side vertex arrays, through a whole llvmpipe screen
+ * and context on the null winsys.
+ *
+ * Vertex arrays are passed as user vertex buffers when the screen
+ * advertises PIPE_CAP_USER_VERTEX_BUFFERS, and uploaded into a buffer
+ * otherwise, like the state tracker does.  This is done with and without
+ * u_threaded_context (GALLIUM_THREAD), which can't take user buffers.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/u_draw.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define WIDTH 32
+#define HEIGHT 32
+
+
+struct vertex
+{
+   float pos[4];
+   float color[4];
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "threaded\n");
+
+   fflush(fp);
+}
+
+
+static void
+set_gallium_thread(boolean threaded)
+{
+#ifdef _WIN32
+   _putenv_s("GALLIUM_THREAD", threaded ? "1" : "0");
+#else
+   setenv("GALLIUM_THREAD", threaded ? "1" : "0", 1);
+#endif
+}
+
+
+/**
+ * Fill verts with two triangles covering x0..x1 in clip space, with the
+ * given color.
+ */
+static void
+make_rect(struct vertex verts[6], float x0, float x1, const float color[4])
+{
+   static const float corners[6][2] = {
+      { 0, 0 }, { 1, 0 }, { 0, 1 },
+      { 0, 1 }, { 1, 0 }, { 1, 1 },
+   };
+   unsigned i;
+
+   for (i = 0; i < 6; i++) {
+      verts[i].pos[0] = corners[i][0] ? x1 : x0;
+      verts[i].pos[1] = corners[i][1] ? 1.0f : -1.0f;
+      verts[i].pos[2] = 0.0f;
+      verts[i].pos[3] = 1.0f;
+      memcpy(verts[i].color, color, sizeof verts[i].color);
+   }
+}
+
+
+/**
+ * Draw the six vertices in verts, from client memory.
+ */
+static void
+draw_client_array(struct pipe_context *pipe, boolean user_buffers,
+                  const struct vertex verts[6])
+{
+   struct pipe_vertex_buffer vb;
+
+   memset(&vb, 0, sizeof vb);
+   vb.stride = sizeof verts[0];
+
+   if (user_buffers) {
+      vb.is_user_buffer = TRUE;
+      vb.buffer.user = verts;
+   }
+   else {
+      vb.buffer.resource = pipe_buffer_create(pipe->screen,
+                                              PIPE_BIND_VERTEX_BUFFER,
+                                              PIPE_USAGE_STREAM,
+                                              6 * sizeof verts[0]);
+      pipe_buffer_write(pipe, vb.buffer.resource, 0, 6 * sizeof verts[0],
+                        verts);
+   }
+
+   pipe->set_vertex_buffers(pipe, 0, 1, &vb);
+   util_draw_arrays(pipe, PIPE_PRIM_TRIANGLES, 0, 6);
+
+   if (!user_buffers)
+      pipe_resource_reference(&vb.buffer.resource, NULL);
+}
+
+
+static boolean
+check_pixel(unsigned verbose, const uint8_t *pixel, const float color[4],
+            unsigned x, unsigned y)
+{
+   /* B8G8R8A8 */
+   static const unsigned swizzle[4] = { 2, 1, 0, 3 };
+   unsigned chan;
+
+   for (chan = 0; chan < 4; chan++) {
+      int expected = (int)(color[swizzle[chan]] * 255.0f + 0.5f);
+      if (abs((int)pixel[chan] - expected) > 1) {
+         if (verbose)
+            fprintf(stderr, "  pixel %u,%u: got %02x%02x%02x%02x\n",
+                    x, y, pixel[0], pixel[1], pixel[2], pixel[3]);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Clear, draw a full screen rectangle and then the left half of the
+ * screen, reusing the same client array, and check the result.
+ */
+static boolean
+test_draw(unsigned verbose, FILE *fp, boolean threaded)
+{
+   static const float clear_color[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+   static const float color0[4] = { 0.25f, 0.5f, 0.75f, 1.0f };
+   static const float color1[4] = { 1.0f, 0.0f, 0.5f, 1.0f };
+   static const enum tgsi_semantic semantic_names[] =
+      { TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_COLOR };
+   static const uint semantic_indexes[] = { 0, 0 };
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct pipe_resource templ, *target;
+   struct pipe_surface surf_templ, *surf;
+   struct pipe_framebuffer_state fb;
+   struct pipe_blend_state blend;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_rasterizer_state rast;
+   struct pipe_viewport_state viewport;
+   struct pipe_vertex_element velems[2];
+   union pipe_color_union clear;
+   struct pipe_transfer *transfer;
+   void *blend_handle, *dsa_handle, *rast_handle, *velems_handle;
+   void *vs, *fs;
+   struct vertex verts[6];
+   boolean user_buffers;
+   boolean success = TRUE;
+   const uint8_t *map;
+   unsigned x, y;
+
+   set_gallium_thread(threaded);
+
+   screen = llvmpipe_create_screen(null_sw_create());
+   if (!screen) {
+      fprintf(stderr, "failed to create the screen\n");
+      return FALSE;
+   }
+
+   user_buffers = screen->get_param(screen, PIPE_CAP_USER_VERTEX_BUFFERS);
+   if (threaded && user_buffers) {
+      fprintf(stderr, "user vertex buffers advertised with GALLIUM_THREAD\n");
+      success = FALSE;
+   }
+
+   pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe) {
+      fprintf(stderr, "failed to create the context\n");
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   templ.width0 = WIDTH;
+   templ.height0 = HEIGHT;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = PIPE_BIND_RENDER_TARGET;
+   target = screen->resource_create(screen, &templ);
+
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = templ.format;
+   surf = pipe->create_surface(pipe, target, &surf_templ);
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = surf;
+   pipe->set_framebuffer_state(pipe, &fb);
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend_handle = pipe->create_blend_state(pipe, &blend);
+   pipe->bind_blend_state(pipe, blend_handle);
+
+   memset(&dsa, 0, sizeof dsa);
+   dsa_handle = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+   pipe->bind_depth_stencil_alpha_state(pipe, dsa_handle);
+
+   memset(&rast, 0, sizeof rast);
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.half_pixel_center = 1;
+   rast.bottom_edge_rule = 1;
+   rast.depth_clip_near = 1;
+   rast.depth_clip_far = 1;
+   rast_handle = pipe->create_rasterizer_state(pipe, &rast);
+   pipe->bind_rasterizer_state(pipe, rast_handle);
+
+   memset(&viewport, 0, sizeof viewport);
+   viewport.scale[0] = WIDTH / 2.0f;
+   viewport.scale[1] = HEIGHT / 2.0f;
+   viewport.scale[2] = 0.5f;
+   viewport.translate[0] = WIDTH / 2.0f;
+   viewport.translate[1] = HEIGHT / 2.0f;
+   viewport.translate[2] = 0.5f;
+   pipe->set_viewport_states(pipe, 0, 1, &viewport);
+
+   memset(velems, 0, sizeof velems);
+   velems[0].src_offset = offsetof(struct vertex, pos);
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = offsetof(struct vertex, color);
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems_handle = pipe->create_vertex_elements_state(pipe, 2, velems);
+   pipe->bind_vertex_elements_state(pipe, velems_handle);
+
+   vs = util_make_vertex_passthrough_shader(pipe, 2, semantic_names,
+                                            semantic_indexes, FALSE);
+   fs = util_make_fragment_passthrough_shader(pipe, TGSI_SEMANTIC_COLOR,
+                                              TGSI_INTERPOLATE_PERSPECTIVE,
+                                              TRUE);
+   pipe->bind_vs_state(pipe, vs);
+   pipe->bind_fs_state(pipe, fs);
+
+   memcpy(clear.f, clear_color, sizeof clear.f);
+   pipe->clear(pipe, PIPE_CLEAR_COLOR, NULL, &clear, 0.0, 0);
+
+   /* The array is overwritten right after each draw. */
+   make_rect(verts, -1.0f, 1.0f, color0);
+   draw_client_array(pipe, user_buffers, verts);
+   make_rect(verts, -1.0f, 0.0f, color1);
+   draw_client_array(pipe, user_buffers, verts);
+   memset(verts, 0, sizeof verts);
+
+   pipe->flush(pipe, NULL, 0);
+
+   map = pipe_transfer_map(pipe, target, 0, 0, PIPE_TRANSFER_READ,
+                           0, 0, WIDTH, HEIGHT, &transfer);
+   if (map) {
+      for (y = 0; y < HEIGHT && success; y++) {
+         for (x = 0; x < WIDTH && success; x++) {
+            const uint8_t *pixel = map + y * transfer->stride + x * 4;
+            success = check_pixel(verbose, pixel,
+                                  x < WIDTH / 2 ? color1 : color0, x, y);
+         }
+      }
+      pipe_transfer_unmap(pipe, transfer);
+   }
+   else {
+      fprintf(stderr, "failed to map the render target\n");
+      success = FALSE;
+   }
+
+   if (verbose || !success)
+      printf("%s: threaded %u, user vertex buffers %u\n",
+             success ? "ok" : "FAIL", threaded, user_buffers);
+
+   if (fp) {
+      fprintf(fp, "%s\t%u\n", success ? "pass" : "fail", threaded);
+      fflush(fp);
+   }
+
+   pipe->bind_vs_state(pipe, NULL);
+   pipe->bind_fs_state(pipe, NULL);
+   pipe->delete_vs_state(pipe, vs);
+   pipe->delete_fs_state(pipe, fs);
+   pipe->bind_vertex_elements_state(pipe, NULL);
+   pipe->delete_vertex_elements_state(pipe, velems_handle);
+   pipe->bind_rasterizer_state(pipe, NULL);
+   pipe->delete_rasterizer_state(pipe, rast_handle);
+   pipe->bind_depth_stencil_alpha_state(pipe, NULL);
+   pipe->delete_depth_stencil_alpha_state(pipe, dsa_handle);
+   pipe->bind_blend_state(pipe, NULL);
+   pipe->delete_blend_state(pipe, blend_handle);
+
+   fb.nr_cbufs = 0;
+   fb.cbufs[0] = NULL;
+   pipe->set_framebuffer_state(pipe, &fb);
+   pipe_surface_reference(&surf, NULL);
+   pipe_resource_reference(&target, NULL);
+
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+
+   if (!test_draw(verbose, fp, FALSE))
+      success = FALSE;
+   if (!test_draw(verbose, fp, TRUE))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_draw(verbose, fp, TRUE);
+}
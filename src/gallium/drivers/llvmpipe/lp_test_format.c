@@ -150,7 +150,7 @@ test_format_float(unsigned verbose, FILE *fp,
    unsigned i, j, k, l;
 
    context = LLVMContextCreate();
-   gallivm = gallivm_create("test_module_float", context);
+   gallivm = gallivm_create("test_module_float", context, NULL);
 
    fetch = add_fetch_rgba_test(gallivm, verbose, desc,
                                lp_float32_vec4_type(), use_cache);
@@ -175,6 +175,9 @@ test_format_float(unsigned verbose, FILE *fp,
 
          /* To ensure it's 16-byte aligned */
          memcpy(packed, test->packed, sizeof packed);
+         /* Same address for every test case, so drop stale blocks */
+         if (use_cache)
+            lp_build_format_cache_reset(cache_ptr);
 
          for (i = 0; i < desc->block.height; ++i) {
             for (j = 0; j < desc->block.width; ++j) {
@@ -251,7 +254,7 @@ test_format_unorm8(unsigned verbose, FILE *fp,
    unsigned i, j, k, l;
 
    context = LLVMContextCreate();
-   gallivm = gallivm_create("test_module_unorm8", context);
+   gallivm = gallivm_create("test_module_unorm8", context, NULL);
 
    fetch = add_fetch_rgba_test(gallivm, verbose, desc,
                                lp_unorm8_vec4_type(), use_cache);
@@ -276,6 +279,9 @@ test_format_unorm8(unsigned verbose, FILE *fp,
          /* To ensure it's 16-byte aligned */
          /* Could skip this and use unaligned lp_build_fetch_rgba_aos */
          memcpy(packed, test->packed, sizeof packed);
+         /* Same address for every test case, so drop stale blocks */
+         if (use_cache)
+            lp_build_format_cache_reset(cache_ptr);
 
          for (i = 0; i < desc->block.height; ++i) {
             for (j = 0; j < desc->block.width; ++j) {
@@ -362,7 +368,7 @@ test_all(unsigned verbose, FILE *fp)
    boolean success = TRUE;
    unsigned use_cache;
 
-   cache_ptr = align_malloc(sizeof(struct lp_build_format_cache), 16);
+   cache_ptr = lp_build_format_cache_create();
 
    for (use_cache = 0; use_cache < 2; use_cache++) {
       for (format = 1; format < PIPE_FORMAT_COUNT; ++format) {
@@ -398,7 +404,7 @@ test_all(unsigned verbose, FILE *fp)
          }
 
          /* only test twice with formats which can use cache */
-         if (format_desc->layout != UTIL_FORMAT_LAYOUT_S3TC && use_cache) {
+         if (use_cache && !lp_build_format_cache_supported(format_desc)) {
             continue;
          }
 
@@ -407,7 +413,7 @@ test_all(unsigned verbose, FILE *fp)
          }
       }
    }
-   align_free(cache_ptr);
+   lp_build_format_cache_destroy(cache_ptr);
 
    return success;
 }
@@ -0,0 +1,592 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * Tiled texture layout (LP_TILED_TEXTURES) tests.
+ *
+ * Textures whose sizes are not multiples of the tile size are written and
+ * read back through transfers of unaligned boxes, and sampled by a
+ * fragment shader at every texel, for the 8-bit AoS and the SoA sampling
+ * paths.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "util/format/u_format.h"
+#include "util/u_draw.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_sampler.h"
+#include "util/u_simple_shaders.h"
+#include "sw/null/null_sw_winsys.h"
+
+#include "lp_public.h"
+#include "lp_texture.h"
+#include "lp_test.h"
+
+
+struct vertex
+{
+   float pos[4];
+   float texcoord[4];
+};
+
+
+struct texture_case
+{
+   enum pipe_format format;
+   enum pipe_texture_target target;
+   unsigned width;
+   unsigned height;
+   unsigned last_level;
+};
+
+
+static const struct texture_case texture_cases[] = {
+   { PIPE_FORMAT_B8G8R8A8_UNORM,      PIPE_TEXTURE_2D,    13,  7, 2 },
+   { PIPE_FORMAT_B8G8R8A8_UNORM,      PIPE_TEXTURE_RECT,  17, 10, 0 },
+   { PIPE_FORMAT_R8G8B8A8_UNORM,      PIPE_TEXTURE_2D,     5, 31, 1 },
+   { PIPE_FORMAT_R32G32B32A32_FLOAT,  PIPE_TEXTURE_2D,    11,  6, 1 },
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "format\t"
+           "size\t"
+           "level\t"
+           "test\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp, boolean success, const struct texture_case *tc,
+              unsigned level, const char *test)
+{
+   if (!fp)
+      return;
+
+   fprintf(fp, "%s\t%s\t%ux%u\t%u\t%s\n",
+           success ? "pass" : "fail",
+           util_format_short_name(tc->format),
+           tc->width, tc->height, level, test);
+   fflush(fp);
+}
+
+
+/**
+ * Texel color, as RGBA unorm8, of the given texel in the given pass.
+ */
+static void
+texel_color(unsigned pass, unsigned level, unsigned x, unsigned y,
+            uint8_t rgba[4])
+{
+   rgba[0] = (uint8_t)(x * 17 + pass * 101);
+   rgba[1] = (uint8_t)(y * 29 + level * 53);
+   rgba[2] = (uint8_t)((x ^ y) * 7 + pass * 31);
+   rgba[3] = (uint8_t)(255 - level * 16 - pass);
+}
+
+
+static void
+pack_texel(enum pipe_format format, const uint8_t rgba[4], void *dst)
+{
+   float f[4];
+   unsigned chan;
+
+   for (chan = 0; chan < 4; chan++)
+      f[chan] = ubyte_to_float(rgba[chan]);
+   util_format_pack_rgba(format, dst, f, 1);
+}
+
+
+/**
+ * Unpack a texel to RGBA unorm8.
+ */
+static void
+unpack_texel(enum pipe_format format, const void *src, uint8_t rgba[4])
+{
+   float f[4];
+   unsigned chan;
+
+   util_format_unpack_rgba(format, f, src, 1);
+   for (chan = 0; chan < 4; chan++)
+      rgba[chan] = float_to_ubyte(f[chan]);
+}
+
+
+static boolean
+compare_texel(unsigned verbose, const uint8_t got[4],
+              const uint8_t expected[4], unsigned x, unsigned y)
+{
+   unsigned chan;
+
+   for (chan = 0; chan < 4; chan++) {
+      if (abs((int)got[chan] - (int)expected[chan]) > 1) {
+         if (verbose)
+            fprintf(stderr, "  texel %u,%u: got %02x%02x%02x%02x, "
+                    "expected %02x%02x%02x%02x\n", x, y,
+                    got[0], got[1], got[2], got[3],
+                    expected[0], expected[1], expected[2], expected[3]);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Write the given pass of the pattern into a box of a texture level.
+ */
+static boolean
+write_box(struct pipe_context *pipe, struct pipe_resource *tex,
+          unsigned level, unsigned pass, unsigned usage,
+          unsigned x, unsigned y, unsigned w, unsigned h)
+{
+   const unsigned bpp = util_format_get_blocksize(tex->format);
+   struct pipe_transfer *transfer;
+   uint8_t *map;
+   unsigned i, j;
+
+   map = pipe_transfer_map(pipe, tex, level, 0, PIPE_TRANSFER_WRITE | usage,
+                           x, y, w, h, &transfer);
+   if (!map)
+      return FALSE;
+
+   for (j = 0; j < h; j++) {
+      for (i = 0; i < w; i++) {
+         uint8_t rgba[4];
+         texel_color(pass, level, x + i, y + j, rgba);
+         pack_texel(tex->format, rgba,
+                    map + j * transfer->stride + i * bpp);
+      }
+   }
+
+   pipe_transfer_unmap(pipe, transfer);
+   return TRUE;
+}
+
+
+/**
+ * Which pass of the pattern a texel should hold after
+ * write_level_pattern().
+ */
+static unsigned
+expected_pass(unsigned x, unsigned y, unsigned width, unsigned height)
+{
+   if (width <= 4 || height <= 2)
+      return 0;
+
+   return x >= 3 && y >= 1 && x < width - 1 && y < height - 1 ? 1 : 0;
+}
+
+
+/**
+ * Fill a level with pass 0 of the pattern, then overwrite a box which
+ * is not aligned to the tiles with pass 1.
+ */
+static boolean
+write_level_pattern(struct pipe_context *pipe, struct pipe_resource *tex,
+                    unsigned level)
+{
+   const unsigned width = u_minify(tex->width0, level);
+   const unsigned height = u_minify(tex->height0, level);
+
+   if (!write_box(pipe, tex, level, 0, PIPE_TRANSFER_DISCARD_RANGE,
+                  0, 0, width, height))
+      return FALSE;
+
+   if (width > 4 && height > 2) {
+      /* no discard, so the texels around the box must survive */
+      if (!write_box(pipe, tex, level, 1, 0, 3, 1, width - 4, height - 2))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Read back a box of a level and check it against the pattern.
+ */
+static boolean
+check_box(unsigned verbose, struct pipe_context *pipe,
+          struct pipe_resource *tex, unsigned level,
+          unsigned x, unsigned y, unsigned w, unsigned h)
+{
+   const unsigned width = u_minify(tex->width0, level);
+   const unsigned height = u_minify(tex->height0, level);
+   const unsigned bpp = util_format_get_blocksize(tex->format);
+   struct pipe_transfer *transfer;
+   const uint8_t *map;
+   boolean success = TRUE;
+   unsigned i, j;
+
+   map = pipe_transfer_map(pipe, tex, level, 0, PIPE_TRANSFER_READ,
+                           x, y, w, h, &transfer);
+   if (!map)
+      return FALSE;
+
+   for (j = 0; j < h && success; j++) {
+      for (i = 0; i < w && success; i++) {
+         uint8_t got[4], expected[4];
+         unpack_texel(tex->format, map + j * transfer->stride + i * bpp, got);
+         texel_color(expected_pass(x + i, y + j, width, height), level,
+                     x + i, y + j, expected);
+         success = compare_texel(verbose, got, expected, x + i, y + j);
+      }
+   }
+
+   pipe_transfer_unmap(pipe, transfer);
+   return success;
+}
+
+
+/**
+ * Sample every texel of a level at its center, into a render target of
+ * the same size, and check the result against the pattern.
+ */
+static boolean
+check_sampling(unsigned verbose, struct pipe_context *pipe,
+               struct pipe_resource *tex, unsigned level,
+               enum pipe_tex_filter filter)
+{
+   static const enum tgsi_semantic semantic_names[] =
+      { TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_GENERIC };
+   static const uint semantic_indexes[] = { 0, 0 };
+   static const float corners[6][2] = {
+      { 0, 0 }, { 1, 0 }, { 0, 1 },
+      { 0, 1 }, { 1, 0 }, { 1, 1 },
+   };
+   struct pipe_screen *screen = pipe->screen;
+   const unsigned width = u_minify(tex->width0, level);
+   const unsigned height = u_minify(tex->height0, level);
+   struct pipe_resource templ, *target, *vbuf;
+   struct pipe_surface surf_templ, *surf;
+   struct pipe_sampler_view view_templ, *view;
+   struct pipe_sampler_state sampler;
+   struct pipe_framebuffer_state fb;
+   struct pipe_blend_state blend;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_rasterizer_state rast;
+   struct pipe_viewport_state viewport;
+   struct pipe_vertex_element velems[2];
+   struct pipe_vertex_buffer vb;
+   struct pipe_transfer *transfer;
+   void *blend_handle, *dsa_handle, *rast_handle, *velems_handle;
+   void *sampler_handle, *null_sampler = NULL;
+   void *vs, *fs;
+   struct vertex verts[6];
+   boolean success = TRUE;
+   const uint8_t *map;
+   unsigned i, x, y;
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_R8G8B8A8_UNORM;
+   templ.width0 = width;
+   templ.height0 = height;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = PIPE_BIND_RENDER_TARGET;
+   target = screen->resource_create(screen, &templ);
+   if (!target)
+      return FALSE;
+
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = templ.format;
+   surf = pipe->create_surface(pipe, target, &surf_templ);
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = width;
+   fb.height = height;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = surf;
+   pipe->set_framebuffer_state(pipe, &fb);
+
+   u_sampler_view_default_template(&view_templ, tex, tex->format);
+   view_templ.u.tex.first_level = level;
+   view_templ.u.tex.last_level = level;
+   view = pipe->create_sampler_view(pipe, tex, &view_templ);
+   pipe->set_sampler_views(pipe, PIPE_SHADER_FRAGMENT, 0, 1, &view);
+
+   memset(&sampler, 0, sizeof sampler);
+   sampler.wrap_s = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+   sampler.wrap_t = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+   sampler.wrap_r = PIPE_TEX_WRAP_CLAMP_TO_EDGE;
+   sampler.min_img_filter = filter;
+   sampler.mag_img_filter = filter;
+   sampler.min_mip_filter = PIPE_TEX_MIPFILTER_NONE;
+   sampler.normalized_coords = tex->target != PIPE_TEXTURE_RECT;
+   sampler_handle = pipe->create_sampler_state(pipe, &sampler);
+   pipe->bind_sampler_states(pipe, PIPE_SHADER_FRAGMENT, 0, 1,
+                             &sampler_handle);
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend_handle = pipe->create_blend_state(pipe, &blend);
+   pipe->bind_blend_state(pipe, blend_handle);
+
+   memset(&dsa, 0, sizeof dsa);
+   dsa_handle = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+   pipe->bind_depth_stencil_alpha_state(pipe, dsa_handle);
+
+   memset(&rast, 0, sizeof rast);
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.half_pixel_center = 1;
+   rast.bottom_edge_rule = 1;
+   rast.depth_clip_near = 1;
+   rast.depth_clip_far = 1;
+   rast_handle = pipe->create_rasterizer_state(pipe, &rast);
+   pipe->bind_rasterizer_state(pipe, rast_handle);
+
+   memset(&viewport, 0, sizeof viewport);
+   viewport.scale[0] = width / 2.0f;
+   viewport.scale[1] = height / 2.0f;
+   viewport.scale[2] = 0.5f;
+   viewport.translate[0] = width / 2.0f;
+   viewport.translate[1] = height / 2.0f;
+   viewport.translate[2] = 0.5f;
+   pipe->set_viewport_states(pipe, 0, 1, &viewport);
+
+   memset(velems, 0, sizeof velems);
+   velems[0].src_offset = offsetof(struct vertex, pos);
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = offsetof(struct vertex, texcoord);
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems_handle = pipe->create_vertex_elements_state(pipe, 2, velems);
+   pipe->bind_vertex_elements_state(pipe, velems_handle);
+
+   vs = util_make_vertex_passthrough_shader(pipe, 2, semantic_names,
+                                            semantic_indexes, FALSE);
+   fs = util_make_fragment_tex_shader(pipe,
+                                      tex->target == PIPE_TEXTURE_RECT ?
+                                      TGSI_TEXTURE_RECT : TGSI_TEXTURE_2D,
+                                      TGSI_INTERPOLATE_LINEAR,
+                                      TGSI_RETURN_TYPE_FLOAT,
+                                      TGSI_RETURN_TYPE_FLOAT,
+                                      FALSE, FALSE);
+   pipe->bind_vs_state(pipe, vs);
+   pipe->bind_fs_state(pipe, fs);
+
+   /* a quad covering the target, with texel centers at pixel centers */
+   for (i = 0; i < 6; i++) {
+      verts[i].pos[0] = corners[i][0] ? 1.0f : -1.0f;
+      verts[i].pos[1] = corners[i][1] ? 1.0f : -1.0f;
+      verts[i].pos[2] = 0.0f;
+      verts[i].pos[3] = 1.0f;
+      verts[i].texcoord[0] = corners[i][0] *
+         (sampler.normalized_coords ? 1.0f : (float)width);
+      verts[i].texcoord[1] = corners[i][1] *
+         (sampler.normalized_coords ? 1.0f : (float)height);
+      verts[i].texcoord[2] = 0.0f;
+      verts[i].texcoord[3] = 1.0f;
+   }
+
+   vbuf = pipe_buffer_create(screen, PIPE_BIND_VERTEX_BUFFER,
+                             PIPE_USAGE_STREAM, sizeof verts);
+   pipe_buffer_write(pipe, vbuf, 0, sizeof verts, verts);
+   memset(&vb, 0, sizeof vb);
+   vb.stride = sizeof verts[0];
+   vb.buffer.resource = vbuf;
+   pipe->set_vertex_buffers(pipe, 0, 1, &vb);
+
+   util_draw_arrays(pipe, PIPE_PRIM_TRIANGLES, 0, 6);
+   pipe->flush(pipe, NULL, 0);
+
+   if (!llvmpipe_resource(tex)->tiled) {
+      fprintf(stderr, "  texture was untiled by sampling\n");
+      success = FALSE;
+   }
+
+   map = pipe_transfer_map(pipe, target, 0, 0, PIPE_TRANSFER_READ,
+                           0, 0, width, height, &transfer);
+   if (map) {
+      for (y = 0; y < height && success; y++) {
+         for (x = 0; x < width && success; x++) {
+            uint8_t expected[4];
+            texel_color(expected_pass(x, y, width, height), level, x, y,
+                        expected);
+            success = compare_texel(verbose, map + y * transfer->stride + x * 4,
+                                    expected, x, y);
+         }
+      }
+      pipe_transfer_unmap(pipe, transfer);
+   }
+   else {
+      success = FALSE;
+   }
+
+   pipe->bind_vs_state(pipe, NULL);
+   pipe->bind_fs_state(pipe, NULL);
+   pipe->delete_vs_state(pipe, vs);
+   pipe->delete_fs_state(pipe, fs);
+   pipe->set_vertex_buffers(pipe, 0, 1, NULL);
+   pipe_resource_reference(&vbuf, NULL);
+   pipe->bind_vertex_elements_state(pipe, NULL);
+   pipe->delete_vertex_elements_state(pipe, velems_handle);
+   pipe->bind_rasterizer_state(pipe, NULL);
+   pipe->delete_rasterizer_state(pipe, rast_handle);
+   pipe->bind_depth_stencil_alpha_state(pipe, NULL);
+   pipe->delete_depth_stencil_alpha_state(pipe, dsa_handle);
+   pipe->bind_blend_state(pipe, NULL);
+   pipe->delete_blend_state(pipe, blend_handle);
+   pipe->bind_sampler_states(pipe, PIPE_SHADER_FRAGMENT, 0, 1,
+                             &null_sampler);
+   pipe->delete_sampler_state(pipe, sampler_handle);
+   pipe_sampler_view_reference(&view, NULL);
+   pipe->set_sampler_views(pipe, PIPE_SHADER_FRAGMENT, 0, 1, &view);
+
+   fb.nr_cbufs = 0;
+   fb.cbufs[0] = NULL;
+   pipe->set_framebuffer_state(pipe, &fb);
+   pipe_surface_reference(&surf, NULL);
+   pipe_resource_reference(&target, NULL);
+
+   return success;
+}
+
+
+static boolean
+test_texture(unsigned verbose, FILE *fp, const struct texture_case *tc)
+{
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct pipe_resource templ, *tex;
+   boolean success = TRUE;
+   unsigned level;
+
+#ifdef _WIN32
+   _putenv_s("LP_TILED_TEXTURES", "1");
+   _putenv_s("GALLIUM_THREAD", "0");
+#else
+   setenv("LP_TILED_TEXTURES", "1", 1);
+   setenv("GALLIUM_THREAD", "0", 1);
+#endif
+
+   screen = llvmpipe_create_screen(null_sw_create());
+   if (!screen) {
+      fprintf(stderr, "failed to create the screen\n");
+      return FALSE;
+   }
+
+   pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe) {
+      fprintf(stderr, "failed to create the context\n");
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = tc->target;
+   templ.format = tc->format;
+   templ.width0 = tc->width;
+   templ.height0 = tc->height;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.last_level = tc->last_level;
+   templ.bind = PIPE_BIND_SAMPLER_VIEW;
+   tex = screen->resource_create(screen, &templ);
+
+   if (!tex || !llvmpipe_resource(tex)->tiled) {
+      fprintf(stderr, "failed to create a tiled %s texture\n",
+              util_format_short_name(tc->format));
+      success = FALSE;
+   }
+
+   for (level = 0; success && level <= tc->last_level; level++) {
+      const unsigned width = u_minify(tc->width, level);
+      const unsigned height = u_minify(tc->height, level);
+      boolean ok;
+
+      ok = write_level_pattern(pipe, tex, level) &&
+           check_box(verbose, pipe, tex, level, 0, 0, width, height) &&
+           check_box(verbose, pipe, tex, level, width / 3, height / 3,
+                     width - width / 3, height - height / 3);
+      write_tsv_row(fp, ok, tc, level, "transfer");
+      if (verbose || !ok)
+         printf("%s: %s %ux%u level %u transfer\n", ok ? "ok" : "FAIL",
+                util_format_short_name(tc->format), tc->width, tc->height,
+                level);
+      if (!ok) {
+         success = FALSE;
+         break;
+      }
+
+      ok = check_sampling(verbose, pipe, tex, level, PIPE_TEX_FILTER_NEAREST) &&
+           check_sampling(verbose, pipe, tex, level, PIPE_TEX_FILTER_LINEAR);
+      write_tsv_row(fp, ok, tc, level, "sample");
+      if (verbose || !ok)
+         printf("%s: %s %ux%u level %u sample\n", ok ? "ok" : "FAIL",
+                util_format_short_name(tc->format), tc->width, tc->height,
+                level);
+      if (!ok)
+         success = FALSE;
+   }
+
+   pipe_resource_reference(&tex, NULL);
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(texture_cases); i++) {
+      if (!test_texture(verbose, fp, &texture_cases[i]))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_texture(verbose, fp, &texture_cases[0]);
+}
@@ -0,0 +1,564 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/**
+ * @file
+ * Unit tests for the triangle edge-mask kernels.
+ *
+ * The AVX2 / AVX-512 mask builders used by the triangle rasterizer are
+ * checked against a plain C evaluation of the edge functions, for random
+ * blocks of 1 to 8 planes, the way lp_rast_tri_tmp.h combines them.
+ *
+ * The whole lp_rast_triangle_* commands, generic and SIMD, are then run
+ * on random triangles against complete and partial tiles, with a fake
+ * fragment shader recording the coverage masks it is called with.
+ */
+
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+
+#include "lp_rast_priv.h"
+#include "lp_scene.h"
+#include "lp_state_fs.h"
+#include "lp_test.h"
+
+
+typedef void (*build_masks_t)(int c, int cdiff, int dcdx, int dcdy,
+                              unsigned *outmask, unsigned *partmask);
+typedef unsigned (*build_mask_linear_t)(int c, int dcdx, int dcdy);
+
+struct tri_kernel {
+   const char *name;
+   boolean supported;
+   build_masks_t build_masks;
+   build_mask_linear_t build_mask_linear;
+};
+
+struct tri_raster {
+   const char *name;
+   boolean supported;
+   boolean raster_32;
+   lp_rast_cmd_func dispatch[LP_RAST_OP_MAX];
+};
+
+struct tri_plane_case {
+   int c;
+   int cdiff;
+   int dcdx;
+   int dcdy;
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "kernel\t"
+           "planes\n");
+
+   fflush(fp);
+}
+
+
+/**
+ * Reference: sign bits of c + j * dcdx + i * dcdy, in wrapping 32-bit
+ * arithmetic like the rasterizer.
+ */
+static unsigned
+ref_mask_linear(int c, int dcdx, int dcdy)
+{
+   unsigned mask = 0;
+   unsigned i, j;
+
+   for (i = 0; i < 4; i++) {
+      for (j = 0; j < 4; j++) {
+         int32_t v = (int32_t)((uint32_t)c +
+                               (uint32_t)dcdx * j +
+                               (uint32_t)dcdy * i);
+         if (v < 0)
+            mask |= 1 << (i * 4 + j);
+      }
+   }
+
+   return mask;
+}
+
+
+static int
+random_int(int bits)
+{
+   uint32_t v = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+   return (int)(v & ((1u << bits) - 1)) - (1 << (bits - 1));
+}
+
+
+/**
+ * Edge function values in the ranges the rasterizer produces at the 16x16
+ * and 4x4 levels: steps up to 21 bits scaled by the block size, and c
+ * within the 30 bits guaranteed by setup.  Most planes are placed so the
+ * edge crosses the block, otherwise the masks are trivially all or none.
+ */
+static void
+random_plane(struct tri_plane_case *plane)
+{
+   int shift = (rand() & 1) ? 4 : 2;
+   int bits = 2 + rand() % 20;
+
+   plane->dcdx = random_int(bits) * (1 << shift);
+   plane->dcdy = random_int(bits) * (1 << shift);
+
+   if (rand() % 8) {
+      int64_t range = 3 * ((int64_t)abs(plane->dcdx) + abs(plane->dcdy)) + 1;
+      plane->c = (int)(((int64_t)random_int(31) % range));
+      plane->cdiff = (int)(((int64_t)random_int(31) % range));
+   }
+   else {
+      plane->c = random_int(31);
+      plane->cdiff = random_int(26);
+   }
+}
+
+
+static boolean
+test_one(unsigned verbose, FILE *fp,
+         const struct tri_kernel *kernel, unsigned nr_planes)
+{
+   struct tri_plane_case planes[8];
+   unsigned ref_out = 0, ref_part = 0, ref_linear = 0xffff;
+   unsigned out = 0, part = 0, linear = 0xffff;
+   boolean success = TRUE;
+   unsigned j;
+
+   assert(nr_planes <= ARRAY_SIZE(planes));
+
+   for (j = 0; j < nr_planes; j++) {
+      const struct tri_plane_case *p = &planes[j];
+      unsigned plane_out = 0, plane_part = 0;
+      unsigned ref_plane_out, ref_plane_part;
+
+      random_plane(&planes[j]);
+
+      ref_plane_out = ref_mask_linear(p->c, p->dcdx, p->dcdy);
+      ref_plane_part = ref_mask_linear((int)((uint32_t)p->c +
+                                             (uint32_t)p->cdiff),
+                                       p->dcdx, p->dcdy);
+      ref_out |= ref_plane_out;
+      ref_part |= ref_plane_part;
+      ref_linear &= ~ref_plane_out;
+
+      /* Each plane on its own, then accumulated like do_block_16 does. */
+      kernel->build_masks(p->c, p->cdiff, p->dcdx, p->dcdy,
+                          &plane_out, &plane_part);
+      if (plane_out != ref_plane_out || plane_part != ref_plane_part)
+         success = FALSE;
+
+      kernel->build_masks(p->c, p->cdiff, p->dcdx, p->dcdy, &out, &part);
+      linear &= ~kernel->build_mask_linear(p->c, p->dcdx, p->dcdy);
+   }
+
+   if (out != ref_out || part != ref_part || linear != ref_linear)
+      success = FALSE;
+
+   if (!success || verbose >= 1) {
+      fprintf(stderr, "%s: %u planes: out %04x/%04x part %04x/%04x "
+              "linear %04x/%04x\n",
+              kernel->name, nr_planes, out, ref_out, part, ref_part,
+              linear, ref_linear);
+      if (!success) {
+         for (j = 0; j < nr_planes; j++)
+            fprintf(stderr, "  plane %u: c=%d cdiff=%d dcdx=%d dcdy=%d\n",
+                    j, planes[j].c, planes[j].cdiff,
+                    planes[j].dcdx, planes[j].dcdy);
+      }
+   }
+
+   if (fp) {
+      fprintf(fp, "%s\t%s\t%u\n", success ? "pass" : "fail",
+              kernel->name, nr_planes);
+      fflush(fp);
+   }
+
+   return success;
+}
+
+
+/** Number of times each pixel of the tile was shaded by the fake shader */
+static uint8_t tile_coverage[TILE_SIZE][TILE_SIZE];
+static unsigned tile_x, tile_y;
+
+
+static void
+record_coverage(const struct lp_jit_context *context,
+                uint32_t x, uint32_t y, uint32_t facing,
+                const void *a0, const void *dadx, const void *dady,
+                uint8_t **color, uint8_t *depth, uint32_t mask,
+                struct lp_jit_thread_data *thread_data,
+                unsigned *stride, unsigned depth_stride)
+{
+   unsigned i, j;
+
+   assert(x >= tile_x && x - tile_x < TILE_SIZE);
+   assert(y >= tile_y && y - tile_y < TILE_SIZE);
+
+   for (i = 0; i < 4; i++) {
+      for (j = 0; j < 4; j++) {
+         if (mask & (1 << (i * 4 + j)))
+            tile_coverage[y - tile_y + i][x - tile_x + j]++;
+      }
+   }
+}
+
+
+/**
+ * Set up the edge functions of a triangle the way lp_setup_tri.c does,
+ * from vertices in FIXED_ORDER fixed point.  The vertices are reordered
+ * so the inside of the triangle is where all planes are positive.
+ * Returns FALSE for degenerate triangles.
+ */
+static boolean
+setup_tri_planes(int32_t x[3], int32_t y[3], struct lp_rast_plane *plane)
+{
+   int64_t area = (int64_t)(x[0] - x[2]) * (y[1] - y[2]) -
+                  (int64_t)(y[0] - y[2]) * (x[1] - x[2]);
+   unsigned i;
+
+   if (area == 0)
+      return FALSE;
+
+   if (area > 0) {
+      int32_t tmp;
+      tmp = x[1]; x[1] = x[2]; x[2] = tmp;
+      tmp = y[1]; y[1] = y[2]; y[2] = tmp;
+   }
+
+   for (i = 0; i < 3; i++) {
+      unsigned next = (i + 1) % 3;
+
+      plane[i].dcdy = x[i] - x[next];
+      plane[i].dcdx = y[i] - y[next];
+      plane[i].c = (int64_t)plane[i].dcdx * x[i] -
+                   (int64_t)plane[i].dcdy * y[i];
+
+      /* top-left fill convention */
+      if (plane[i].dcdx < 0 || (plane[i].dcdx == 0 && plane[i].dcdy > 0))
+         plane[i].c++;
+
+      plane[i].dcdx <<= FIXED_ORDER;
+      plane[i].dcdy <<= FIXED_ORDER;
+
+      plane[i].eo = 0;
+      if (plane[i].dcdx < 0) plane[i].eo -= plane[i].dcdx;
+      if (plane[i].dcdy > 0) plane[i].eo += plane[i].dcdy;
+      plane[i].pad = 0;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Random triangle around the tile, in fixed point.  Small triangles fit
+ * the 32-bit rasterization functions, large ones often cover the tile
+ * completely.
+ */
+static void
+random_tri(boolean small, int32_t x[3], int32_t y[3])
+{
+   unsigned i;
+
+   if (small) {
+      int32_t x0 = ((int)tile_x - 16 + rand() % 80) * FIXED_ONE;
+      int32_t y0 = ((int)tile_y - 16 + rand() % 80) * FIXED_ONE;
+
+      /* keep the bounding box within MAX_FIXED_LENGTH32 / 2 */
+      for (i = 0; i < 3; i++) {
+         x[i] = x0 + rand() % (32 * FIXED_ONE);
+         y[i] = y0 + rand() % (32 * FIXED_ONE);
+      }
+   }
+   else {
+      for (i = 0; i < 3; i++) {
+         x[i] = ((int)tile_x - 448 + rand() % 960) * FIXED_ONE +
+                rand() % FIXED_ONE;
+         y[i] = ((int)tile_y - 448 + rand() % 960) * FIXED_ONE +
+                rand() % FIXED_ONE;
+      }
+   }
+}
+
+
+static boolean
+test_tri_one(unsigned verbose, FILE *fp,
+             const struct tri_raster *rasters, unsigned num_rasters,
+             unsigned nr_planes, boolean small, boolean partial)
+{
+   struct lp_scene *scene;
+   struct lp_fragment_shader_variant *variant;
+   struct lp_rast_state state;
+   struct lp_rasterizer_task task;
+   struct lp_rast_triangle *tri;
+   struct lp_rast_plane *plane;
+   union lp_rast_cmd_arg arg;
+   uint8_t ref[TILE_SIZE][TILE_SIZE];
+   unsigned width, height;
+   boolean success = TRUE;
+   unsigned i, j, k, r;
+
+   scene = CALLOC_STRUCT(lp_scene);
+   variant = CALLOC_STRUCT(lp_fragment_shader_variant);
+   tri = align_malloc(sizeof *tri + 8 * sizeof *plane, 16);
+   if (!scene || !variant || !tri) {
+      FREE(scene);
+      FREE(variant);
+      align_free(tri);
+      return FALSE;
+   }
+
+   tile_x = (rand() % 4) * TILE_SIZE;
+   tile_y = (rand() % 4) * TILE_SIZE;
+   width = partial ? 1 + rand() % (TILE_SIZE - 1) : TILE_SIZE;
+   height = partial ? 1 + rand() % (TILE_SIZE - 1) : TILE_SIZE;
+
+   scene->tiles_x = tile_x / TILE_SIZE + 1;
+   scene->tiles_y = tile_y / TILE_SIZE + 1;
+
+   variant->jit_function[RAST_WHOLE] = record_coverage;
+   variant->jit_function[RAST_EDGE_TEST] = record_coverage;
+
+   memset(&state, 0, sizeof state);
+   state.variant = variant;
+
+   memset(&task, 0, sizeof task);
+   task.scene = scene;
+   task.state = &state;
+   task.x = tile_x;
+   task.y = tile_y;
+   task.width = width;
+   task.height = height;
+
+   memset(tri, 0, sizeof *tri);
+   tri->inputs.stride = 0;
+   plane = GET_PLANES(tri);
+
+   /* Up to three triangles, the extra planes clip the first one. */
+   for (i = 0; i < nr_planes; i += 3) {
+      struct lp_rast_plane tri_planes[3];
+      int32_t x[3], y[3];
+
+      do {
+         random_tri(small, x, y);
+      } while (!setup_tri_planes(x, y, tri_planes));
+
+      for (j = 0; j < 3 && i + j < nr_planes; j++)
+         plane[i + j] = tri_planes[j];
+   }
+
+   arg.triangle.tri = tri;
+   arg.triangle.plane_mask = (1 << nr_planes) - 1;
+
+   /* Pixels are inside when all the edge functions are positive; the
+    * shader is called for whole 4x4 blocks starting within the tile.
+    */
+   for (i = 0; i < TILE_SIZE; i++) {
+      for (j = 0; j < TILE_SIZE; j++) {
+         int64_t px = tile_x + j, py = tile_y + i;
+         boolean inside = (j & ~3) < width && (i & ~3) < height;
+
+         for (k = 0; k < nr_planes && inside; k++) {
+            if (plane[k].c + plane[k].dcdy * py - plane[k].dcdx * px <= 0)
+               inside = FALSE;
+         }
+         ref[i][j] = inside;
+      }
+   }
+
+   for (r = 0; r < num_rasters; r++) {
+      const struct tri_raster *raster = &rasters[r];
+      unsigned op;
+
+      if (!raster->supported || (raster->raster_32 && !small))
+         continue;
+
+      op = (raster->raster_32 ? LP_RAST_OP_TRIANGLE_32_1 :
+                                LP_RAST_OP_TRIANGLE_1) + nr_planes - 1;
+
+      memset(tile_coverage, 0, sizeof tile_coverage);
+      raster->dispatch[op](&task, arg);
+
+      if (memcmp(tile_coverage, ref, sizeof ref) != 0) {
+         success = FALSE;
+         fprintf(stderr, "%s: %u planes, tile %ux%u at %u,%u: "
+                 "coverage mismatch\n", raster->name, nr_planes,
+                 width, height, tile_x, tile_y);
+         for (k = 0; k < nr_planes; k++)
+            fprintf(stderr, "  plane %u: c=%" PRId64 " dcdx=%d dcdy=%d "
+                    "eo=%u\n", k, plane[k].c, plane[k].dcdx,
+                    plane[k].dcdy, plane[k].eo);
+      }
+      else if (verbose >= 1) {
+         fprintf(stderr, "%s: %u planes, tile %ux%u: ok\n",
+                 raster->name, nr_planes, width, height);
+      }
+
+      if (fp) {
+         fprintf(fp, "%s\t%s\t%u\n", success ? "pass" : "fail",
+                 raster->name, nr_planes);
+         fflush(fp);
+      }
+   }
+
+   FREE(scene);
+   FREE(variant);
+   align_free(tri);
+
+   return success;
+}
+
+
+static unsigned
+get_rasters(struct tri_raster *rasters)
+{
+   static const lp_rast_cmd_func generic[] = {
+      lp_rast_triangle_1, lp_rast_triangle_2, lp_rast_triangle_3,
+      lp_rast_triangle_4, lp_rast_triangle_5, lp_rast_triangle_6,
+      lp_rast_triangle_7, lp_rast_triangle_8,
+   };
+   static const lp_rast_cmd_func generic_32[] = {
+      lp_rast_triangle_32_1, lp_rast_triangle_32_2, lp_rast_triangle_32_3,
+      lp_rast_triangle_32_4, lp_rast_triangle_32_5, lp_rast_triangle_32_6,
+      lp_rast_triangle_32_7, lp_rast_triangle_32_8,
+   };
+   unsigned n = 0, i, bits;
+
+   for (bits = 0; bits < 2; bits++) {
+      memset(&rasters[n], 0, sizeof rasters[n]);
+      rasters[n].name = bits ? "generic_32" : "generic";
+      rasters[n].supported = TRUE;
+      rasters[n].raster_32 = bits;
+      for (i = 0; i < 8; i++) {
+         rasters[n].dispatch[LP_RAST_OP_TRIANGLE_1 + i] = generic[i];
+         rasters[n].dispatch[LP_RAST_OP_TRIANGLE_32_1 + i] = generic_32[i];
+      }
+      n++;
+   }
+
+#ifdef LP_USE_AVX2
+   for (bits = 0; bits < 2; bits++) {
+      memset(&rasters[n], 0, sizeof rasters[n]);
+      rasters[n].name = bits ? "avx2_32" : "avx2";
+      rasters[n].supported = util_cpu_caps.has_avx2;
+      rasters[n].raster_32 = bits;
+      lp_rast_tri_init_avx2(rasters[n].dispatch);
+      n++;
+   }
+#endif
+#ifdef LP_USE_AVX512
+   for (bits = 0; bits < 2; bits++) {
+      memset(&rasters[n], 0, sizeof rasters[n]);
+      rasters[n].name = bits ? "avx512_32" : "avx512";
+      rasters[n].supported = util_cpu_caps.has_avx512f;
+      rasters[n].raster_32 = bits;
+      lp_rast_tri_init_avx512(rasters[n].dispatch);
+      n++;
+   }
+#endif
+
+   return n;
+}
+
+
+static unsigned
+get_kernels(struct tri_kernel *kernels)
+{
+   unsigned n = 0;
+
+#ifdef LP_USE_AVX2
+   kernels[n].name = "avx2";
+   kernels[n].supported = util_cpu_caps.has_avx2;
+   kernels[n].build_masks = lp_rast_tri_build_masks_avx2;
+   kernels[n].build_mask_linear = lp_rast_tri_build_mask_linear_avx2;
+   n++;
+#endif
+#ifdef LP_USE_AVX512
+   kernels[n].name = "avx512";
+   kernels[n].supported = util_cpu_caps.has_avx512f;
+   kernels[n].build_masks = lp_rast_tri_build_masks_avx512;
+   kernels[n].build_mask_linear = lp_rast_tri_build_mask_linear_avx512;
+   n++;
+#endif
+
+   return n;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   struct tri_kernel kernels[2];
+   unsigned num_kernels = get_kernels(kernels);
+   struct tri_raster rasters[6];
+   unsigned num_rasters = get_rasters(rasters);
+   boolean success = TRUE;
+   unsigned long i;
+   unsigned k;
+
+   for (k = 0; k < num_kernels; k++) {
+      if (!kernels[k].supported) {
+         if (verbose >= 1)
+            fprintf(stderr, "%s: not supported by this CPU, skipped\n",
+                    kernels[k].name);
+         continue;
+      }
+
+      for (i = 0; i < n; ++i) {
+         if (!test_one(verbose, fp, &kernels[k], 1 + i % 8))
+            success = FALSE;
+      }
+   }
+
+   /* Whole triangle commands, on complete and partial tiles */
+   for (i = 0; i < MAX2(n / 50, 32); ++i) {
+      if (!test_tri_one(verbose, fp, rasters, num_rasters,
+                        1 + i % 8, (i >> 3) & 1, (i >> 4) & 1))
+         success = FALSE;
+   }
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   return test_some(verbose, fp, 100000);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   return test_some(verbose, fp, 8);
+}
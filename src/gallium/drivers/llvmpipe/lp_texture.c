@@ -34,21 +34,28 @@
 
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
+#include "draw/draw_context.h"
 
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/u_cpu_detect.h"
 #include "util/format/u_format.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
+#include "util/simple_mtx.h"
 #include "util/u_transfer.h"
+#include "util/u_surface.h"
+#include "gallivm/lp_bld_sample.h"
 
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
 #include "lp_setup.h"
 #include "lp_state.h"
+#include "lp_state_cs.h"
 #include "lp_rast.h"
 
 #include "state_tracker/sw_winsys.h"
@@ -56,9 +63,100 @@
 
 #ifdef DEBUG
 static struct llvmpipe_resource resource_list;
+/* The threaded context creates resources from the application thread. */
+static simple_mtx_t resource_list_mutex = _SIMPLE_MTX_INITIALIZER_NP;
 #endif
 static unsigned id_counter = 0;
 
+/* Contexts may bind a texture in a way that needs it untiled concurrently. */
+static simple_mtx_t untile_mutex = _SIMPLE_MTX_INITIALIZER_NP;
+
+/* The damage region is set by the window system code, which may run in
+ * another thread than the context rendering to the resource.
+ */
+static simple_mtx_t damage_mutex = _SIMPLE_MTX_INITIALIZER_NP;
+
+
+/**
+ * Whether a texture may be stored tiled (see LP_SAMPLER_TILE_SIZE).
+ *
+ * Textures which are also bound as render targets or shader images, or
+ * sampled outside of the fragment and compute shaders, are converted with
+ * llvmpipe_resource_untile() the first time that happens.  Depth/stencil
+ * textures are left linear since they are usually rendered to first.
+ */
+static boolean
+llvmpipe_can_tile(const struct llvmpipe_screen *screen,
+                  const struct pipe_resource *pt)
+{
+   const struct util_format_description *desc =
+      util_format_description(pt->format);
+
+   /* llvmpipe_texture_layout() must align the levels to whole tiles */
+   STATIC_ASSERT(LP_RASTER_BLOCK_SIZE % LP_SAMPLER_TILE_SIZE == 0);
+
+   if (!screen->tiled_textures)
+      return FALSE;
+
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+   case PIPE_TEXTURE_3D:
+      break;
+   default:
+      return FALSE;
+   }
+
+   if (!(pt->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (pt->bind & (PIPE_BIND_DEPTH_STENCIL | PIPE_BIND_LINEAR)))
+      return FALSE;
+
+   return desc->block.width == 1 && desc->block.height == 1 &&
+          desc->layout == UTIL_FORMAT_LAYOUT_PLAIN &&
+          !util_format_is_depth_or_stencil(pt->format) &&
+          pt->nr_samples <= 1;
+}
+
+
+/**
+ * Copy a w x h rectangle at (x, y) of a tiled image from or to linear
+ * memory.  Texels are contiguous along x within a tile, so the copies are
+ * done a tile row at a time.
+ */
+static void
+llvmpipe_copy_tiled_rect(ubyte *tiled, unsigned tiled_stride,
+                         ubyte *linear, unsigned linear_stride,
+                         unsigned x, unsigned y, unsigned w, unsigned h,
+                         unsigned bpp, boolean to_tiled)
+{
+   const unsigned tile_size = LP_SAMPLER_TILE_SIZE;
+   const unsigned tile_mask = LP_SAMPLER_TILE_SIZE - 1;
+   unsigned i, j;
+
+   for (j = 0; j < h; j++) {
+      const unsigned ty = y + j;
+      ubyte *tiled_row = tiled + (ty & ~tile_mask) * tiled_stride +
+                         (ty & tile_mask) * tile_size * bpp;
+      ubyte *linear_row = linear + j * linear_stride;
+
+      for (i = 0; i < w; ) {
+         const unsigned tx = x + i;
+         const unsigned n = MIN2(tile_size - (tx & tile_mask), w - i);
+         ubyte *texel = tiled_row +
+                        ((tx & ~tile_mask) * tile_size + (tx & tile_mask)) * bpp;
+
+         if (to_tiled)
+            memcpy(texel, linear_row + i * bpp, n * bpp);
+         else
+            memcpy(linear_row + i * bpp, texel, n * bpp);
+         i += n;
+      }
+   }
+}
+
 
 /**
  * Conventional allocation path for non-display textures:
@@ -264,6 +362,7 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
          /* texture map */
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
+         lpr->tiled = llvmpipe_can_tile(screen, &lpr->base);
       }
    }
    else {
@@ -291,10 +390,14 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
       memset(lpr->data, 0, bytes);
    }
 
-   lpr->id = id_counter++;
+   threaded_resource_init(&lpr->base);
+
+   lpr->id = p_atomic_inc_return(&id_counter) - 1;
 
 #ifdef DEBUG
+   simple_mtx_lock(&resource_list_mutex);
    insert_at_tail(&resource_list, lpr);
+   simple_mtx_unlock(&resource_list_mutex);
 #endif
 
    return &lpr->base;
@@ -331,21 +434,63 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
          align_free(lpr->tex_data);
          lpr->tex_data = NULL;
       }
+      if (lpr->tiled_data) {
+         align_free(lpr->tiled_data);
+         lpr->tiled_data = NULL;
+      }
+   }
+   else if (lpr->storage) {
+      pipe_resource_reference(&lpr->storage, NULL);
    }
    else if (!lpr->userBuffer) {
       assert(lpr->data);
       align_free(lpr->data);
    }
 
+   FREE(lpr->tile_clears);
+
+   threaded_resource_deinit(pt);
+
 #ifdef DEBUG
+   simple_mtx_lock(&resource_list_mutex);
    if (lpr->next)
       remove_from_list(lpr);
+   simple_mtx_unlock(&resource_list_mutex);
 #endif
 
    FREE(lpr);
 }
 
 
+/**
+ * Flag the fragment constants as dirty if resource is the storage of one of
+ * the bound constant buffers.  The data pointer is compared rather than the
+ * resource, as the threaded context maps the buffer whose storage it last
+ * gave to the bound one (see llvmpipe_replace_buffer_storage).
+ */
+static void
+check_constant_buffer_write(struct llvmpipe_context *llvmpipe,
+                            struct pipe_resource *resource)
+{
+   const void *data = llvmpipe_resource(resource)->data;
+   unsigned i;
+
+   if (!(resource->bind & PIPE_BIND_CONSTANT_BUFFER))
+      return;
+
+   for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
+      struct pipe_resource *buffer =
+         llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer;
+
+      if (buffer && llvmpipe_resource(buffer)->data == data) {
+         /* constants may have changed */
+         llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
+         break;
+      }
+   }
+}
+
+
 /**
  * Map a resource for read/write.
  */
@@ -471,10 +616,17 @@ llvmpipe_resource_from_handle(struct pipe_screen *screen,
       goto no_dt;
    }
 
-   lpr->id = id_counter++;
+   threaded_resource_init(&lpr->base);
+
+   /* others may write to it */
+   lpr->untracked_writes = TRUE;
+
+   lpr->id = p_atomic_inc_return(&id_counter) - 1;
 
 #ifdef DEBUG
+   simple_mtx_lock(&resource_list_mutex);
    insert_at_tail(&resource_list, lpr);
+   simple_mtx_unlock(&resource_list_mutex);
 #endif
 
    return &lpr->base;
@@ -500,10 +652,47 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
    if (!lpr->dt)
       return false;
 
+   llvmpipe_resource_untrack_clears(pt);
+
    return winsys->displaytarget_get_handle(winsys, lpr->dt, whandle);
 }
 
 
+/**
+ * Copy the box of a transfer between a tiled texture and the linear
+ * staging memory of the transfer.
+ */
+static void
+llvmpipe_transfer_copy_tiles(struct llvmpipe_resource *lpr,
+                             struct llvmpipe_transfer *lpt,
+                             boolean to_tiled)
+{
+   const struct pipe_transfer *pt = &lpt->base.b;
+   const struct pipe_box *box = &pt->box;
+   const unsigned bpp = util_format_get_blocksize(lpr->base.format);
+   int z;
+
+   for (z = 0; z < box->depth; z++) {
+      ubyte *image = llvmpipe_get_texture_image_address(lpr, box->z + z,
+                                                        pt->level);
+      ubyte *staging = (ubyte *) lpt->staging + z * pt->layer_stride;
+
+      if (lpr->tiled) {
+         llvmpipe_copy_tiled_rect(image, lpr->row_stride[pt->level],
+                                  staging, pt->stride,
+                                  box->x, box->y, box->width, box->height,
+                                  bpp, to_tiled);
+      }
+      else if (to_tiled) {
+         /* untiled while mapped */
+         util_copy_rect(image, lpr->base.format, lpr->row_stride[pt->level],
+                        box->x, box->y, box->width, box->height,
+                        staging, pt->stride, 0, 0);
+      }
+   }
+}
+
+
 static void *
 llvmpipe_transfer_map( struct pipe_context *pipe,
                        struct pipe_resource *resource,
@@ -546,23 +735,19 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       }
    }
 
-   /* Check if we're mapping a current constant buffer */
+   /*
+    * Check if we're mapping a current constant buffer.  Unsynchronized
+    * threaded maps come from the application thread and mustn't touch the
+    * context, they are checked on unmap instead.
+    */
    if ((usage & PIPE_TRANSFER_WRITE) &&
-       (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
-      unsigned i;
-      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[PIPE_SHADER_FRAGMENT]); ++i) {
-         if (resource == llvmpipe->constants[PIPE_SHADER_FRAGMENT][i].buffer) {
-            /* constants may have changed */
-            llvmpipe->dirty |= LP_NEW_FS_CONSTANTS;
-            break;
-         }
-      }
-   }
+       !(usage & TC_TRANSFER_MAP_THREADED_UNSYNC))
+      check_constant_buffer_write(llvmpipe, resource);
 
    lpt = CALLOC_STRUCT(llvmpipe_transfer);
    if (!lpt)
       return NULL;
-   pt = &lpt->base;
+   pt = &lpt->base.b;
    pipe_resource_reference(&pt->resource, resource);
    pt->box = *box;
    pt->level = level;
@@ -609,6 +794,24 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       /* Do something to notify sharing contexts of a texture change.
        */
       screen->timestamp++;
+      llvmpipe_resource_forget_clears(resource, level, box);
+   }
+
+   if (lpr->tiled) {
+      /* Map a linear copy, written back in llvmpipe_transfer_unmap() */
+      pt->stride = align(box->width * util_format_get_blocksize(format), 16);
+      pt->layer_stride = pt->stride * box->height;
+      lpt->staging = align_malloc(pt->layer_stride * box->depth, 64);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+      if (!(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE)))
+         llvmpipe_transfer_copy_tiles(lpr, lpt, FALSE);
+      return lpt->staging;
    }
 
    map +=
@@ -623,35 +826,124 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
+   if ((transfer->usage & PIPE_TRANSFER_WRITE) &&
+       (transfer->usage & TC_TRANSFER_MAP_THREADED_UNSYNC))
+      check_constant_buffer_write(llvmpipe_context(pipe), transfer->resource);
+
    llvmpipe_resource_unmap(transfer->resource,
                            transfer->level,
                            transfer->box.z);
 
-   /* Effectively do the texture_update work here - if texture images
-    * needed post-processing to put them into hardware layout, this is
-    * where it would happen.  For llvmpipe, nothing to do.
+   /* Effectively do the texture_update work here - tiled textures were
+    * mapped through a linear copy which is written back now.
     */
+   if (lpt->staging) {
+      if (transfer->usage & PIPE_TRANSFER_WRITE)
+         llvmpipe_transfer_copy_tiles(llvmpipe_resource(transfer->resource),
+                                      lpt, TRUE);
+      align_free(lpt->staging);
+   }
+
    assert (transfer->resource);
    pipe_resource_reference(&transfer->resource, NULL);
    FREE(transfer);
 }
 
+/**
+ * Make the dst buffer use the storage of src.
+ *
+ * This is how the threaded context invalidates buffers: it allocates src
+ * on the application thread, maps it there instead of dst, and queues this
+ * call.  src keeps being the buffer it maps afterwards, so the storage is
+ * shared with dst rather than moved, and dst holds a reference to src.
+ */
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_resource *lp_dst = llvmpipe_resource(dst);
+   struct llvmpipe_resource *lp_src = llvmpipe_resource(src);
+   enum pipe_shader_type sh;
+   unsigned i;
+
+   assert(dst->target == PIPE_BUFFER && src->target == PIPE_BUFFER);
+   assert(!lp_dst->userBuffer && !lp_src->storage);
+
+   /* Queued scenes may still be reading or writing the old storage. */
+   llvmpipe_flush_resource(pipe, dst, 0,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           __FUNCTION__);
+
+   if (lp_dst->storage)
+      pipe_resource_reference(&lp_dst->storage, NULL);
+   else
+      align_free(lp_dst->data);
+
+   lp_dst->data = lp_src->data;
+   pipe_resource_reference(&lp_dst->storage, src);
+
+   /*
+    * Rebind dst wherever a pointer to its data was taken at bind time.
+    * The rest is looked up at draw time or when the state is dirty.
+    */
+   for (sh = 0; sh < PIPE_SHADER_TYPES; sh++) {
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->constants[sh]); i++) {
+         if (llvmpipe->constants[sh][i].buffer == dst)
+            pipe->set_constant_buffer(pipe, sh, i,
+                                      &llvmpipe->constants[sh][i]);
+      }
+      for (i = 0; i < ARRAY_SIZE(llvmpipe->ssbos[sh]); i++) {
+         if (llvmpipe->ssbos[sh][i].buffer == dst)
+            pipe->set_shader_buffers(pipe, sh, i, 1,
+                                     &llvmpipe->ssbos[sh][i], 0);
+      }
+   }
+
+   for (i = 0; i < (unsigned)llvmpipe->num_so_targets; i++) {
+      if (llvmpipe->so_targets[i] &&
+          llvmpipe->so_targets[i]->target.buffer == dst)
+         llvmpipe->so_targets[i]->mapping = lp_dst->data;
+   }
+
+   if (dst->bind & PIPE_BIND_SAMPLER_VIEW) {
+      llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+      llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
+   }
+   if (dst->bind & PIPE_BIND_SHADER_IMAGE) {
+      llvmpipe->dirty |= LP_NEW_FS_IMAGES;
+      llvmpipe->cs_dirty |= LP_CSNEW_IMAGES;
+   }
+}
+
+
 unsigned int
 llvmpipe_is_resource_referenced( struct pipe_context *pipe,
                                  struct pipe_resource *presource,
                                  unsigned level)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
+   unsigned referenced;
+
+   /* The last compute dispatch may still be running. */
+   referenced = lp_csctx_is_resource_referenced(llvmpipe->csctx, presource);
+
    if (!(presource->bind & (PIPE_BIND_DEPTH_STENCIL |
                             PIPE_BIND_RENDER_TARGET |
                             PIPE_BIND_SAMPLER_VIEW |
                             PIPE_BIND_SHADER_BUFFER |
                             PIPE_BIND_SHADER_IMAGE)))
-      return LP_UNREFERENCED;
+      return referenced;
 
-   return lp_setup_is_resource_referenced(llvmpipe->setup, presource);
+   return referenced |
+          lp_setup_is_resource_referenced(llvmpipe->setup, presource);
 }
 
 
@@ -712,6 +1004,7 @@ llvmpipe_user_buffer_create(struct pipe_screen *screen,
    buffer->base.array_size = 1;
    buffer->userBuffer = TRUE;
    buffer->data = ptr;
+   threaded_resource_init(&buffer->base);
 
    return &buffer->base;
 }
@@ -749,6 +1042,223 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
 }
 
 
+/**
+ * Convert a tiled texture to the linear layout, for the uses which only
+ * support that (rendering, shader images, sampling in the draw module).
+ *
+ * Scenes already binned may still sample the tiled storage, so it is kept
+ * until the texture is destroyed.  Bumping the screen timestamp has every
+ * context rebuild its sampler state for the new layout.
+ */
+void
+llvmpipe_resource_untile(struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   const unsigned mip_align = MAX2(64, util_cpu_caps.cacheline);
+   const unsigned bpp = util_format_get_blocksize(resource->format);
+   const unsigned last_level = resource->last_level;
+   unsigned level, layer, size;
+   ubyte *linear;
+
+   simple_mtx_lock(&untile_mutex);
+
+   if (!lpr->tiled) {
+      simple_mtx_unlock(&untile_mutex);
+      return;
+   }
+
+   size = lpr->mip_offsets[last_level] +
+          lpr->img_stride[last_level] * util_num_layers(resource, last_level);
+   linear = align_malloc(size, mip_align);
+   if (!linear) {
+      simple_mtx_unlock(&untile_mutex);
+      debug_printf("%s: out of memory, texture %u stays tiled\n",
+                   __FUNCTION__, lpr->id);
+      return;
+   }
+
+   for (level = 0; level <= last_level; level++) {
+      for (layer = 0; layer < util_num_layers(resource, level); layer++) {
+         unsigned offset = lpr->mip_offsets[level] +
+                           layer * lpr->img_stride[level];
+
+         llvmpipe_copy_tiled_rect((ubyte *) lpr->tex_data + offset,
+                                  lpr->row_stride[level],
+                                  linear + offset, lpr->row_stride[level],
+                                  0, 0,
+                                  u_minify(resource->width0, level),
+                                  u_minify(resource->height0, level),
+                                  bpp, FALSE);
+      }
+   }
+
+   lpr->tiled_data = lpr->tex_data;
+   lpr->tex_data = linear;
+   lpr->tiled = FALSE;
+   screen->timestamp++;
+
+   simple_mtx_unlock(&untile_mutex);
+}
+
+
+static unsigned
+llvmpipe_tiles_x(const struct pipe_resource *resource)
+{
+   return DIV_ROUND_UP(resource->width0, TILE_SIZE);
+}
+
+
+static unsigned
+llvmpipe_tiles_y(const struct pipe_resource *resource)
+{
+   return DIV_ROUND_UP(resource->height0, TILE_SIZE);
+}
+
+
+/**
+ * Return the clear state of the tiles of level 0 of a texture which is
+ * rendered to, allocating it the first time.  The state of tile (x, y) of
+ * layer l is at [(l * tiles_y + y) * tiles_x + x].
+ *
+ * Returns NULL if the resource's clears aren't tracked.
+ */
+struct lp_tile_clear_state *
+llvmpipe_resource_tile_clears(struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct lp_tile_clear_state *tiles, *old;
+
+   if (lpr->untracked_writes ||
+       !llvmpipe_resource_is_texture(resource) ||
+       (LP_PERF & PERF_NO_FASTCLEAR))
+      return NULL;
+
+   tiles = p_atomic_read(&lpr->tile_clears);
+   if (tiles)
+      return tiles;
+
+   /* Contexts may start rendering to the resource concurrently. */
+   tiles = CALLOC(llvmpipe_tiles_x(resource) * llvmpipe_tiles_y(resource) *
+                  util_num_layers(resource, 0), sizeof *tiles);
+   if (!tiles)
+      return NULL;
+
+   old = p_atomic_cmpxchg(&lpr->tile_clears, NULL, tiles);
+   if (old) {
+      FREE(tiles);
+      return old;
+   }
+   return tiles;
+}
+
+
+/**
+ * Forget what is known about the contents of the tiles in the box, after
+ * they were written by the CPU.
+ */
+void
+llvmpipe_resource_forget_clears(struct pipe_resource *resource,
+                                unsigned level, const struct pipe_box *box)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct lp_tile_clear_state *tiles = p_atomic_read(&lpr->tile_clears);
+   const unsigned tiles_x = llvmpipe_tiles_x(resource);
+   const unsigned tiles_y = llvmpipe_tiles_y(resource);
+   unsigned x0, x1, y0, y1, x, y;
+   int z;
+
+   if (!tiles || level != 0 || !box->width || !box->height)
+      return;
+
+   x0 = box->x / TILE_SIZE;
+   x1 = MIN2((box->x + box->width - 1) / TILE_SIZE, tiles_x - 1);
+   y0 = box->y / TILE_SIZE;
+   y1 = MIN2((box->y + box->height - 1) / TILE_SIZE, tiles_y - 1);
+
+   for (z = box->z; z < box->z + box->depth; z++) {
+      for (y = y0; y <= y1; y++) {
+         for (x = x0; x <= x1; x++)
+            tiles[(z * tiles_y + y) * tiles_x + x].bytes = 0;
+      }
+   }
+}
+
+
+/**
+ * Stop tracking the tile clears of a resource for good, once it may be
+ * written without the rasterizer noticing.
+ */
+void
+llvmpipe_resource_untrack_clears(struct pipe_resource *resource)
+{
+   llvmpipe_resource(resource)->untracked_writes = TRUE;
+}
+
+
+/**
+ * Record the bounding box of the damage region of a window system buffer.
+ * The rects have a bottom-left origin, nrects == 0 resets the region.
+ */
+static void
+llvmpipe_set_damage_region(struct pipe_screen *screen,
+                           struct pipe_resource *resource,
+                           unsigned int nrects,
+                           const struct pipe_box *rects)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   const int width = resource->width0;
+   const int height = resource->height0;
+   struct u_rect damage = { width, -1, height, -1 };
+   unsigned i;
+
+   for (i = 0; i < nrects; i++) {
+      const struct pipe_box *box = &rects[i];
+
+      if (box->width <= 0 || box->height <= 0)
+         continue;
+
+      damage.x0 = MIN2(damage.x0, box->x);
+      damage.x1 = MAX2(damage.x1, box->x + box->width - 1);
+      damage.y0 = MIN2(damage.y0, height - (box->y + box->height));
+      damage.y1 = MAX2(damage.y1, height - 1 - box->y);
+   }
+
+   damage.x0 = MAX2(damage.x0, 0);
+   damage.y0 = MAX2(damage.y0, 0);
+   damage.x1 = MIN2(damage.x1, width - 1);
+   damage.y1 = MIN2(damage.y1, height - 1);
+
+   simple_mtx_lock(&damage_mutex);
+   /* An empty region can't be told apart from a reset one, both mean the
+    * whole buffer may be rendered to.
+    */
+   lpr->has_damage = damage.x0 <= damage.x1 && damage.y0 <= damage.y1;
+   lpr->damage = damage;
+   simple_mtx_unlock(&damage_mutex);
+}
+
+
+/**
+ * Get the damage region of a resource, return false if there is none and
+ * the whole resource must be rendered.
+ */
+boolean
+llvmpipe_resource_get_damage(struct pipe_resource *resource,
+                             struct u_rect *damage)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   boolean has_damage;
+
+   simple_mtx_lock(&damage_mutex);
+   has_damage = lpr->has_damage;
+   *damage = lpr->damage;
+   simple_mtx_unlock(&damage_mutex);
+
+   return has_damage;
+}
+
+
 /**
  * Return size of resource in bytes
  */
@@ -784,6 +1294,7 @@ llvmpipe_print_resources(void)
    unsigned n = 0, total = 0;
 
    debug_printf("LLVMPIPE: current resources:\n");
+   simple_mtx_lock(&resource_list_mutex);
    foreach(lpr, &resource_list) {
       unsigned size = llvmpipe_resource_size(&lpr->base);
       debug_printf("resource %u at %p, size %ux%ux%u: %u bytes, refcount %u\n",
@@ -793,6 +1304,7 @@ llvmpipe_print_resources(void)
       total += size;
       n++;
    }
+   simple_mtx_unlock(&resource_list_mutex);
    debug_printf("LLVMPIPE: total size of %u resources: %u\n", n, total);
 }
 #endif
@@ -819,6 +1331,7 @@ llvmpipe_init_screen_resource_funcs(struct pipe_screen *screen)
    screen->resource_from_handle = llvmpipe_resource_from_handle;
    screen->resource_get_handle = llvmpipe_resource_get_handle;
    screen->can_create_resource = llvmpipe_can_create_resource;
+   screen->set_damage_region = llvmpipe_set_damage_region;
 }
 
 
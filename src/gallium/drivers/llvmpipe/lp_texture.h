@@ -31,6 +31,9 @@
 
 #include "pipe/p_state.h"
 #include "util/u_debug.h"
+#include "util/u_threaded_context.h"
+#include "util/u_pack_color.h"
+#include "util/u_rect.h"
 #include "lp_limits.h"
 
 
@@ -49,6 +52,18 @@ struct llvmpipe_context;
 struct sw_displaytarget;
 
 
+/**
+ * Whether a TILE_SIZE x TILE_SIZE tile of a color buffer holds nothing but
+ * a clear value, so that clearing it to the same value again can be
+ * skipped.  Kept up to date by the rasterizer.
+ */
+struct lp_tile_clear_state
+{
+   union util_color value;
+   unsigned bytes;  /**< size of the value, 0 if the contents are unknown */
+};
+
+
 /**
  * llvmpipe subclass of pipe_resource.  A texture, drawing surface,
  * vertex buffer, const buffer, etc.
@@ -58,7 +73,11 @@ struct sw_displaytarget;
  */
 struct llvmpipe_resource
 {
-   struct pipe_resource base;
+   union {
+      struct pipe_resource base;
+      /** What u_threaded_context sees; begins with the pipe_resource. */
+      struct threaded_resource tres;
+   };
 
    /** Row stride in bytes */
    unsigned row_stride[LP_MAX_TEXTURE_LEVELS];
@@ -85,6 +104,42 @@ struct llvmpipe_resource
     */
    void *data;
 
+   /**
+    * Buffer whose data we are using after a replace_buffer_storage, or
+    * NULL if data is our own allocation.
+    */
+   struct pipe_resource *storage;
+
+   /**
+    * tex_data stores the texels in tiles (see LP_SAMPLER_TILE_SIZE) rather
+    * than in rows.  Only set for sampled textures when LP_TILED_TEXTURES is
+    * on, until llvmpipe_resource_untile() is called.
+    */
+   boolean tiled;
+
+   /** Tiled storage replaced by llvmpipe_resource_untile() */
+   void *tiled_data;
+
+   /**
+    * Clear state of each tile of each layer of level 0, allocated the first
+    * time the resource is rendered to.  See llvmpipe_resource_tile_clears().
+    */
+   struct lp_tile_clear_state *tile_clears;
+
+   /**
+    * Written or shared in ways the rasterizer doesn't see (shader images,
+    * exported handles), so tile_clears can't be trusted any longer.
+    */
+   boolean untracked_writes;
+
+   /**
+    * Bounding box of the damage region set with
+    * pipe_screen::set_damage_region(), with a top-left origin.  Rendering
+    * outside of it may be skipped.  Only valid if has_damage is set.
+    */
+   struct u_rect damage;
+   boolean has_damage;
+
    boolean userBuffer;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
@@ -99,9 +154,12 @@ struct llvmpipe_resource
 
 struct llvmpipe_transfer
 {
-   struct pipe_transfer base;
+   struct threaded_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the box, for tiled textures */
+   void *staging;
 };
 
 
@@ -130,6 +188,11 @@ llvmpipe_transfer(struct pipe_transfer *pt)
 void llvmpipe_init_screen_resource_funcs(struct pipe_screen *screen);
 void llvmpipe_init_context_resource_funcs(struct pipe_context *pipe);
 
+void
+llvmpipe_replace_buffer_storage(struct pipe_context *pipe,
+                                struct pipe_resource *dst,
+                                struct pipe_resource *src);
+
 
 static inline boolean
 llvmpipe_resource_is_texture(const struct pipe_resource *resource)
@@ -219,6 +282,23 @@ ubyte *
 llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
                                    unsigned face_slice, unsigned level);
 
+void
+llvmpipe_resource_untile(struct pipe_resource *resource);
+
+struct lp_tile_clear_state *
+llvmpipe_resource_tile_clears(struct pipe_resource *resource);
+
+void
+llvmpipe_resource_forget_clears(struct pipe_resource *resource,
+                                unsigned level, const struct pipe_box *box);
+
+void
+llvmpipe_resource_untrack_clears(struct pipe_resource *resource);
+
+boolean
+llvmpipe_resource_get_damage(struct pipe_resource *resource,
+                             struct u_rect *damage);
+
 
 extern void
 llvmpipe_print_resources(void);
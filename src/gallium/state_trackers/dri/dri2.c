@@ -1887,22 +1887,8 @@ static void
 dri2_set_damage_region(__DRIdrawable *dPriv, unsigned int nrects, int *rects)
 {
    struct dri_drawable *drawable = dri_drawable(dPriv);
-   struct pipe_box *boxes = NULL;
 
-   if (nrects) {
-      boxes = CALLOC(nrects, sizeof(*boxes));
-      assert(boxes);
-
-      for (unsigned int i = 0; i < nrects; i++) {
-         int *rect = &rects[i * 4];
-
-         u_box_2d(rect[0], rect[1], rect[2], rect[3], &boxes[i]);
-      }
-   }
-
-   FREE(drawable->damage_rects);
-   drawable->damage_rects = boxes;
-   drawable->num_damage_rects = nrects;
+   dri_drawable_set_damage_rects(drawable, nrects, rects);
 
    /* Only apply the damage region if the BACK_LEFT texture is up-to-date. */
    if (drawable->texture_stamp == drawable->dPriv->lastStamp &&
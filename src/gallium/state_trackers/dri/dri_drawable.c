@@ -37,6 +37,7 @@
 #include "util/format/u_format.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
+#include "util/u_box.h"
 
 static uint32_t drifb_ID = 0;
 
@@ -344,6 +345,32 @@ dri_drawable_get_format(struct dri_drawable *drawable,
    }
 }
 
+/**
+ * Store the damage region passed to the DRI2bufferDamageExtension
+ * set_damage_region method, as pipe boxes.
+ */
+void
+dri_drawable_set_damage_rects(struct dri_drawable *drawable,
+                              unsigned int nrects, int *rects)
+{
+   struct pipe_box *boxes = NULL;
+
+   if (nrects) {
+      boxes = CALLOC(nrects, sizeof(*boxes));
+      assert(boxes);
+
+      for (unsigned int i = 0; i < nrects; i++) {
+         int *rect = &rects[i * 4];
+
+         u_box_2d(rect[0], rect[1], rect[2], rect[3], &boxes[i]);
+      }
+   }
+
+   FREE(drawable->damage_rects);
+   drawable->damage_rects = boxes;
+   drawable->num_damage_rects = nrects;
+}
+
 void
 dri_pipe_blit(struct pipe_context *pipe,
               struct pipe_resource *dst,
@@ -64,6 +64,7 @@ struct dri_drawable
 
    /* used only by DRISW */
    struct pipe_surface *drisw_surface;
+   int buffer_age;              /**< see __DRIswrastExtension::queryBufferAge */
 
    /* hooks filled in by dri2 & drisw */
    void (*allocate_textures)(struct dri_context *ctx,
@@ -107,6 +108,10 @@ dri_drawable_get_format(struct dri_drawable *drawable,
                         enum pipe_format *format,
                         unsigned *bind);
 
+void
+dri_drawable_set_damage_rects(struct dri_drawable *drawable,
+                              unsigned int nrects, int *rects);
+
 void
 dri_pipe_blit(struct pipe_context *pipe,
               struct pipe_resource *dst,
@@ -233,8 +233,14 @@ drisw_copy_to_front(__DRIdrawable * dPriv,
  * Backend functions for st_framebuffer interface and swap_buffers.
  */
 
+/**
+ * Swap, copying only the given rectangles (x, y, width, height with a
+ * bottom-left origin) of the back buffer to the window, or all of it if
+ * there are none.
+ */
 static void
-drisw_swap_buffers(__DRIdrawable *dPriv)
+drisw_swap_buffers_with_damage(__DRIdrawable *dPriv, int nrects,
+                               const int *rects)
 {
    struct dri_context *ctx = dri_get_current(dPriv->driScreenPriv);
    struct dri_drawable *drawable = dri_drawable(dPriv);
@@ -254,10 +260,55 @@ drisw_swap_buffers(__DRIdrawable *dPriv)
 
       ctx->st->flush(ctx->st, ST_FLUSH_FRONT, NULL, NULL, NULL);
 
-      drisw_copy_to_front(dPriv, ptex);
+      if (nrects == 0) {
+         drisw_copy_to_front(dPriv, ptex);
+      }
+      else {
+         for (int i = 0; i < nrects; i++) {
+            const int *rect = &rects[i * 4];
+            int x0 = MAX2(rect[0], 0);
+            int y0 = MAX2(rect[1], 0);
+            int x1 = MIN2(rect[0] + rect[2], (int)ptex->width0);
+            int y1 = MIN2(rect[1] + rect[3], (int)ptex->height0);
+            struct pipe_box box;
+
+            if (x0 >= x1 || y0 >= y1)
+               continue;
+
+            u_box_2d(x0, ptex->height0 - y1, x1 - x0, y1 - y0, &box);
+            drisw_present_texture(dPriv, ptex, &box);
+         }
+
+         drisw_invalidate_drawable(dPriv);
+      }
+
+      /* the back buffer keeps what was just presented */
+      drawable->buffer_age = 1;
    }
 }
 
+static void
+drisw_swap_buffers(__DRIdrawable *dPriv)
+{
+   drisw_swap_buffers_with_damage(dPriv, 0, NULL);
+}
+
+static int
+drisw_query_buffer_age(__DRIdrawable *dPriv)
+{
+   struct dri_drawable *drawable = dri_drawable(dPriv);
+
+   if (!drawable->buffer_age)
+      return 0;
+
+   /* a resize reallocates the back buffer at the next validation */
+   drisw_update_drawable_info(drawable);
+   if (dPriv->w != drawable->old_w || dPriv->h != drawable->old_h)
+      return 0;
+
+   return drawable->buffer_age;
+}
+
 static void
 drisw_copy_sub_buffer(__DRIdrawable *dPriv, int x, int y,
                       int w, int h)
@@ -331,6 +382,10 @@ drisw_allocate_textures(struct dri_context *stctx,
          pipe_resource_reference(&drawable->textures[i], NULL);
    }
 
+   /* a new back buffer has undefined contents */
+   if (!drawable->textures[ST_ATTACHMENT_BACK_LEFT])
+      drawable->buffer_age = 0;
+
    memset(&templ, 0, sizeof(templ));
    templ.target = screen->target;
    templ.width0 = width;
@@ -419,6 +474,31 @@ static __DRIimageExtension driSWImageExtension = {
     .destroyImage = dri2_destroy_image,
 };
 
+/**
+ * \brief the DRI2bufferDamageExtension set_damage_region method
+ *
+ * The back buffer of a drisw drawable survives swaps, so unlike with DRI2
+ * the region can be handed to the driver right away.
+ */
+static void
+drisw_set_damage_region(__DRIdrawable *dPriv, unsigned int nrects, int *rects)
+{
+   struct dri_drawable *drawable = dri_drawable(dPriv);
+   struct pipe_screen *screen = drawable->screen->base.screen;
+   struct pipe_resource *resource = drawable->textures[ST_ATTACHMENT_BACK_LEFT];
+
+   dri_drawable_set_damage_rects(drawable, nrects, rects);
+
+   if (resource && screen->set_damage_region)
+      screen->set_damage_region(screen, resource,
+                                drawable->num_damage_rects,
+                                drawable->damage_rects);
+}
+
+static __DRI2bufferDamageExtension driswBufferDamageExtension = {
+   .base = { __DRI2_BUFFER_DAMAGE, 1 },
+};
+
 /*
  * Backend function for init_screen.
  */
@@ -431,6 +511,7 @@ static const __DRIextension *drisw_screen_extensions[] = {
    &dri2NoErrorExtension.base,
    &driSWImageExtension.base,
    &dri2FlushControlExtension.base,
+   &driswBufferDamageExtension.base,
    NULL
 };
 
@@ -485,6 +566,9 @@ drisw_init_screen(__DRIscreen * sPriv)
    if (!configs)
       goto fail;
 
+   if (pscreen->set_damage_region)
+      driswBufferDamageExtension.set_damage_region = drisw_set_damage_region;
+
    screen->lookup_egl_image = dri2_lookup_egl_image;
 
    return configs;
@@ -532,6 +616,8 @@ const struct __DriverAPIRec galliumsw_driver_api = {
    .MakeCurrent = dri_make_current,
    .UnbindContext = dri_unbind_context,
    .CopySubBuffer = drisw_copy_sub_buffer,
+   .SwapBuffersWithDamage = drisw_swap_buffers_with_damage,
+   .QueryBufferAge = drisw_query_buffer_age,
 };
 
 /* This is the table of extensions that the loader will dlsym() for. */
@@ -787,6 +787,40 @@ driSwapBuffers(__DRIdrawable *pdp)
     pdp->driScreenPriv->driver->SwapBuffers(pdp);
 }
 
+/**
+ * swrast swapbuffers with damage entrypoint, a full swap for drivers
+ * which can't limit the presentation to the damage.
+ */
+static void
+driSwapBuffersWithDamage(__DRIdrawable *pdp, int nrects, const int *rects)
+{
+    const struct __DriverAPIRec *driver = pdp->driScreenPriv->driver;
+
+    assert(pdp->driScreenPriv->swrast_loader);
+
+    if (driver->SwapBuffersWithDamage)
+        driver->SwapBuffersWithDamage(pdp, nrects, rects);
+    else
+        driver->SwapBuffers(pdp);
+}
+
+/**
+ * swrast buffer age entrypoint, the back buffer contents are undefined
+ * after a swap unless the driver says otherwise.
+ */
+static int
+driSWRastQueryBufferAge(__DRIdrawable *pdp)
+{
+    const struct __DriverAPIRec *driver = pdp->driScreenPriv->driver;
+
+    assert(pdp->driScreenPriv->swrast_loader);
+
+    if (driver->QueryBufferAge)
+        return driver->QueryBufferAge(pdp);
+
+    return 0;
+}
+
 /** Core interface */
 const __DRIcoreExtension driCoreExtension = {
     .base = { __DRI_CORE, 2 },
@@ -822,13 +856,15 @@ const __DRIdri2Extension driDRI2Extension = {
 };
 
 const __DRIswrastExtension driSWRastExtension = {
-    .base = { __DRI_SWRAST, 4 },
+    .base = { __DRI_SWRAST, 5 },
 
     .createNewScreen            = driSWRastCreateNewScreen,
     .createNewDrawable          = driCreateNewDrawable,
     .createNewContextForAPI     = driCreateNewContextForAPI,
     .createContextAttribs       = driCreateContextAttribs,
     .createNewScreen2           = driSWRastCreateNewScreen2,
+    .swapBuffersWithDamage      = driSwapBuffersWithDamage,
+    .queryBufferAge             = driSWRastQueryBufferAge,
 };
 
 const __DRI2configQueryExtension dri2ConfigQueryExtension = {
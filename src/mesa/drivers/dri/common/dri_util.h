@@ -155,6 +155,11 @@ struct __DriverAPIRec {
 
     void (*CopySubBuffer)(__DRIdrawable *driDrawPriv, int x, int y,
                           int w, int h);
+
+    void (*SwapBuffersWithDamage)(__DRIdrawable *driDrawPriv,
+                                  int nrects, const int *rects);
+
+    int (*QueryBufferAge)(__DRIdrawable *driDrawPriv);
 };
 
 extern const struct __DriverAPIRec driDriverAPI;
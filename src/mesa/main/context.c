@@ -122,6 +122,7 @@
 #include "remap.h"
 #include "scissor.h"
 #include "shared.h"
+#include "shaderapi.h"
 #include "shaderobj.h"
 #include "shaderimage.h"
 #include "state.h"
@@ -1327,6 +1328,9 @@ _mesa_free_context_data(struct gl_context *ctx)
       _mesa_make_current(ctx, NULL, NULL);
    }
 
+   /* Queued compiles and links may still be using this context. */
+   _mesa_finish_shader_compiler_queue(ctx);
+
    /* unreference WinSysDraw/Read buffers */
    _mesa_reference_framebuffer(&ctx->WinSysDrawBuffer, NULL);
    _mesa_reference_framebuffer(&ctx->WinSysReadBuffer, NULL);
@@ -497,6 +497,17 @@ struct dd_function_table {
     */
    GLboolean (*LinkShader)(struct gl_context *ctx,
                            struct gl_shader_program *shader);
+
+   /**
+    * Called on the application thread after LinkShader ran on the shader
+    * compiler queue, for the work that needs the driver's context.
+    *
+    * LinkShader is only called from the queue for drivers that implement
+    * this, and then must not use the context when
+    * shader->data->LinkOnQueue is set.
+    */
+   void (*FinishLinkShader)(struct gl_context *ctx,
+                            struct gl_shader_program *shader);
    /*@}*/
 
 
@@ -427,6 +427,15 @@ _mesa_shader_debug(struct gl_context *ctx, GLenum type, GLuint *id,
    enum mesa_debug_severity severity = MESA_DEBUG_SEVERITY_HIGH;
    int len;
 
+   /* The shader compiler queue compiles on threads the context isn't
+    * current on, where the application doesn't expect its callback to run.
+    * Compiles are only queued while debug output is disabled, so this only
+    * drops messages of compiles still running when it got enabled.
+    */
+   GET_CURRENT_CONTEXT(cur);
+   if (ctx != cur)
+      return;
+
    _mesa_debug_get_id(id);
 
    len = strlen(msg);
@@ -23,6 +23,7 @@
 
 #include "glspirv.h"
 #include "errors.h"
+#include "shaderapi.h"
 #include "shaderobj.h"
 #include "mtypes.h"
 
@@ -330,6 +331,8 @@ _mesa_SpecializeShaderARB(GLuint shader,
    if (!sh)
       return;
 
+   _mesa_wait_shader_idle(ctx, sh);
+
    if (!sh->spirv_data) {
       _mesa_error(ctx, GL_INVALID_OPERATION,
                   "glSpecializeShaderARB(not SPIR-V)");
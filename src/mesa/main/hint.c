@@ -30,6 +30,7 @@
 #include "hint.h"
 
 #include "mtypes.h"
+#include "shaderapi.h"
 
 
 
@@ -137,6 +138,7 @@ _mesa_MaxShaderCompilerThreadsKHR(GLuint count)
    GET_CURRENT_CONTEXT(ctx);
 
    ctx->Hint.MaxShaderCompilerThreads = count;
+   _mesa_set_shader_compiler_threads(ctx, count);
 
    if (ctx->Driver.SetMaxShaderCompilerThreads)
       ctx->Driver.SetMaxShaderCompilerThreads(ctx, count);
@@ -2624,6 +2624,14 @@ struct gl_shader
 
    enum gl_compile_status CompileStatus;
 
+   /**
+    * Signalled when a compile running on the shader compiler queue is done.
+    */
+   struct util_queue_fence CompileFence;
+
+   /** Number of links on the shader compiler queue reading this shader. */
+   unsigned PendingLinks;
+
 #ifdef DEBUG
    unsigned SourceChecksum;       /**< for debug/logging purposes */
 #endif
@@ -2964,6 +2972,13 @@ struct gl_shader_program_data
     * ARB_gl_spirv extension.
     */
    bool spirv;
+
+   /**
+    * Whether the program is linked on the shader compiler queue.  The
+    * driver can't use its context from there, so LinkShader leaves such
+    * work to FinishLinkShader.
+    */
+   bool LinkOnQueue;
 };
 
 /**
@@ -2978,6 +2993,23 @@ struct gl_shader_program
    GLint RefCount;  /**< Reference count */
    GLboolean DeletePending;
 
+   /**
+    * Signalled when a link running on the shader compiler queue is done.
+    */
+   struct util_queue_fence LinkFence;
+
+   /**
+    * Set while the application thread still has to finish a link started
+    * on the shader compiler queue, see _mesa_wait_shader_program_link().
+    */
+   bool LinkPending;
+
+   /**
+    * Held while finishing a link started on the shader compiler queue, as
+    * every context of the share group may look the program up.
+    */
+   simple_mtx_t LinkMutex;
+
    /**
     * Is the application intending to glGetProgramBinary this program?
     *
@@ -3155,7 +3187,12 @@ struct gl_pipeline_object
     */
    struct gl_shader_program *ActiveProgram;
 
-   GLbitfield Flags;         /**< Mask of GLSL_x flags */
+   /**
+    * Mask of GLSL_x flags.  Compiles and links, which may run on the shader
+    * compiler queue, read the one of gl_context::Shader, which doesn't change
+    * after context creation.
+    */
+   GLbitfield Flags;
    GLboolean EverBound;      /**< Has the pipeline object been created */
    GLboolean Validated;      /**< Pipeline Validation status */
 
@@ -3367,6 +3404,21 @@ struct gl_shared_state
     */
    mtx_t ShaderIncludeMutex;
 
+   /**
+    * \name GL_KHR_parallel_shader_compile
+    *
+    * GLSL compiles and links started by any context of the share group run
+    * on this queue.
+    */
+   /*@{*/
+   struct util_queue ShaderCompilerQueue;
+   /**
+    * Held by links which may recompile shaders that were skipped because
+    * of the shader cache, as those shaders may be used by other links.
+    */
+   simple_mtx_t ShaderCacheFallbackMutex;
+   /*@}*/
+
    /**
     * Some context in this share group was affected by a GPU reset
     *
@@ -38,6 +38,7 @@
 
 #include "main/glheader.h"
 #include "main/context.h"
+#include "main/debug_output.h"
 #include "main/enums.h"
 #include "main/glspirv.h"
 #include "main/hash.h"
@@ -63,6 +64,8 @@
 #include "util/crc32.h"
 #include "util/os_file.h"
 #include "util/simple_list.h"
+#include "util/u_atomic.h"
+#include "util/u_cpu_detect.h"
 #include "util/u_string.h"
 
 /**
@@ -667,8 +670,30 @@ static void
 get_programiv(struct gl_context *ctx, GLuint program, GLenum pname,
               GLint *params)
 {
-   struct gl_shader_program *shProg
-      = _mesa_lookup_shader_program_err(ctx, program, "glGetProgramiv(program)");
+   struct gl_shader_program *shProg;
+
+   /* Unlike every other query, this one mustn't wait for the link. */
+   if (pname == GL_COMPLETION_STATUS_ARB) {
+      shProg = _mesa_lookup_shader_program_err_no_wait(ctx, program,
+                                                       "glGetProgramiv(program)");
+      if (!shProg)
+         return;
+
+      if (!util_queue_fence_is_signalled(&shProg->LinkFence)) {
+         *params = GL_FALSE;
+         return;
+      }
+
+      _mesa_wait_shader_program_link(ctx, shProg);
+      if (ctx->Driver.GetShaderProgramCompletionStatus)
+         *params = ctx->Driver.GetShaderProgramCompletionStatus(ctx, shProg);
+      else
+         *params = GL_TRUE;
+      return;
+   }
+
+   shProg = _mesa_lookup_shader_program_err(ctx, program,
+                                            "glGetProgramiv(program)");
 
    /* Is transform feedback available in this context?
     */
@@ -699,12 +724,6 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname,
    case GL_DELETE_STATUS:
       *params = shProg->DeletePending;
       return;
-   case GL_COMPLETION_STATUS_ARB:
-      if (ctx->Driver.GetShaderProgramCompletionStatus)
-         *params = ctx->Driver.GetShaderProgramCompletionStatus(ctx, shProg);
-      else
-         *params = GL_TRUE;
-      return;
    case GL_LINK_STATUS:
       *params = shProg->data->LinkStatus ? GL_TRUE : GL_FALSE;
       return;
@@ -1019,6 +1038,13 @@ get_shaderiv(struct gl_context *ctx, GLuint name, GLenum pname, GLint *params)
       return;
    }
 
+   if (pname == GL_COMPLETION_STATUS_ARB) {
+      *params = util_queue_fence_is_signalled(&shader->CompileFence);
+      return;
+   }
+
+   util_queue_fence_wait(&shader->CompileFence);
+
    switch (pname) {
    case GL_SHADER_TYPE:
       *params = shader->Type;
@@ -1026,10 +1052,6 @@ get_shaderiv(struct gl_context *ctx, GLuint name, GLenum pname, GLint *params)
    case GL_DELETE_STATUS:
       *params = shader->DeletePending;
       break;
-   case GL_COMPLETION_STATUS_ARB:
-      /* _mesa_glsl_compile_shader is not offloaded to other threads. */
-      *params = GL_TRUE;
-      return;
    case GL_COMPILE_STATUS:
       *params = shader->CompileStatus ? GL_TRUE : GL_FALSE;
       break;
@@ -1099,6 +1121,7 @@ get_shader_info_log(struct gl_context *ctx, GLuint shader, GLsizei bufSize,
       return;
    }
 
+   util_queue_fence_wait(&sh->CompileFence);
    _mesa_copy_string(infoLog, bufSize, length, sh->InfoLog);
 }
 
@@ -1171,50 +1194,137 @@ ensure_builtin_types(struct gl_context *ctx)
 }
 
 /**
- * Compile a shader.
+ * \name Shader compiler queue
+ *
+ * With GL_KHR_parallel_shader_compile, glCompileShader and glLinkProgram
+ * return right away and the GLSL front-end and linker run on a queue shared
+ * by the share group.  Anything using the shader or program other than a
+ * GL_COMPLETION_STATUS_ARB query waits for them to finish.
+ */
+/*@{*/
+
+struct shader_compiler_job {
+   struct gl_context *ctx;
+   void *object;
+};
+
+static void
+free_shader_compiler_job(void *data, int thread_index)
+{
+   free(data);
+}
+
+/**
+ * Return the queue to compile and link on, or NULL to do it on the calling
+ * thread.
+ *
+ * The GLSL front-end reports its messages through GL_KHR_debug, and the
+ * application's callback must be called on its own thread, so nothing is
+ * queued while debug output is enabled.
+ */
+static struct util_queue *
+get_shader_compiler_queue(struct gl_context *ctx)
+{
+   struct gl_shared_state *shared = ctx->Shared;
+
+   if (ctx->Hint.MaxShaderCompilerThreads == 0 ||
+       _mesa_get_debug_state_int(ctx, GL_DEBUG_OUTPUT))
+      return NULL;
+
+   simple_mtx_lock(&shared->Mutex);
+   if (!util_queue_is_initialized(&shared->ShaderCompilerQueue)) {
+      util_cpu_detect();
+
+      if (util_queue_init(&shared->ShaderCompilerQueue, "glsl", 64,
+                          MAX2(util_cpu_caps.nr_cpus, 1),
+                          UTIL_QUEUE_INIT_RESIZE_IF_FULL)) {
+         util_queue_adjust_num_threads(&shared->ShaderCompilerQueue,
+                                       ctx->Hint.MaxShaderCompilerThreads);
+      }
+   }
+   simple_mtx_unlock(&shared->Mutex);
+
+   return util_queue_is_initialized(&shared->ShaderCompilerQueue) ?
+          &shared->ShaderCompilerQueue : NULL;
+}
+
+/**
+ * Called via glMaxShaderCompilerThreadsKHR().  A count of 0 makes compiles
+ * and links run on the application thread again, and leaves the queue alone.
  */
 void
-_mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
+_mesa_set_shader_compiler_threads(struct gl_context *ctx, unsigned count)
 {
-   if (!sh)
-      return;
+   struct gl_shared_state *shared = ctx->Shared;
 
-   /* The GL_ARB_gl_spirv spec says:
-    *
-    *    "Add a new error for the CompileShader command:
-    *
-    *      An INVALID_OPERATION error is generated if the SPIR_V_BINARY_ARB
-    *      state of <shader> is TRUE."
-    */
-   if (sh->spirv_data) {
-      _mesa_error(ctx, GL_INVALID_OPERATION, "glCompileShader(SPIR-V)");
+   if (count == 0)
       return;
-   }
 
+   simple_mtx_lock(&shared->Mutex);
+   if (util_queue_is_initialized(&shared->ShaderCompilerQueue))
+      util_queue_adjust_num_threads(&shared->ShaderCompilerQueue, count);
+   simple_mtx_unlock(&shared->Mutex);
+}
+
+/**
+ * Wait for everything that was queued, before the context it was queued
+ * from goes away.
+ */
+void
+_mesa_finish_shader_compiler_queue(struct gl_context *ctx)
+{
+   struct gl_shared_state *shared = ctx->Shared;
+
+   if (shared && util_queue_is_initialized(&shared->ShaderCompilerQueue))
+      util_queue_finish(&shared->ShaderCompilerQueue);
+}
+
+/**
+ * Wait until no compile or link on the queue uses the shader, before
+ * changing it.
+ */
+void
+_mesa_wait_shader_idle(struct gl_context *ctx, struct gl_shader *sh)
+{
+   util_queue_fence_wait(&sh->CompileFence);
+
+   /* Links don't have a fence per shader, wait for all of them. */
+   if (p_atomic_read(&sh->PendingLinks))
+      util_queue_finish(&ctx->Shared->ShaderCompilerQueue);
+}
+
+/*@}*/
+
+
+/**
+ * Run the GLSL compiler on the shader.  This may be called on the shader
+ * compiler queue.
+ */
+static void
+do_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
+{
    if (!sh->Source) {
       /* If the user called glCompileShader without first calling
        * glShaderSource, we should fail to compile, but not raise a GL_ERROR.
        */
       sh->CompileStatus = COMPILE_FAILURE;
    } else {
-      if (ctx->_Shader->Flags & GLSL_DUMP) {
+      if (ctx->Shader.Flags & GLSL_DUMP) {
          _mesa_log("GLSL source for %s shader %d:\n",
                  _mesa_shader_stage_to_string(sh->Stage), sh->Name);
          _mesa_log("%s\n", sh->Source);
       }
 
-      ensure_builtin_types(ctx);
-
       /* this call will set the shader->CompileStatus field to indicate if
        * compilation was successful.
        */
       _mesa_glsl_compile_shader(ctx, sh, false, false, false);
 
-      if (ctx->_Shader->Flags & GLSL_LOG) {
+      if (ctx->Shader.Flags & GLSL_LOG) {
          _mesa_write_shader_to_file(sh);
       }
 
-      if (ctx->_Shader->Flags & GLSL_DUMP) {
+      if (ctx->Shader.Flags & GLSL_DUMP) {
          if (sh->CompileStatus) {
             if (sh->ir) {
                _mesa_log("GLSL IR for shader %d:\n", sh->Name);
@@ -1235,20 +1345,90 @@ _mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
    }
 
    if (!sh->CompileStatus) {
-      if (ctx->_Shader->Flags & GLSL_DUMP_ON_ERROR) {
+      if (ctx->Shader.Flags & GLSL_DUMP_ON_ERROR) {
          _mesa_log("GLSL source for %s shader %d:\n",
                  _mesa_shader_stage_to_string(sh->Stage), sh->Name);
          _mesa_log("%s\n", sh->Source);
          _mesa_log("Info Log:\n%s\n", sh->InfoLog);
       }
 
-      if (ctx->_Shader->Flags & GLSL_REPORT_ERRORS) {
+      if (ctx->Shader.Flags & GLSL_REPORT_ERRORS) {
          _mesa_debug(ctx, "Error compiling shader %u:\n%s\n",
                      sh->Name, sh->InfoLog);
       }
    }
 }
 
+static void
+compile_shader_job(void *data, int thread_index)
+{
+   struct shader_compiler_job *job = data;
+
+   do_compile_shader(job->ctx, job->object);
+}
+
+static bool
+queue_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
+{
+   /* Includes are looked up in the share group's named strings, which
+    * can change while the compile is running.
+    */
+   if (!sh->Source || glcpp_has_include(sh->Source, ctx))
+      return false;
+
+   struct util_queue *queue = get_shader_compiler_queue(ctx);
+   if (!queue)
+      return false;
+
+   struct shader_compiler_job *job = malloc(sizeof(*job));
+   if (!job)
+      return false;
+
+   job->ctx = ctx;
+   job->object = sh;
+
+   util_queue_fence_reset(&sh->CompileFence);
+   util_queue_add_job(queue, job, &sh->CompileFence, compile_shader_job,
+                      free_shader_compiler_job, 0);
+   return true;
+}
+
+static void
+compile_shader(struct gl_context *ctx, struct gl_shader *sh, bool use_queue)
+{
+   if (!sh)
+      return;
+
+   /* The GL_ARB_gl_spirv spec says:
+    *
+    *    "Add a new error for the CompileShader command:
+    *
+    *      An INVALID_OPERATION error is generated if the SPIR_V_BINARY_ARB
+    *      state of <shader> is TRUE."
+    */
+   if (sh->spirv_data) {
+      _mesa_error(ctx, GL_INVALID_OPERATION, "glCompileShader(SPIR-V)");
+      return;
+   }
+
+   _mesa_wait_shader_idle(ctx, sh);
+   ensure_builtin_types(ctx);
+
+   if (use_queue && queue_compile_shader(ctx, sh))
+      return;
+
+   do_compile_shader(ctx, sh);
+}
+
+/**
+ * Compile a shader.
+ */
+void
+_mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh)
+{
+   compile_shader(ctx, sh, false);
+}
+
 
 struct update_programs_in_pipeline_params
 {
@@ -1274,41 +1454,50 @@ update_programs_in_pipeline(GLuint key, void *data, void *userData)
 
 
 /**
- * Link a program's shaders.
+ * Link the program's shaders after _mesa_glsl_prepare_link_shader().  This
+ * may be called on the shader compiler queue.
  */
-static ALWAYS_INLINE void
-link_program(struct gl_context *ctx, struct gl_shader_program *shProg,
-             bool no_error)
+static void
+do_link_program(struct gl_context *ctx, struct gl_shader_program *shProg)
 {
-   if (!shProg)
-      return;
+   simple_mtx_t *fallback_mutex = NULL;
 
-   if (!no_error) {
-      /* From the ARB_transform_feedback2 specification:
-       * "The error INVALID_OPERATION is generated by LinkProgram if <program>
-       * is the name of a program being used by one or more transform feedback
-       * objects, even if the objects are not currently bound or are paused."
-       */
-      if (_mesa_transform_feedback_is_using_program(ctx, shProg)) {
-         _mesa_error(ctx, GL_INVALID_OPERATION,
-                     "glLinkProgram(transform feedback is using the program)");
-         return;
+   for (unsigned i = 0; i < shProg->NumShaders; i++)
+      util_queue_fence_wait(&shProg->Shaders[i]->CompileFence);
+
+   /* Shaders whose compile was skipped because they are in the shader cache
+    * get compiled by the link if the program isn't in the cache.  Other links
+    * may be using the same shaders, so these links run one at a time.
+    */
+   if (ctx->Cache) {
+      simple_mtx_lock(&ctx->Shared->ShaderCacheFallbackMutex);
+      for (unsigned i = 0; i < shProg->NumShaders; i++) {
+         if (shProg->Shaders[i]->CompileStatus == COMPILE_SKIPPED)
+            fallback_mutex = &ctx->Shared->ShaderCacheFallbackMutex;
       }
+      if (!fallback_mutex)
+         simple_mtx_unlock(&ctx->Shared->ShaderCacheFallbackMutex);
    }
 
-   unsigned programs_in_use = 0;
-   if (ctx->_Shader)
-      for (unsigned stage = 0; stage < MESA_SHADER_STAGES; stage++) {
-         if (ctx->_Shader->CurrentProgram[stage] &&
-             ctx->_Shader->CurrentProgram[stage]->Id == shProg->Name) {
-            programs_in_use |= 1 << stage;
-         }
-      }
+   _mesa_glsl_link_prepared_shader(ctx, shProg);
 
-   ensure_builtin_types(ctx);
+   if (fallback_mutex)
+      simple_mtx_unlock(fallback_mutex);
+}
 
-   FLUSH_VERTICES(ctx, 0);
-   _mesa_glsl_link_shader(ctx, shProg);
+/**
+ * The part of glLinkProgram that runs on the application thread after the
+ * program is linked.
+ */
+static void
+finish_link_program(struct gl_context *ctx, struct gl_shader_program *shProg,
+                    unsigned programs_in_use)
+{
+   if (shProg->data->LinkOnQueue) {
+      shProg->data->LinkOnQueue = false;
+      if (shProg->data->LinkStatus)
+         ctx->Driver.FinishLinkShader(ctx, shProg);
+   }
 
    /* From section 7.3 (Program Objects) of the OpenGL 4.5 spec:
     *
@@ -1412,25 +1601,189 @@ link_program(struct gl_context *ctx, struct gl_shader_program *shProg,
    }
 }
 
+static void
+link_program_job(void *data, int thread_index)
+{
+   struct shader_compiler_job *job = data;
+   struct gl_shader_program *shProg = job->object;
+
+   do_link_program(job->ctx, shProg);
+
+   for (unsigned i = 0; i < shProg->NumShaders; i++)
+      p_atomic_dec(&shProg->Shaders[i]->PendingLinks);
+}
+
+static bool
+program_in_shader_state(const struct gl_pipeline_object *obj,
+                        const struct gl_shader_program *shProg)
+{
+   if (obj->ActiveProgram == shProg)
+      return true;
+
+   for (unsigned stage = 0; stage < MESA_SHADER_STAGES; stage++) {
+      if (obj->CurrentProgram[stage] &&
+          obj->CurrentProgram[stage]->Id == shProg->Name)
+         return true;
+   }
+
+   return false;
+}
+
+struct find_program_in_pipeline_params
+{
+   const struct gl_shader_program *shProg;
+   bool found;
+};
+
+static void
+find_program_in_pipeline(GLuint key, void *data, void *userData)
+{
+   struct find_program_in_pipeline_params *params =
+      (struct find_program_in_pipeline_params *) userData;
+   const struct gl_pipeline_object *obj =
+      (const struct gl_pipeline_object *) data;
+
+   params->found |= program_in_shader_state(obj, params->shProg);
+}
+
+/**
+ * Start linking the program on the shader compiler queue, if the driver
+ * supports that.  Programs in use are always linked right away, because
+ * glLinkProgram has to install their new executables.
+ */
+static bool
+queue_link_program(struct gl_context *ctx, struct gl_shader_program *shProg,
+                   unsigned programs_in_use)
+{
+   if (!ctx->Driver.FinishLinkShader || programs_in_use ||
+       program_in_shader_state(&ctx->Shader, shProg))
+      return false;
+
+   if (ctx->Pipeline.Objects) {
+      struct find_program_in_pipeline_params params = {
+         .shProg = shProg,
+         .found = false
+      };
+      _mesa_HashWalk(ctx->Pipeline.Objects, find_program_in_pipeline,
+                     &params);
+      if (params.found)
+         return false;
+   }
+
+   struct util_queue *queue = get_shader_compiler_queue(ctx);
+   if (!queue)
+      return false;
+
+   struct shader_compiler_job *job = malloc(sizeof(*job));
+   if (!job)
+      return false;
+
+   job->ctx = ctx;
+   job->object = shProg;
+
+   _mesa_glsl_prepare_link_shader(ctx, shProg);
+   shProg->data->LinkOnQueue = true;
+   p_atomic_set(&shProg->LinkPending, true);
+
+   for (unsigned i = 0; i < shProg->NumShaders; i++)
+      p_atomic_inc(&shProg->Shaders[i]->PendingLinks);
+
+   util_queue_fence_reset(&shProg->LinkFence);
+   util_queue_add_job(queue, job, &shProg->LinkFence, link_program_job,
+                      free_shader_compiler_job, 0);
+   return true;
+}
+
+/**
+ * Wait for a link running on the shader compiler queue, and finish it on
+ * this thread.  Looking up the program does this, so that every command
+ * using it waits implicitly.
+ */
+void
+_mesa_wait_shader_program_link(struct gl_context *ctx,
+                               struct gl_shader_program *shProg)
+{
+   if (likely(!p_atomic_read(&shProg->LinkPending)))
+      return;
+
+   util_queue_fence_wait(&shProg->LinkFence);
+
+   /* Only one of the contexts looking the program up finishes the link, the
+    * others wait for it.  LinkPending is cleared last so that they don't
+    * skip this while the link isn't finished.
+    */
+   simple_mtx_lock(&shProg->LinkMutex);
+   if (shProg->LinkPending) {
+      finish_link_program(ctx, shProg, 0);
+      p_atomic_set(&shProg->LinkPending, false);
+   }
+   simple_mtx_unlock(&shProg->LinkMutex);
+}
+
+
+/**
+ * Link a program's shaders.
+ */
+static ALWAYS_INLINE void
+link_program(struct gl_context *ctx, struct gl_shader_program *shProg,
+             bool no_error, bool use_queue)
+{
+   if (!shProg)
+      return;
+
+   if (!no_error) {
+      /* From the ARB_transform_feedback2 specification:
+       * "The error INVALID_OPERATION is generated by LinkProgram if <program>
+       * is the name of a program being used by one or more transform feedback
+       * objects, even if the objects are not currently bound or are paused."
+       */
+      if (_mesa_transform_feedback_is_using_program(ctx, shProg)) {
+         _mesa_error(ctx, GL_INVALID_OPERATION,
+                     "glLinkProgram(transform feedback is using the program)");
+         return;
+      }
+   }
+
+   unsigned programs_in_use = 0;
+   if (ctx->_Shader)
+      for (unsigned stage = 0; stage < MESA_SHADER_STAGES; stage++) {
+         if (ctx->_Shader->CurrentProgram[stage] &&
+             ctx->_Shader->CurrentProgram[stage]->Id == shProg->Name) {
+            programs_in_use |= 1 << stage;
+         }
+      }
+
+   ensure_builtin_types(ctx);
+
+   FLUSH_VERTICES(ctx, 0);
+
+   if (use_queue && queue_link_program(ctx, shProg, programs_in_use))
+      return;
+
+   _mesa_glsl_prepare_link_shader(ctx, shProg);
+   do_link_program(ctx, shProg);
+   finish_link_program(ctx, shProg, programs_in_use);
+}
+
 
 static void
 link_program_error(struct gl_context *ctx, struct gl_shader_program *shProg)
 {
-   link_program(ctx, shProg, false);
+   link_program(ctx, shProg, false, true);
 }
 
 
 static void
 link_program_no_error(struct gl_context *ctx, struct gl_shader_program *shProg)
 {
-   link_program(ctx, shProg, true);
+   link_program(ctx, shProg, true, true);
 }
 
 
 void
 _mesa_link_program(struct gl_context *ctx, struct gl_shader_program *shProg)
 {
-   link_program_error(ctx, shProg);
+   link_program(ctx, shProg, false, false);
 }
 
 
@@ -1611,8 +1964,8 @@ _mesa_CompileShader(GLuint shaderObj)
    GET_CURRENT_CONTEXT(ctx);
    if (MESA_VERBOSE & VERBOSE_API)
       _mesa_debug(ctx, "glCompileShader %u\n", shaderObj);
-   _mesa_compile_shader(ctx, _mesa_lookup_shader_err(ctx, shaderObj,
-                                                     "glCompileShader"));
+   compile_shader(ctx, _mesa_lookup_shader_err(ctx, shaderObj,
+                                               "glCompileShader"), true);
 }
 
 
@@ -2116,6 +2469,7 @@ shader_source(struct gl_context *ctx, GLuint shaderObj, GLsizei count,
    }
 #endif /* ENABLE_SHADER_CACHE */
 
+   _mesa_wait_shader_idle(ctx, sh);
    set_shader_source(sh, source);
 
    free(offsets);
@@ -2350,6 +2704,9 @@ _mesa_ShaderBinary(GLint n, const GLuint* shaders, GLenum binaryformat,
       if (!ctx->Extensions.ARB_gl_spirv) {
          _mesa_error(ctx, GL_INVALID_OPERATION, "glShaderBinary(SPIR-V)");
       } else if (n > 0) {
+         for (int i = 0; i < n; ++i)
+            _mesa_wait_shader_idle(ctx, sh[i]);
+
          _mesa_spirv_shader_binary(ctx, (unsigned) n, sh, binary,
                                    (size_t) length);
       }
@@ -70,6 +70,19 @@ _mesa_compile_shader(struct gl_context *ctx, struct gl_shader *sh);
 extern void
 _mesa_link_program(struct gl_context *ctx, struct gl_shader_program *sh_prog);
 
+extern void
+_mesa_set_shader_compiler_threads(struct gl_context *ctx, unsigned count);
+
+extern void
+_mesa_finish_shader_compiler_queue(struct gl_context *ctx);
+
+extern void
+_mesa_wait_shader_idle(struct gl_context *ctx, struct gl_shader *sh);
+
+extern void
+_mesa_wait_shader_program_link(struct gl_context *ctx,
+                               struct gl_shader_program *shProg);
+
 extern unsigned
 _mesa_count_active_attribs(struct gl_shader_program *shProg);
 
@@ -91,6 +91,7 @@ static void
 _mesa_init_shader(struct gl_shader *shader)
 {
    shader->RefCount = 1;
+   util_queue_fence_init(&shader->CompileFence);
    shader->info.Geom.VerticesOut = -1;
    shader->info.Geom.InputType = GL_TRIANGLES;
    shader->info.Geom.OutputType = GL_TRIANGLE_STRIP;
@@ -122,6 +123,9 @@ _mesa_new_shader(GLuint name, gl_shader_stage stage)
 void
 _mesa_delete_shader(struct gl_context *ctx, struct gl_shader *sh)
 {
+   util_queue_fence_wait(&sh->CompileFence);
+   util_queue_fence_destroy(&sh->CompileFence);
+
    _mesa_shader_spirv_data_reference(&sh->spirv_data, NULL);
    free((void *)sh->Source);
    free((void *)sh->FallbackSource);
@@ -285,6 +289,8 @@ init_shader_program(struct gl_shader_program *prog)
 {
    prog->Type = GL_SHADER_PROGRAM_MESA;
    prog->RefCount = 1;
+   util_queue_fence_init(&prog->LinkFence);
+   simple_mtx_init(&prog->LinkMutex, mtx_plain);
 
    prog->AttributeBindings = string_to_uint_map_ctor();
    prog->FragDataBindings = string_to_uint_map_ctor();
@@ -411,6 +417,10 @@ void
 _mesa_delete_shader_program(struct gl_context *ctx,
                             struct gl_shader_program *shProg)
 {
+   util_queue_fence_wait(&shProg->LinkFence);
+   util_queue_fence_destroy(&shProg->LinkFence);
+   simple_mtx_destroy(&shProg->LinkMutex);
+
    _mesa_free_shader_program_data(ctx, shProg);
    ralloc_free(shProg);
 }
@@ -418,6 +428,9 @@ _mesa_delete_shader_program(struct gl_context *ctx,
 
 /**
  * Lookup a GLSL program object.
+ *
+ * If the program is being linked on the shader compiler queue, this waits
+ * for the link to finish.
  */
 struct gl_shader_program *
 _mesa_lookup_shader_program(struct gl_context *ctx, GLuint name)
@@ -433,6 +446,8 @@ _mesa_lookup_shader_program(struct gl_context *ctx, GLuint name)
       if (shProg && shProg->Type != GL_SHADER_PROGRAM_MESA) {
          return NULL;
       }
+      if (shProg)
+         _mesa_wait_shader_program_link(ctx, shProg);
       return shProg;
    }
    return NULL;
@@ -445,6 +460,23 @@ _mesa_lookup_shader_program(struct gl_context *ctx, GLuint name)
 struct gl_shader_program *
 _mesa_lookup_shader_program_err(struct gl_context *ctx, GLuint name,
                                 const char *caller)
+{
+   struct gl_shader_program *shProg =
+      _mesa_lookup_shader_program_err_no_wait(ctx, name, caller);
+
+   if (shProg)
+      _mesa_wait_shader_program_link(ctx, shProg);
+   return shProg;
+}
+
+
+/**
+ * As _mesa_lookup_shader_program_err(), but don't wait for a link running on
+ * the shader compiler queue.  This is for GL_COMPLETION_STATUS_ARB queries.
+ */
+struct gl_shader_program *
+_mesa_lookup_shader_program_err_no_wait(struct gl_context *ctx, GLuint name,
+                                        const char *caller)
 {
    if (!name) {
       _mesa_error(ctx, GL_INVALID_VALUE, "%s", caller);
@@ -96,6 +96,9 @@ _mesa_alloc_shared_state(struct gl_context *ctx)
    _mesa_init_shader_includes(shared);
    mtx_init(&shared->ShaderIncludeMutex, mtx_plain);
 
+   /* GL_KHR_parallel_shader_compile, the queue is created on first use */
+   simple_mtx_init(&shared->ShaderCacheFallbackMutex, mtx_plain);
+
    /* Create default texture objects */
    for (i = 0; i < NUM_TEXTURE_TARGETS; i++) {
       /* NOTE: the order of these enums matches the TEXTURE_x_INDEX values */
@@ -361,6 +364,13 @@ free_shared_state(struct gl_context *ctx, struct gl_shared_state *shared)
       _mesa_DeleteHashTable(shared->BitmapAtlas);
    }
 
+   /* GL_KHR_parallel_shader_compile */
+   if (util_queue_is_initialized(&shared->ShaderCompilerQueue)) {
+      util_queue_finish(&shared->ShaderCompilerQueue);
+      util_queue_destroy(&shared->ShaderCompilerQueue);
+   }
+   simple_mtx_destroy(&shared->ShaderCacheFallbackMutex);
+
    if (shared->ShaderObjects) {
       _mesa_HashWalk(shared->ShaderObjects, free_shader_program_data_cb, ctx);
       _mesa_HashDeleteAll(shared->ShaderObjects, delete_shader_cb, ctx);
@@ -0,0 +1,298 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * \name shader_compiler_queue.cpp
+ *
+ * Check the GL_KHR_parallel_shader_compile status queries of shaders and
+ * programs whose compile or link is still waiting on the shader compiler
+ * queue, and the cases that don't use the queue.
+ */
+
+#include <gtest/gtest.h>
+
+#include "GL/gl.h"
+#include "GL/glext.h"
+#include "main/context.h"
+#include "main/debug_output.h"
+#include "main/hint.h"
+#include "main/mtypes.h"
+#include "main/shaderapi.h"
+#include "drivers/common/driverfuncs.h"
+#include "util/u_queue.h"
+
+static unsigned finish_link_calls;
+
+static GLboolean
+link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   return GL_TRUE;
+}
+
+static void
+finish_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   finish_link_calls++;
+}
+
+static void
+wait_for_gate(void *data, int thread_index)
+{
+   util_queue_fence_wait((struct util_queue_fence *) data);
+}
+
+static const char vs_source[] =
+   "void main() { gl_Position = vec4(0.0); }\n";
+
+static const char fs_source[] =
+   "void main() { gl_FragColor = vec4(1.0); }\n";
+
+class shader_compiler_queue : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   GLuint create_shader(GLenum type, const char *source);
+   GLint shader_status(GLuint shader, GLenum pname);
+   GLint program_status(GLuint program, GLenum pname);
+
+   void block_queue();
+   void unblock_queue();
+
+   struct gl_config visual;
+   struct dd_function_table driver_functions;
+   struct gl_context ctx;
+
+   /* Holds back the queue's only thread while unsignalled. */
+   struct util_queue_fence gate;
+   struct util_queue_fence blocker;
+};
+
+void
+shader_compiler_queue::SetUp()
+{
+   memset(&visual, 0, sizeof(visual));
+   memset(&driver_functions, 0, sizeof(driver_functions));
+   memset(&ctx, 0, sizeof(ctx));
+
+   _mesa_init_driver_functions(&driver_functions);
+   driver_functions.LinkShader = link_shader;
+   driver_functions.FinishLinkShader = finish_link_shader;
+   finish_link_calls = 0;
+
+   _mesa_initialize_context(&ctx, API_OPENGL_COMPAT, &visual, NULL,
+                            &driver_functions);
+   _mesa_make_current(&ctx, NULL, NULL);
+
+   /* A single thread, so that jobs queued behind the blocker wait. */
+   _mesa_MaxShaderCompilerThreadsKHR(1);
+
+   util_queue_fence_init(&gate);
+   util_queue_fence_init(&blocker);
+
+   /* The queue is created by the first compile that uses it. */
+   GLuint shader = create_shader(GL_VERTEX_SHADER, vs_source);
+   ASSERT_EQ(GL_TRUE, shader_status(shader, GL_COMPILE_STATUS));
+   _mesa_DeleteShader(shader);
+   ASSERT_TRUE(util_queue_is_initialized(&ctx.Shared->ShaderCompilerQueue));
+}
+
+void
+shader_compiler_queue::TearDown()
+{
+   _mesa_finish_shader_compiler_queue(&ctx);
+   util_queue_fence_destroy(&gate);
+   util_queue_fence_destroy(&blocker);
+
+   _mesa_free_context_data(&ctx);
+   _mesa_make_current(NULL, NULL, NULL);
+}
+
+GLuint
+shader_compiler_queue::create_shader(GLenum type, const char *source)
+{
+   GLuint shader = _mesa_CreateShader(type);
+
+   _mesa_ShaderSource(shader, 1, &source, NULL);
+   _mesa_CompileShader(shader);
+   return shader;
+}
+
+GLint
+shader_compiler_queue::shader_status(GLuint shader, GLenum pname)
+{
+   GLint value = -1;
+
+   _mesa_GetShaderiv(shader, pname, &value);
+   return value;
+}
+
+GLint
+shader_compiler_queue::program_status(GLuint program, GLenum pname)
+{
+   GLint value = -1;
+
+   _mesa_GetProgramiv(program, pname, &value);
+   return value;
+}
+
+void
+shader_compiler_queue::block_queue()
+{
+   util_queue_fence_reset(&gate);
+   util_queue_add_job(&ctx.Shared->ShaderCompilerQueue, &gate, &blocker,
+                      wait_for_gate, NULL, 0);
+}
+
+void
+shader_compiler_queue::unblock_queue()
+{
+   util_queue_fence_signal(&gate);
+   util_queue_fence_wait(&blocker);
+}
+
+TEST_F(shader_compiler_queue, compile_status_while_pending)
+{
+   block_queue();
+   GLuint shader = create_shader(GL_VERTEX_SHADER, vs_source);
+
+   EXPECT_EQ(GL_FALSE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+   EXPECT_EQ(GL_FALSE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+
+   unblock_queue();
+
+   /* GL_COMPILE_STATUS waits for the compile. */
+   EXPECT_EQ(GL_TRUE, shader_status(shader, GL_COMPILE_STATUS));
+   EXPECT_EQ(GL_TRUE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+
+   _mesa_DeleteShader(shader);
+}
+
+TEST_F(shader_compiler_queue, failed_compile_status_while_pending)
+{
+   block_queue();
+   GLuint shader = create_shader(GL_VERTEX_SHADER, "void main() { x; }\n");
+
+   EXPECT_EQ(GL_FALSE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+
+   unblock_queue();
+
+   EXPECT_EQ(GL_FALSE, shader_status(shader, GL_COMPILE_STATUS));
+   EXPECT_LT(0, shader_status(shader, GL_INFO_LOG_LENGTH));
+   EXPECT_EQ(GL_TRUE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+
+   _mesa_DeleteShader(shader);
+}
+
+TEST_F(shader_compiler_queue, link_status_while_pending)
+{
+   GLuint vs = create_shader(GL_VERTEX_SHADER, vs_source);
+   GLuint fs = create_shader(GL_FRAGMENT_SHADER, fs_source);
+   GLuint program = _mesa_CreateProgram();
+
+   _mesa_AttachShader(program, vs);
+   _mesa_AttachShader(program, fs);
+
+   block_queue();
+   _mesa_LinkProgram(program);
+
+   EXPECT_EQ(GL_FALSE, program_status(program, GL_COMPLETION_STATUS_ARB));
+   EXPECT_EQ(0u, finish_link_calls);
+
+   unblock_queue();
+
+   /* Once the link is done, the completion status query finishes it. */
+   EXPECT_EQ(GL_TRUE, program_status(program, GL_COMPLETION_STATUS_ARB));
+   EXPECT_EQ(1u, finish_link_calls);
+   EXPECT_EQ(GL_TRUE, program_status(program, GL_LINK_STATUS));
+   EXPECT_EQ(1u, finish_link_calls);
+
+   _mesa_DeleteProgram(program);
+   _mesa_DeleteShader(vs);
+   _mesa_DeleteShader(fs);
+}
+
+TEST_F(shader_compiler_queue, link_status_waits_for_pending_link)
+{
+   GLuint vs = create_shader(GL_VERTEX_SHADER, vs_source);
+   GLuint fs = create_shader(GL_FRAGMENT_SHADER, fs_source);
+   GLuint program = _mesa_CreateProgram();
+
+   _mesa_AttachShader(program, vs);
+   _mesa_AttachShader(program, fs);
+
+   block_queue();
+   _mesa_LinkProgram(program);
+
+   EXPECT_EQ(GL_FALSE, program_status(program, GL_COMPLETION_STATUS_ARB));
+
+   unblock_queue();
+
+   EXPECT_EQ(GL_TRUE, program_status(program, GL_LINK_STATUS));
+   EXPECT_EQ(1u, finish_link_calls);
+   EXPECT_EQ(GL_TRUE, program_status(program, GL_COMPLETION_STATUS_ARB));
+   EXPECT_EQ(1u, finish_link_calls);
+
+   _mesa_DeleteProgram(program);
+   _mesa_DeleteShader(vs);
+   _mesa_DeleteShader(fs);
+}
+
+TEST_F(shader_compiler_queue, include_compiles_synchronously)
+{
+   block_queue();
+
+   /* The preprocessor allows spaces between '#' and the directive. */
+   GLuint shader = create_shader(GL_VERTEX_SHADER,
+                                 "#  include \"/missing.glsl\"\n"
+                                 "void main() { gl_Position = vec4(0.0); }\n");
+   EXPECT_EQ(GL_TRUE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+   EXPECT_EQ(GL_FALSE, shader_status(shader, GL_COMPILE_STATUS));
+   _mesa_DeleteShader(shader);
+
+   /* An #include in a comment isn't one. */
+   shader = create_shader(GL_VERTEX_SHADER,
+                          "/* #include \"/missing.glsl\" */\n"
+                          "void main() { gl_Position = vec4(0.0); }\n");
+   EXPECT_EQ(GL_FALSE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+
+   unblock_queue();
+
+   EXPECT_EQ(GL_TRUE, shader_status(shader, GL_COMPILE_STATUS));
+   _mesa_DeleteShader(shader);
+}
+
+TEST_F(shader_compiler_queue, debug_output_compiles_synchronously)
+{
+   _mesa_set_debug_state_int(&ctx, GL_DEBUG_OUTPUT, GL_TRUE);
+
+   block_queue();
+   GLuint shader = create_shader(GL_VERTEX_SHADER, vs_source);
+
+   EXPECT_EQ(GL_TRUE, shader_status(shader, GL_COMPLETION_STATUS_ARB));
+
+   unblock_queue();
+
+   EXPECT_EQ(GL_TRUE, shader_status(shader, GL_COMPILE_STATUS));
+   _mesa_DeleteShader(shader);
+}
@@ -3059,19 +3059,31 @@ _mesa_ir_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
 }
 
 /**
- * Link a GLSL shader program.  Called via glLinkProgram().
+ * Throw away the results of the previous link of a GLSL shader program.
+ *
+ * This must happen on the application thread, the rest of the link may be
+ * done by _mesa_glsl_link_prepared_shader() on the shader compiler queue.
  */
 void
-_mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
+_mesa_glsl_prepare_link_shader(struct gl_context *ctx,
+                               struct gl_shader_program *prog)
 {
-   unsigned int i;
-   bool spirv = false;
-
    _mesa_clear_shader_program_data(ctx, prog);
 
    prog->data = _mesa_create_shader_program_data();
 
    prog->data->LinkStatus = LINKING_SUCCESS;
+}
+
+/**
+ * Link a GLSL shader program prepared by _mesa_glsl_prepare_link_shader().
+ */
+void
+_mesa_glsl_link_prepared_shader(struct gl_context *ctx,
+                                struct gl_shader_program *prog)
+{
+   unsigned int i;
+   bool spirv = false;
 
    for (i = 0; i < prog->NumShaders; i++) {
       if (!prog->Shaders[i]->CompileStatus) {
@@ -3138,4 +3150,14 @@ _mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
 #endif
 }
 
+/**
+ * Link a GLSL shader program.  Called via glLinkProgram().
+ */
+void
+_mesa_glsl_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   _mesa_glsl_prepare_link_shader(ctx, prog);
+   _mesa_glsl_link_prepared_shader(ctx, prog);
+}
+
 } /* extern "C" */
@@ -196,6 +196,7 @@ st_init_program_functions(struct dd_function_table *functions)
    functions->ProgramStringNotify = st_program_string_notify;
    functions->NewATIfs = st_new_ati_fs;
    functions->LinkShader = st_link_shader;
+   functions->FinishLinkShader = st_finish_link_shader;
    functions->SetMaxShaderCompilerThreads = st_max_shader_compiler_threads;
    functions->GetShaderProgramCompletionStatus =
       st_get_shader_program_completion_status;
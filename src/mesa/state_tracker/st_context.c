@@ -31,6 +31,7 @@
 #include "main/context.h"
 #include "main/glthread.h"
 #include "main/samplerobj.h"
+#include "main/shaderapi.h"
 #include "main/shaderobj.h"
 #include "main/version.h"
 #include "main/vtxfmt.h"
@@ -1081,6 +1082,9 @@ st_destroy_context(struct st_context *st)
    _mesa_glthread_destroy(ctx);
 #endif
 
+   /* Queued compiles and links may still be using this context. */
+   _mesa_finish_shader_compiler_queue(ctx);
+
    _mesa_HashWalk(ctx->Shared->TexObjects, destroy_tex_sampler_cb, st);
 
    /* For the fallback textures, free any sampler views belonging to this
@@ -28,7 +28,9 @@
 #include "compiler/glsl/ir_optimization.h"
 #include "compiler/glsl/program.h"
 
+#include "st_debug.h"
 #include "st_nir.h"
+#include "st_program.h"
 #include "st_shader_cache.h"
 #include "st_glsl_to_tgsi.h"
 
@@ -180,4 +182,26 @@ st_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
       return st_link_tgsi(ctx, prog);
 }
 
+/**
+ * Called via ctx->Driver.FinishLinkShader() once st_link_shader() has run
+ * on the shader compiler queue.  Does what st_finalize_program() couldn't
+ * do without the pipe context.
+ */
+void
+st_finish_link_shader(struct gl_context *ctx, struct gl_shader_program *prog)
+{
+   struct st_context *st = st_context(ctx);
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_linked_shader *shader = prog->_LinkedShaders[i];
+
+      if (!shader || !shader->Program)
+         continue;
+
+      /* Create Gallium shaders now instead of on demand. */
+      if (ST_DEBUG & DEBUG_PRECOMPILE || st->shader_has_one_variant[i])
+         st_precompile_shader_variant(st, shader->Program);
+   }
+}
+
 } /* extern "C" */
@@ -31,6 +31,9 @@ extern "C" {
 GLboolean
 st_link_shader(struct gl_context *ctx, struct gl_shader_program *prog);
 
+void
+st_finish_link_shader(struct gl_context *ctx, struct gl_shader_program *prog);
+
 #ifdef __cplusplus
 }
 #endif
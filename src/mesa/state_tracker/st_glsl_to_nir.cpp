@@ -51,6 +51,9 @@
 #include "compiler/glsl/ir.h"
 #include "compiler/glsl/ir_optimization.h"
 #include "compiler/glsl/string_to_uint_map.h"
+#include "util/simple_mtx.h"
+
+static simple_mtx_t soft_fp64_mutex = _SIMPLE_MTX_INITIALIZER_NP;
 
 static int
 type_size(const struct glsl_type *type)
@@ -365,9 +368,13 @@ st_nir_preprocess(struct st_context *st, struct gl_program *prog,
    }
 
    nir_shader_gather_info(nir, nir_shader_get_entrypoint(nir));
-   if (!st->ctx->SoftFP64 && nir->info.uses_64bit &&
+   if (nir->info.uses_64bit &&
        (options->lower_doubles_options & nir_lower_fp64_full_software) != 0) {
-      st->ctx->SoftFP64 = glsl_float64_funcs_to_nir(st->ctx, options);
+      /* Programs of the same context may be linked on several threads. */
+      simple_mtx_lock(&soft_fp64_mutex);
+      if (!st->ctx->SoftFP64)
+         st->ctx->SoftFP64 = glsl_float64_funcs_to_nir(st->ctx, options);
+      simple_mtx_unlock(&soft_fp64_mutex);
    }
 
    /* ES has strict SSO validation rules for shader IO matching so we can't
@@ -513,7 +520,7 @@ st_glsl_to_nir_post_opts(struct st_context *st, struct gl_program *prog,
    if (st->allow_st_finalize_nir_twice)
       st_finalize_nir(st, prog, shader_program, nir, true);
 
-   if (st->ctx->_Shader->Flags & GLSL_DUMP) {
+   if (st->ctx->Shader.Flags & GLSL_DUMP) {
       _mesa_log("\n");
       _mesa_log("NIR IR for linked %s program %d:\n",
              _mesa_shader_stage_to_string(prog->info.stage),
@@ -671,7 +678,7 @@ st_link_nir(struct gl_context *ctx,
       } else {
          validate_ir_tree(shader->ir);
 
-         if (ctx->_Shader->Flags & GLSL_DUMP) {
+         if (ctx->Shader.Flags & GLSL_DUMP) {
             _mesa_log("\n");
             _mesa_log("GLSL IR for linked %s program %d:\n",
                       _mesa_shader_stage_to_string(shader->Stage),
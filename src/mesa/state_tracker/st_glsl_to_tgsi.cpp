@@ -7157,7 +7157,7 @@ get_mesa_program_tgsi(struct gl_context *ctx,
    /* Write the END instruction. */
    v->emit_asm(NULL, TGSI_OPCODE_END);
 
-   if (ctx->_Shader->Flags & GLSL_DUMP) {
+   if (ctx->Shader.Flags & GLSL_DUMP) {
       _mesa_log("\n");
       _mesa_log("GLSL IR for linked %s program %d:\n",
              _mesa_shader_stage_to_string(shader->Stage),
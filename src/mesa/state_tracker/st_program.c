@@ -1999,7 +1999,7 @@ st_destroy_program_variants(struct st_context *st)
 /**
  * Compile one shader variant.
  */
-static void
+void
 st_precompile_shader_variant(struct st_context *st,
                              struct gl_program *prog)
 {
@@ -2066,7 +2066,12 @@ st_serialize_nir(struct st_program *stp)
 void
 st_finalize_program(struct st_context *st, struct gl_program *prog)
 {
-   if (st->current_program[prog->info.stage] == prog) {
+   /* Linking on the shader compiler queue, the program isn't bound and the
+    * pipe context mustn't be used.  st_finish_link_shader precompiles it.
+    */
+   bool on_queue = prog->sh.data && prog->sh.data->LinkOnQueue;
+
+   if (!on_queue && st->current_program[prog->info.stage] == prog) {
       if (prog->info.stage == MESA_SHADER_VERTEX)
          st->dirty |= ST_NEW_VERTEX_PROGRAM(st, (struct st_program *)prog);
       else
@@ -2086,7 +2091,8 @@ st_finalize_program(struct st_context *st, struct gl_program *prog)
 #endif
 
    /* Create Gallium shaders now instead of on demand. */
-   if (ST_DEBUG & DEBUG_PRECOMPILE ||
-       st->shader_has_one_variant[prog->info.stage])
+   if (!on_queue &&
+       (ST_DEBUG & DEBUG_PRECOMPILE ||
+        st->shader_has_one_variant[prog->info.stage]))
       st_precompile_shader_variant(st, prog);
 }
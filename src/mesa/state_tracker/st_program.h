@@ -347,6 +347,9 @@ st_translate_common_program(struct st_context *st,
 extern void
 st_serialize_nir(struct st_program *stp);
 
+extern void
+st_precompile_shader_variant(struct st_context *st, struct gl_program *prog);
+
 extern void
 st_finalize_program(struct st_context *st, struct gl_program *prog);
 
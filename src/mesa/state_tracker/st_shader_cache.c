@@ -146,7 +146,7 @@ st_store_ir_in_disk_cache(struct st_context *st, struct gl_program *prog,
 
    st_serialise_ir_program(st->ctx, prog, nir);
 
-   if (st->ctx->_Shader->Flags & GLSL_CACHE_INFO) {
+   if (st->ctx->Shader.Flags & GLSL_CACHE_INFO) {
       fprintf(stderr, "putting %s state tracker IR in cache\n",
               _mesa_shader_stage_to_string(prog->info.stage));
    }
@@ -234,7 +234,7 @@ st_deserialise_ir_program(struct gl_context *ctx,
    if (blob_reader.current != blob_reader.end || blob_reader.overrun) {
       assert(!"Invalid TGSI shader disk cache item!");
 
-      if (ctx->_Shader->Flags & GLSL_CACHE_INFO) {
+      if (ctx->Shader.Flags & GLSL_CACHE_INFO) {
          fprintf(stderr, "Error reading program from cache (invalid "
                  "TGSI cache item)\n");
       }
@@ -269,7 +269,7 @@ st_load_ir_from_disk_cache(struct gl_context *ctx,
       glprog->driver_cache_blob = NULL;
       glprog->driver_cache_blob_size = 0;
 
-      if (ctx->_Shader->Flags & GLSL_CACHE_INFO) {
+      if (ctx->Shader.Flags & GLSL_CACHE_INFO) {
          fprintf(stderr, "%s state tracker IR retrieved from cache\n",
                  _mesa_shader_stage_to_string(i));
       }
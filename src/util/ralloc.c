@@ -80,12 +80,17 @@ __declspec(align(16))
    struct ralloc_header *next;
 
    void (*destructor)(void *);
+
+   /* The pool slab this block was carved from, NULL for malloc'd blocks. */
+   struct ralloc_pool_slab *slab;
 };
 
 typedef struct ralloc_header ralloc_header;
 
 static void unlink_block(ralloc_header *info);
 static void unsafe_free(ralloc_header *info);
+static size_t pool_block_size(const ralloc_header *info);
+static void pool_free_block(ralloc_header *info);
 
 static ralloc_header *
 get_header(const void *ptr)
@@ -137,6 +142,7 @@ ralloc_size(const void *ctx, size_t size)
    info->prev = NULL;
    info->next = NULL;
    info->destructor = NULL;
+   info->slab = NULL;
 
    parent = ctx != NULL ? get_header(ctx) : NULL;
 
@@ -167,7 +173,21 @@ resize(void *ptr, size_t size)
    ralloc_header *child, *old, *info;
 
    old = get_header(ptr);
-   info = realloc(old, size + sizeof(ralloc_header));
+
+   if (old->slab != NULL) {
+      /* Pooled blocks have a fixed size, move the block to the heap. */
+      size_t old_size = pool_block_size(old);
+
+      info = malloc(size + sizeof(ralloc_header));
+      if (info == NULL)
+         return NULL;
+
+      memcpy(info, old, sizeof(ralloc_header) + MIN2(old_size, size));
+      info->slab = NULL;
+      pool_free_block(old);
+   } else {
+      info = realloc(old, size + sizeof(ralloc_header));
+   }
 
    if (info == NULL)
       return NULL;
@@ -300,7 +320,10 @@ unsafe_free(ralloc_header *info)
    if (info->destructor != NULL)
       info->destructor(PTR_FROM_HEADER(info));
 
-   free(info);
+   if (info->slab != NULL)
+      pool_free_block(info);
+   else
+      free(info);
 }
 
 void
@@ -562,6 +585,253 @@ ralloc_vasprintf_rewrite_tail(char **str, size_t *start, const char *fmt,
    return true;
 }
 
+/***************************************************************************
+ * Pool allocator for many small, long-lived allocations.
+ ***************************************************************************
+ *
+ * Blocks are carved out of slabs, one list of slabs per size class. Every
+ * block carries a regular ralloc_header, so it can be a context, stolen,
+ * resized (which moves it to the heap) and freed like any other block.
+ * Freed blocks go back on their slab's free list.
+ *
+ * The pool is itself a ralloc'd object. When it's freed, empty slabs are
+ * released and the remaining ones are orphaned: they are released when the
+ * last of their blocks is freed.
+ */
+
+#define POOL_GRANULE 16
+#define POOL_NUM_CLASSES 64
+#define POOL_MAX_SIZE (POOL_NUM_CLASSES * POOL_GRANULE)
+#define POOL_SLAB_SIZE (16 * 1024)
+
+struct
+#ifdef _MSC_VER
+#if _WIN64
+__declspec(align(16))
+#else
+ __declspec(align(8))
+#endif
+#elif defined(__LP64__)
+ __attribute__((aligned(16)))
+#else
+ __attribute__((aligned(8)))
+#endif
+   ralloc_pool_slab
+{
+   /* The owning pool, NULL once the pool has been freed. */
+   struct ralloc_pool *pool;
+
+   /* Links in the pool's partial[] or full list. */
+   struct ralloc_pool_slab *prev;
+   struct ralloc_pool_slab *next;
+
+   /* Freed blocks, linked through ralloc_header::next. */
+   ralloc_header *free_list;
+
+   unsigned size_class;
+   unsigned num_blocks;
+   unsigned num_used;
+   /* Blocks past this index have never been handed out. */
+   unsigned num_initialized;
+
+   /* The blocks follow. */
+};
+
+struct ralloc_pool
+{
+   /* Slabs with at least one free block, per size class. */
+   struct ralloc_pool_slab *partial[POOL_NUM_CLASSES];
+
+   /* Slabs without free blocks, any size class. */
+   struct ralloc_pool_slab *full;
+};
+
+static unsigned
+pool_block_stride(unsigned size_class)
+{
+   return sizeof(ralloc_header) + (size_class + 1) * POOL_GRANULE;
+}
+
+static size_t
+pool_block_size(const ralloc_header *info)
+{
+   return (info->slab->size_class + 1) * POOL_GRANULE;
+}
+
+static void
+pool_slab_link(struct ralloc_pool_slab **list, struct ralloc_pool_slab *slab)
+{
+   slab->prev = NULL;
+   slab->next = *list;
+   if (slab->next != NULL)
+      slab->next->prev = slab;
+   *list = slab;
+}
+
+static void
+pool_slab_unlink(struct ralloc_pool_slab **list, struct ralloc_pool_slab *slab)
+{
+   if (slab->prev != NULL)
+      slab->prev->next = slab->next;
+   else
+      *list = slab->next;
+
+   if (slab->next != NULL)
+      slab->next->prev = slab->prev;
+}
+
+static void
+pool_free_block(ralloc_header *info)
+{
+   struct ralloc_pool_slab *slab = info->slab;
+   struct ralloc_pool *pool = slab->pool;
+
+   assert(slab->num_used > 0);
+   slab->num_used--;
+
+   if (pool == NULL) {
+      /* Orphaned slab, release it along with its last block. */
+      if (slab->num_used == 0)
+         free(slab);
+      return;
+   }
+
+   info->next = slab->free_list;
+   slab->free_list = info;
+
+   if (slab->num_used + 1 == slab->num_blocks) {
+      pool_slab_unlink(&pool->full, slab);
+      pool_slab_link(&pool->partial[slab->size_class], slab);
+   }
+}
+
+static void
+pool_orphan_slabs(struct ralloc_pool_slab *list)
+{
+   struct ralloc_pool_slab *slab, *next;
+
+   for (slab = list; slab != NULL; slab = next) {
+      next = slab->next;
+      if (slab->num_used == 0)
+         free(slab);
+      else
+         slab->pool = NULL;
+   }
+}
+
+static void
+pool_destructor(void *ptr)
+{
+   struct ralloc_pool *pool = ptr;
+
+   for (unsigned i = 0; i < POOL_NUM_CLASSES; i++)
+      pool_orphan_slabs(pool->partial[i]);
+   pool_orphan_slabs(pool->full);
+}
+
+void *
+ralloc_pool_create(const void *ctx)
+{
+   struct ralloc_pool *pool = rzalloc_size(ctx, sizeof(struct ralloc_pool));
+
+   if (unlikely(pool == NULL))
+      return NULL;
+
+   ralloc_set_destructor(pool, pool_destructor);
+   return pool;
+}
+
+void *
+ralloc_pool_size(void *pool_ptr, const void *ctx, size_t size)
+{
+   struct ralloc_pool *pool = pool_ptr;
+   struct ralloc_pool_slab *slab;
+   ralloc_header *info;
+   unsigned size_class;
+
+   if (size > POOL_MAX_SIZE)
+      return ralloc_size(ctx, size);
+
+   size_class = size ? (size - 1) / POOL_GRANULE : 0;
+   slab = pool->partial[size_class];
+
+   if (slab == NULL) {
+      unsigned stride = pool_block_stride(size_class);
+      unsigned num_blocks = MAX2(POOL_SLAB_SIZE / stride, 1);
+
+      slab = malloc(sizeof(*slab) + (size_t)num_blocks * stride);
+      if (unlikely(slab == NULL))
+         return NULL;
+
+      slab->pool = pool;
+      slab->free_list = NULL;
+      slab->size_class = size_class;
+      slab->num_blocks = num_blocks;
+      slab->num_used = 0;
+      slab->num_initialized = 0;
+      pool_slab_link(&pool->partial[size_class], slab);
+   }
+
+   if (slab->free_list != NULL) {
+      info = slab->free_list;
+      slab->free_list = info->next;
+   } else {
+      assert(slab->num_initialized < slab->num_blocks);
+      info = (ralloc_header *) ((char *) (slab + 1) +
+                                (size_t)slab->num_initialized *
+                                pool_block_stride(size_class));
+      slab->num_initialized++;
+   }
+
+   if (++slab->num_used == slab->num_blocks) {
+      pool_slab_unlink(&pool->partial[size_class], slab);
+      pool_slab_link(&pool->full, slab);
+   }
+
+   info->parent = NULL;
+   info->child = NULL;
+   info->prev = NULL;
+   info->next = NULL;
+   info->destructor = NULL;
+   info->slab = slab;
+
+   add_child(ctx != NULL ? get_header(ctx) : NULL, info);
+
+#ifndef NDEBUG
+   info->canary = CANARY;
+#endif
+
+   return PTR_FROM_HEADER(info);
+}
+
+void *
+rzalloc_pool_size(void *pool, const void *ctx, size_t size)
+{
+   void *ptr = ralloc_pool_size(pool, ctx, size);
+
+   if (likely(ptr))
+      memset(ptr, 0, size);
+
+   return ptr;
+}
+
+void
+ralloc_pool_trim(void *pool_ptr)
+{
+   struct ralloc_pool *pool = pool_ptr;
+   struct ralloc_pool_slab *slab, *next;
+
+   for (unsigned i = 0; i < POOL_NUM_CLASSES; i++) {
+      for (slab = pool->partial[i]; slab != NULL; slab = next) {
+         next = slab->next;
+         if (slab->num_used == 0) {
+            pool_slab_unlink(&pool->partial[i], slab);
+            free(slab);
+         }
+      }
+   }
+}
+
 /***************************************************************************
  * Linear allocator for short-lived allocations.
  ***************************************************************************
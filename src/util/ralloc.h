@@ -478,6 +478,48 @@ bool ralloc_asprintf_append (char **str, const char *fmt, ...)
 bool ralloc_vasprintf_append(char **str, const char *fmt, va_list args);
 /// @}
 
+/**
+ * \name Pool allocation
+ *
+ * A pool hands out small blocks from size-class slabs instead of malloc'ing
+ * each one. Pooled blocks are ordinary ralloc blocks: they can be parents of
+ * other blocks, stolen, resized and freed with the usual functions.
+ *
+ * A pool is not thread-safe. Allocations larger than the biggest size class
+ * fall back to ralloc_size().
+ */
+/// @{
+
+/**
+ * Create a pool, owned by \p ctx.
+ *
+ * Freeing the pool doesn't free the blocks allocated from it. Their memory
+ * is released when the last block of each slab is freed.
+ */
+void *ralloc_pool_create(const void *ctx);
+
+/**
+ * Allocate \p size bytes from \p pool, as a child of \p ctx.
+ */
+void *ralloc_pool_size(void *pool, const void *ctx, size_t size) MALLOCLIKE;
+
+/**
+ * Same as ralloc_pool_size, but also clears memory.
+ */
+void *rzalloc_pool_size(void *pool, const void *ctx, size_t size) MALLOCLIKE;
+
+#define ralloc_pool(pool, ctx, type) \
+   ((type *) ralloc_pool_size(pool, ctx, sizeof(type)))
+
+#define rzalloc_pool(pool, ctx, type) \
+   ((type *) rzalloc_pool_size(pool, ctx, sizeof(type)))
+
+/**
+ * Release the pool's slabs that have no blocks in use.
+ */
+void ralloc_pool_trim(void *pool);
+/// @}
+
 /**
  * Declare C++ new and delete operators which use ralloc.
  *
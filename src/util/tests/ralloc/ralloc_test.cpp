@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "util/ralloc.h"
+#include "gtest/gtest.h"
+
+static unsigned destructor_calls;
+
+static void
+count_destructor(void *ptr)
+{
+   destructor_calls++;
+}
+
+TEST(ralloc_pool, reuse)
+{
+   void *ctx = ralloc_context(NULL);
+   void *pool = ralloc_pool_create(ctx);
+
+   void *a = ralloc_pool_size(pool, ctx, 40);
+   void *b = ralloc_pool_size(pool, ctx, 40);
+   ASSERT_NE(a, b);
+   EXPECT_EQ(ralloc_parent(a), ctx);
+   EXPECT_EQ((uintptr_t) a % sizeof(void *), 0u);
+
+   /* A freed block is handed out again for the same size. */
+   ralloc_free(a);
+   void *c = ralloc_pool_size(pool, ctx, 40);
+   EXPECT_EQ(a, c);
+
+   ralloc_free(ctx);
+}
+
+TEST(ralloc_pool, children)
+{
+   void *ctx = ralloc_context(NULL);
+   void *pool = ralloc_pool_create(ctx);
+
+   destructor_calls = 0;
+
+   char *block = (char *) rzalloc_pool_size(pool, ctx, 64);
+   for (unsigned i = 0; i < 64; i++)
+      EXPECT_EQ(block[i], 0);
+
+   /* Pooled blocks work as contexts, for pooled or malloc'd blocks. */
+   void *child = ralloc_pool_size(pool, block, 16);
+   char *str = ralloc_strdup(block, "child");
+   ralloc_set_destructor(child, count_destructor);
+   ralloc_set_destructor(str, count_destructor);
+
+   ralloc_free(block);
+   EXPECT_EQ(destructor_calls, 2u);
+
+   ralloc_free(ctx);
+}
+
+TEST(ralloc_pool, large)
+{
+   void *ctx = ralloc_context(NULL);
+   void *pool = ralloc_pool_create(ctx);
+
+   /* Too large for any slab, the block is malloc'd. */
+   char *large = (char *) ralloc_pool_size(pool, ctx, 8192);
+   memset(large, 0xff, 8192);
+   ralloc_free(large);
+
+   ralloc_free(ctx);
+}
+
+TEST(ralloc_pool, resize)
+{
+   void *ctx = ralloc_context(NULL);
+   void *pool = ralloc_pool_create(ctx);
+
+   char *str = (char *) ralloc_pool_size(pool, ctx, 4);
+   strcpy(str, "abc");
+   void *child = ralloc_size(str, 8);
+
+   ASSERT_TRUE(ralloc_strcat(&str, "defghijklmnopqrstuvwxyz"));
+   EXPECT_STREQ(str, "abcdefghijklmnopqrstuvwxyz");
+   EXPECT_EQ(ralloc_parent(str), ctx);
+   EXPECT_EQ(ralloc_parent(child), str);
+
+   ralloc_free(ctx);
+}
+
+TEST(ralloc_pool, outlives_owner)
+{
+   void *ctx = ralloc_context(NULL);
+   void *other = ralloc_context(NULL);
+   void *pool = ralloc_pool_create(ctx);
+
+   /* A block stolen by another context stays valid after the pool's owner
+    * is freed, the memory is released along with the last block.
+    */
+   unsigned *value = (unsigned *) ralloc_pool_size(pool, ctx, sizeof(*value));
+   ralloc_steal(other, value);
+   *value = 42;
+
+   ralloc_free(ctx);
+   EXPECT_EQ(*value, 42u);
+
+   ralloc_free(other);
+}
+
+TEST(ralloc_pool, trim)
+{
+   void *ctx = ralloc_context(NULL);
+   void *dead = ralloc_context(ctx);
+   void *pool = ralloc_pool_create(ctx);
+
+   void *live = ralloc_pool_size(pool, ctx, 24);
+   for (unsigned i = 0; i < 1000; i++)
+      ralloc_pool_size(pool, dead, 24);
+
+   ralloc_free(dead);
+   ralloc_pool_trim(pool);
+
+   /* The pool keeps working after its empty slabs were released. */
+   for (unsigned i = 0; i < 1000; i++)
+      EXPECT_NE(ralloc_pool_size(pool, ctx, 24), live);
+
+   ralloc_free(ctx);
+}